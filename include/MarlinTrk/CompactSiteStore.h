@@ -0,0 +1,84 @@
+#ifndef CompactSiteStore_h
+#define CompactSiteStore_h
+
+#include <vector>
+#include <cstddef>
+
+namespace MarlinTrk {
+
+  /** Compact storage of the track states of finished measurement sites in single precision,
+   *  as structure of arrays: one array per track parameter and per element of the lower
+   *  triangle of the covariance matrix, indexed by the site.
+   *
+   * @version $Id$
+   */
+  class CompactSiteStore {
+
+  public:
+
+    /** C'tor - dim is the dimension of the track state, e.g. 5 or 6 for KalTest
+     */
+    explicit CompactSiteStore( unsigned dim=5 ) :
+      _dim( dim ),
+      _par( dim ),
+      _cov( dim * ( dim + 1 ) / 2 ),
+      _smoothed() {}
+
+    /** the dimension of the stored track states */
+    unsigned dimension() const { return _dim ; }
+
+    /** the number of stored sites */
+    std::size_t size() const { return _smoothed.size() ; }
+
+    /** append the state of the next site - par has dimension() elements, cov is the full
+     *  dimension() x dimension() covariance matrix in row major order.
+     */
+    void push_back( const double* par, const double* cov, bool smoothed ) {
+
+      for( unsigned i = 0 ; i < _dim ; ++i ) _par[i].push_back( par[i] ) ;
+
+      for( unsigned i = 0, k = 0 ; i < _dim ; ++i )
+        for( unsigned j = 0 ; j <= i ; ++j, ++k )
+          _cov[k].push_back( cov[ i * _dim + j ] ) ;
+
+      _smoothed.push_back( smoothed ) ;
+    }
+
+    /** fill the state of the site with the given index into par and the full, symmetric covariance matrix cov
+     */
+    void get( std::size_t index, double* par, double* cov ) const {
+
+      for( unsigned i = 0 ; i < _dim ; ++i ) par[i] = _par[i][index] ;
+
+      for( unsigned i = 0, k = 0 ; i < _dim ; ++i )
+        for( unsigned j = 0 ; j <= i ; ++j, ++k )
+          cov[ i * _dim + j ] = cov[ j * _dim + i ] = _cov[k][index] ;
+    }
+
+    /** true if the stored state of the site is a smoothed state */
+    bool isSmoothed( std::size_t index ) const { return _smoothed[index] ; }
+
+    /** remove all stored sites */
+    void clear() {
+      for( unsigned i = 0 ; i < _par.size() ; ++i ) _par[i].clear() ;
+      for( unsigned i = 0 ; i < _cov.size() ; ++i ) _cov[i].clear() ;
+      _smoothed.clear() ;
+    }
+
+  private:
+
+    unsigned _dim ;
+
+    /** _par[k][i] is parameter k of site i */
+    std::vector< std::vector<float> > _par ;
+
+    /** _cov[k][i] is element k of the lower triangle of the covariance matrix of site i */
+    std::vector< std::vector<float> > _cov ;
+
+    std::vector<bool> _smoothed ;
+
+  } ;
+
+} // end of namespace MarlinTrk
+
+#endif
@@ -17,7 +17,7 @@ namespace MarlinTrk{
   
   /** Factory methods for creating the MarlinTrkSystem of a certain type:
    *  DDKalTest, aidaTT,...<br>
-   *  Currently implemented: DDKalTest, aidaTT.
+   *  Currently implemented: DDKalTest, aidaTT, FastKF, FastHelix.
    *  The returned instance for a given type is cached, thus: <br>
    * 
    *  DO NOT DELETE THE POINTER at the end of your software module (Marlin processor) ! 
@@ -0,0 +1,683 @@
+#ifndef FastKFKernels_h
+#define FastKFKernels_h
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+namespace MarlinTrk {
+
+  /** Fixed size kernels of the native Kalman filter (MarlinFastKF): track states in the LCIO helix
+   *  parametrisation ( d0, phi0, omega, z0, tanLambda ) w.r.t. a reference point, transport with
+   *  Jacobian, material effects and the measurement update. All lengths are in mm, momenta and
+   *  energies in GeV and the magnetic field in Tesla. No heap memory is used.
+   *
+   * @version $Id$
+   */
+  namespace FastKF {
+
+    /** track parameters d0, phi0, omega, z0, tanLambda */
+    typedef std::array<double,5>  Vector5 ;
+
+    /** 5x5 matrix in row major order */
+    typedef std::array<double,25> Matrix5 ;
+
+    /** lower triangle of a symmetric 5x5 matrix, in the order used for the LCIO covariance matrix */
+    typedef std::array<double,15> SymMatrix5 ;
+
+    enum ParIndex { iD0 = 0, iPhi = 1, iOmega = 2, iZ0 = 3, iTanL = 4 } ;
+
+    /** c in GeV / ( T mm ), pt = c * Bz / |omega| */
+    const double c_light = 2.99792458e-4 ;
+
+    /** speed of light in mm / ns */
+    const double c_mm_per_ns = 299.792458 ;
+
+    /** track state: parameters, covariance matrix and reference point */
+    struct State {
+      Vector5    par ;
+      SymMatrix5 cov ;
+      double     ref[3] ;
+    } ;
+
+    /** index of element (i,j) in a SymMatrix5 */
+    inline int symIndex( int i, int j ) { return ( i >= j ? i * ( i + 1 ) / 2 + j : j * ( j + 1 ) / 2 + i ) ; }
+
+    /** restrict the range of the azimuthal angle to ]-pi,pi] */
+    inline double toBaseRange( double phi ) {
+      while( phi <= -M_PI ){  phi += 2. * M_PI ; }
+      while( phi >   M_PI ){  phi -= 2. * M_PI ; }
+      return phi ;
+    }
+
+    inline void setIdentity( Matrix5& m ) {
+      m.fill( 0. ) ;
+      for( int i = 0 ; i < 5 ; ++i ) m[ i * 5 + i ] = 1. ;
+    }
+
+    /** c = a * b */
+    inline void multiply( const Matrix5& a, const Matrix5& b, Matrix5& c ) {
+      for( int i = 0 ; i < 5 ; ++i )
+        for( int j = 0 ; j < 5 ; ++j ) {
+          double sum = 0. ;
+          for( int k = 0 ; k < 5 ; ++k ) sum += a[ i * 5 + k ] * b[ k * 5 + j ] ;
+          c[ i * 5 + j ] = sum ;
+        }
+    }
+
+    /** cov = J * cov * J^T */
+    inline void similarity( const Matrix5& J, SymMatrix5& cov ) {
+
+      double JC[25] ;
+
+      for( int i = 0 ; i < 5 ; ++i )
+        for( int j = 0 ; j < 5 ; ++j ) {
+          double sum = 0. ;
+          for( int k = 0 ; k < 5 ; ++k ) sum += J[ i * 5 + k ] * cov[ symIndex( k, j ) ] ;
+          JC[ i * 5 + j ] = sum ;
+        }
+
+      for( int i = 0, n = 0 ; i < 5 ; ++i )
+        for( int j = 0 ; j <= i ; ++j, ++n ) {
+          double sum = 0. ;
+          for( int k = 0 ; k < 5 ; ++k ) sum += JC[ i * 5 + k ] * J[ j * 5 + k ] ;
+          cov[n] = sum ;
+        }
+    }
+
+    /** invert the symmetric, positive definite matrix in place using a Cholesky decomposition -
+     *  returns false if the matrix is not positive definite
+     */
+    inline bool invert( SymMatrix5& m ) {
+
+      double L[5][5] = { { 0. } } ;
+
+      for( int j = 0 ; j < 5 ; ++j ) {
+
+        double d = m[ symIndex( j, j ) ] ;
+        for( int k = 0 ; k < j ; ++k ) d -= L[j][k] * L[j][k] ;
+
+        if( !( d > 0. ) ) return false ;
+
+        L[j][j] = std::sqrt( d ) ;
+
+        for( int i = j + 1 ; i < 5 ; ++i ) {
+          double s = m[ symIndex( i, j ) ] ;
+          for( int k = 0 ; k < j ; ++k ) s -= L[i][k] * L[j][k] ;
+          L[i][j] = s / L[j][j] ;
+        }
+      }
+
+      // inverse of the lower triangular L
+      double Li[5][5] = { { 0. } } ;
+
+      for( int i = 0 ; i < 5 ; ++i ) {
+        Li[i][i] = 1. / L[i][i] ;
+        for( int j = 0 ; j < i ; ++j ) {
+          double s = 0. ;
+          for( int k = j ; k < i ; ++k ) s -= L[i][k] * Li[k][j] ;
+          Li[i][j] = s / L[i][i] ;
+        }
+      }
+
+      // m^-1 = Li^T * Li
+      for( int i = 0 ; i < 5 ; ++i )
+        for( int j = 0 ; j <= i ; ++j ) {
+          double s = 0. ;
+          for( int k = i ; k < 5 ; ++k ) s += Li[k][i] * Li[k][j] ;
+          m[ symIndex( i, j ) ] = s ;
+        }
+
+      return true ;
+    }
+
+    /** invert the general matrix in place using Gauss-Jordan elimination with partial pivoting -
+     *  returns false if the matrix is singular
+     */
+    inline bool invert( Matrix5& m ) {
+
+      int perm[5] = { 0, 1, 2, 3, 4 } ;
+
+      for( int c = 0 ; c < 5 ; ++c ) {
+
+        int pivot = c ;
+        for( int r = c + 1 ; r < 5 ; ++r )
+          if( std::fabs( m[ r * 5 + c ] ) > std::fabs( m[ pivot * 5 + c ] ) ) pivot = r ;
+
+        if( m[ pivot * 5 + c ] == 0. ) return false ;
+
+        if( pivot != c ) {
+          for( int j = 0 ; j < 5 ; ++j ) std::swap( m[ c * 5 + j ], m[ pivot * 5 + j ] ) ;
+          std::swap( perm[c], perm[pivot] ) ;
+        }
+
+        const double inv = 1. / m[ c * 5 + c ] ;
+        m[ c * 5 + c ] = 1. ;
+        for( int j = 0 ; j < 5 ; ++j ) m[ c * 5 + j ] *= inv ;
+
+        for( int r = 0 ; r < 5 ; ++r ) {
+          if( r == c ) continue ;
+          const double f = m[ r * 5 + c ] ;
+          m[ r * 5 + c ] = 0. ;
+          for( int j = 0 ; j < 5 ; ++j ) m[ r * 5 + j ] -= f * m[ c * 5 + j ] ;
+        }
+      }
+
+      // undo the row permutation as a column permutation of the inverse
+      Matrix5 tmp = m ;
+      for( int c = 0 ; c < 5 ; ++c )
+        for( int r = 0 ; r < 5 ; ++r ) m[ r * 5 + perm[c] ] = tmp[ r * 5 + c ] ;
+
+      return true ;
+    }
+
+    /** point of closest approach to the reference point in the xy-plane */
+    inline void pca( const State& st, double* pos ) {
+      pos[0] = st.ref[0] - st.par[iD0] * std::sin( st.par[iPhi] ) ;
+      pos[1] = st.ref[1] + st.par[iD0] * std::cos( st.par[iPhi] ) ;
+      pos[2] = st.ref[2] + st.par[iZ0] ;
+    }
+
+    /** position on the helix at the signed arc length s in the xy-plane from the pca,
+     *  s is positive in the direction of the momentum
+     */
+    inline void positionAt( const State& st, double s, double* pos ) {
+
+      pca( st, pos ) ;
+
+      const double half = 0.5 * st.par[iOmega] * s ;
+      const double sinc = ( std::fabs( half ) > 1.e-8 ? std::sin( half ) / half : 1. - half * half / 6. ) ;
+      const double phi = st.par[iPhi] - half ;
+
+      pos[0] += s * sinc * std::cos( phi ) ;
+      pos[1] += s * sinc * std::sin( phi ) ;
+      pos[2] += s * st.par[iTanL] ;
+    }
+
+    /** direction of the helix at the signed arc length s - not normalised: ( cos(phi), sin(phi), tanLambda ) */
+    inline void directionAt( const State& st, double s, double* dir ) {
+
+      const double phi = st.par[iPhi] - st.par[iOmega] * s ;
+
+      dir[0] = std::cos( phi ) ;
+      dir[1] = std::sin( phi ) ;
+      dir[2] = st.par[iTanL] ;
+    }
+
+    /** moveReferencePoint() for a straight line, i.e. omega == 0: the Jacobian is linear in the
+     *  displacement of the reference point
+     */
+    inline double moveLineReferencePoint( State& st, const double* ref, Matrix5* jacobian ) {
+
+      const double tanL = st.par[iTanL] ;
+
+      const double dx = ref[0] - st.ref[0] ;
+      const double dy = ref[1] - st.ref[1] ;
+
+      const double sinPhi0 = std::sin( st.par[iPhi] ) ;
+      const double cosPhi0 = std::cos( st.par[iPhi] ) ;
+
+      // displacement along and perpendicular to the line
+      const double q = dx * cosPhi0 + dy * sinPhi0 ;
+      const double w = dx * sinPhi0 - dy * cosPhi0 ;
+
+      if( jacobian ) {
+
+        Matrix5& J = *jacobian ;
+        setIdentity( J ) ;
+
+        J[ iD0 * 5 + iPhi ]  = q ;
+        J[ iZ0 * 5 + iPhi ]  = -tanL * w ;
+        J[ iZ0 * 5 + iTanL ] = q ;
+      }
+
+      st.par[iD0] += w ;
+      st.par[iZ0]  = st.ref[2] + st.par[iZ0] + tanL * q - ref[2] ;
+
+      st.ref[0] = ref[0] ;
+      st.ref[1] = ref[1] ;
+      st.ref[2] = ref[2] ;
+
+      return q ;
+    }
+
+    /** move the reference point of the state to ref, transforming the parameters and, if jacobian
+     *  is not 0, computing the Jacobian of the transformation - the covariance matrix is not changed.
+     *  Returns the signed arc length in the xy-plane from the old to the new pca.
+     */
+    inline double moveReferencePoint( State& st, const double* ref, Matrix5* jacobian ) {
+
+      if( st.par[iOmega] == 0. ) return moveLineReferencePoint( st, ref, jacobian ) ;
+
+      const double d0    = st.par[iD0] ;
+      const double phi0  = st.par[iPhi] ;
+      const double omega = st.par[iOmega] ;
+      const double tanL  = st.par[iTanL] ;
+
+      const double dx = ref[0] - st.ref[0] ;
+      const double dy = ref[1] - st.ref[1] ;
+
+      const double sinPhi0 = std::sin( phi0 ) ;
+      const double cosPhi0 = std::cos( phi0 ) ;
+
+      // q along and w perpendicular to the direction at the old pca
+      const double q = dx * cosPhi0 + dy * sinPhi0 ;
+      const double w = dx * sinPhi0 - dy * cosPhi0 ;
+
+      const double f = 1. - omega * d0 ;
+      const double sf = ( f < 0. ? -1. : 1. ) ;
+
+      const double phi0New = std::atan2( sf * ( f * sinPhi0 - omega * dx ), sf * ( f * cosPhi0 + omega * dy ) ) ;
+
+      const double X = omega * ( omega * ( dx * dx + dy * dy ) - 2. * w * f ) / ( f * f ) ;
+      const double d0New = d0 - ( omega * ( dx * dx + dy * dy ) - 2. * w * f ) / ( f * ( 1. + std::sqrt( 1. + X ) ) ) ;
+
+      const double e = 1. - omega * d0New ;
+
+      const double dPhi = toBaseRange( phi0New - phi0 ) ;
+      const double sinDPhi = std::sin( dPhi ) ;
+      const double cosDPhi = std::cos( dPhi ) ;
+
+      // arc length from the old to the new pca, stable for omega -> 0
+      const double s = ( std::fabs( dPhi ) < 1. ? ( q / e ) * ( std::fabs( sinDPhi ) > 1.e-15 ? dPhi / sinDPhi : 1. ) : -dPhi / omega ) ;
+
+      const double z0New = st.ref[2] + st.par[iZ0] + tanL * s - ref[2] ;
+
+      if( jacobian ) {
+
+        Matrix5& J = *jacobian ;
+        setIdentity( J ) ;
+
+        // sin(dphi)/omega and (1-cos(dphi))/omega
+        const double sinOverOmega = -q / e ;
+        const double oneMinusCosOverOmega = sinDPhi * sinOverOmega / ( 1. + cosDPhi ) ;
+
+        // (dphi - sin(dphi)) / omega^2 = s^2 * (dphi - sin(dphi)) / dphi^2
+        const double g = ( std::fabs( dPhi ) > 1.e-4 ? ( dPhi - sinDPhi ) / ( dPhi * dPhi ) : dPhi / 6. ) ;
+
+        J[ iD0 * 5 + iD0 ]      = cosDPhi ;
+        J[ iD0 * 5 + iPhi ]     = -f * sinOverOmega ;
+        J[ iD0 * 5 + iOmega ]   = -sinOverOmega * sinOverOmega / ( 1. + cosDPhi ) ;
+
+        J[ iPhi * 5 + iD0 ]     = omega * sinDPhi / e ;
+        J[ iPhi * 5 + iPhi ]    = f * cosDPhi / e ;
+        J[ iPhi * 5 + iOmega ]  = sinOverOmega / e ;
+
+        J[ iZ0 * 5 + iD0 ]      = -tanL * sinDPhi / e ;
+        J[ iZ0 * 5 + iPhi ]     = tanL * ( d0 - d0New + f * oneMinusCosOverOmega ) / e ;
+        J[ iZ0 * 5 + iOmega ]   = tanL * ( s * s * g - sinOverOmega * d0New / e ) ;
+        J[ iZ0 * 5 + iTanL ]    = s ;
+      }
+
+      st.par[iD0]  = d0New ;
+      st.par[iPhi] = phi0New ;
+      st.par[iZ0]  = z0New ;
+
+      st.ref[0] = ref[0] ;
+      st.ref[1] = ref[1] ;
+      st.ref[2] = ref[2] ;
+
+      return s ;
+    }
+
+    /** set the parameters of the helix through the three points, ordered in the direction of the momentum,
+     *  with the reference point at x1 - the covariance matrix is not changed. Returns false if the points
+     *  are on a straight line in the xy-plane.
+     */
+    inline bool helixFromThreePoints( const double* x1, const double* x2, const double* x3, State& st ) {
+
+      const double ax = x2[0] - x1[0], ay = x2[1] - x1[1] ;
+      const double bx = x3[0] - x2[0], by = x3[1] - x2[1] ;
+
+      const double cross = ax * by - ay * bx ;
+
+      // x2 and x3 relative to x1
+      const double ux = x3[0] - x1[0], uy = x3[1] - x1[1] ;
+
+      const double a2 = ax * ax + ay * ay ;
+      const double u2 = ux * ux + uy * uy ;
+
+      if( std::fabs( cross ) <= 1.e-12 * std::sqrt( a2 * u2 ) ) return false ;
+
+      // centre of the circle relative to x1
+      const double d = 2. * cross ;
+      const double cx = ( uy * a2 - ay * u2 ) / d ;
+      const double cy = ( ax * u2 - ux * a2 ) / d ;
+
+      // clockwise motion, i.e. a negative cross product, has positive omega
+      const double radius = std::sqrt( cx * cx + cy * cy ) ;
+      const double omega = ( cross < 0. ? 1. : -1. ) / radius ;
+
+      // x1 is at centre + ( -sin(phi), cos(phi) ) / omega
+      const double phi1 = std::atan2(  cx * omega, -cy * omega ) ;
+
+      const double ex = ux - cx ;
+      const double ey = uy - cy ;
+      const double phi3 = std::atan2( -ex * omega, ey * omega ) ;
+
+      double dPhi = phi1 - phi3 ;
+      if( omega < 0. ) dPhi = -dPhi ;
+      while( dPhi <= 0. ) dPhi += 2. * M_PI ;
+
+      const double arc = dPhi * radius ;
+
+      st.par[iD0]    = 0. ;
+      st.par[iPhi]   = toBaseRange( phi1 ) ;
+      st.par[iOmega] = omega ;
+      st.par[iZ0]    = 0. ;
+      st.par[iTanL]  = ( x3[2] - x1[2] ) / arc ;
+
+      st.ref[0] = x1[0] ;
+      st.ref[1] = x1[1] ;
+      st.ref[2] = x1[2] ;
+
+      return true ;
+    }
+
+    /** transport the state to the new reference point: parameters and covariance matrix,
+     *  the Jacobian is returned in jacobian if not 0. Returns the signed arc length.
+     */
+    inline double transport( State& st, const double* ref, Matrix5* jacobian=0 ) {
+
+      Matrix5 J ;
+      const double s = moveReferencePoint( st, ref, &J ) ;
+      similarity( J, st.cov ) ;
+
+      if( jacobian ) *jacobian = J ;
+
+      return s ;
+    }
+
+    /** intersections of the helix with a cylinder parallel to z with the given axis and radius:
+     *  the arc lengths of the crossing points in ]-pi/|omega|,pi/|omega|] are filled into arcs,
+     *  returns the number of intersections ( 0 or 2 ). Solved directly for a straight line.
+     */
+    inline int intersectZCylinder( const State& st, double xAxis, double yAxis, double radius, double* arcs ) {
+
+      const double omega = st.par[iOmega] ;
+
+      if( omega == 0. ) {
+
+        double p[3] ;
+        pca( st, p ) ;
+
+        // | p + s u - axis |^2 = radius^2 for the unit direction u in the xy-plane
+        const double dx = p[0] - xAxis ;
+        const double dy = p[1] - yAxis ;
+
+        const double b = dx * std::cos( st.par[iPhi] ) + dy * std::sin( st.par[iPhi] ) ;
+        const double disc = b * b - ( dx * dx + dy * dy - radius * radius ) ;
+
+        if( disc < 0. ) return 0 ;
+
+        const double root = std::sqrt( disc ) ;
+
+        arcs[0] = -b + root ;
+        arcs[1] = -b - root ;
+
+        return 2 ;
+      }
+      const double rho = 1. / omega ;
+
+      double p[3] ;
+      pca( st, p ) ;
+
+      const double sinPhi0 = std::sin( st.par[iPhi] ) ;
+      const double cosPhi0 = std::cos( st.par[iPhi] ) ;
+
+      // centre of the helix and its distance to the axis
+      const double xc = p[0] + rho * sinPhi0 ;
+      const double yc = p[1] - rho * cosPhi0 ;
+
+      const double dx = xc - xAxis ;
+      const double dy = yc - yAxis ;
+      const double d = std::sqrt( dx * dx + dy * dy ) ;
+
+      const double r = std::fabs( rho ) ;
+
+      if( d > radius + r || d < std::fabs( radius - r ) || d == 0. ) return 0 ;
+
+      const double a = ( radius * radius - r * r + d * d ) / ( 2. * d ) ;
+      const double h = std::sqrt( std::max( radius * radius - a * a, 0. ) ) ;
+
+      const double ex = dx / d ;
+      const double ey = dy / d ;
+
+      for( int i = 0 ; i < 2 ; ++i ) {
+
+        const double sign = ( i == 0 ? 1. : -1. ) ;
+
+        const double x = xAxis + a * ex - sign * h * ey ;
+        const double y = yAxis + a * ey + sign * h * ex ;
+
+        // the point is at xc - rho sin(phi), yc + rho cos(phi)
+        const double phi = std::atan2( -( x - xc ) / rho, ( y - yc ) / rho ) ;
+
+        arcs[i] = -toBaseRange( phi - st.par[iPhi] ) * rho ;
+      }
+
+      return 2 ;
+    }
+
+    /** intersection of the helix with the plane through origin with the given normal, found with
+     *  Newton's method starting from the pca, or directly for a straight line - returns false if it
+     *  does not converge
+     */
+    inline bool intersectPlane( const State& st, const double* origin, const double* normal, double& arc ) {
+
+      double s = 0. ;
+
+      if( st.par[iOmega] == 0. ) {
+
+        double pos[3], dir[3] ;
+        pca( st, pos ) ;
+        directionAt( st, 0., dir ) ;
+
+        const double df = dir[0] * normal[0] + dir[1] * normal[1] + dir[2] * normal[2] ;
+
+        if( std::fabs( df ) < 1.e-12 ) return false ;
+
+        arc = ( ( origin[0] - pos[0] ) * normal[0] + ( origin[1] - pos[1] ) * normal[1] + ( origin[2] - pos[2] ) * normal[2] ) / df ;
+        return true ;
+      }
+
+      for( int iter = 0 ; iter < 20 ; ++iter ) {
+
+        double pos[3], dir[3] ;
+        positionAt( st, s, pos ) ;
+        directionAt( st, s, dir ) ;
+
+        const double f = ( pos[0] - origin[0] ) * normal[0] + ( pos[1] - origin[1] ) * normal[1] + ( pos[2] - origin[2] ) * normal[2] ;
+        const double df = dir[0] * normal[0] + dir[1] * normal[1] + dir[2] * normal[2] ;
+
+        if( std::fabs( df ) < 1.e-12 ) return false ;
+
+        const double ds = -f / df ;
+        s += ds ;
+
+        if( std::fabs( ds ) < 1.e-6 ) {
+          arc = s ;
+          return true ;
+        }
+      }
+
+      return false ;
+    }
+
+    /** total momentum of the state */
+    inline double momentum( const State& st, double bz ) {
+      return c_light * std::fabs( bz / st.par[iOmega] ) * std::sqrt( 1. + st.par[iTanL] * st.par[iTanL] ) ;
+    }
+
+    /** path length in 3D for the arc length s in the xy-plane */
+    inline double pathLength( const State& st, double s ) {
+      return s * std::sqrt( 1. + st.par[iTanL] * st.par[iTanL] ) ;
+    }
+
+    /** time of flight in ns along the path length in mm for a particle with the given mass - the speed
+     *  of light is used if the momentum is not defined
+     */
+    inline double timeOfFlight( const State& st, double bz, double mass, double path ) {
+
+      const double p = momentum( st, bz ) ;
+      const double beta = ( p > 0. && std::isfinite( p ) ? p / std::sqrt( p * p + mass * mass ) : 1. ) ;
+
+      return path / ( beta * c_mm_per_ns ) ;
+    }
+
+    /** add the multiple scattering in a layer of the given thickness in radiation lengths, traversed
+     *  along the track by a particle with momentum p, to the covariance matrix ( Highland formula )
+     */
+    inline void addMultipleScatteringAtMomentum( State& st, double p, double mass, double pathOverX0 ) {
+
+      if( !( pathOverX0 > 0. ) ) return ;
+
+      const double beta = p / std::sqrt( p * p + mass * mass ) ;
+
+      const double corr = std::max( 1. + 0.038 * std::log( pathOverX0 ), 0. ) ;
+      const double theta = 0.0136 / ( beta * p ) * std::sqrt( pathOverX0 ) * corr ;
+      const double theta2 = theta * theta ;
+
+      const double omega = st.par[iOmega] ;
+      const double tanL = st.par[iTanL] ;
+      const double sec2 = 1. + tanL * tanL ;
+
+      st.cov[ symIndex( iPhi, iPhi ) ]     += theta2 * sec2 ;
+      st.cov[ symIndex( iTanL, iTanL ) ]   += theta2 * sec2 * sec2 ;
+      st.cov[ symIndex( iOmega, iOmega ) ] += theta2 * omega * omega * tanL * tanL ;
+      st.cov[ symIndex( iOmega, iTanL ) ]  += theta2 * omega * tanL * sec2 ;
+    }
+
+    /** addMultipleScatteringAtMomentum() for the momentum of the state */
+    inline void addMultipleScattering( State& st, double bz, double mass, double pathOverX0 ) {
+      addMultipleScatteringAtMomentum( st, momentum( st, bz ), mass, pathOverX0 ) ;
+    }
+
+    /** mean energy loss in GeV/mm of a particle with momentum p and mass m in a material with the
+     *  given atomic number, mass number and density in g/cm^3 ( Bethe formula, without density correction )
+     */
+    inline double dEdx( double p, double mass, double Z, double A, double density ) {
+
+      if( !( density > 0. ) || !( A > 0. ) ) return 0. ;
+
+      const double K = 0.307075 ;       // MeV cm^2 / mol
+      const double me = 0.510998950 ;   // MeV
+
+      const double E2 = p * p + mass * mass ;
+      const double beta2 = p * p / E2 ;
+      const double bg2 = p * p / ( mass * mass ) ;
+
+      const double I = 16.e-6 * std::pow( Z, 0.9 ) ;   // MeV
+
+      const double arg = 2. * me * bg2 / I ;
+      if( arg <= 1. ) return 0. ;
+
+      const double dedx = K * Z / A * density / beta2 * ( std::log( arg ) - beta2 ) ;   // MeV / cm
+
+      return dedx * 1.e-4 ;
+    }
+
+    /** change the energy of the particle by -deltaE ( deltaE > 0 is an energy loss ) and scale omega and
+     *  its covariances accordingly - the scaling factor of omega is returned in factor. Returns false if the
+     *  particle would be stopped.
+     */
+    inline bool applyEnergyLoss( State& st, double bz, double mass, double deltaE, double& factor ) {
+
+      factor = 1. ;
+
+      if( deltaE == 0. ) return true ;
+
+      const double p = momentum( st, bz ) ;
+      const double E = std::sqrt( p * p + mass * mass ) - deltaE ;
+
+      if( E <= mass ) return false ;
+
+      const double pNew = std::sqrt( E * E - mass * mass ) ;
+
+      factor = p / pNew ;
+
+      st.par[iOmega] *= factor ;
+
+      for( int i = 0 ; i < 5 ; ++i ) st.cov[ symIndex( iOmega, i ) ] *= factor ;
+      st.cov[ symIndex( iOmega, iOmega ) ] *= factor ;
+
+      return true ;
+    }
+
+    /** Kalman filter update with a measurement of dimension dim ( 1 or 2 ): H is the dim x 5 projection
+     *  matrix, residual the measurement minus the prediction and V the lower triangle of the measurement
+     *  covariance matrix. The chi2 increment is returned in chi2 - the state is only updated if it is below
+     *  maxChi2. Returns false if the chi2 is above the maximum or the residual covariance is singular.
+     */
+    inline bool filter( State& st, const double H[2][5], const double* residual, const double* V, int dim, double maxChi2, double& chi2 ) {
+
+      // C H^T
+      double CHt[5][2] = { { 0. } } ;
+
+      for( int i = 0 ; i < 5 ; ++i )
+        for( int m = 0 ; m < dim ; ++m ) {
+          double sum = 0. ;
+          for( int k = 0 ; k < 5 ; ++k ) sum += st.cov[ symIndex( i, k ) ] * H[m][k] ;
+          CHt[i][m] = sum ;
+        }
+
+      // S = V + H C H^T and its inverse
+      double S[2][2] = { { 0. } } ;
+
+      for( int m = 0 ; m < dim ; ++m )
+        for( int n = 0 ; n <= m ; ++n ) {
+          double sum = V[ m * ( m + 1 ) / 2 + n ] ;
+          for( int k = 0 ; k < 5 ; ++k ) sum += H[m][k] * CHt[k][n] ;
+          S[m][n] = S[n][m] = sum ;
+        }
+
+      double Si[2][2] = { { 0. } } ;
+
+      if( dim == 1 ) {
+
+        if( !( S[0][0] > 0. ) ) return false ;
+
+        Si[0][0] = 1. / S[0][0] ;
+      }
+      else {
+
+        const double det = S[0][0] * S[1][1] - S[0][1] * S[1][0] ;
+
+        if( !( det > 0. ) ) return false ;
+
+        Si[0][0] =  S[1][1] / det ;
+        Si[1][1] =  S[0][0] / det ;
+        Si[0][1] = Si[1][0] = -S[0][1] / det ;
+      }
+
+      chi2 = 0. ;
+      for( int m = 0 ; m < dim ; ++m )
+        for( int n = 0 ; n < dim ; ++n ) chi2 += residual[m] * Si[m][n] * residual[n] ;
+
+      if( chi2 > maxChi2 ) return false ;
+
+      // gain K = C H^T S^-1
+      double K[5][2] = { { 0. } } ;
+
+      for( int i = 0 ; i < 5 ; ++i )
+        for( int m = 0 ; m < dim ; ++m )
+          for( int n = 0 ; n < dim ; ++n ) K[i][m] += CHt[i][n] * Si[n][m] ;
+
+      for( int i = 0 ; i < 5 ; ++i )
+        for( int m = 0 ; m < dim ; ++m ) st.par[i] += K[i][m] * residual[m] ;
+
+      st.par[iPhi] = toBaseRange( st.par[iPhi] ) ;
+
+      // C' = C - K H C = C - K (C H^T)^T
+      for( int i = 0, n = 0 ; i < 5 ; ++i )
+        for( int j = 0 ; j <= i ; ++j, ++n )
+          for( int m = 0 ; m < dim ; ++m ) st.cov[n] -= K[i][m] * CHt[j][m] ;
+
+      return true ;
+    }
+
+  } // end of namespace FastKF
+
+} // end of namespace MarlinTrk
+
+#endif
@@ -0,0 +1,132 @@
+#ifndef FitResultCache_h
+#define FitResultCache_h
+
+#include <cstddef>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace EVENT {
+  class TrackerHit ;
+  class TrackState ;
+}
+
+namespace IMPL {
+  class TrackImpl ;
+}
+
+namespace MarlinTrk {
+
+  class IMarlinTrack ;
+  class IMarlinTrkSystem ;
+
+  /** Cache for the results of createFinalisedLCIOTrack(), enabled with IMarlinTrkSystem::CFG::useFitResultCache -
+   *  one instance per job, see MarlinTrk::fitResultCache(). The key is built from the ordered hits, the prefit,
+   *  the fit direction, the mass, the B-field, the maximum chi2 increment and the options and address of the
+   *  track system. Hits are identified by their LCIO id, which is unique within a job, such that hits of a new
+   *  event never match the entries of an old one.
+   *
+   *  The library does not know about events: only newEvent(), to be called by the processors at the start of
+   *  every event, releases the entries of the previous event. Without it the cache spans the whole job and all
+   *  entries are only released once it holds maxSize() entries.
+   *
+   *  A result holds the content of the TrackImpl, the hits in the fit, the outliers and the status of the fit.
+   *
+   * @version $Id$
+   */
+  class FitResultCache {
+
+  public:
+
+    typedef std::vector< std::pair<EVENT::TrackerHit*, double> > HitList ;
+
+    /** key of the fit of a list of hits */
+    struct Key {
+      std::vector<int> hitIDs{} ;
+      /** parameters, reference point and covariance matrix of the prefit - empty if no prefit is given */
+      std::vector<float> prefit{} ;
+      bool fitDirection = false ;
+      double mass = 0. ;
+      float bfield = 0. ;
+      double maxChi2Increment = 0. ;
+      /** bit i is the value of option i of the track system */
+      unsigned options = 0 ;
+      const IMarlinTrkSystem* trkSystem = nullptr ;
+
+      bool operator==( const Key& rhs ) const ;
+
+      /** hash of all elements of the key */
+      std::size_t hash() const ;
+    } ;
+
+    FitResultCache() = default ;
+    FitResultCache(const FitResultCache&) = delete ;
+    FitResultCache& operator=(const FitResultCache&) = delete ;
+
+    ~FitResultCache() ;
+
+    /** create the key for fitting the hits with the given track of the given track system */
+    static Key makeKey( IMarlinTrkSystem& trkSystem, IMarlinTrack& marlinTrk, const std::vector<EVENT::TrackerHit*>& hit_list,
+			const EVENT::TrackState* pre_fit, bool fit_direction, float bfield_z, double maxChi2Increment ) ;
+
+    /** to be called at the start of every event: releases all entries if the event differs from the last one */
+    void newEvent( int runNumber, int eventNumber ) ;
+
+    /** release all entries */
+    void clear() ;
+
+    /** if a result is cached for the key, restore the hits in the fit and the outliers of a successful fit in marlinTrk
+     *  with IMarlinTrack::restoreFitResult(), fill the result into track, set the status code of the fit and return true -
+     *  return false otherwise, also if the fit result cannot be restored. Counts the cache hits and misses.
+     */
+    bool find( const Key& key, IMarlinTrack& marlinTrk, IMPL::TrackImpl* track, int& status ) ;
+
+    /** store the result of the fit for the key: the content of track, the hits in the fit, the outliers and the status code of the fit */
+    void insert( const Key& key, const IMPL::TrackImpl* track, const HitList& hitsInFit, const HitList& outliers, int status ) ;
+
+    /** number of entries */
+    std::size_t size() const { return _results.size() ; }
+
+    /** maximum number of entries - the cache is cleared when it is reached */
+    std::size_t maxSize() const { return _maxSize ; }
+
+    /** set the maximum number of entries */
+    void setMaxSize( std::size_t maxSize ) { _maxSize = maxSize ; }
+
+    /** number of calls to find() that returned a cached result */
+    unsigned long hits() const { return _hits ; }
+
+    /** number of calls to find() that did not find a cached result */
+    unsigned long misses() const { return _misses ; }
+
+    /** reset the hit and miss counters */
+    void resetCounters() { _hits = 0 ; _misses = 0 ; }
+
+  private:
+
+    struct KeyHash {
+      std::size_t operator()( const Key& key ) const { return key.hash() ; }
+    } ;
+
+    struct Result {
+      IMPL::TrackImpl* track ;
+      HitList hitsInFit ;
+      HitList outliers ;
+      int status ;
+    } ;
+
+    std::unordered_map< Key, Result, KeyHash > _results{} ;
+
+    std::size_t _maxSize = 10000 ;
+
+    int _runNumber = -1 ;
+    int _eventNumber = -1 ;
+
+    unsigned long _hits = 0 ;
+    unsigned long _misses = 0 ;
+
+  } ;
+
+} // end of namespace MarlinTrk
+
+#endif
@@ -40,16 +40,103 @@
  //-----------------------------------------------------------------
  */
 
+#include "FastKFKernels.h"
+
+#include <vector>
+
 namespace MarlinTrk {
   
+  /** Many point sets to be fit with the fast helix fit in one call. The points of all sets are stored back to back, 
+   *  point set i is [offset[i],offset[i+1]). The results are filled into contiguous arrays with 5 parameters, 
+   *  15 elements of the inverse covariance matrix and the chi2s per point set in the order of fastHelixFit().
+   */
+  struct HelixFitBatch {
+    
+    std::vector<double> x, y, z ;
+    
+    /** 1/sig(rphi)**2 and 1/sig(z)**2 of the points */
+    std::vector<double> wrphi, wz ;
+    
+    std::vector<unsigned> offset ;
+    
+    std::vector<float> par, invCov ;
+    std::vector<float> chi2rphi, chi2z ;
+    
+    /** return code of the fit of every point set, 0 if it was fit */
+    std::vector<int> status ;
+    
+    unsigned size() const { return offset.empty() ? 0 : offset.size() - 1 ; }
+    
+    /** remove all point sets and results, keeping the memory */
+    void clear() ;
+    
+    /** append a point set with n points */
+    void addPointSet( unsigned n, const double* xp, const double* yp, const double* zp, const double* wrphip, const double* wzp ) ;
+  } ;
+  
+  
   class HelixFit {
     
     
   public:
     
+    /** the fast helix fit in double precision, see fastHelixFitT()
+     */
     int fastHelixFit(int npt, double* xf, double* yf, float* rf, float* pf, double* wf, float* zf , float* wzf, int iopt,
                      float* vv0, float* ee0, float& ch2ph, float& ch2z);
     
+    /** the fast helix fit with the per point workspace and the sums over the points in precision Real, instantiated for 
+     *  float and double. The workspace is sized from npt and kept for the next fit, there is no limit on the number of points.
+     */
+    template <typename Real>
+    int fastHelixFitT(int npt, const double* xf, const double* yf, const float* rf, const float* pf, const double* wf, const float* zf , const float* wzf, int iopt,
+                      float* vv0, float* ee0, float& ch2ph, float& ch2z);
+    
+    /** the non-iterative Riemann fit in double precision, see riemannHelixFitT()
+     */
+    int riemannHelixFit(int npt, double* xf, double* yf, float* rf, float* pf, double* wf, float* zf , float* wzf, int iopt,
+                        float* vv0, float* ee0, float& ch2ph, float& ch2z);
+    
+    /** the Riemann fit with the same inputs and outputs as fastHelixFitT(): the circle is the intersection of the plane fit to 
+     *  the points mapped onto the paraboloid w = x**2 + y**2 with the paraboloid - solved directly without the iteration of 
+     *  the circle fit of fastHelixFitT(). The s-z line, the chi2s, the error matrix and the Newton step for iopt = 3 are the same.
+     */
+    template <typename Real>
+    int riemannHelixFitT(int npt, const double* xf, const double* yf, const float* rf, const float* pf, const double* wf, const float* zf , const float* wzf, int iopt,
+                         float* vv0, float* ee0, float& ch2ph, float& ch2z);
+    
+    /** the fast helix fit of all point sets of the batch in double precision - the points of all sets are processed in 
+     *  common loops. Returns the number of point sets that could not be fit, the return code of every set is in batch.status.
+     */
+    int fastHelixFit(HelixFitBatch& batch, int iopt);
+    
+    /** fit the helix to the points with fastHelixFitT<double>() and fill the state at the origin in the LCIO parametrisation. The 
+     *  momentum points from the first to the last point if firstToLast is true, otherwise from the last to the first. The covariance 
+     *  matrix is the inverse of the sum of H^T V^-1 H over the points, H being the derivatives of the r-phi and z residuals of a point. 
+     *  The chi2 contributions of the points and their arc lengths in the xy-plane from the pca to the origin are filled into chi2s 
+     *  and arcs if not 0. Returns 0 if the fit succeeded.
+     */
+    int fitState(int npt, const double* xf, const double* yf, const double* zf, const double* wf, const double* wzf, bool firstToLast,
+                 FastKF::State& state, double* chi2s=0, double* arcs=0);
+    
+  private:
+    
+    /** the circle fits of fastHelixFitT() and riemannHelixFitT() */
+    enum CircleFit { chernovOsokov, riemann } ;
+    
+    template <typename Real>
+    int helixFit(CircleFit circleFit, int npt, const double* xf, const double* yf, const float* rf, const float* pf, const double* wf, const float* zf , const float* wzf, int iopt,
+                 float* vv0, float* ee0, float& ch2ph, float& ch2z);
+    
+    /** the reusable workspace of the given precision */
+    template <typename Real>
+    std::vector<Real>& workspace() ;
+    
+    std::vector<float>  _workspaceFloat{} ;
+    std::vector<double> _workspaceDouble{} ;
+    std::vector<double> _workspaceBatch{} ;
+    std::vector<float>  _workspaceState{} ;
+    
   };
   
 }
@@ -2,6 +2,24 @@
 #define HelixTrack_h
 
 #include <cmath>
+#include <vector>
+
+/** Triplets of space points and the helices through them in structure of arrays layout, see HelixTrack::fromTriplets().
+ *  The helix parameters are in the LCIO convention with the reference point at the first point of the triplet.
+ */
+struct HelixTripletBatch {
+  
+  std::vector<double> x1, y1, z1 ;
+  std::vector<double> x2, y2, z2 ;
+  std::vector<double> x3, y3, z3 ;
+  
+  std::vector<double> d0, z0, phi0, omega, tanLambda ;
+  
+  unsigned size() const { return x1.size() ; }
+  
+  void resize( unsigned n ) ;
+} ;
+
 
 class HelixTrack {
   
@@ -14,8 +32,15 @@ public:
     while ( _phi0 >= M_PI ) _phi0 -= 2.0*M_PI;
   } 
   
+  /** helix through the three points, solved analytically with the reference point at x1. For direction == true the momentum
+   *  points from x1 to x3, otherwise from x3 to x1 - points on a straight line in the xy-plane give omega = 0.
+   */
   HelixTrack( const double* x1, const double* x2, const double* x3, double Bz, bool direction );
   
+  /** fill the helix parameters of all triplets of the batch in one loop, see the three point constructor
+   */
+  static void fromTriplets( HelixTripletBatch& batch, bool direction=true ) ;
+  
   
   
   HelixTrack( const double* position, const double* p, double charge, double Bz ) ;
@@ -31,7 +56,7 @@ public:
   double  getOmega() const { return _omega ; }  
   double  getTanLambda() const { return _tanLambda ; } 
   
-  // defines if s of the helix increases in the direction of x2 to x3 
+  // defines if s of the helix increases in the direction of x2 to x3 - used by createPrefit
   static bool forwards;
   
 private:
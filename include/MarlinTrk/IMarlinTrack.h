@@ -12,6 +12,7 @@
 
 #include <exception>
 #include <string>
+#include <vector>
 
 
 #ifdef MARLINTRK_BACKWARD_GEAR_WRAPPERS
@@ -22,6 +23,8 @@
 
 namespace MarlinTrk{
   
+  class IMarlinTrkSystem ;
+
   /// the Vector3D used for the tracking interface
   typedef dd4hep::rec::Vector3D Vector3D ;
   
@@ -59,6 +62,54 @@ namespace MarlinTrk{
     static const int all_sites_fail_fit ;   // no single measurement added to the fit
     
     
+    /** A destination for propagateToMany(): a point, a numbered sensitive layer or a sensitive detector element.
+     *  The results of the propagation to this target are returned in the output members.
+     */
+    struct PropagationTarget {
+      
+      enum Type { toPoint, toLayer, toDetElement } ;
+      
+      PropagationTarget( Type t, const Vector3D& p, int i, int m ) : type(t), point(p), id(i), mode(m) {}
+      
+      /** point of closest approach to the given point */
+      static PropagationTarget atPoint( const Vector3D& p ) { return PropagationTarget( toPoint, p, 0, modeClosest ) ; }
+      
+      /** crossing with the numbered sensitive layer in the given mode */
+      static PropagationTarget atLayer( int layerID, int m=modeClosest ) { return PropagationTarget( toLayer, Vector3D(), layerID, m ) ; }
+      
+      /** crossing with the sensitive detector element in the given mode */
+      static PropagationTarget atDetElement( int detElementID, int m=modeClosest ) { return PropagationTarget( toDetElement, Vector3D(), detElementID, m ) ; }
+      
+      // input
+      Type type ;
+      Vector3D point ;
+      int id ;
+      int mode ;
+      
+      // output
+      int status = error ;
+      IMPL::TrackStateImpl trackState{} ;
+      double chi2 = 0. ;
+      int ndf = 0 ;
+      int detElementID = 0 ;
+      double pathLength = 0. ;    // mm, from the measurement site used
+      double timeOfFlight = 0. ;  // ns, for the mass of the track
+    } ;
+    
+    
+    /** A sensitive detector element crossed by the fitted track, see getHitPattern().
+     */
+    struct PatternCrossing {
+      
+      int detElementID = 0 ;
+      Vector3D point{} ;
+      /** the hit of the fit on the detector element - 0 for a hole */
+      EVENT::TrackerHit* hit = 0 ;
+      
+      bool isHole() const { return hit == 0 ; }
+    } ;
+    
+    
     /**default d'tor*/
     virtual ~IMarlinTrack() {};
     
@@ -71,8 +122,13 @@ namespace MarlinTrk{
      */
     virtual double getMass() = 0 ;
 
+    /** the tracking system that created this track - implementation dependant, the default implementation returns 0.
+     */
+    virtual IMarlinTrkSystem* getTrkSystem() ;
+
     /** add hit to track - the hits have to be added ordered in time ( i.e. typically outgoing )
-     *  this order will define the direction of the energy loss used in the fit
+     *  this order will define the direction of the energy loss used in the fit.
+     *  Implementations may order the hits themselves if IMarlinTrkSystem::CFG::useHitSorting is set.
      */
     virtual int addHit(EVENT::TrackerHit* hit) = 0 ;
     
@@ -108,7 +164,30 @@ namespace MarlinTrk{
      */
     virtual int testChi2Increment( EVENT::TrackerHit* hit, double& chi2increment ) = 0 ;
 
-    
+
+    /** remove the hit from the current fit, e.g. after an ambiguity or outlier decision. Only the part of the fit
+     *  that depends on the hit is updated - implementation dependant. The default implementation returns IMarlinTrack::error.
+     */
+    virtual int removeHit( EVENT::TrackerHit* hit ) ;
+
+
+    /** insert the hit into the current fit at the position given by its measurement surface, rather than at the end
+     *  as for addAndFit. Provides the Chi2 increment to the fit from adding the hit via reference, the given hit will
+     *  not be added if chi2increment > maxChi2Increment - implementation dependant. The default implementation returns
+     *  IMarlinTrack::error.
+     */
+    virtual int insertHit( EVENT::TrackerHit* hit, double& chi2increment, double maxChi2Increment=DBL_MAX ) ;
+
+
+    /** fit the hits of this initialised track once for every particle mass in masses, reusing the navigation and
+     *  hit conversion already done for this track, which itself is not changed. One new track per mass is returned
+     *  in tracks, in the order of masses - the tracks are owned by the caller. Returns IMarlinTrack::success if all fits
+     *  succeeded, otherwise the error code of the first failed fit - implementation dependant. The default implementation
+     *  returns IMarlinTrack::error.
+     */
+    virtual int fitMassHypotheses( const std::vector<double>& masses, std::vector<IMarlinTrack*>& tracks, double maxChi2Increment=DBL_MAX ) ;
+
+
     /** smooth all track states 
      */
     virtual int smooth() = 0 ;
@@ -145,6 +224,12 @@ namespace MarlinTrk{
      */
     virtual int getOutliers( std::vector<std::pair<EVENT::TrackerHit*, double> >& hits ) = 0 ;
     
+    /** set the hits in the fit and the outliers of an identical fit, e.g. from the FitResultCache, instead of fitting the track -
+     *  afterwards only getHitsInFit() and getOutliers() can be used. Implementation dependant, the default implementation returns error.
+     */
+    virtual int restoreFitResult( const std::vector<std::pair<EVENT::TrackerHit*, double> >& hitsInFit,
+                                  const std::vector<std::pair<EVENT::TrackerHit*, double> >& outliers ) ;
+    
     /** get the current number of degrees of freedom for the fit.
      */
     virtual int getNDF( int& ndf ) = 0 ;
@@ -152,8 +237,30 @@ namespace MarlinTrk{
     /** get TrackeHit at which fit became constrained, i.e. ndf >= 0
      */
     virtual int getTrackerHitAtPositiveNDF( EVENT::TrackerHit*& trkhit ) = 0 ;
+
+    /** get the path length in mm and the time of flight in ns, for the mass of the track, accumulated in the order
+     *  of the fit from the first measurement site to the site associated with the given hit - implementation dependant.
+     *  The default implementation returns IMarlinTrack::error.
+     */
+    virtual int getPathLength( EVENT::TrackerHit* hit, double& pathLength, double& timeOfFlight ) ;
+
+    /** get the path length in mm and the time of flight in ns of the last propagation or extrapolation, from the
+     *  measurement site used to the destination - negative if the track was followed against its momentum.
+     *  Returns IMarlinTrack::error if there has been no propagation yet, which is also the default implementation.
+     */
+    virtual int getLastPropagationLength( double& pathLength, double& timeOfFlight ) ;
+    
+    /** get the sensitive detector elements crossed by the fitted track in one walk outwards from its point of closest approach 
+     *  to the origin, ordered along the track up to half a turn. Every crossing is flagged with the hit of the fit on the 
+     *  detector element or as a hole - outliers count as holes. Returns IMarlinTrack::error if the track has not been fitted, 
+     *  the default implementation always does.
+     */
+    virtual int getHitPattern( std::vector<PatternCrossing>& crossings ) ;
     
     // PROPAGATORS 
+    //
+    // If IMarlinTrkSystem::CFG::useParametersOnly is set, propagators and extrapolators only transport the track 
+    // parameters and return track states with a zero covariance matrix.
     
     /** propagate the fit to the point of closest approach to the given point, returning TrackState, chi2 and ndf via reference    
      */
@@ -184,6 +291,30 @@ namespace MarlinTrk{
      */
     virtual int propagateToDetElement( int detEementID, EVENT::TrackerHit* hit, IMPL::TrackStateImpl& ts, double& chi2, int& ndf, int mode=modeClosest ) = 0  ;
     
+    /** propagate the fit to all given targets in one go, filling the output members of each target. Implementations
+     *  may order the targets by path length and follow the track only once, sharing the navigation between targets.
+     *  Returns IMarlinTrack::success if all targets were reached, otherwise the first failing status in the given order.
+     *  The default implementation calls propagate(), propagateToLayer() or propagateToDetElement() for every target.
+     */
+    virtual int propagateToMany( std::vector<PropagationTarget>& targets ) ;
+    
+    /** propagate the fit at the measurement site associated with the given hit to all given targets in one go,
+     *  see propagateToMany( std::vector<PropagationTarget>& ).
+     */
+    virtual int propagateToMany( std::vector<PropagationTarget>& targets, EVENT::TrackerHit* hit ) ;
+    
+    /** propagate the fit to whichever of the numbered sensitive layers the track crosses first in the given mode, returning 
+     *  TrackState, chi2, ndf, the ID of the layer reached and the integer ID of the intersected sensitive detector element via reference.
+     *  Only the first crossing is transported to. The default implementation orders the crossings from intersectionWithLayer() 
+     *  along the helix of the track state and calls propagateToLayer() for the first one.
+     */
+    virtual int propagateToFirstLayer( const std::vector<int>& layerIDs, IMPL::TrackStateImpl& ts, double& chi2, int& ndf, int& layerID, int& detElementID, int mode=modeForward ) ;
+    
+    /** propagate the fit at the measurement site associated with the given hit to whichever of the numbered sensitive layers
+     *  the track crosses first in the given mode, see propagateToFirstLayer( const std::vector<int>&, ... ).
+     */
+    virtual int propagateToFirstLayer( const std::vector<int>& layerIDs, EVENT::TrackerHit* hit, IMPL::TrackStateImpl& ts, double& chi2, int& ndf, int& layerID, int& detElementID, int mode=modeForward ) ;
+    
     
     
     // EXTRAPOLATORS
@@ -215,6 +346,29 @@ namespace MarlinTrk{
      */
     virtual int extrapolateToDetElement( int detEementID, EVENT::TrackerHit* hit, IMPL::TrackStateImpl& ts, double& chi2, int& ndf, int mode=modeClosest ) = 0  ;
     
+    /** extrapolate the fit in one walk along the track to the cylinders around the z-axis with the given radii, in the given order:
+     *  every crossing is searched from the previous one in the given mode, the first one from the last site. The track states at the 
+     *  crossings are returned in states and the status of every crossing in status - a cylinder that is not crossed does not stop the walk.
+     *  Returns IMarlinTrack::success if all cylinders were crossed, otherwise the first failing status.
+     *  The default implementation transports the LCIO track state with the LCIOTrackPropagators.
+     */
+    virtual int extrapolateToCylinders( const std::vector<double>& radii, std::vector<IMPL::TrackStateImpl>& states, std::vector<int>& status, int mode=modeForward ) ;
+    
+    /** extrapolate the fit at the measurement site associated with the given hit to the cylinders with the given radii, 
+     *  see extrapolateToCylinders( const std::vector<double>&, std::vector<IMPL::TrackStateImpl>&, std::vector<int>&, int ).
+     */
+    virtual int extrapolateToCylinders( const std::vector<double>& radii, EVENT::TrackerHit* hit, std::vector<IMPL::TrackStateImpl>& states, std::vector<int>& status, int mode=modeForward ) ;
+    
+    /** extrapolate the fit in one walk along the track to the planes perpendicular to the z-axis at the given z positions,
+     *  see extrapolateToCylinders( const std::vector<double>&, std::vector<IMPL::TrackStateImpl>&, std::vector<int>&, int ).
+     */
+    virtual int extrapolateToZPlanes( const std::vector<double>& zPositions, std::vector<IMPL::TrackStateImpl>& states, std::vector<int>& status, int mode=modeForward ) ;
+    
+    /** extrapolate the fit at the measurement site associated with the given hit to the planes at the given z positions,
+     *  see extrapolateToCylinders( const std::vector<double>&, std::vector<IMPL::TrackStateImpl>&, std::vector<int>&, int ).
+     */
+    virtual int extrapolateToZPlanes( const std::vector<double>& zPositions, EVENT::TrackerHit* hit, std::vector<IMPL::TrackStateImpl>& states, std::vector<int>& status, int mode=modeForward ) ;
+    
     
     // INTERSECTORS
     
@@ -305,6 +459,11 @@ namespace MarlinTrk{
   /** Helper function to convert error return code to string */
   std::string errorCode( int error );
   
+  /** Signed arc length in the xy plane from the pca of the track state to the point on its helix, taking the first turn in the
+   *  given mode. This orders the crossings in IMarlinTrack::propagateToFirstLayer(): the smallest absolute value is reached first.
+   */
+  double arcLengthToPoint( const EVENT::TrackState& ts, const Vector3D& p, int mode ) ;
+  
   
   
   
@@ -55,8 +55,24 @@ namespace MarlinTrk {
       static const unsigned  usedEdx  = 2 ;
       /** Use smoothing when calling fit( bool fitDirection ) */
       static const unsigned  useSmoothing = 3 ;
+      /** Keep the states of finished measurement sites in compact single precision storage after smoothing - done in
+       *  smooth(), which createFinalisedLCIOTrack() always calls: tracks that are only filtered and never smoothed are not compacted.
+       *  The sites used in later queries get their full states back for the lifetime of the track. */
+      static const unsigned  useCompactSites = 4 ;
+      /** Reuse the results of createFinalisedLCIOTrack() for identical fits from MarlinTrk::fitResultCache() - only for
+       *  tracks that implement IMarlinTrack::restoreFitResult(), i.e. MarlinDDKalTest and MarlinAidaTT */
+      static const unsigned  useFitResultCache = 5 ;
+      /** Order the hits by the sorting policy of their measurement layers in initialise(), instead of relying on the order of addHit() */
+      static const unsigned  useHitSorting = 6 ;
+      /** Fit straight lines instead of helices (MarlinFastKF, MarlinDDKalTest) - both always fit straight lines in a vanishing magnetic field */
+      static const unsigned  useStraightLine = 7 ;
+      /** Propagate and extrapolate the track parameters only - the covariance matrix of the returned track states is zero */
+      static const unsigned  useParametersOnly = 8 ;
+      /** Initialise createFinalisedLCIOTrack() with the weighted helix fit of all 2D hits and its covariance matrix - also used
+       *  by the aidaTT tracks instead of the GBL prefit in initialise() */
+      static const unsigned  useWeightedPrefit = 9 ;
       //---
-      static const unsigned  size     = 4 ;
+      static const unsigned  size     = 10 ;
       
     } ;
     
@@ -1,6 +1,9 @@
 #ifndef LCIOTrackPropagators_h
 #define LCIOTrackPropagators_h
 
+#include <array>
+#include <vector>
+
 namespace EVENT{
   class TrackState ;
 }
@@ -12,28 +15,77 @@ namespace IMPL{
 
 namespace LCIOTrackPropagators{
   
+  // All propagators transport the covariance matrix along with the parameters. For withCovariance == false only the 
+  // parameters are transported, skipping the Jacobian, and the covariance matrix of the trackstate is set to zero.
+  // They share the fixed size kernels of MarlinFastKF and do not allocate memory on the heap.
+  
   /** Propagate trackstate to a new reference point
    */
-  int PropagateLCIOToNewRef( IMPL::TrackStateImpl& ts, double xref, double yref, double zref) ;
+  int PropagateLCIOToNewRef( IMPL::TrackStateImpl& ts, double xref, double yref, double zref, bool withCovariance=true) ;
   
   /** Propagate trackstate to a new reference point taken as its crossing point with a cylinder of infinite length centered at x0,y0, parallel to the z axis. 
    For direction== 0  the closest crossing point will be taken
    For direction== 1  the first crossing traversing in positive s will be taken
    For direction==-1  the first crossing traversing in negative s will be taken
    */
-  int PropagateLCIOToCylinder( IMPL::TrackStateImpl& ts, float r, float x0, float y0, int direction=0, double epsilon=1.0e-8) ;
+  int PropagateLCIOToCylinder( IMPL::TrackStateImpl& ts, float r, float x0, float y0, int direction=0, double epsilon=1.0e-8, bool withCovariance=true) ;
   
   
   /** Propagate trackstate to a new reference point taken as its crossing point with an infinite plane located at z, perpendicular to the z axis 
    */
-  int PropagateLCIOToZPlane( IMPL::TrackStateImpl& ts, float z) ;
+  int PropagateLCIOToZPlane( IMPL::TrackStateImpl& ts, float z, bool withCovariance=true) ;
   
   /** Propagate trackstate to a new reference point taken as its crossing point with a plane parallel to the z axis, containing points x1,x2 and y1,y2. Tolerance for intersection determined by epsilon.
    For direction== 0  the closest crossing point will be taken
    For direction== 1  the first crossing traversing in positive s will be taken
    For direction==-1  the first crossing traversing in negative s will be taken
    */
-  int PropagateLCIOToPlaneParralelToZ( IMPL::TrackStateImpl& ts, float x1, float y1, float x2, float y2, int direction=0, double epsilon=1.0e-8) ;
+  int PropagateLCIOToPlaneParralelToZ( IMPL::TrackStateImpl& ts, float x1, float y1, float x2, float y2, int direction=0, double epsilon=1.0e-8, bool withCovariance=true) ;
+  
+  
+  /** Track states in structure of arrays layout for the batch propagators, in the LCIO parametrisation. cov[k][i] is element k 
+   *  of the lower triangle of the covariance matrix of track state i, in the order of TrackState::getCovMatrix().
+   */
+  struct TrackStateBatch {
+    
+    std::vector<double> d0, phi, omega, z0, tanLambda ;
+    std::vector<double> refX, refY, refZ ;
+    std::array< std::vector<double>, 15 > cov ;
+    
+    /** return code of the last propagation of every track state, 0 if it was propagated - the track state is unchanged otherwise */
+    std::vector<int> status ;
+    
+    unsigned size() const { return d0.size() ; }
+    
+    void resize( unsigned n ) ;
+    
+    /** copy the track state into slot i */
+    void set( unsigned i, const EVENT::TrackState& ts ) ;
+    
+    /** copy slot i into the track state */
+    void get( unsigned i, IMPL::TrackStateImpl& ts ) const ;
+  } ;
+  
+  // The batch propagators give the same results as the propagators above for all track states of the batch and return the number
+  // of track states that could not be propagated. The return code of every track state is in batch.status. The track states are
+  // propagated in blocks on the stack: the crossing points and the math library calls are computed track by track, the remaining
+  // arithmetic of the move and of the covariance matrix runs in one branch free loop over the block that the compiler vectorises.
+  
+  /** Propagate all track states to the same new reference point
+   */
+  int PropagateToNewRef( TrackStateBatch& batch, double xref, double yref, double zref, bool withCovariance=true) ;
+  
+  /** Propagate all track states to their crossing points with a cylinder parallel to the z axis, see PropagateLCIOToCylinder
+   */
+  int PropagateToCylinder( TrackStateBatch& batch, double r, double x0, double y0, int direction=0, double epsilon=1.0e-8, bool withCovariance=true) ;
+  
+  /** Propagate all track states to their crossing points with a plane perpendicular to the z axis, see PropagateLCIOToZPlane
+   */
+  int PropagateToZPlane( TrackStateBatch& batch, double z, bool withCovariance=true) ;
+  
+  /** Propagate all track states to their crossing points with a plane parallel to the z axis, see PropagateLCIOToPlaneParralelToZ
+   */
+  int PropagateToPlaneParralelToZ( TrackStateBatch& batch, double x1, double y1, double x2, double y2, int direction=0, double epsilon=1.0e-8, bool withCovariance=true) ;
   
   
   
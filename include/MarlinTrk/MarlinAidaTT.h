@@ -104,7 +104,11 @@ namespace MarlinTrk{
     
     bool _useQMS=false;
     bool _usedEdx=false;
+    bool _useWeightedPrefit=false;
     bool _is_initialised=false;
+
+    /// Bz at the origin in Tesla, used for the multiple scattering in MarlinAidaTTTrack::addAndFit()
+    double _bz=0.;
     
     /// multi-map of surfaces
     SurfMap _surfMap{};
@@ -3,6 +3,7 @@
 
 #include "IMarlinTrack.h"
 #include "IMarlinTrkSystem.h"
+#include "FastKFKernels.h"
 
 #include "aidaTT/AidaTT.hh"
 
@@ -54,6 +55,10 @@ private:
    */
   double getMass() ;
 
+  /** the MarlinAidaTT system of this track
+   */
+  IMarlinTrkSystem* getTrkSystem() ;
+
   /** add hit to track - the hits have to be added ordered in time ( i.e. typically outgoing )
    *  this order will define the direction of the energy loss used in the fit
    */
@@ -62,6 +67,7 @@ private:
   /** initialise the fit using the hits added up to this point -
    *  the fit direction has to be specified using IMarlinTrack::backward or IMarlinTrack::forward. 
    *  this is the order  wrt the order used in addHit() that will be used in the fit() 
+   *  The start parameters are from a GBL prefit or, with IMarlinTrkSystem::CFG::useWeightedPrefit, from the weighted helix fit of all 2D hits.
    */
   int initialise( bool /*fitDirection*/ ); 
   
@@ -95,17 +101,17 @@ private:
   int smooth( EVENT::TrackerHit* )  ;
   
   
-  /** this method has no effect for aidaTT/GBL ...
-   * update the current fit using the supplied hit, return code via int. Provides the Chi2 increment to the fit from adding the hit via reference. 
+  /** update the current fit using the supplied hit, return code via int. Provides the Chi2 increment to the fit from adding the hit via reference. 
+   *  The hit is filtered into a material free Kalman filter state (multiple scattering in the hit surface only) - accepted hits 
+   *  are added to the list of hits and used in the next call to fit(), which performs the GBL fit. Only 2D hits are supported.
    */
-  int addAndFit( EVENT::TrackerHit* , double& , double) ;
+  int addAndFit( EVENT::TrackerHit* trkhit, double& chi2increment, double maxChi2Increment=DBL_MAX ) ;
   
   
-  /**  this method has no effect for aidaTT/GBL ...
-   *  obtain the chi2 increment which would result in adding the hit to the fit. 
+  /** obtain the chi2 increment which would result in adding the hit to the fit, from the Kalman filter state used in addAndFit(). 
    *  This method will not alter the current fit, and the hit will not be stored in the list of hits or outliers
    */
-  int testChi2Increment( EVENT::TrackerHit* , double&  ) ;
+  int testChi2Increment( EVENT::TrackerHit* trkhit, double& chi2increment ) ;
 
   
   // Track State Accessesors
@@ -127,14 +133,19 @@ private:
    */
   int getHitsInFit( std::vector<std::pair<EVENT::TrackerHit*, double> >& hits ) ;
   
-  /** this method has no effect for aidaTT/GBL ...
-   *  get the list of hits which have been rejected by from the fit due to the a chi2 increment greater than threshold,
+  /** get the list of hits which have been rejected by addAndFit() due to the a chi2 increment greater than threshold,
    *  Pointers to the hits together with their chi2 contribution will be filled into a vector of 
    *  pairs consitining of the pointer as the first part of the pair and the chi2 contribution as
    *  the second.
    */
   int getOutliers( std::vector<std::pair<EVENT::TrackerHit*, double> >&  ) ;
 
+  /** set the hits in the fit and the outliers of an identical fit instead of fitting the track - only for a track
+   *  that has not been initialised, afterwards only getHitsInFit() and getOutliers() can be used.
+   */
+  int restoreFitResult( const std::vector<std::pair<EVENT::TrackerHit*, double> >& hitsInFit,
+                        const std::vector<std::pair<EVENT::TrackerHit*, double> >& outliers ) ;
+
 
   /** get the current number of degrees of freedom for the fit.
    */
@@ -252,8 +263,15 @@ protected:
 
   int getTrackState( const aidaTT::Vector3D& refPoint, int label, IMPL::TrackStateImpl& ts, double& chi2, int& ndf ) ;
 
-  /// common initialization
-  int myInit() ;
+  /** seed the Kalman filter state from the prefit if given, else from the initial track parameters with large errors,
+   *  and filter the hits added so far */
+  void seedKalmanState( const EVENT::TrackState* preFit ) ;
+
+  /** transport the state to the hit and filter it, the state is only updated if the chi2 increment is below maxChi2Increment */
+  int filterHit( EVENT::TrackerHit* trkhit, FastKF::State& state, double maxChi2Increment, double& chi2increment ) const ;
+
+  /// common initialization - the covariance matrix of the prefit is used if given, else large errors
+  int myInit( const EVENT::TrackState* preFit=0 ) ;
 
   // memeber variables 
   
@@ -272,6 +290,15 @@ protected:
   aidaTT::trackParameters _initialTrackParams{};
 
   aidaTT::trajectory* _fitTrajectory{};
+
+  /** set once the GBL fit has been performed on _fitTrajectory */
+  bool _fitted=false;
+
+  /** Kalman filter state in LCIO units at the last hit, used in addAndFit() and testChi2Increment() */
+  FastKF::State _kalmanState{};
+
+  /** hits rejected in addAndFit() with their chi2 increment */
+  std::vector< std::pair<EVENT::TrackerHit*, double> > _outliers{};
   
   const std::vector<std::pair<double, const aidaTT::ISurface*> >* _intersections{};
 
@@ -21,13 +21,15 @@
 #include "TVector3.h"
 
 #include <cmath>
+#include <map>
+#include <utility>
 #include <vector>
 
 
 class TKalDetCradle ;
 class TVKalDetector ;
 class DDVMeasLayer ;
-class THelicalTrack ;
+class TVTrack ;
 
 class DDCylinderMeasLayer;
 
@@ -44,6 +46,7 @@ namespace MarlinTrk{
   public:
     
     friend class MarlinDDKalTestTrack;
+    friend class MarlinDDKalTestCKF;
     
     // define some configuration constants
     static const bool FitBackward   = kIterBackward ;
@@ -74,6 +77,11 @@ namespace MarlinTrk{
     /** instantiate its implementation of the IMarlinTrack */
     MarlinTrk::IMarlinTrack* createTrack()  ;
     
+    /** the momentum in GeV assumed for the multiple scattering of straight lines fitted in a vanishing field */
+    void setStraightLineMomentum( double p ) { _straightLineMomentum = p ; }
+    
+    double getStraightLineMomentum() const { return _straightLineMomentum ; }
+    
     
   protected:
     
@@ -92,6 +100,14 @@ namespace MarlinTrk{
     /** Store active measurement module IDs needed for navigation  */
     void getSensitiveMeasurementModulesForLayer( int layerID, std::vector<const DDVMeasLayer *>& measmodules) const;
     
+    /** Fill the modules of the layer that can be crossed by the helix, selected from the phi index built in init() - 
+     *  falls back to all modules of the layer if the layer is not indexed, the crossing cannot be bounded or the track is a straight line.
+     */
+    void getSensitiveMeasurementModulesForLayer( int layerID, const TVTrack& track, std::vector<const DDVMeasLayer *>& measmodules) const;
+    
+    /** Build the phi index of the planar modules of every layer - called at the end of init() */
+    void buildLayerPhiIndex() ;
+    
     //  void init(bool MSOn, bool EnergyLossOn) ;
     bool is_initialised=false;
     
@@ -100,8 +116,11 @@ namespace MarlinTrk{
     //** find the measurment layer for a given det element ID and point in space 
     const DDVMeasLayer* findMeasLayer( int detElementID, const TVector3& point) const ;
     
-    // get the last layer crossed by the helix when extrapolating from the present position to the pca to point
-    const DDVMeasLayer* getLastMeasLayer(THelicalTrack const& helix, TVector3 const& point) const ;
+    // get the last layer crossed by the helix or straight line when extrapolating from the present position to the pca to point
+    const DDVMeasLayer* getLastMeasLayer(TVTrack const& track, TVector3 const& point) const ;
+    
+    /** a copy of the helix or, in a vanishing field, the straight line of a track state that can be moved independently - owned by the caller */
+    static TVTrack* cloneTrack( TVTrack const& track ) ;
     
     const DDCylinderMeasLayer* getIPLayer() const { return _ipLayer; }
     
@@ -118,6 +137,20 @@ namespace MarlinTrk{
 
     std::vector< DDKalDetector* > _detectors{};
     
+    /** planar modules of one layer binned in phi, radial and z extent in mm */
+    struct LayerPhiIndex {
+      bool isDisk = false ;
+      double rMin = 0., rMax = 0. ;
+      double zMin = 0., zMax = 0. ;
+      std::vector< const DDVMeasLayer* > modules{} ;
+      std::vector< std::pair<double,double> > moduleR{} ;
+      std::vector< std::vector<unsigned> > bins{} ;
+    } ;
+    
+    std::map< int, LayerPhiIndex > _layerPhiIndex{} ;
+    
+    double _straightLineMomentum = 1. ;
+    
 #ifdef MARLINTRK_DIAGNOSTICS_ON
 
   private:    
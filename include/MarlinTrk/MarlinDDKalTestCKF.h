@@ -0,0 +1,125 @@
+#ifndef MarlinDDKalTestCKF_h
+#define MarlinDDKalTestCKF_h
+
+#include "IMarlinTrack.h"
+
+#include "lcio.h"
+#include "EVENT/TrackerHit.h"
+
+#include <map>
+#include <vector>
+
+
+class TKalTrack ;
+class TKalTrackSite ;
+class DDVTrackHit ;
+
+namespace MarlinTrk{
+
+  class MarlinDDKalTest ;
+  class MarlinDDKalTestTrack ;
+
+
+  /** Combinatorial Kalman filter driver for the KalTest implementation of the IMarlinTrack interface:
+   *  a fitted seed track is followed through a list of layers, branching on every hit of a layer that passes
+   *  the chi2 cut. Branches are kept in a tree of measurement sites, so that all branches share the sites
+   *  of their common prefix and every site is filtered exactly once. The number of branches per layer and
+   *  the number of candidates kept after every layer (beam width) are bounded, the candidates are ranked
+   *  by the number of hits and the total chi2.
+   *
+   *  The KalTest hits are created once per hit and kept until clear() is called - call clear() before
+   *  the LCIO hits given to findTracks() are deleted, e.g. at the end of every event.
+   *
+   * @version $Id$
+   */
+  class MarlinDDKalTestCKF {
+
+  public:
+
+    /** hits to follow the seeds through, keyed by a layer ID chosen by the caller */
+    typedef std::map< int, EVENT::TrackerHitVec > LayerHitMap ;
+
+    /** C'tor - the track system has to be initialised */
+    MarlinDDKalTestCKF( MarlinDDKalTest* ktest ) ;
+
+    MarlinDDKalTestCKF(const MarlinDDKalTestCKF&) = delete ;
+    MarlinDDKalTestCKF& operator=(const MarlinDDKalTestCKF&) = delete ;
+
+    ~MarlinDDKalTestCKF() ;
+
+    /** maximum chi2 increment for adding a hit to a branch - default: 35. */
+    void setMaxChi2Increment( double maxChi2Increment ) { _maxChi2Increment = maxChi2Increment ; }
+
+    /** maximum number of hits a branch is continued with on a single layer - default: 3 */
+    void setMaxBranchesPerLayer( unsigned maxBranches ) { _maxBranchesPerLayer = maxBranches ; }
+
+    /** maximum number of candidates kept after every layer - default: 10 */
+    void setBeamWidth( unsigned beamWidth ) { _beamWidth = beamWidth ; }
+
+    /** maximum number of layers without a hit a candidate may have - default: 2 */
+    void setMaxHoles( unsigned maxHoles ) { _maxHoles = maxHoles ; }
+
+    /** follow the fitted seed through the given layers, in the given order which has to be the direction of the fit
+     *  of the seed, using the hits in layerHits. The surviving candidates are returned in tracks, best first, as new
+     *  tracks holding the hits of the seed and of the candidate, fitted with the maximum chi2 increment of the CKF
+     *  and owned by the caller. Candidates whose refit fails are dropped. Returns IMarlinTrack::no_intersection if no hit
+     *  could be added to the seed and the error code of the refit if no candidate could be refitted.
+     */
+    int findTracks( IMarlinTrack* seed, const std::vector<int>& layers, const LayerHitMap& layerHits,
+		    std::vector<IMarlinTrack*>& tracks ) ;
+
+    /** delete the KalTest hits created for the LCIO hits used so far */
+    void clear() ;
+
+  protected:
+
+    /** a node of the branch tree: the site filtered with the hit on top of the parent node,
+     *  or a hole on the layer, which shares the site of its parent
+     */
+    struct Node {
+      const Node* parent ;
+      TKalTrackSite* site ;
+      EVENT::TrackerHit* hit ;
+      bool ownsSite ;
+      double chi2 ;
+      unsigned nHits ;
+      unsigned nHoles ;
+    } ;
+
+    /** better candidates have more hits, then a smaller chi2 */
+    static bool betterCandidate( const Node* lhs, const Node* rhs ) ;
+
+    /** the KalTest hit for the given LCIO hit, converted on first use - 0 if no measurement layer is found */
+    DDVTrackHit* getKalHit( EVENT::TrackerHit* hit ) ;
+
+    /** filter the hit on top of the site of the given node, returning the new node or 0 if the hit fails the chi2 cut */
+    Node* filter( const Node& parent, EVENT::TrackerHit* hit ) ;
+
+    /** create the fitted track for the given candidate from a copy of the seed - returns 0 and the error code of the
+     *  copy or of the refit if one of them fails */
+    IMarlinTrack* createTrack( const MarlinDDKalTestTrack& seed, const Node& leaf, int& error_code ) ;
+
+    /** delete all nodes of the current branch tree */
+    void clearNodes() ;
+
+    MarlinDDKalTest* _ktest ;
+
+    /** track used for filtering a site on top of its parent - does not own any site */
+    TKalTrack* _filterTrack ;
+
+    double _maxChi2Increment = 35. ;
+    unsigned _maxBranchesPerLayer = 3 ;
+    unsigned _beamWidth = 10 ;
+    unsigned _maxHoles = 2 ;
+
+    /** the KalTest hits created for the LCIO hits */
+    std::map< EVENT::TrackerHit*, DDVTrackHit* > _kalHits{} ;
+
+    /** all nodes of the current branch tree */
+    std::vector< Node* > _nodes{} ;
+
+  } ;
+
+} // end of namespace MarlinTrk
+
+#endif
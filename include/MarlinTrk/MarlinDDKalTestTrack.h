@@ -3,22 +3,27 @@
 
 #include "IMarlinTrack.h"
 #include "IMarlinTrkSystem.h"
+#include "CompactSiteStore.h"
 
 #include <TObjArray.h>
 
 #include <cmath>
+#include <map>
+#include <tuple>
 
 #include "TMatrixD.h"
 
 
 class TKalTrack ;
-class THelicalTrack ;
+class TVTrack ;
 class TKalTrackSite ;
 class DDVTrackHit ;
 class DDVMeasLayer ;
+class TVTrackHit ;
 
 namespace MarlinTrk {
   class MarlinDDKalTest;
+  class MarlinDDKalTestCKF;
 }
 
 namespace EVENT{
@@ -43,6 +48,8 @@ public:
 #ifdef MARLINTRK_DIAGNOSTICS_ON
   friend class DiagnosticsController;
 #endif
+
+  friend class MarlinDDKalTestCKF;
     
   MarlinDDKalTestTrack(MarlinDDKalTest* ktest) ;
   
@@ -55,6 +62,36 @@ private:
   MarlinDDKalTestTrack(const MarlinDDKalTestTrack&) ;                 // Prevent copy-construction
   MarlinDDKalTestTrack& operator=(const MarlinDDKalTestTrack&) ;      // Prevent assignment
   
+  /** state and covariance of a site transported to a measurement layer, see propagateToMany()
+   */
+  struct LayerTransport ;
+  
+  /** a propagated or extrapolated track state kept in the transport memo
+   */
+  struct MemoState {
+    bool valid = false ;
+    IMPL::TrackStateImpl ts{} ;
+    double chi2 = 0. ;
+    int ndf = 0 ;
+    double pathLength = 0. ;
+    double timeOfFlight = 0. ;
+  } ;
+  
+  /** intersection of the track at a site with a layer or detector element, and the states transported there
+   */
+  struct TransportMemo {
+    int status = 0 ;
+    Vector3D point{} ;
+    int detElementID = 0 ;
+    const DDVMeasLayer* ml = nullptr ;
+    MemoState propagated{} ;
+    MemoState extrapolated{} ;
+  } ;
+  
+  /** site, PropagationTarget::Type, layer or detector element ID and mode of a memoised transport
+   */
+  typedef std::tuple<const TKalTrackSite*, int, int, int> TransportMemoKey ;
+  
   // make member functions private to force use through interface
   
   /** set the mass of the charged particle (GeV) that is used for energy loss and multiple scattering -
@@ -66,6 +103,10 @@ private:
    */
   double getMass() ;
 
+  /** the MarlinDDKalTest system of this track
+   */
+  IMarlinTrkSystem* getTrkSystem() ;
+
   /** add hit to track - the hits have to be added ordered in time ( i.e. typically outgoing )
    *  this order will define the direction of the energy loss used in the fit
    */
@@ -130,7 +171,27 @@ private:
    */
   int testChi2Increment( EVENT::TrackerHit* hit, double& chi2increment ) ;
 
-  
+
+  /** remove the hit from the current fit: the sites filtered before the hit are kept, the sites after it are
+   *  re-filtered from the already converted hits, and the smoothing is redone if the track had been smoothed.
+   */
+  int removeHit( EVENT::TrackerHit* hit ) ;
+
+
+  /** insert the hit into the current fit at the position given by the sorting policy of its measurement layer:
+   *  the sites filtered before that position are kept, the sites after it are re-filtered from the already converted hits,
+   *  and the smoothing is redone if the track had been smoothed.
+   *  the given hit will not be added if chi2increment > maxChi2Increment.
+   */
+  int insertHit( EVENT::TrackerHit* hit, double& chi2increment, double maxChi2Increment=DBL_MAX ) ;
+
+
+  /** fit the hits of this track once for every given mass: the kaltest hits and the initial site are copied
+   *  into the new tracks, so that the hits are neither searched for nor converted again.
+   */
+  int fitMassHypotheses( const std::vector<double>& masses, std::vector<IMarlinTrack*>& tracks, double maxChi2Increment=DBL_MAX ) ;
+
+
   // Track State Accessesors
   
   /** get track state, returning TrackState, chi2 and ndf via reference 
@@ -157,6 +218,12 @@ private:
    */
   int getOutliers( std::vector<std::pair<EVENT::TrackerHit*, double> >& hits ) ;
 
+  /** set the hits in the fit and the outliers of an identical fit instead of fitting the track - only for a track
+   *  that has not been initialised, afterwards only getHitsInFit() and getOutliers() can be used.
+   */
+  int restoreFitResult( const std::vector<std::pair<EVENT::TrackerHit*, double> >& hitsInFit,
+                        const std::vector<std::pair<EVENT::TrackerHit*, double> >& outliers ) ;
+
 
   /** get the current number of degrees of freedom for the fit.
    */
@@ -165,6 +232,19 @@ private:
   /** get TrackeHit at which fit became constrained, i.e. ndf >= 0
    */
   int getTrackerHitAtPositiveNDF( EVENT::TrackerHit*& trkhit ) ;
+
+  /** get the path length and time of flight from the first site to the site of the given hit
+   */
+  int getPathLength( EVENT::TrackerHit* trkhit, double& pathLength, double& timeOfFlight ) ;
+
+  /** get the path length and time of flight of the last propagation or extrapolation
+   */
+  int getLastPropagationLength( double& pathLength, double& timeOfFlight ) ;
+  
+  /** get the sensitive detector elements crossed by the helix of the innermost site, moved to the origin,
+   *  selecting the modules of every layer with the phi index of MarlinDDKalTest
+   */
+  int getHitPattern( std::vector<PatternCrossing>& crossings ) ;
   
   // PROPAGATORS 
   
@@ -182,7 +262,8 @@ private:
   /** propagate the fit at the provided measurement site, to the point of closest approach to the given point,
    *  returning TrackState, chi2 and ndf via reference   
    */    
-  int propagate( const Vector3D& point, const TKalTrackSite& site, IMPL::TrackStateImpl& ts, double& chi2, int& ndf, const DDVMeasLayer* ml = 0 ) ;
+  int propagate( const Vector3D& point, const TKalTrackSite& site, IMPL::TrackStateImpl& ts, double& chi2, int& ndf, const DDVMeasLayer* ml = 0,
+                 std::map<const DDVMeasLayer*, LayerTransport>* transports = 0 ) ;
   
   
   /** propagate the fit to the numbered sensitive layer, returning TrackState, chi2, ndf and integer ID of sensitive detector element via reference 
@@ -213,6 +294,33 @@ private:
    */
   int propagateToDetElement( int detEementID, const TKalTrackSite& site, IMPL::TrackStateImpl& ts, double& chi2, int& ndf, int mode=modeClosest ) ;
   
+  /** propagate the fit to all given targets in one go, ordered by path length from the last measurement site
+   */
+  int propagateToMany( std::vector<PropagationTarget>& targets ) ;
+  
+  /** propagate the fit at the measurement site associated with the given hit to all given targets in one go
+   */
+  int propagateToMany( std::vector<PropagationTarget>& targets, EVENT::TrackerHit* hit ) ;
+  
+  /** propagate the fit at the measurement site to all given targets in one go - the targets are visited in the order of
+   *  their path length and the transport to the last layer crossed before a target is shared by all targets behind that layer
+   */
+  int propagateToMany( std::vector<PropagationTarget>& targets, const TKalTrackSite& site ) ;
+  
+  /** propagate the fit to whichever of the numbered sensitive layers the track crosses first in the given mode
+   */
+  int propagateToFirstLayer( const std::vector<int>& layerIDs, IMPL::TrackStateImpl& ts, double& chi2, int& ndf, int& layerID, int& detElementID, int mode=modeForward ) ;
+  
+  /** propagate the fit at the measurement site associated with the given hit to whichever of the numbered sensitive layers 
+   *  the track crosses first in the given mode
+   */
+  int propagateToFirstLayer( const std::vector<int>& layerIDs, EVENT::TrackerHit* hit, IMPL::TrackStateImpl& ts, double& chi2, int& ndf, int& layerID, int& detElementID, int mode=modeForward ) ;
+  
+  /** propagate the fit at the measurement site to whichever of the numbered sensitive layers the track crosses first -
+   *  the modules in reach of all layers are intersected together and only the crossing with the smallest deflection is transported to
+   */
+  int propagateToFirstLayer( const std::vector<int>& layerIDs, const TKalTrackSite& site, IMPL::TrackStateImpl& ts, double& chi2, int& ndf, int& layerID, int& detElementID, int mode=modeForward ) ;
+  
   
   
   // EXTRAPOLATORS
@@ -302,6 +410,18 @@ private:
    */
   int findIntersection( std::vector<DDVMeasLayer const*>& meas_modules, const TKalTrackSite& site, Vector3D& point, int& detElementID, const DDVMeasLayer*& ml, int mode=modeClosest ) ;
   
+  /** the memo of the intersection of the track at the site with the layer or detector element, 0 if there is none yet
+   */
+  TransportMemo* findTransportMemo( const TKalTrackSite& site, int type, int id, int mode ) ;
+  
+  /** return the memoised state, if any, and set the length of the last propagation from it
+   */
+  bool fromMemo( const MemoState& memo, IMPL::TrackStateImpl& ts, double& chi2, int& ndf ) ;
+  
+  /** keep the state of the last propagation or extrapolation in the memo - not done for parameters only states
+   */
+  void toMemo( MemoState& memo, const IMPL::TrackStateImpl& ts, double chi2, int ndf ) const ;
+  
   /** extrapolate the fit at the measurement site, to the DDVMeasLayer,
    *  and return intersection point in global coordinates via reference 
    */
@@ -316,15 +436,77 @@ private:
    */
   void ToLCIOTrackState( const TKalTrackSite& site,  IMPL::TrackStateImpl& ts, double& chi2, int& ndf ) const ;
   
-  /** fill LCIO Track State with parameters from helix and cov matrix 
+  /** fill LCIO Track State with parameters from helix and cov matrix - a zero cov matrix is set if withCovariance is false
+   */
+  void ToLCIOTrackState( const TVTrack& track, const TMatrixD& cov, IMPL::TrackStateImpl& ts, double& chi2, int& ndf, bool withCovariance=true ) const ;
+  
+  /** ndf of the kaltrack - one more than counted by KalTest for the straight line model, which does not fit the curvature
    */
-  void ToLCIOTrackState( const THelicalTrack& helix, const TMatrixD& cov, IMPL::TrackStateImpl& ts, double& chi2, int& ndf ) const ;
+  int kalTrackNDF() const ;
+  
+  /** true if IMarlinTrkSystem::CFG::useParametersOnly is set: propagate and extrapolate without the cov matrix
+   */
+  bool parametersOnly() const ;
   
   /** get the measurement site associated with the given lcio TrackerHit trkhit
    */
   int getSiteFromLCIOHit( EVENT::TrackerHit* trkhit, TKalTrackSite*& site ) const ;
 
-  
+  /** store the relation between the lcio hit and its measurement site and update the point at which the fit became constrained
+   */
+  void recordSite( EVENT::TrackerHit* trkhit, TKalTrackSite* site, double chi2increment ) ;
+
+  /** remove all measurement sites from the given index onwards, returning the corresponding lcio hits in the order of the fit
+   */
+  void truncateSites( int index, std::vector<EVENT::TrackerHit*>& removedHits ) ;
+
+  /** filter the given, already converted, hits in the given order behind the last site of the track
+   */
+  void refilterHits( const std::vector<EVENT::TrackerHit*>& trkhits ) ;
+
+  /** drop the smoothed states from all sites, such that the filtered states become the current ones again
+   */
+  void removeSmoothedStates() ;
+
+  /** insert the kaltest hit into the time ordered list of hits, in front of the hit nextInFit in the order of the fit
+   *  or at the end of the fit if nextInFit is 0
+   */
+  void insertKalHit( EVENT::TrackerHit* trkhit, DDVTrackHit* kalhit, EVENT::TrackerHit* nextInFit ) ;
+
+  /** remove the kaltest hit of the given lcio hit from the list of hits and delete it
+   */
+  void removeKalHit( EVENT::TrackerHit* trkhit ) ;
+
+  /** order the hits in time, i.e. by the sorting policy of their measurement layers, keeping the order
+   *  of addHit() for equal keys - only done in initialise() if IMarlinTrkSystem::CFG::useHitSorting is set
+   */
+  void sortHits() ;
+
+  /** move the current states of all finished sites, i.e. all but the last one, into the compact site store
+   *  and release the kaltest states - only done after smoothing if IMarlinTrkSystem::CFG::useCompactSites is set,
+   *  as compacted sites cannot be smoothed any more: tracks fitted without smoothing are not compacted
+   */
+  void compactSites() ;
+
+  /** the site with the given index in the fit - all access to the states of sites other than the last one has to go
+   *  through here, as compacted sites get their state back from the compact site store on first use. The restored
+   *  states are kept until the track is deleted, i.e. the memory of the sites used in queries is not saved.
+   */
+  TKalTrackSite& getSite( int index ) const ;
+
+  /** give a compacted site its current state back from the compact site store, at the index of its type in the site
+   */
+  void restoreCompactSite( TKalTrackSite& site, int index ) const ;
+
+  /** copy the hits and the initial site of this track into the track trk, which has not been initialised yet
+   */
+  int copyInitialisedTrack( MarlinDDKalTestTrack& trk ) const ;
+
+  /** copy of a kaltest hit of one of the supported types - 0 for any other type
+   */
+  static DDVTrackHit* cloneKalHit( const TVTrackHit& hit ) ;
+
+
   
   /** helper function to restrict the range of the azimuthal angle to ]-pi,pi]*/
   inline double toBaseRange( double phi) const {
@@ -356,6 +538,11 @@ private:
    */
   bool _fitDirection=false;
   
+  /** set in initialise if the field at the first hit vanishes or IMarlinTrkSystem::CFG::useStraightLine is set: the curvature
+   *  is not fitted. In a vanishing field KalTest moves straight lines, else helices with a pinned, negligible kappa.
+   */
+  bool _straightLine=false;
+  
   
   /** used to store whether smoothing has been performed
    */
@@ -376,11 +563,30 @@ private:
   /** vector to store the chi-sqaure increment for measurement sites
    */
   std::vector< std::pair<EVENT::TrackerHit*, double> > _hit_chi2_values{};
+
+  /** map to store the path length and time of flight of the measurement sites, accumulated from the first site
+   */
+  std::map<EVENT::TrackerHit*, std::pair<double, double> > _hit_path_lengths{};
+
+  /** path length and time of flight of the last propagation, valid if _hasPropagated is set
+   */
+  double _lastPathLength = 0. ;
+  double _lastTimeOfFlight = 0. ;
+  bool _hasPropagated = false ;
+  
+  /** intersections with and transports to layers and detector elements from the sites, shared by the intersection,
+   *  propagation and extrapolation methods - cleared whenever the fit or the mass changes
+   */
+  std::map<TransportMemoKey, TransportMemo> _transportMemo{} ;
   
   /** vector to store the chi-sqaure increment for measurement sites
    */
   std::vector< std::pair<EVENT::TrackerHit*, double> > _outlier_chi2_values{};
 
+  /** single precision copies of the states of the compacted sites, indexed by the site index in the fit
+   */
+  CompactSiteStore _compactSites ;
+
   
 } ;
 
@@ -0,0 +1,56 @@
+#ifndef MarlinFastHelix_h
+#define MarlinFastHelix_h
+
+#include "MarlinTrk/IMarlinTrkSystem.h"
+
+#include <string>
+
+namespace MarlinTrk{
+
+  /** Material free implementation of the IMarlinTrkSystem for quick fits: the hits are fit with the
+   *  HelixFit in one go and the tracks are propagated analytically with the LCIOTrackPropagators. No
+   *  geometry is needed, calls to layers and detector elements return errors.
+   *
+   * @version $Id$
+   */
+  class MarlinFastHelix : public MarlinTrk::IMarlinTrkSystem {
+
+  public:
+
+    friend class MarlinFastHelixTrack ;
+
+    /// Default c'tor
+    MarlinFastHelix() ;
+    MarlinFastHelix(const MarlinFastHelix&) = delete ;
+    MarlinFastHelix& operator=(const MarlinFastHelix&) = delete ;
+
+    /** d'tor */
+    ~MarlinFastHelix() ;
+
+    /** initialise track fitter system - only the options are read, no geometry is loaded */
+    void init() ;
+
+    /// the name of the implementation
+    virtual std::string name() { return "FastHelix" ; }
+
+    /** instantiate its implementation of the IMarlinTrack */
+    MarlinTrk::IMarlinTrack* createTrack() ;
+
+    /** Bz in Tesla, only used for the momentum in the time of flight - the speed of light is assumed if not set */
+    void setBz( double bz ) { _bz = bz ; }
+
+  protected:
+
+    bool _is_initialised = false ;
+
+    /** propagate and extrapolate the parameters only: set with IMarlinTrkSystem::CFG::useParametersOnly */
+    bool _parametersOnly = false ;
+
+    /** Bz in Tesla */
+    double _bz = 0. ;
+
+  } ;
+
+} // end of namespace MarlinTrk
+
+#endif
@@ -0,0 +1,295 @@
+#ifndef MarlinFastHelixTrack_h
+#define MarlinFastHelixTrack_h
+
+#include "IMarlinTrack.h"
+#include "FastKFKernels.h"
+#include "HelixFit.h"
+
+#include <utility>
+#include <vector>
+
+namespace EVENT{
+  class TrackerHit ;
+}
+
+namespace MarlinTrk{
+
+  class MarlinFastHelix ;
+
+
+  /** Implementation of the IMarlinTrack interface with the material free fit of MarlinFastHelix: all
+   *  hits are fit at once with the HelixFit, the covariance matrix follows from the derivatives of the
+   *  hit residuals. States at the hits and propagations are transported analytically on the helix.
+   *
+   * @version $Id$
+   */
+  class MarlinFastHelixTrack : public MarlinTrk::IMarlinTrack {
+
+  public:
+
+    MarlinFastHelixTrack( MarlinFastHelix* fastHelix ) ;
+
+    ~MarlinFastHelixTrack() ;
+
+  private:
+
+    MarlinFastHelixTrack(const MarlinFastHelixTrack&) = delete ;
+    MarlinFastHelixTrack& operator=(const MarlinFastHelixTrack&) = delete ;
+
+    // make member functions private to force use through interface
+
+    /** set the mass of the charged particle (GeV) that is used for the time of flight -
+     *  default value if this method is not called is the pion mass.
+     */
+    void setMass( double mass ) ;
+
+    /** return the of the charged particle (GeV) that is used for the time of flight.
+     */
+    double getMass() ;
+
+    /** the MarlinFastHelix system of this track
+     */
+    IMarlinTrkSystem* getTrkSystem() ;
+
+    /** add hit to track - the hits have to be added ordered in time ( i.e. typically outgoing )
+     *  this order will define the direction of the momentum of the fitted helix. One dimensional hits are rejected.
+     */
+    int addHit( EVENT::TrackerHit* hit ) ;
+
+    /** initialise the fit using the hits added up to this point -
+     *  the fit direction has to be specified using IMarlinTrack::backward or IMarlinTrack::forward.
+     *  this is the order  wrt the order used in addHit() that will be used in the fit()
+     */
+    int initialise( bool fitDirection ) ;
+
+    /** initialise the fit with a track state
+     *  the fit direction has to be specified using IMarlinTrack::backward or IMarlinTrack::forward.
+     *  this is the order that will be used in the fit().
+     */
+    int initialise( const EVENT::TrackState& ts, double bfield_z, bool fitDirection ) ;
+
+    /** perform the fit of all current hits, returns error code ( IMarlinTrack::success if no error ) .
+     *  all hits are fit at once, the hit with the largest chi2 contribution above maxChi2Increment is removed
+     *  as outlier and the remaining hits are refit until all contributions pass.
+     */
+    int fit( double maxChi2Increment=DBL_MAX ) ;
+
+    /** update the current fit using the supplied hit, return code via int. Provides the Chi2 increment to the fit from adding the hit via reference.
+     *  the given hit will not be added if chi2increment > maxChi2Increment. All hits in the fit are refit once there are three of them.
+     */
+    int addAndFit( EVENT::TrackerHit* hit, double& chi2increment, double maxChi2Increment=DBL_MAX ) ;
+
+    /** obtain the chi2 increment which would result in adding the hit to the fit. This method will not alter the current fit, and the hit will not be stored in the list of hits or outliers
+     */
+    int testChi2Increment( EVENT::TrackerHit* hit, double& chi2increment ) ;
+
+    /** smooth all track states - nothing to do, the states at all hits are from the fit of all hits
+     */
+    int smooth() ;
+
+    /** smooth track states from the last filtered hit back to the measurement site associated with the given hit
+     */
+    int smooth( EVENT::TrackerHit* hit ) ;
+
+    // Track State Accessesors
+
+    /** get track state, returning TrackState, chi2 and ndf via reference
+     */
+    int getTrackState( IMPL::TrackStateImpl& ts, double& chi2, int& ndf ) ;
+
+    /** get track state at measurement associated with the given hit, returning TrackState, chi2 and ndf via reference
+     */
+    int getTrackState( EVENT::TrackerHit* hit, IMPL::TrackStateImpl& ts, double& chi2, int& ndf ) ;
+
+    /** get the list of hits included in the fit, together with the chi2 contributions of the hits.
+     */
+    int getHitsInFit( std::vector<std::pair<EVENT::TrackerHit*, double> >& hits ) ;
+
+    /** get the list of hits which have been rejected by from the fit due to the a chi2 increment greater than threshold,
+     */
+    int getOutliers( std::vector<std::pair<EVENT::TrackerHit*, double> >& hits ) ;
+
+    /** get the current number of degrees of freedom for the fit.
+     */
+    int getNDF( int& ndf ) ;
+
+    /** get TrackeHit at which fit became constrained, i.e. ndf >= 0
+     */
+    int getTrackerHitAtPositiveNDF( EVENT::TrackerHit*& trkhit ) ;
+
+    /** get the path length and time of flight from the first site to the site of the given hit
+     */
+    int getPathLength( EVENT::TrackerHit* hit, double& pathLength, double& timeOfFlight ) ;
+
+    /** get the path length and time of flight of the last propagation or extrapolation
+     */
+    int getLastPropagationLength( double& pathLength, double& timeOfFlight ) ;
+
+    // PROPAGATORS
+
+    /** propagate the fit to the point of closest approach to the given point, returning TrackState, chi2 and ndf via reference
+     */
+    int propagate( const Vector3D& point, IMPL::TrackStateImpl& ts, double& chi2, int& ndf ) ;
+
+    /** propagate the fit at the measurement site associated with the given hit, to the point of closest approach to the given point,
+     *  returning TrackState, chi2 and ndf via reference
+     */
+    int propagate( const Vector3D& point, EVENT::TrackerHit* hit, IMPL::TrackStateImpl& ts, double& chi2, int& ndf ) ;
+
+    // layers and detector elements need the geometry, which is not loaded: the following return IMarlinTrack::error
+
+    /** propagate the fit to the numbered sensitive layer, returning TrackState, chi2, ndf and integer ID of sensitive detector element via reference
+     */
+    int propagateToLayer( int layerID, IMPL::TrackStateImpl& ts, double& chi2, int& ndf, int& detElementID, int mode=modeClosest ) ;
+
+    /** propagate the fit at the measurement site associated with the given hit, to numbered sensitive layer,
+     *  returning TrackState, chi2, ndf and integer ID of sensitive detector element via reference
+     */
+    int propagateToLayer( int layerID, EVENT::TrackerHit* hit, IMPL::TrackStateImpl& ts, double& chi2, int& ndf, int& detElementID, int mode=modeClosest ) ;
+
+    /** propagate the fit to sensitive detector element, returning TrackState, chi2 and ndf via reference
+     */
+    int propagateToDetElement( int detElementID, IMPL::TrackStateImpl& ts, double& chi2, int& ndf, int mode=modeClosest ) ;
+
+    /** propagate the fit at the measurement site associated with the given hit, to sensitive detector element,
+     *  returning TrackState, chi2 and ndf via reference
+     */
+    int propagateToDetElement( int detEementID, EVENT::TrackerHit* hit, IMPL::TrackStateImpl& ts, double& chi2, int& ndf, int mode=modeClosest ) ;
+
+    // EXTRAPOLATORS - without material these are the same as the propagators
+
+    /** extrapolate the fit to the point of closest approach to the given point, returning TrackState, chi2 and ndf via reference
+     */
+    int extrapolate( const Vector3D& point, IMPL::TrackStateImpl& ts, double& chi2, int& ndf ) ;
+
+    /** extrapolate the fit at the measurement site associated with the given hit, to the point of closest approach to the given point,
+     *  returning TrackState, chi2 and ndf via reference
+     */
+    int extrapolate( const Vector3D& point, EVENT::TrackerHit* hit, IMPL::TrackStateImpl& ts, double& chi2, int& ndf ) ;
+
+    /** extrapolate the fit to numbered sensitive layer, returning TrackState via provided reference
+     */
+    int extrapolateToLayer( int layerID, IMPL::TrackStateImpl& ts, double& chi2, int& ndf, int& detElementID, int mode=modeClosest ) ;
+
+    /** extrapolate the fit at the measurement site associated with the given hit, to numbered sensitive layer,
+     *  returning TrackState, chi2, ndf and integer ID of sensitive detector element via reference
+     */
+    int extrapolateToLayer( int layerID, EVENT::TrackerHit* hit, IMPL::TrackStateImpl& ts, double& chi2, int& ndf, int& detElementID, int mode=modeClosest ) ;
+
+    /** extrapolate the fit to sensitive detector element, returning TrackState, chi2 and ndf via reference
+     */
+    int extrapolateToDetElement( int detElementID, IMPL::TrackStateImpl& ts, double& chi2, int& ndf, int mode=modeClosest ) ;
+
+    /** extrapolate the fit at the measurement site associated with the given hit, to sensitive detector element,
+     *  returning TrackState, chi2 and ndf via reference
+     */
+    int extrapolateToDetElement( int detEementID, EVENT::TrackerHit* hit, IMPL::TrackStateImpl& ts, double& chi2, int& ndf, int mode=modeClosest ) ;
+
+    // INTERSECTORS
+
+    /** extrapolate the fit to numbered sensitive layer, returning intersection point in global coordinates and integer ID of the
+     *  intersected sensitive detector element via reference
+     */
+    int intersectionWithLayer( int layerID, Vector3D& point, int& detElementID, int mode=modeClosest ) ;
+
+    /** extrapolate the fit at the measurement site associated with the given hit, to numbered sensitive layer,
+     *  returning intersection point in global coordinates and integer ID of the intersected sensitive detector element via reference
+     */
+    int intersectionWithLayer( int layerID, EVENT::TrackerHit* hit, Vector3D& point, int& detElementID, int mode=modeClosest ) ;
+
+    /** extrapolate the fit to numbered sensitive detector element, returning intersection point in global coordinates via reference
+     */
+    int intersectionWithDetElement( int detElementID, Vector3D& point, int mode=modeClosest ) ;
+
+    /** extrapolate the fit at the measurement site associated with the given hit, to sensitive detector element,
+     *  returning intersection point in global coordinates via reference
+     */
+    int intersectionWithDetElement( int detElementID, EVENT::TrackerHit* hit, Vector3D& point, int mode=modeClosest ) ;
+
+    /** Dump this track to a string for debugging.
+     */
+    std::string toString() ;
+
+    //** end of memeber functions from IMarlinTrack interface
+
+  protected:
+
+    /** a hit in the fit */
+    struct Site {
+      EVENT::TrackerHit* hit ;
+      double deltaChi2 ;
+      /** signed arc length in the xy-plane from the pca to the origin of the fitted helix to the pca to the hit */
+      double arc ;
+    } ;
+
+    /** fit the helix to the hits, given in the order of the fit: the state is at the origin, with the direction of the
+     *  momentum following the time order of the hits. The sites are filled in the order of the hits.
+     */
+    int fitHits( const std::vector< EVENT::TrackerHit* >& hits, FastKF::State& state, std::vector< Site >& sites, double& chi2 ) ;
+
+    /** keep the result of fitHits() as the current fit */
+    void setFit( const FastKF::State& state, std::vector< Site >& sites, double chi2 ) ;
+
+    /** index of the site of the hit - -1 if the hit is not in the fit */
+    int findSite( EVENT::TrackerHit* hit ) const ;
+
+    /** the fitted state transported to the hit - returns bad_intputs if the hit is not in the fit */
+    int getSiteState( EVENT::TrackerHit* hit, FastKF::State& state ) const ;
+
+    /** fill the state into the LCIO track state - with a zero covariance matrix if withCovariance is false */
+    void toLCIOTrackState( const FastKF::State& state, IMPL::TrackStateImpl& ts, bool withCovariance = true ) const ;
+
+    int propagate( const FastKF::State& start, const Vector3D& point, IMPL::TrackStateImpl& ts, double& chi2, int& ndf ) ;
+
+    /** log and return IMarlinTrack::error for the calls that need the geometry */
+    int noGeometry( const char* method ) const ;
+
+    MarlinFastHelix* _fastHelix ;
+
+    /** used to store whether initial track state has been supplied or created
+     */
+    bool _initialised = false ;
+
+    /** used to store the fit direction supplied to intialise
+     */
+    bool _fitDirection = false ;
+
+    double _mass ;
+
+    std::vector< EVENT::TrackerHit* > _lcioHits{} ;
+
+    /** the fitted helix with the reference point at the origin */
+    FastKF::State _fitState{} ;
+
+    /** the state at the last hit in the order of the fit, or the initial state if there is no fit yet */
+    FastKF::State _currentState{} ;
+
+    /** set if _currentState is defined */
+    bool _hasState = false ;
+
+    /** the hits in the order of the fit - the helix is fit once there are three of them */
+    std::vector< Site > _sites{} ;
+
+    std::vector< std::pair<EVENT::TrackerHit*, double> > _outliers{} ;
+
+    double _chi2 = 0. ;
+
+    /** twice the number of hits minus the five track parameters */
+    int _ndf = -5 ;
+
+    /** path length and time of flight of the last propagation, valid if _hasPropagated is set */
+    double _lastPathLength = 0. ;
+    double _lastTimeOfFlight = 0. ;
+    bool _hasPropagated = false ;
+
+    HelixFit _helixFit{} ;
+
+    /** the inputs and outputs of HelixFit::fitState(), reused between fits */
+    std::vector< double > _xf{}, _yf{}, _zf{}, _wf{}, _wzf{} ;
+    std::vector< double > _chi2s{}, _arcs{} ;
+
+  } ;
+
+} // end of namespace MarlinTrk
+
+#endif
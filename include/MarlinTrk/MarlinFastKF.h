@@ -0,0 +1,100 @@
+#ifndef MarlinFastKF_h
+#define MarlinFastKF_h
+
+#include "MarlinTrk/IMarlinTrkSystem.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace dd4hep{
+  namespace rec{
+    class ISurface ;
+  }
+}
+
+namespace MarlinTrk{
+
+  /** Native Kalman filter implementation of the IMarlinTrkSystem, without ROOT and KalTest:
+   *  the fit uses the fixed size kernels in FastKFKernels.h and the DDRec surfaces of the
+   *  tracking detectors for the measurements and the passive material.
+   *
+   * @version $Id$
+   */
+  class MarlinFastKF : public MarlinTrk::IMarlinTrkSystem {
+
+  public:
+
+    friend class MarlinFastKFTrack ;
+
+    /// Default c'tor
+    MarlinFastKF() ;
+    MarlinFastKF(const MarlinFastKF&) = delete ;
+    MarlinFastKF& operator=(const MarlinFastKF&) = delete ;
+
+    /** d'tor */
+    ~MarlinFastKF() ;
+
+    /** initialise track fitter system */
+    void init() ;
+
+    /// the name of the implementation
+    virtual std::string name() { return "FastKF" ; }
+
+    /** instantiate its implementation of the IMarlinTrack */
+    MarlinTrk::IMarlinTrack* createTrack() ;
+
+    /** the momentum in GeV assumed for the multiple scattering in the straight line model */
+    void setStraightLineMomentum( double p ) { _straightLineMomentum = p ; }
+
+  protected:
+
+    /** the sensitive surface with the given cellID0 - 0 if not found */
+    const dd4hep::rec::ISurface* findSurface( int cellID0 ) const ;
+
+    /** fill the sensitive surfaces of the layer with the given layerID ( subdet, side and layer ) */
+    void getSurfacesForLayer( int layerID, std::vector<const dd4hep::rec::ISurface*>& surfaces ) const ;
+
+    bool _useQMS = false ;
+    bool _usedEdx = false ;
+    bool _is_initialised = false ;
+
+    /** fit straight lines: set with IMarlinTrkSystem::CFG::useStraightLine or if Bz is zero */
+    bool _straightLine = false ;
+    double _straightLineMomentum = 1. ;
+
+    /** propagate and extrapolate the parameters only: set with IMarlinTrkSystem::CFG::useParametersOnly */
+    bool _parametersOnly = false ;
+
+    /** Bz at the origin in Tesla */
+    double _bz = 0. ;
+
+    /** the sensitive surfaces keyed by cellID0 */
+    std::map< int, const dd4hep::rec::ISurface* > _surfMap{} ;
+
+    /** the sensitive surfaces keyed by layerID */
+    std::multimap< int, const dd4hep::rec::ISurface* > _layerMap{} ;
+
+    /** cylinders parallel to z with material, sensitive or passive, ordered in radius */
+    std::vector< const dd4hep::rec::ISurface* > _materialCylinders{} ;
+
+    /** the radii of the material cylinders in mm */
+    std::vector< double > _materialRadii{} ;
+
+    /** radial and z range in mm covered by a material plane, from the sphere around its origin that contains it */
+    struct PlaneExtent {
+      double rMin = 0., rMax = 0. ;
+      double zMin = 0., zMax = 0. ;
+    } ;
+
+    /** planes with material, sensitive or passive, ordered in the smallest radius of their extent */
+    std::vector< const dd4hep::rec::ISurface* > _materialPlanes{} ;
+
+    /** the extents of the material planes */
+    std::vector< PlaneExtent > _materialPlaneExtents{} ;
+
+  } ;
+
+} // end of namespace MarlinTrk
+
+#endif
@@ -0,0 +1,398 @@
+#ifndef MarlinFastKFTrack_h
+#define MarlinFastKFTrack_h
+
+#include "IMarlinTrack.h"
+#include "FastKFKernels.h"
+
+#include <cmath>
+#include <utility>
+#include <vector>
+
+namespace EVENT{
+  class TrackerHit ;
+}
+
+namespace dd4hep{
+  namespace rec{
+    class ISurface ;
+  }
+}
+
+namespace MarlinTrk{
+
+  class MarlinFastKF ;
+
+
+  /** Implementation of the IMarlinTrack interface with the native Kalman filter of MarlinFastKF:
+   *  hits are filtered on their DDRec surfaces, with multiple scattering and energy loss in the
+   *  measurement surfaces and in the cylinders with material crossed in between. Smoothing is done
+   *  with the Rauch-Tung-Striebel smoother from the stored predicted states and Jacobians.
+   *
+   * @version $Id$
+   */
+  class MarlinFastKFTrack : public MarlinTrk::IMarlinTrack {
+
+  public:
+
+    MarlinFastKFTrack( MarlinFastKF* fastKF ) ;
+
+    ~MarlinFastKFTrack() ;
+
+  private:
+
+    MarlinFastKFTrack(const MarlinFastKFTrack&) = delete ;
+    MarlinFastKFTrack& operator=(const MarlinFastKFTrack&) = delete ;
+
+    // make member functions private to force use through interface
+
+    /** set the mass of the charged particle (GeV) that is used for energy loss and multiple scattering -
+     *  default value if this method is not called is the pion mass.
+     */
+    void setMass( double mass ) ;
+
+    /** return the of the charged particle (GeV) that is used for energy loss and multiple scattering.
+     */
+    double getMass() ;
+
+    /** the MarlinFastKF system of this track
+     */
+    IMarlinTrkSystem* getTrkSystem() ;
+
+    /** add hit to track - the hits have to be added ordered in time ( i.e. typically outgoing )
+     *  this order will define the direction of the energy loss used in the fit
+     */
+    int addHit( EVENT::TrackerHit* hit ) ;
+
+    /** initialise the fit using the hits added up to this point -
+     *  the fit direction has to be specified using IMarlinTrack::backward or IMarlinTrack::forward.
+     *  this is the order  wrt the order used in addHit() that will be used in the fit()
+     */
+    int initialise( bool fitDirection ) ;
+
+    /** initialise the fit with a track state
+     *  the fit direction has to be specified using IMarlinTrack::backward or IMarlinTrack::forward.
+     *  this is the order that will be used in the fit().
+     */
+    int initialise( const EVENT::TrackState& ts, double bfield_z, bool fitDirection ) ;
+
+    /** perform the fit of all current hits, returns error code ( IMarlinTrack::success if no error ) .
+     *  the fit will be performed  in the order specified at initialise() wrt the order used in addHit(), i.e.
+     *  IMarlinTrack::backward implies fitting from the outside to the inside for tracks comming from the IP.
+     */
+    int fit( double maxChi2Increment=DBL_MAX ) ;
+
+    /** update the current fit using the supplied hit, return code via int. Provides the Chi2 increment to the fit from adding the hit via reference.
+     *  the given hit will not be added if chi2increment > maxChi2Increment.
+     */
+    int addAndFit( EVENT::TrackerHit* hit, double& chi2increment, double maxChi2Increment=DBL_MAX ) ;
+
+    /** obtain the chi2 increment which would result in adding the hit to the fit. This method will not alter the current fit, and the hit will not be stored in the list of hits or outliers
+     */
+    int testChi2Increment( EVENT::TrackerHit* hit, double& chi2increment ) ;
+
+    /** smooth all track states
+     */
+    int smooth() ;
+
+    /** smooth track states from the last filtered hit back to the measurement site associated with the given hit
+     */
+    int smooth( EVENT::TrackerHit* hit ) ;
+
+    // Track State Accessesors
+
+    /** get track state, returning TrackState, chi2 and ndf via reference
+     */
+    int getTrackState( IMPL::TrackStateImpl& ts, double& chi2, int& ndf ) ;
+
+    /** get track state at measurement associated with the given hit, returning TrackState, chi2 and ndf via reference
+     */
+    int getTrackState( EVENT::TrackerHit* hit, IMPL::TrackStateImpl& ts, double& chi2, int& ndf ) ;
+
+    /** get the list of hits included in the fit, together with the chi2 contributions of the hits.
+     */
+    int getHitsInFit( std::vector<std::pair<EVENT::TrackerHit*, double> >& hits ) ;
+
+    /** get the list of hits which have been rejected by from the fit due to the a chi2 increment greater than threshold,
+     */
+    int getOutliers( std::vector<std::pair<EVENT::TrackerHit*, double> >& hits ) ;
+
+    /** get the current number of degrees of freedom for the fit.
+     */
+    int getNDF( int& ndf ) ;
+
+    /** get TrackeHit at which fit became constrained, i.e. ndf >= 0
+     */
+    int getTrackerHitAtPositiveNDF( EVENT::TrackerHit*& trkhit ) ;
+
+    /** get the path length and time of flight from the first site to the site of the given hit
+     */
+    int getPathLength( EVENT::TrackerHit* hit, double& pathLength, double& timeOfFlight ) ;
+
+    /** get the path length and time of flight of the last propagation or extrapolation
+     */
+    int getLastPropagationLength( double& pathLength, double& timeOfFlight ) ;
+
+    /** get the sensitive surfaces crossed by the state of the innermost site, moved to the origin
+     */
+    int getHitPattern( std::vector<PatternCrossing>& crossings ) ;
+
+    // PROPAGATORS
+
+    /** propagate the fit to the point of closest approach to the given point, returning TrackState, chi2 and ndf via reference
+     */
+    int propagate( const Vector3D& point, IMPL::TrackStateImpl& ts, double& chi2, int& ndf ) ;
+
+    /** propagate the fit at the measurement site associated with the given hit, to the point of closest approach to the given point,
+     *  returning TrackState, chi2 and ndf via reference
+     */
+    int propagate( const Vector3D& point, EVENT::TrackerHit* hit, IMPL::TrackStateImpl& ts, double& chi2, int& ndf ) ;
+
+    /** propagate the fit to the numbered sensitive layer, returning TrackState, chi2, ndf and integer ID of sensitive detector element via reference
+     */
+    int propagateToLayer( int layerID, IMPL::TrackStateImpl& ts, double& chi2, int& ndf, int& detElementID, int mode=modeClosest ) ;
+
+    /** propagate the fit at the measurement site associated with the given hit, to numbered sensitive layer,
+     *  returning TrackState, chi2, ndf and integer ID of sensitive detector element via reference
+     */
+    int propagateToLayer( int layerID, EVENT::TrackerHit* hit, IMPL::TrackStateImpl& ts, double& chi2, int& ndf, int& detElementID, int mode=modeClosest ) ;
+
+    /** propagate the fit to sensitive detector element, returning TrackState, chi2 and ndf via reference
+     */
+    int propagateToDetElement( int detElementID, IMPL::TrackStateImpl& ts, double& chi2, int& ndf, int mode=modeClosest ) ;
+
+    /** propagate the fit at the measurement site associated with the given hit, to sensitive detector element,
+     *  returning TrackState, chi2 and ndf via reference
+     */
+    int propagateToDetElement( int detEementID, EVENT::TrackerHit* hit, IMPL::TrackStateImpl& ts, double& chi2, int& ndf, int mode=modeClosest ) ;
+
+    /** propagate the fit to all given targets, following the track once in each direction from the last site
+     */
+    int propagateToMany( std::vector<PropagationTarget>& targets ) ;
+
+    /** propagate the fit at the measurement site associated with the given hit to all given targets,
+     *  following the track once in each direction from the site
+     */
+    int propagateToMany( std::vector<PropagationTarget>& targets, EVENT::TrackerHit* hit ) ;
+
+    /** propagate the fit to whichever of the numbered sensitive layers the track crosses first in the given mode
+     */
+    int propagateToFirstLayer( const std::vector<int>& layerIDs, IMPL::TrackStateImpl& ts, double& chi2, int& ndf, int& layerID, int& detElementID, int mode=modeForward ) ;
+
+    /** propagate the fit at the measurement site associated with the given hit to whichever of the numbered sensitive layers
+     *  the track crosses first in the given mode
+     */
+    int propagateToFirstLayer( const std::vector<int>& layerIDs, EVENT::TrackerHit* hit, IMPL::TrackStateImpl& ts, double& chi2, int& ndf, int& layerID, int& detElementID, int mode=modeForward ) ;
+
+    // EXTRAPOLATORS
+
+    /** extrapolate the fit to the point of closest approach to the given point, returning TrackState, chi2 and ndf via reference
+     */
+    int extrapolate( const Vector3D& point, IMPL::TrackStateImpl& ts, double& chi2, int& ndf ) ;
+
+    /** extrapolate the fit at the measurement site associated with the given hit, to the point of closest approach to the given point,
+     *  returning TrackState, chi2 and ndf via reference
+     */
+    int extrapolate( const Vector3D& point, EVENT::TrackerHit* hit, IMPL::TrackStateImpl& ts, double& chi2, int& ndf ) ;
+
+    /** extrapolate the fit to numbered sensitive layer, returning TrackState via provided reference
+     */
+    int extrapolateToLayer( int layerID, IMPL::TrackStateImpl& ts, double& chi2, int& ndf, int& detElementID, int mode=modeClosest ) ;
+
+    /** extrapolate the fit at the measurement site associated with the given hit, to numbered sensitive layer,
+     *  returning TrackState, chi2, ndf and integer ID of sensitive detector element via reference
+     */
+    int extrapolateToLayer( int layerID, EVENT::TrackerHit* hit, IMPL::TrackStateImpl& ts, double& chi2, int& ndf, int& detElementID, int mode=modeClosest ) ;
+
+    /** extrapolate the fit to sensitive detector element, returning TrackState, chi2 and ndf via reference
+     */
+    int extrapolateToDetElement( int detElementID, IMPL::TrackStateImpl& ts, double& chi2, int& ndf, int mode=modeClosest ) ;
+
+    /** extrapolate the fit at the measurement site associated with the given hit, to sensitive detector element,
+     *  returning TrackState, chi2 and ndf via reference
+     */
+    int extrapolateToDetElement( int detEementID, EVENT::TrackerHit* hit, IMPL::TrackStateImpl& ts, double& chi2, int& ndf, int mode=modeClosest ) ;
+
+    /** extrapolate the fit from the last site to the cylinders with the given radii, transporting the state from crossing to crossing
+     */
+    int extrapolateToCylinders( const std::vector<double>& radii, std::vector<IMPL::TrackStateImpl>& states, std::vector<int>& status, int mode=modeForward ) ;
+
+    /** extrapolate the fit at the measurement site associated with the given hit to the cylinders with the given radii
+     */
+    int extrapolateToCylinders( const std::vector<double>& radii, EVENT::TrackerHit* hit, std::vector<IMPL::TrackStateImpl>& states, std::vector<int>& status, int mode=modeForward ) ;
+
+    /** extrapolate the fit from the last site to the planes at the given z positions, transporting the state from crossing to crossing
+     */
+    int extrapolateToZPlanes( const std::vector<double>& zPositions, std::vector<IMPL::TrackStateImpl>& states, std::vector<int>& status, int mode=modeForward ) ;
+
+    /** extrapolate the fit at the measurement site associated with the given hit to the planes at the given z positions
+     */
+    int extrapolateToZPlanes( const std::vector<double>& zPositions, EVENT::TrackerHit* hit, std::vector<IMPL::TrackStateImpl>& states, std::vector<int>& status, int mode=modeForward ) ;
+
+    // INTERSECTORS
+
+    /** extrapolate the fit to numbered sensitive layer, returning intersection point in global coordinates and integer ID of the
+     *  intersected sensitive detector element via reference
+     */
+    int intersectionWithLayer( int layerID, Vector3D& point, int& detElementID, int mode=modeClosest ) ;
+
+    /** extrapolate the fit at the measurement site associated with the given hit, to numbered sensitive layer,
+     *  returning intersection point in global coordinates and integer ID of the intersected sensitive detector element via reference
+     */
+    int intersectionWithLayer( int layerID, EVENT::TrackerHit* hit, Vector3D& point, int& detElementID, int mode=modeClosest ) ;
+
+    /** extrapolate the fit to numbered sensitive detector element, returning intersection point in global coordinates via reference
+     */
+    int intersectionWithDetElement( int detElementID, Vector3D& point, int mode=modeClosest ) ;
+
+    /** extrapolate the fit at the measurement site associated with the given hit, to sensitive detector element,
+     *  returning intersection point in global coordinates via reference
+     */
+    int intersectionWithDetElement( int detElementID, EVENT::TrackerHit* hit, Vector3D& point, int mode=modeClosest ) ;
+
+    /** Dump this track to a string for debugging.
+     */
+    std::string toString() ;
+
+    //** end of memeber functions from IMarlinTrack interface
+
+  protected:
+
+    /** a measurement site of the fit */
+    struct Site {
+      EVENT::TrackerHit* hit ;
+      /** predicted state, including the material of the surface of the hit */
+      FastKF::State predicted ;
+      FastKF::State filtered ;
+      FastKF::State smoothed ;
+      /** Jacobian from the state of the previous site to the predicted state */
+      FastKF::Matrix5 jacobian ;
+      /** process noise of the material between the previous site and the predicted state */
+      FastKF::SymMatrix5 noise ;
+      double deltaChi2 ;
+      /** path length in mm and time of flight in ns, accumulated from the first site */
+      double pathLength ;
+      double timeOfFlight ;
+      /** dimension of the measurement */
+      int dim ;
+      bool isSmoothed ;
+    } ;
+
+    /** the state of the site used for propagation: smoothed if available, otherwise filtered */
+    const FastKF::State& siteState( const Site& site ) const {
+      return ( site.isSmoothed ? site.smoothed : site.filtered ) ;
+    }
+
+    /** the state of the last site, or the initial state if no hit has been filtered yet */
+    const FastKF::State& currentState() const {
+      return ( _sites.empty() ? _initialState : siteState( _sites.back() ) ) ;
+    }
+
+    /** number of fitted track parameters: 4 for the straight line model, which fixes omega to 0 */
+    int nParameters() const ;
+
+    /** fix the curvature of the state to zero for the straight line model */
+    void fixCurvature( FastKF::State& state ) const ;
+
+    /** index of the site of the hit - -1 if the hit is not in the fit */
+    int findSite( EVENT::TrackerHit* hit ) const ;
+
+    /** predict the state at the surface of the hit and filter the hit - the site is filled if successful */
+    int filterHit( const FastKF::State& start, EVENT::TrackerHit* hit, double maxChi2Increment, Site& site ) ;
+
+    /** transport the state to the given reference point, including the material of the crossed cylinders and planes
+     *  if withMaterial is true. The Jacobian of the transport is multiplied to jacobian if not 0, the
+     *  process noise of the material is transported and added to noise if not 0. Only the parameters are
+     *  transported if withCovariance is false, jacobian and noise have to be 0 then.
+     */
+    int transportTo( FastKF::State& state, const double* ref, bool withMaterial, FastKF::Matrix5* jacobian, FastKF::SymMatrix5* noise = 0,
+                     bool withCovariance = true ) ;
+
+    /** fill _crossings with the material cylinders and planes crossed between the state and the given reference point,
+     *  ordered by arc length - surfaces at the start and at the reference point are not included
+     */
+    void findCrossings( const FastKF::State& state, const double* ref ) ;
+
+    /** add the material of the surface to the state, the reference point of which is on the surface -
+     *  arc is the signed arc length travelled to the surface, defining the sign of the energy loss.
+     *  Multiple scattering is skipped if withCovariance is false.
+     */
+    int addMaterial( FastKF::State& state, const dd4hep::rec::ISurface* surf, double arc, FastKF::Matrix5* jacobian, FastKF::SymMatrix5* noise = 0,
+                     bool withCovariance = true ) ;
+
+    /** intersection of the state with the surface in the given mode - returns false if there is none */
+    bool intersect( const FastKF::State& state, const dd4hep::rec::ISurface* surf, int mode, bool checkBounds, double& arc, double* point ) const ;
+
+    /** intersection of the state with the sensitive surfaces of the layer in the given mode */
+    int intersectLayer( const FastKF::State& state, int layerID, int mode, double* point, int& detElementID ) const ;
+
+    /** run the smoother from the last site back to the site with the given index */
+    int smoothBackTo( int index ) ;
+
+    /** fill the state into the LCIO track state - with a zero covariance matrix if withCovariance is false */
+    void toLCIOTrackState( const FastKF::State& state, IMPL::TrackStateImpl& ts, bool withCovariance = true ) const ;
+
+    /** the state of the site of the hit - returns bad_intputs if the hit is not in the fit */
+    int getSiteState( EVENT::TrackerHit* hit, const FastKF::State*& state ) const ;
+
+    int propagate( const FastKF::State& start, const Vector3D& point, bool withMaterial, IMPL::TrackStateImpl& ts, double& chi2, int& ndf ) ;
+
+    int propagateToLayer( const FastKF::State& start, int layerID, bool withMaterial, IMPL::TrackStateImpl& ts, double& chi2, int& ndf, int& detElementID, int mode ) ;
+
+    int propagateToDetElement( const FastKF::State& start, int detElementID, bool withMaterial, IMPL::TrackStateImpl& ts, double& chi2, int& ndf, int mode ) ;
+
+    /** intersect all targets with the start state, then transport the state from target to target in the order of the arc length,
+     *  separately for the targets in front of and behind the start
+     */
+    int propagateToMany( const FastKF::State& start, std::vector<PropagationTarget>& targets ) ;
+
+    /** intersect the sensitive surfaces of all layers with the start state and transport it to the crossing with the smallest arc length */
+    int propagateToFirstLayer( const FastKF::State& start, const std::vector<int>& layerIDs, IMPL::TrackStateImpl& ts, double& chi2, int& ndf,
+                               int& layerID, int& detElementID, int mode ) ;
+
+    /** transport the state without material from one cylinder around the z-axis, or plane perpendicular to it, to the next */
+    int extrapolateToSurfaces( const FastKF::State& start, const std::vector<double>& positions, bool zPlanes,
+                               std::vector<IMPL::TrackStateImpl>& states, std::vector<int>& status, int mode ) ;
+
+    /** transport the state through the targets with the given (arc length, index) order and reference points */
+    void walkTargets( FastKF::State state, const std::vector<std::pair<double, unsigned> >& order, const std::vector<double>& refs,
+                      std::vector<PropagationTarget>& targets ) ;
+
+    MarlinFastKF* _fastKF ;
+
+    /** used to store whether initial track state has been supplied or created
+     */
+    bool _initialised = false ;
+
+    /** used to store the fit direction supplied to intialise
+     */
+    bool _fitDirection = false ;
+
+    double _mass ;
+
+    std::vector< EVENT::TrackerHit* > _lcioHits{} ;
+
+    FastKF::State _initialState{} ;
+
+    /** the filtered sites in the order of the fit */
+    std::vector< Site > _sites{} ;
+
+    std::vector< std::pair<EVENT::TrackerHit*, double> > _outliers{} ;
+
+    double _chi2 = 0. ;
+
+    /** number of measurements minus the number of track parameters */
+    int _ndf = -5 ;
+
+    /** path length and time of flight of the last propagation, valid if _hasPropagated is set */
+    double _lastPathLength = 0. ;
+    double _lastTimeOfFlight = 0. ;
+    bool _hasPropagated = false ;
+
+    /** crossings of material cylinders, reused between transports */
+    std::vector< std::pair< double, const dd4hep::rec::ISurface* > > _crossings{} ;
+
+  } ;
+
+} // end of namespace MarlinTrk
+
+#endif
@@ -24,6 +24,7 @@ namespace UTIL {
 
 namespace MarlinTrk{
   class IMarlinTrack ;
+  class FitResultCache ;
 }
 
 
@@ -31,7 +32,7 @@ namespace MarlinTrk{
 
   /** Takes a list of hits and uses the IMarlinTrack inferface to fit them using a supplied prefit containing
    *  a covariance matrix for the initialisation. The TrackImpl will have the 4 trackstates added to
-   *  it @IP, @First_Hit, @Last_Hit and @CaloFace */
+   *  it @IP, @First_Hit, @Last_Hit and @CaloFace. Uses the fitResultCache() like the version below. */
   int createFinalisedLCIOTrack(
       IMarlinTrack* marlinTrk,
       std::vector<EVENT::TrackerHit*>& hit_list,
@@ -43,7 +44,11 @@ namespace MarlinTrk{
   
   /** Takes a list of hits and uses the IMarlinTrack inferface to fit them using a supplied covariance matrix
    *  for the initialisation. The TrackImpl will have the 4 trackstates added to
-   *  it @IP, @First_Hit, @Last_Hit and @CaloFace */
+   *  it @IP, @First_Hit, @Last_Hit and @CaloFace. With IMarlinTrkSystem::CFG::useWeightedPrefit the prefit from
+   *  createWeightedPrefit() is used instead, with its covariance matrix scaled by weightedPrefitCovarianceScale.
+   *  With IMarlinTrkSystem::CFG::useFitResultCache the result of an identical fit is taken from the fitResultCache(): the TrackImpl
+   *  is filled and the hits in the fit and the outliers are restored in the IMarlinTrack, which is not fitted otherwise and can
+   *  only be used for getHitsInFit() and getOutliers() then. */
   int createFinalisedLCIOTrack(
       IMarlinTrack* marlinTrk,
       std::vector<EVENT::TrackerHit*>& hit_list,
@@ -56,6 +61,21 @@ namespace MarlinTrk{
   /** Provides the values of a track state from the first, middle and last hits in the hit_list. */
   int createPrefit( std::vector<EVENT::TrackerHit*>& hit_list, IMPL::TrackStateImpl* pre_fit, float bfield_z, bool fit_direction );
 
+  /** Provides the values of a track state and its covariance matrix from the weighted helix fit of all 2D hits in the hit_list,
+   *  which have to be ordered in time. The covariance matrix is the one of the fit, without material effects. The state is
+   *  given at the hit the fit starts from, the first hit for IMarlinTrack::forward and the last one for IMarlinTrack::backward,
+   *  with its momentum along the time order of the hits in both cases. For bfield_z == 0 it is a straight line, omega == 0. */
+  int createWeightedPrefit( std::vector<EVENT::TrackerHit*>& hit_list, IMPL::TrackStateImpl* pre_fit, float bfield_z, bool fit_direction );
+
+  /** Scale factor for the covariance matrix of createWeightedPrefit() when it seeds the fit of the same hits: the prefit already
+   *  holds the information of these hits and has no multiple scattering, the loosened seed keeps the double counting at the
+   *  percent level and the errors of the fit and its chi2 increments essentially those of an unbiased fit. */
+  const double weightedPrefitCovarianceScale = 1.e2 ;
+
+  /** Variances of the position of a 2D hit in r-phi and along z, for planar hits projected from the errors along u and v. Returns
+   *  IMarlinTrack::bad_intputs for one dimensional hits and hits without errors. */
+  int getHitVariancesRPhiZ( EVENT::TrackerHit* hit, double& varRPhi, double& varZ );
+
   /** Takes a list of hits and uses the IMarlinTrack inferface to fit them using a supplied prefit containing a covariance matrix for the initialisation. */  
   int createFit( std::vector<EVENT::TrackerHit*>& hit_list, IMarlinTrack* marlinTrk, EVENT::TrackState* pre_fit, float bfield_z, bool fit_direction, double maxChi2Increment=DBL_MAX );
 
@@ -63,7 +83,10 @@ namespace MarlinTrk{
    *  The TrackImpl will have the 4 trackstates added to it @IP, @First_Hit, @Last_Hit and @CaloFace.
    *  Note: the hit list is needed as the IMarlinTrack only contains the hits used in the fit, not the spacepoints
    *  (if any have been included) so as the strip hits cannot point to the space points we need to have the list so
-   *  that they can be recorded in the LCIO TrackImpl */
+   *  that they can be recorded in the LCIO TrackImpl.
+   *  The states @Last_Hit and @CaloFace are propagated from the last constrained hit with one IMarlinTrack::propagateToMany() call,
+   *  the calo face being the one reached first as in IMarlinTrack::propagateToFirstLayer(). If the propagation fails, the single
+   *  propagations are tried instead. */
   int finaliseLCIOTrack(
       IMarlinTrack* marlinTrk,
       IMPL::TrackImpl* track,
@@ -78,6 +101,11 @@ namespace MarlinTrk{
   /** Set the subdetector hit numbers for the TrackImpl */
   void addHitNumbersToTrack(IMPL::TrackImpl* track, std::vector<std::pair<EVENT::TrackerHit* , double> >& hit_list, bool hits_in_fit, UTIL::BitField64& cellID_encoder);
   
+  /** The cache of fit results of createFinalisedLCIOTrack() used with IMarlinTrkSystem::CFG::useFitResultCache - one instance per job,
+   *  shared by all processors and track systems. Processors using the option should call FitResultCache::newEvent() at the start of
+   *  every event, otherwise the results of all events are kept until FitResultCache::maxSize() is reached. */
+  FitResultCache& fitResultCache();
+  
 }
 
 #endif
@@ -2,6 +2,8 @@
 
 #include "MarlinTrk/MarlinDDKalTest.h"
 #include "MarlinTrk/MarlinAidaTT.h"
+#include "MarlinTrk/MarlinFastKF.h"
+#include "MarlinTrk/MarlinFastHelix.h"
 
 #include "streamlog/streamlog.h"
 
@@ -45,6 +47,14 @@ namespace MarlinTrk{
       
       trkSystem = new MarlinAidaTT ;
     }
+    else if( systemType == std::string( "FastKF" ) ) {
+      
+      trkSystem = new MarlinFastKF ;
+    }
+    else if( systemType == std::string( "FastHelix" ) ) {
+      
+      trkSystem = new MarlinFastHelix ;
+    }
       
     if( ! trkSystem ) {
       
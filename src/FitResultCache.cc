@@ -0,0 +1,188 @@
+#include "MarlinTrk/FitResultCache.h"
+
+#include "MarlinTrk/IMarlinTrack.h"
+#include "MarlinTrk/IMarlinTrkSystem.h"
+
+#include "EVENT/TrackerHit.h"
+#include "EVENT/TrackState.h"
+#include "IMPL/TrackImpl.h"
+#include "IMPL/TrackStateImpl.h"
+
+#include <functional>
+
+#include "streamlog/streamlog.h"
+
+
+namespace {
+
+  /** combine the hash of value into seed */
+  template <class T>
+  void hashCombine( std::size_t& seed, const T& value ) {
+    seed ^= std::hash<T>()( value ) + 0x9e3779b9 + ( seed << 6 ) + ( seed >> 2 ) ;
+  }
+
+  /** copy everything set by createFinalisedLCIOTrack() from one track to another */
+  void copyFitResult( const IMPL::TrackImpl& from, IMPL::TrackImpl& to ) {
+
+    const EVENT::TrackerHitVec& hits = from.getTrackerHits() ;
+    for( unsigned i = 0 ; i < hits.size() ; ++i ) to.addHit( hits[i] ) ;
+
+    const EVENT::TrackStateVec& states = from.getTrackStates() ;
+    for( unsigned i = 0 ; i < states.size() ; ++i ) to.trackStates().push_back( new IMPL::TrackStateImpl( *states[i] ) ) ;
+
+    to.setChi2( from.getChi2() ) ;
+    to.setNdf( from.getNdf() ) ;
+    to.setRadiusOfInnermostHit( from.getRadiusOfInnermostHit() ) ;
+    to.subdetectorHitNumbers() = from.getSubdetectorHitNumbers() ;
+  }
+
+}
+
+
+namespace MarlinTrk {
+
+
+  bool FitResultCache::Key::operator==( const Key& rhs ) const {
+
+    return ( hitIDs == rhs.hitIDs && prefit == rhs.prefit && fitDirection == rhs.fitDirection && mass == rhs.mass &&
+	     bfield == rhs.bfield && maxChi2Increment == rhs.maxChi2Increment && options == rhs.options && trkSystem == rhs.trkSystem ) ;
+  }
+
+
+  std::size_t FitResultCache::Key::hash() const {
+
+    std::size_t seed = hitIDs.size() ;
+
+    for( unsigned i = 0 ; i < hitIDs.size() ; ++i ) hashCombine( seed, hitIDs[i] ) ;
+    for( unsigned i = 0 ; i < prefit.size() ; ++i ) hashCombine( seed, prefit[i] ) ;
+
+    hashCombine( seed, fitDirection ) ;
+    hashCombine( seed, mass ) ;
+    hashCombine( seed, bfield ) ;
+    hashCombine( seed, maxChi2Increment ) ;
+    hashCombine( seed, options ) ;
+    hashCombine( seed, trkSystem ) ;
+
+    return seed ;
+  }
+
+
+  FitResultCache::~FitResultCache() {
+    this->clear() ;
+  }
+
+
+  FitResultCache::Key FitResultCache::makeKey( IMarlinTrkSystem& trkSystem, IMarlinTrack& marlinTrk, const std::vector<EVENT::TrackerHit*>& hit_list,
+					       const EVENT::TrackState* pre_fit, bool fit_direction, float bfield_z, double maxChi2Increment ) {
+    Key key ;
+
+    key.hitIDs.reserve( hit_list.size() ) ;
+    for( unsigned i = 0 ; i < hit_list.size() ; ++i ) key.hitIDs.push_back( hit_list[i]->id() ) ;
+
+    if( pre_fit ) {
+
+      key.prefit.reserve( 23 ) ;
+
+      key.prefit.push_back( pre_fit->getD0() ) ;
+      key.prefit.push_back( pre_fit->getPhi() ) ;
+      key.prefit.push_back( pre_fit->getOmega() ) ;
+      key.prefit.push_back( pre_fit->getZ0() ) ;
+      key.prefit.push_back( pre_fit->getTanLambda() ) ;
+
+      const float* ref = pre_fit->getReferencePoint() ;
+      key.prefit.insert( key.prefit.end(), ref, ref + 3 ) ;
+
+      const EVENT::FloatVec& cov = pre_fit->getCovMatrix() ;
+      key.prefit.insert( key.prefit.end(), cov.begin(), cov.end() ) ;
+    }
+
+    key.fitDirection = fit_direction ;
+    key.mass = marlinTrk.getMass() ;
+    key.bfield = bfield_z ;
+    key.maxChi2Increment = maxChi2Increment ;
+
+    for( unsigned i = 1 ; i < IMarlinTrkSystem::CFG::size ; ++i ) {
+      if( trkSystem.getOption( i ) ) key.options |= ( 1u << i ) ;
+    }
+
+    key.trkSystem = &trkSystem ;
+
+    return key ;
+  }
+
+
+  void FitResultCache::newEvent( int runNumber, int eventNumber ) {
+
+    if( runNumber == _runNumber && eventNumber == _eventNumber ) return ;
+
+    streamlog_out( DEBUG4 ) << "FitResultCache::newEvent: run " << runNumber << " event " << eventNumber
+			    << " - releasing " << _results.size() << " entries, hits: " << _hits << " misses: " << _misses << std::endl ;
+
+    _runNumber = runNumber ;
+    _eventNumber = eventNumber ;
+
+    this->clear() ;
+  }
+
+
+  void FitResultCache::clear() {
+
+    for( std::unordered_map< Key, Result, KeyHash >::iterator it = _results.begin() ; it != _results.end() ; ++it ) {
+      delete it->second.track ;
+    }
+
+    _results.clear() ;
+  }
+
+
+  bool FitResultCache::find( const Key& key, IMarlinTrack& marlinTrk, IMPL::TrackImpl* track, int& status ) {
+
+    std::unordered_map< Key, Result, KeyHash >::const_iterator it = _results.find( key ) ;
+
+    if( it == _results.end() ) {
+      ++_misses ;
+      return false ;
+    }
+
+    // the caller can still ask the track for the hits in the fit and the outliers, as after a fit
+    if( it->second.status == IMarlinTrack::success &&
+	marlinTrk.restoreFitResult( it->second.hitsInFit, it->second.outliers ) != IMarlinTrack::success ) {
+
+      streamlog_out( DEBUG3 ) << "FitResultCache::find: the fit result cannot be restored in the track" << std::endl ;
+
+      ++_misses ;
+      return false ;
+    }
+
+    ++_hits ;
+
+    copyFitResult( *it->second.track, *track ) ;
+    status = it->second.status ;
+
+    return true ;
+  }
+
+
+  void FitResultCache::insert( const Key& key, const IMPL::TrackImpl* track, const HitList& hitsInFit, const HitList& outliers, int status ) {
+
+    // bound the memory if newEvent() is not called
+    if( _results.size() >= _maxSize ) {
+
+      streamlog_out( DEBUG4 ) << "FitResultCache::insert: maximum size " << _maxSize << " reached - releasing all entries" << std::endl ;
+
+      this->clear() ;
+    }
+
+    IMPL::TrackImpl* result = new IMPL::TrackImpl ;
+
+    copyFitResult( *track, *result ) ;
+
+    std::pair< std::unordered_map< Key, Result, KeyHash >::iterator, bool > inserted = _results.insert( std::make_pair( key, Result{ result, hitsInFit, outliers, status } ) ) ;
+
+    if( ! inserted.second ) {
+      delete inserted.first->second.track ;
+      inserted.first->second = Result{ result, hitsInFit, outliers, status } ;
+    }
+  }
+
+} // end of namespace MarlinTrk
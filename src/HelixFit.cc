@@ -9,424 +9,674 @@
 
 #include "MarlinTrk/HelixFit.h"
 #include "MarlinTrk/HelixTrack.h"
+#include "MarlinTrk/FastKFKernels.h"
 #include "streamlog/streamlog.h"
 
-#include "CLHEP/Matrix/SymMatrix.h"
+#include <algorithm>
+#include <cmath>
 
 namespace MarlinTrk{
-  
-  
-  int HelixFit::fastHelixFit(int npt, double* xf, double* yf, float* rf, float* pf, double* wf, float* zf , float* wzf,int iopt, 
-                             float* vv0, float* ee0, float& ch2ph, float& ch2z){
-    
-    
-    
-    if (npt < 3) {
-      streamlog_out(ERROR) << "Cannot fit less than 3 points return 1" << std::endl;
+
+  namespace {
+
+    const int    ITMAX    = 15 ;
+    const double MAX_CHI2 = 5000.0 ;
+    const double EPS      = 1.0e-16 ;
+
+    // number of per point arrays in the workspace of the single fit
+    const int NWORK = 6 ;
+
+    // number of per point and per point set arrays in the workspace of the batch fit
+    const int NWORK_POINT = 12 ;
+    const int NWORK_SET   = 32 ;
+
+    inline int failed( float& ch2ph, float& ch2z ) {
       ch2ph = 1.0e30;
       ch2z  = 1.0e30;
       return 1;
     }
-    
-    double eps = 1.0e-16;
-#define ITMAX 15
-#define MPT   600
-#define MAX_CHI2 5000.0
-    
-    
-    float sp2[MPT],
-    del[MPT],deln[MPT],delzn[MPT],sxy[MPT],ss0[MPT],eee[MPT],
-    delz[MPT],grad[5],cov[15],vv1[5],dv[5];
-    
-    //  double xf[MPT],yf[MPT],wf[MPT],zf[MPT],wzf[MPT];
-    
-    double alf,a0,a1,a2,a22,bet,cur,
-    dd,den,det,dy,d2,f,fact,fg,f1,g,gam,gam0,g1,
-    h,h2,p2,q2,rm,rn,
-    xa,xb,xd,xi,xm,xx,xy,x1,x2,den2,
-    ya,yb,yd,yi,ym,yy,y1,y2,wn,sa2b2,dd0,phic,aaa;
-    
-    
-    xm = 0.;
-    ym = 0.;
-    
-    for(int i=1; i < 15; ++i){
+
+    /** weighted moments of the points about their mean */
+    struct Moments {
+      double xm, ym ;
+      double x2, y2, xy, d2, xd, yd ;
+    } ;
+
+    /** circle in the xy-plane, sign is the orientation aa0 and (alf,bet) the direction used for the sign of the points */
+    struct Circle {
+      double omega, phi0, d0 ;
+      double sign, alf, bet ;
+    } ;
+
+    /** weighted moments of the points, sp2 is filled with the weights of the phi residuals
+     */
+    template <typename Real, typename TR>
+    inline bool moments( int npt, const double* xf, const double* yf, const TR* rf, const double* wf, Real* sp2, Moments& m ) {
+
+      Real xs = 0., ys = 0., wn = 0. ;
+
+      for (int i = 0; i<npt; ++i) {
+        sp2[i] = wf[i]*(rf[i]*rf[i]);
+        xs += xf[i]*wf[i];
+        ys += yf[i]*wf[i];
+        wn += wf[i];
+      }
+
+      if( !( wn > 0. ) ) return false ;
+
+      const double rn = 1.0/wn;
+
+      m.xm = xs * rn;
+      m.ym = ys * rn;
+
+      Real sx2 = 0., sy2 = 0., sxy2 = 0., sxd = 0., syd = 0., sd2 = 0. ;
+
+      for (int i =0; i<npt; ++i) {
+        const Real xi = xf[i] - m.xm;
+        const Real yi = yf[i] - m.ym;
+        const Real xx = xi*xi;
+        const Real yy = yi*yi;
+        const Real dd = xx + yy;
+        sx2  += xx*wf[i];
+        sy2  += yy*wf[i];
+        sxy2 += xi*yi*wf[i];
+        sxd  += xi*dd*wf[i];
+        syd  += yi*dd*wf[i];
+        sd2  += dd*dd*wf[i];
+      }
+
+      m.x2 = sx2*rn;
+      m.y2 = sy2*rn;
+      m.xy = sxy2*rn;
+      m.d2 = sd2*rn;
+      m.xd = sxd*rn;
+      m.yd = syd*rn;
+
+      return true ;
+    }
+
+    /** circle parameters from the moments of the points, false if there is no solution
+     */
+    inline bool circleFromMoments( const Moments& m, Circle& c ) {
+
+      const double f = 3.0* m.x2 + m.y2;
+      const double g = 3.0* m.y2 + m.x2;
+      const double fg = f*g;
+      const double h = m.xy + m.xy;
+      const double h2 = h*h;
+      const double p2 = m.xd*m.xd;
+      const double q2 = m.yd*m.yd;
+      const double gam0 = m.x2 + m.y2;
+      double fact = gam0*gam0;
+      const double a2 = (fg-h2-m.d2)/fact;
+      fact = fact*gam0;
+      const double a1 = (m.d2*(f+g) - 2.0*(p2+q2))/fact;
+      fact = fact*gam0;
+      const double a0 = (m.d2*(h2-fg) + 2.0*(p2*g + q2*f) - 4.0*m.xd*m.yd*h)/fact;
+      const double a22 = a2 + a2;
+      double yb = 1.0e30;
+      double xa = 1.0;
+      double xb = xa;
+
+      //  **                main iteration - always ITMAX steps, the root is kept once it has converged
+
+      bool done = false ;
+
+      for (int i = 0 ; i < ITMAX; ++i) {
+
+        const double ya = a0 + xa*(a1 + xa*(a2 + xa*(xa-4.0)));
+        const double dy = a1 + xa*(a22 + xa*(4.0*xa - 12.0));
+
+        double xn = xa - ya/dy;
+        xn = ( std::fabs(ya) > std::fabs(yb) ? 0.5 * (xn+xa) : xn ) ;
+
+        const bool next = !done && std::fabs(xa-xn) >= EPS ;
+
+        xb   = ( done ? xb : xn ) ;
+        xa   = ( next ? xn : xa ) ;
+        yb   = ( next ? ya : yb ) ;
+        done = !next ;
+      }
+
+      //  **
+
+      double gam = gam0*xb;
+      const double f1 = f - gam;
+      const double g1 = g - gam;
+      const double x1 = m.xd*g1 - m.yd*h;
+      const double y1 = m.yd*f1 - m.xd*h;
+      const double det = f1*g1 - h2;
+      const double den2= 1.0/(x1*x1 + y1*y1 + gam*det*det);
+
+      if(den2 <= 0.0) return false ;
+
+      const double den = std::sqrt(den2);
+      const double cur = det*den + 0.0000000001 ;
+      const double alf = -(m.xm*det + x1)*den ;
+      const double bet = -(m.ym*det + y1)*den ;
+
+      //
+      //  --------> calculation of standard circle parameters
+      //            nb: cur is always positive
+
+      const double asym = bet*m.xm-alf*m.ym;
+      const double sst = ( asym < 0.0 ? -1.0 : 1.0 ) ;
+
+      const double rr0 = sst*cur;
+
+      if( (alf*alf+bet*bet) <= 0.0 ) return false ;
+
+      const double sa2b2 = 1.0/std::sqrt(alf*alf+bet*bet);
+      double dd0 = (1.0-1.0/sa2b2)/cur;
+      const double aaa = std::min( std::max( alf*sa2b2, -1.0 ), 1.0 ) ;
+
+      double phic = std::asin(aaa)+ M_PI_2;
+
+      if( bet > 0 ) phic = 2*M_PI - phic;
+
+      double ph0 = phic + M_PI_2;
+
+      if(rr0 <= 0.0)   ph0=ph0-M_PI;
+      if(ph0 > 2*M_PI) ph0=ph0-2*M_PI;
+      if(ph0 < 0.0)    ph0=ph0+2*M_PI;
+
+      const double check=sst*rr0*dd0;
+
+      if(check > 1.0-EPS && check < 1.0+EPS) {
+        dd0 = dd0 - 0.007;
+      }
+
+      c.omega = rr0 ;
+      c.phi0  = ph0 ;
+      c.d0    = dd0 ;
+      c.sign  = sst ;
+      c.alf   = alf ;
+      c.bet   = bet ;
+
+      return true ;
+    }
+
+    /** normalised eigenvector n of the smallest eigenvalue of the symmetric 3x3 matrix a (a00,a01,a02,a11,a12,a22) - the 
+     *  eigenvalue is the analytic root of the characteristic polynomial, the vector the largest cross product of two rows of a-l*1
+     */
+    inline void smallestEigenvector( const double* a, double* n ) {
+
+      const double q  = ( a[0] + a[3] + a[5] ) / 3.0 ;
+      const double p1 = a[1]*a[1] + a[2]*a[2] + a[4]*a[4] ;
+      const double p2 = (a[0]-q)*(a[0]-q) + (a[3]-q)*(a[3]-q) + (a[5]-q)*(a[5]-q) + 2.0*p1 ;
+      const double p  = std::sqrt( p2 / 6.0 ) ;
+
+      double l = q ;
+
+      if( p > 0.0 ) {
+
+        const double b0 = (a[0]-q)/p, b1 = a[1]/p, b2 = a[2]/p, b3 = (a[3]-q)/p, b4 = a[4]/p, b5 = (a[5]-q)/p ;
+
+        const double r = std::min( std::max( 0.5*( b0*(b3*b5-b4*b4) - b1*(b1*b5-b4*b2) + b2*(b1*b4-b3*b2) ), -1.0 ), 1.0 ) ;
+
+        l = q + 2.0*p*std::cos( std::acos( r )/3.0 + 2.0*M_PI/3.0 ) ;
+      }
+
+      const double r0[3] = { a[0]-l, a[1], a[2] } ;
+      const double r1[3] = { a[1], a[3]-l, a[4] } ;
+      const double r2[3] = { a[2], a[4], a[5]-l } ;
+
+      const double c[3][3] = {
+        { r0[1]*r1[2]-r0[2]*r1[1], r0[2]*r1[0]-r0[0]*r1[2], r0[0]*r1[1]-r0[1]*r1[0] },
+        { r0[1]*r2[2]-r0[2]*r2[1], r0[2]*r2[0]-r0[0]*r2[2], r0[0]*r2[1]-r0[1]*r2[0] },
+        { r1[1]*r2[2]-r1[2]*r2[1], r1[2]*r2[0]-r1[0]*r2[2], r1[0]*r2[1]-r1[1]*r2[0] } } ;
+
+      int best = 0 ;
+      double norm2 = 0.0 ;
+
+      for (int i = 0; i < 3; ++i) {
+        const double c2 = c[i][0]*c[i][0] + c[i][1]*c[i][1] + c[i][2]*c[i][2] ;
+        if( c2 > norm2 ) { norm2 = c2 ; best = i ; }
+      }
+
+      if( norm2 > 0.0 ) {
+        const double norm = 1.0/std::sqrt( norm2 ) ;
+        n[0] = c[best][0]*norm ; n[1] = c[best][1]*norm ; n[2] = c[best][2]*norm ;
+      } else {
+        // the points are degenerate, any vector in the null space of a-l*1
+        n[0] = 0.0 ; n[1] = 0.0 ; n[2] = 1.0 ;
+      }
+    }
+
+    /** Riemann fit of the circle: the points relative to their weighted mean are mapped onto the paraboloid w = u**2 + v**2 
+     *  and the plane through them is fit - its intersection with the paraboloid projects onto the circle. sp2 is filled with 
+     *  the weights of the phi residuals and c in the conventions of circleFromMoments(), false if there is no solution.
+     */
+    template <typename Real, typename TR>
+    inline bool circleRiemann( int npt, const double* xf, const double* yf, const TR* rf, const double* wf, Real* sp2, Circle& c ) {
+
+      Real xs = 0., ys = 0., wn = 0. ;
+
+      for (int i = 0; i<npt; ++i) {
+        sp2[i] = wf[i]*(rf[i]*rf[i]);
+        xs += xf[i]*wf[i];
+        ys += yf[i]*wf[i];
+        wn += wf[i];
+      }
+
+      if( !( wn > 0. ) ) return false ;
+
+      const double rn = 1.0/wn;
+
+      const double xm = xs * rn;
+      const double ym = ys * rn;
+
+      Real sww = 0. ;
+
+      for (int i = 0; i<npt; ++i) {
+        const Real u = xf[i] - xm;
+        const Real v = yf[i] - ym;
+        sww += (u*u + v*v)*wf[i];
+      }
+
+      const double wm = sww * rn ;
+
+      // covariance matrix of the points on the paraboloid
+      Real suu = 0., suv = 0., suw = 0., svv = 0., svw = 0., sw2 = 0. ;
+
+      for (int i = 0; i<npt; ++i) {
+        const Real u = xf[i] - xm;
+        const Real v = yf[i] - ym;
+        const Real w = u*u + v*v - wm;
+        suu += u*u*wf[i];
+        suv += u*v*wf[i];
+        suw += u*w*wf[i];
+        svv += v*v*wf[i];
+        svw += v*w*wf[i];
+        sw2 += w*w*wf[i];
+      }
+
+      const double a[6] = { suu*rn, suv*rn, suw*rn, svv*rn, svw*rn, sw2*rn } ;
+
+      double n[3] ;
+
+      smallestEigenvector( a, n ) ;
+
+      // plane n.(u,v,w) = n2*wm, a straight line has n2 = 0
+      const double n2 = ( std::fabs( n[2] ) > 1.0e-12 ? n[2] : ( n[2] < 0.0 ? -1.0e-12 : 1.0e-12 ) ) ;
+
+      const double xc = xm - 0.5*n[0]/n2 ;
+      const double yc = ym - 0.5*n[1]/n2 ;
+
+      const double rad = std::sqrt( ( n[0]*n[0] + n[1]*n[1] + 4.0*n2*n2*wm ) / ( 4.0*n2*n2 ) ) ;
+
+      const double dc = std::sqrt( xc*xc + yc*yc ) ;
+
+      if( !( dc > 0.0 && rad > 0.0 ) ) return false ;
+
+      // the track runs from the origin to the mean of the points, (alf,bet) is -centre/radius
+      const double alf = -xc/rad ;
+      const double bet = -yc/rad ;
+
+      const double sst = ( bet*xm-alf*ym < 0.0 ? -1.0 : 1.0 ) ;
+
+      double ph0 = std::atan2( yc, xc ) + M_PI_2 ;
+
+      if(sst <= 0.0)   ph0=ph0-M_PI;
+      if(ph0 > 2*M_PI) ph0=ph0-2*M_PI;
+      if(ph0 < 0.0)    ph0=ph0+2*M_PI;
+
+      c.omega = sst/rad ;
+      c.phi0  = ph0 ;
+      c.d0    = rad - dc ;
+      c.sign  = sst ;
+      c.alf   = alf ;
+      c.bet   = bet ;
+
+      return true ;
+    }
+
+    /** phi distance of the point at (r,phi) to the circle and the arc length of the point on the circle, without branches
+     */
+    inline void circleResidual( double r, double phi, double ome, double dd0, double ph0, double aa0, double ss0, double& del, double& eee, double& sxy ) {
+
+      const double gg0 = ome*dd0-aa0 ;
+      const double r2  = r*r ;
+
+      const double ff0 = std::min( std::max( ome*(r2-dd0*dd0)/(2.0*r*gg0) + dd0/r, -1.0 ), 1.0 ) ;
+
+      double d = ph0 + (ss0-aa0)*M_PI_2 + ss0*std::asin(ff0) - phi ;
+
+      d -= ( d >  M_PI ? 2*M_PI : 0.0 ) ;
+      d += ( d < -M_PI ? 2*M_PI : 0.0 ) ;
+
+      del = d ;
+
+      const double e = std::min( std::max( 0.5*ome*std::sqrt( std::fabs( (r2-dd0*dd0) / (1.0-aa0*ome*dd0) ) ), -0.99990 ), 0.99990 ) ;
+
+      eee = e ;
+      sxy = 2.0*std::asin(e)/ome ;
+    }
+
+    /** circle residuals of all points for the parameters vv */
+    template <typename Real, typename TR>
+    inline void circleResiduals( int npt, const TR* rf, const TR* pf, const double* vv, double aa0, const Real* ss0, Real* del, Real* eee, Real* sxy ) {
+
+      for (int i = 0 ; i < npt ; ++i) {
+
+        double d, e, s ;
+
+        circleResidual( rf[i], pf[i], vv[0], vv[3], vv[2], aa0, ss0[i], d, e, s ) ;
+
+        del[i] = d ;
+        eee[i] = e ;
+        sxy[i] = s ;
+      }
+    }
+
+    /** straight line fit in s-z, fills tanLambda and z0 of vv */
+    template <typename Real, typename TZ>
+    inline bool lineFit( int npt, const TZ* zf, const TZ* wzf, const Real* sxy, double* vv ) {
+
+      Real sums = 0., sumss = 0., sumz = 0., sumsz = 0., sumw = 0. ;
+
+      for (int i = 0; i<npt; ++i) {
+        sumw  += wzf[i];
+        sums  += sxy[i]        * wzf[i];
+        sumss += sxy[i]*sxy[i] * wzf[i];
+        sumz  += zf[i]         * wzf[i];
+        sumsz += zf[i]*sxy[i]  * wzf[i];
+      }
+
+      const double denom = double(sumw)*sumss - double(sums)*sums;
+
+      if (std::fabs(denom) < EPS) return false ;
+
+      vv[1] = (double(sumw)*sumsz-double(sums)*sumz) /denom;
+      vv[4] = (double(sumss)*sumz-double(sums)*sumsz)/denom;
+
+      return true ;
+    }
+
+    /** z residuals for the parameters vv and the chi2s of the phi and z residuals */
+    template <typename Real, typename TZ>
+    inline void chi2( int npt, const TZ* zf, const TZ* wzf, const Real* sp2, const Real* del, const Real* sxy, const double* vv, Real* delz, Real& chi2ph, Real& chi2z ) {
+
+      chi2ph = 0. ;
+      chi2z  = 0. ;
+
+      for (int i = 0 ; i<npt; ++i) {
+        delz[i] = vv[4]+vv[1]*sxy[i]-zf[i];
+        chi2ph += sp2[i]*del[i]*del[i];
+        chi2z  += wzf[i]*delz[i]*delz[i];
+      }
+    }
+
+    /** inverse of the error matrix and gradient of the chi2 at the parameters vv
+     */
+    template <typename Real, typename TR, typename TZ>
+    inline void errorMatrix( int npt, const TR* rf, const TZ* wzf, const Real* sp2, const Real* ss0, const Real* eee, const Real* sxy,
+                             const Real* del, const Real* delz, const double* vv, double aa0, Real* ee, Real* grad ) {
+
+      const double ome = vv[0] ;
+      const double dd0 = vv[3] ;
+      const double gg0 = ome*dd0-aa0 ;
+      const double hh0 = 1.0/gg0 ;
+
+      for (int i = 0; i < 15; ++i) ee[i] = 0. ;
+      for (int i = 0; i < 5; ++i) grad[i] = 0. ;
+
+      for (int i = 0 ; i<npt; ++i) {
+
+        const double r2 = double(rf[i])*rf[i] ;
+
+        const double ff0 = std::min( std::max( ome*(r2-dd0*dd0)/(2.0*rf[i]*gg0) + dd0/rf[i], -0.99990 ), 0.99990 ) ;
+
+        const double eta = ss0[i]/std::sqrt(std::fabs((1.0+ff0)*(1.0-ff0)));
+        const double dfd = (1.0+hh0*hh0*(1.0-ome*ome*r2))/(2.0*rf[i]);
+        const double dfo = -aa0*(r2-dd0*dd0)*hh0*hh0/(2.0*rf[i]);
+        const double dpd = eta*dfd;
+        const double dpo = eta*dfo;
+
+        //        -----> derivatives of z component
+        const double ggg = eee[i]/std::sqrt(std::fabs( (1.0+eee[i])*(1.0-eee[i])));
+        const double dza = sxy[i];
+        double chk = r2-vv[3]*vv[3];
+
+        chk = ( std::fabs(chk) > 1.0-EPS ? 2.*0.007 : chk ) ;
+
+        const double dzd = 2.0*( vv[1]/vv[0] ) * std::fabs( ggg ) * ( 0.5*aa0*vv[0]/( 1.0-aa0*vv[3]*vv[0] )-vv[3]/chk );
+
+        const double dzo = -vv[1]*sxy[i]/vv[0] + vv[1] * ggg/( vv[0]*vv[0]) * ( 2.0+ aa0*vv[0]*vv[3]/(1.0-aa0*vv[0]*vv[3]) );
+
+        const double sp = sp2[i] ;
+        const double wz = wzf[i] ;
+
+        //  -----> error martix
+
+        ee[0] += sp*  dpo*dpo  + wz * dzo*dzo;
+        ee[1] +=                 wz * dza*dzo;
+        ee[2] +=                 wz * dza*dza;
+        ee[3] += sp*  dpo;
+        ee[5] += sp;
+        ee[6] += sp*  dpo*dpd  + wz * dzo*dzd;
+        ee[7] +=                 wz * dza*dzd;
+        ee[8] += sp*      dpd;
+        ee[9] += sp*  dpd*dpd  + wz * dzd*dzd;
+        ee[10]+=                 wz * dzo;
+        ee[11]+=                 wz * dza;
+        ee[13]+=                 wz * dzd;
+        ee[14]+=                 wz;
+
+        //        -----> gradient vector
+        grad[0] -= del[i] *sp*dpo + delz[i]*wz*dzo;
+        grad[1] -=                  delz[i]*wz*dza;
+        grad[2] -= del[i] *sp;
+        grad[3] -= del[i] *sp*dpd + delz[i]*wz*dzd;
+        grad[4] -=                  delz[i]*wz;
+      }
+    }
+
+    /** Newton's next guess vv1 from the inverse error matrix and the gradient, false if the matrix cannot be inverted
+     */
+    template <typename Real>
+    inline bool newtonStep( const Real* ee, const Real* grad, const double* vv, double* vv1 ) {
+
+      FastKF::SymMatrix5 cov ;
+
+      for (int i =0; i<15; ++i) {
+        cov[i]=ee[i];
+      }
+
+      if( ! FastKF::invert( cov ) ) return false ;
+
+      for (int i = 0; i<5; ++i) {
+        double dv = 0.0 ;
+        for (int j = 0; j<5; ++j) {
+          dv += cov[ FastKF::symIndex( i, j ) ] * grad[j] ;
+        }
+        vv1[i] = vv[i]+dv;
+      }
+
+      return true ;
+    }
+  }
+
+
+  void HelixFitBatch::clear() {
+
+    x.clear() ; y.clear() ; z.clear() ;
+    wrphi.clear() ; wz.clear() ;
+
+    offset.clear() ;
+
+    par.clear() ;
+    invCov.clear() ;
+    chi2rphi.clear() ;
+    chi2z.clear() ;
+    status.clear() ;
+  }
+
+
+  void HelixFitBatch::addPointSet( unsigned n, const double* xp, const double* yp, const double* zp, const double* wrphip, const double* wzp ) {
+
+    if( offset.empty() ) offset.push_back( x.size() ) ;
+
+    x.insert( x.end(), xp, xp + n ) ;
+    y.insert( y.end(), yp, yp + n ) ;
+    z.insert( z.end(), zp, zp + n ) ;
+
+    wrphi.insert( wrphi.end(), wrphip, wrphip + n ) ;
+    wz.insert( wz.end(), wzp, wzp + n ) ;
+
+    offset.push_back( x.size() ) ;
+  }
+
+
+  template <>
+  std::vector<float>& HelixFit::workspace<float>() { return _workspaceFloat ; }
+
+  template <>
+  std::vector<double>& HelixFit::workspace<double>() { return _workspaceDouble ; }
+
+
+  int HelixFit::fastHelixFit(int npt, double* xf, double* yf, float* rf, float* pf, double* wf, float* zf , float* wzf,int iopt,
+                             float* vv0, float* ee0, float& ch2ph, float& ch2z){
+
+    return this->fastHelixFitT<double>( npt, xf, yf, rf, pf, wf, zf, wzf, iopt, vv0, ee0, ch2ph, ch2z ) ;
+
+  }
+
+
+  int HelixFit::riemannHelixFit(int npt, double* xf, double* yf, float* rf, float* pf, double* wf, float* zf , float* wzf,int iopt,
+                                float* vv0, float* ee0, float& ch2ph, float& ch2z){
+
+    return this->riemannHelixFitT<double>( npt, xf, yf, rf, pf, wf, zf, wzf, iopt, vv0, ee0, ch2ph, ch2z ) ;
+
+  }
+
+
+  template <typename Real>
+  int HelixFit::fastHelixFitT(int npt, const double* xf, const double* yf, const float* rf, const float* pf, const double* wf, const float* zf , const float* wzf, int iopt,
+                              float* vv0, float* ee0, float& ch2ph, float& ch2z){
+
+    return this->helixFit<Real>( chernovOsokov, npt, xf, yf, rf, pf, wf, zf, wzf, iopt, vv0, ee0, ch2ph, ch2z ) ;
+
+  }
+
+
+  template <typename Real>
+  int HelixFit::riemannHelixFitT(int npt, const double* xf, const double* yf, const float* rf, const float* pf, const double* wf, const float* zf , const float* wzf, int iopt,
+                                 float* vv0, float* ee0, float& ch2ph, float& ch2z){
+
+    return this->helixFit<Real>( riemann, npt, xf, yf, rf, pf, wf, zf, wzf, iopt, vv0, ee0, ch2ph, ch2z ) ;
+
+  }
+
+
+  template <typename Real>
+  int HelixFit::helixFit(CircleFit circleFit, int npt, const double* xf, const double* yf, const float* rf, const float* pf, const double* wf, const float* zf , const float* wzf, int iopt,
+                         float* vv0, float* ee0, float& ch2ph, float& ch2z){
+
+    if (npt < 3) {
+      streamlog_out(ERROR) << "Cannot fit less than 3 points return 1" << std::endl;
+      return failed( ch2ph, ch2z ) ;
+    }
+
+    if( !( xf && yf && rf && pf && wf && zf && wzf && vv0 && ee0 ) ) {
+      streamlog_out(ERROR) << "HelixFit: null input or output array return 1" << std::endl;
+      return failed( ch2ph, ch2z ) ;
+    }
+
+    // per point workspace, sized from the number of points and reused by the next fit
+    std::vector<Real>& work = this->workspace<Real>() ;
+
+    if( work.size() < size_t(NWORK) * npt ) work.resize( size_t(NWORK) * npt ) ;
+
+    Real* sp2   = &work[0] ;
+    Real* del   = sp2   + npt ;
+    Real* sxy   = del   + npt ;
+    Real* ss0   = sxy   + npt ;
+    Real* eee   = ss0   + npt ;
+    Real* delz  = eee   + npt ;
+
+    for(int i=0; i < 15; ++i){
       ee0[i]=0.0;
     }
-    
-    for( int i=1; i < 5; ++i){
-      grad[i]= 0.0;
+
+    for( int i=0; i < 5; ++i){
       vv0[i] = 0.0;
     }
-    
-    float chi2=0.0;
+
     ch2ph = 0.0;
     ch2z = 0.0;
-    
-    for (int i = 0; i<npt; ++i) {
-      sp2[i] = wf[i]*(rf[i]*rf[i]);
-    }
-    
-    
-    //std::cout <<  "npt = " <<  npt << std::endl;
-    
-    //  for(int i = 0; i<n; ++i){
-    //std::cout << "xf = " <<  xf[i] << " " <<  i << std::endl; 
-    //std::cout << "yf = " <<  yf[i] << " " <<  i << std::endl; 
-    //std::cout << "zf = " <<  zf[i] << " " <<  i << std::endl; 
-    //std::cout << "rf = " <<  rf[i] << " " <<  i << std::endl; 
-    //std::cout << "pf = " <<  pf[i] << " " <<  i << std::endl; 
-    //std::cout << "wf = " <<  wf[i] << " " <<  i << std::endl; 
-    //std::cout << "wzf = " <<  wzf[i] << " " <<  i << std::endl; 
-    //}
-    
-    
-    wn=0.0;
-    
-    for (int i =0; i<npt; ++i) {
-      xm = xm + xf[i]*wf[i];
-      ym = ym + yf[i]*wf[i];
-      wn = wn + wf[i];
-    }
-    
-    rn = 1.0/wn;
-    
-    xm = xm * rn;
-    ym = ym * rn;
-    x2 = 0.;
-    y2 = 0.;
-    xy = 0.;
-    xd = 0.;
-    yd = 0.;
-    d2 = 0.;
-    
-    //std::cout << "xm = " <<  xm <<  std::endl; 
-    //std::cout << "ym = " <<  ym <<  std::endl; 
-    //std::cout << "rn = " <<  rn <<  std::endl; 
-    
-    for (int i =0; i<npt; ++i) {
-      xi = xf[i] - xm;
-      yi = yf[i] - ym;
-      xx = xi*xi;
-      yy = yi*yi;
-      x2 = x2 + xx*wf[i];
-      y2 = y2 + yy*wf[i];
-      xy = xy + xi*yi*wf[i];
-      dd = xx + yy;
-      xd = xd + xi*dd*wf[i];
-      yd = yd + yi*dd*wf[i];
-      d2 = d2 + dd*dd*wf[i];
-    }
-    
-    
-    //std::cout << "xd = " <<  xd <<  std::endl; 
-    //std::cout << "yd = " <<  yd <<  std::endl; 
-    //std::cout << "d2 = " <<  d2 <<  std::endl; 
-    
-    
-    x2 = x2*rn;
-    y2 = y2*rn;
-    xy = xy*rn;
-    d2 = d2*rn;
-    xd = xd*rn;
-    yd = yd*rn;
-    f = 3.0* x2 + y2;
-    g = 3.0* y2 + x2;
-    fg = f*g;
-    h = xy + xy;
-    h2 = h*h;
-    p2 = xd*xd;
-    q2 = yd*yd;
-    gam0 = x2 + y2;
-    fact = gam0*gam0;
-    a2 = (fg-h2-d2)/fact;
-    fact = fact*gam0;
-    a1 = (d2*(f+g) - 2.0*(p2+q2))/fact;
-    fact = fact*gam0;
-    a0 = (d2*(h2-fg) + 2.0*(p2*g + q2*f) - 4.0*xd*yd*h)/fact;
-    a22 = a2 + a2;
-    yb = 1.0e30;
-    xa = 1.0;
-    
-    //std::cout << "a0 = " <<  a0 <<  std::endl; 
-    //std::cout << "a22 = " <<  a22 <<  std::endl; 
-    
-    
-    //  **                main iteration
-    
-    for (int i = 0 ; i < ITMAX; ++i) {
-      
-      ya = a0 + xa*(a1 + xa*(a2 + xa*(xa-4.0)));
-      dy = a1 + xa*(a22 + xa*(4.0*xa - 12.0));
-      xb = xa - ya/dy;
-      
-      if (fabs(ya) > fabs(yb)) {
-        xb = 0.5 * (xb+xa) ;
-      }
-      
-      if (fabs(xa-xb) < eps) break ;
-      xa = xb;
-      yb = ya;
-      
-      
-    }
-    
-    //  **      
-    
-    gam = gam0*xb;
-    f1 = f - gam;
-    g1 = g - gam;
-    x1 = xd*g1 - yd*h;
-    y1 = yd*f1 - xd*h;
-    det = f1*g1 - h2;
-    den2= 1.0/(x1*x1 + y1*y1 + gam*det*det);
-    
-    if(den2 <= 0.0) {
-      //                        streamlog_out(ERROR) << "den2 less than or equal to zero" 
-      //                        << " x1 = " << x1 
-      //                        << " y1 = " << y1
-      //                        << " gam = " << gam  
-      //                        << " det = " << det  
-      //                        << std::endl;
-      ch2ph = 1.0e30;
-      ch2z  = 1.0e30;
-      return 1;
-    }
-    
-    den = sqrt(den2);
-    cur = det*den + 0.0000000001 ;
-    alf = -(xm*det + x1)*den ;
-    bet = -(ym*det + y1)*den ;
-    rm = xm*xm + ym*ym ;
-    gam = ((rm-gam)*det + 2.0*(xm*x1 + ym*y1))*den*0.5;
-    
-    
-    //  
-    //  --------> calculation of standard circle parameters
-    //            nb: cur is always positive
-    
-    double rr0=cur;
-    double asym = bet*xm-alf*ym;
-    double sst = 1.0;
-    
-    if(asym < 0.0) { 
-      sst = -1.0 ;
-    }
-    
-    rr0 = sst*cur;
-    
-    if( (alf*alf+bet*bet) <= 0.0 ){
-      //                        streamlog_out(ERROR) << "(alf*alf+bet*bet) less than or equal to zero" << std::endl;
-      ch2ph = 1.0e30;
-      ch2z  = 1.0e30;
-      return 1;
+
+    //
+    //  -----> circle from the weighted moments of the points or from the Riemann fit
+    //
+
+    Moments m ;
+    Circle c ;
+
+    const bool circleOK = ( circleFit == riemann ? circleRiemann( npt, xf, yf, rf, wf, sp2, c )
+                                                  : moments( npt, xf, yf, rf, wf, sp2, m ) && circleFromMoments( m, c ) ) ;
+
+    if( ! circleOK ) {
+      return failed( ch2ph, ch2z ) ;
     }
-    
-    sa2b2 = 1.0/sqrt(alf*alf+bet*bet);
-    dd0 = (1.0-1.0/sa2b2)/cur;
-    aaa = alf*sa2b2;
-    
-    if( aaa >  1.0 ) aaa = 1.0;
-    if( aaa < -1.0 ) aaa =-1.0;
-    
-    //  std::cout << std::setprecision(10) << "aaa = " <<  aaa <<  std::endl; 
-    
-    phic = asin(aaa)+ M_PI_2;
-    
-    if( bet > 0 ) phic = 2*M_PI - phic;
-    
-    double ph0 = phic + M_PI_2;
-    
-    if(rr0 <= 0.0)   ph0=ph0-M_PI;
-    if(ph0 > 2*M_PI) ph0=ph0-2*M_PI;
-    if(ph0 < 0.0)    ph0=ph0+2*M_PI;
-    
-    vv0[0] = rr0;
-    vv0[2] = ph0;
-    vv0[3] = dd0;
-    
-    //  std::cout << std::setprecision(10) << "rr0 = " <<  rr0 <<  std::endl; 
-    //  std::cout << "ph0 = " <<  ph0 <<  std::endl; 
-    //  std::cout << "dd0 = " <<  dd0 <<  std::endl; 
-    
-    double check=sst*rr0*dd0;
-    //  std::cout << "check = " <<  check <<  std::endl; 
-    
-    if(check > 1.0-eps && check < 1.0+eps) {
-      dd0 = dd0 - 0.007;
-      vv0[3]=dd0;
-    }
-    
-    //  
+
+    // omega, tanLambda, phi0, d0, z0
+    double vv[5] = { c.omega, 0.0, c.phi0, c.d0, 0.0 } ;
+
+    const double aa0 = c.sign ;
+
+    //
     //  -----> calculate phi distances to measured points
-    //  
-    
-    double aa0 = sst;
-    double ome = rr0;
-    double gg0 = ome*dd0-aa0;
-    
-    double hh0 = 1.0/gg0;
-    
-    //  std::cout << "dd0 = " <<  dd0 <<  std::endl; 
-    //  std::cout << "ome = " <<  ome <<  std::endl; 
-    //  std::cout << "aa0 = " <<  aa0 <<  std::endl; 
-    //  std::cout << "hh0 = " <<  hh0 <<  std::endl; 
-    //  std::cout << "gg0 = " <<  gg0 <<  std::endl; 
-    
+    //
+
     for (int i = 0 ; i < npt ; ++i) {
-      
-      asym   = bet*xf[i]-alf*yf[i] ;
-      ss0[i] = 1.0 ;
-      
-      if(asym < 0.0) ss0[i] = -1.0 ;
-      
-      double ff0 = ome*(rf[i]*rf[i]-dd0*dd0)/(2.0*rf[i]*gg0) + dd0/rf[i];
-      
-      if(ff0 < -1.0) ff0 = -1.0;
-      if(ff0 >  1.0) ff0 =  1.0;
-      
-      del[i]= ph0 + (ss0[i]-aa0)* M_PI_2 + ss0[i]*asin(ff0) - pf[i];
-      
-      //                std::cout << "asin(ff0) = " << asin(ff0)  << " i = " << i <<  std::endl; 
-      //                std::cout << "aa0 = " <<  aa0 << " i = " << i <<  std::endl; 
-      //                std::cout << "M_PI_2 = " <<  M_PI_2 << " i = " << i <<  std::endl; 
-      //                std::cout << "pf[i] = " <<  pf[i] << " i = " << i <<  std::endl; 
-      //                std::cout << "ff0 = " <<  ff0 << " i = " << i <<  std::endl; 
-      //                std::cout << "ss0[i] = " <<  ss0[i] << " i = " << i <<  std::endl; 
-      //                std::cout << "ph0 + (ss0[i]-aa0)* M_PI_2 = " <<  ph0 + (ss0[i]-aa0)* M_PI_2  << " i = " << i <<  std::endl; 
-      //                std::cout << "ss0[i]*asin(ff0) = " <<  ss0[i]*asin(ff0)  << " i = " << i <<  std::endl; 
-      //                std::cout << "ph0 + (ss0[i]-aa0)* M_PI_2 + ss0[i]*asin(ff0) = " << ph0 + (ss0[i]-aa0)* M_PI_2 + ss0[i]*asin(ff0) << std::endl;
-      //                std::cout << "del[i] = " <<  del[i] << " i = " << i <<  std::endl; 
-      
-      if(del[i] >  M_PI) del[i] = del[i] - 2*M_PI;
-      if(del[i] < -M_PI) del[i] = del[i] + 2*M_PI;
-      
-      
-      
-    }
-    
-    
-    
-    //  
+      ss0[i] = ( c.bet*xf[i]-c.alf*yf[i] < 0.0 ? -1.0 : 1.0 ) ;
+    }
+
+    circleResiduals( npt, rf, pf, vv, aa0, ss0, del, eee, sxy ) ;
+
+    //
     //  -----> fit straight line in s-z
-    //  
-    
-    
-    for (int i = 0 ; i < npt ; ++i) {
-      
-      eee[i] = 0.5*vv0[0] * sqrt( fabs( (rf[i] * rf[i]-vv0[3]*vv0[3]) / (1.0-aa0*vv0[0]*vv0[3]) ) );
-      
-      if(eee[i] >  0.99990)  eee[i]=  0.99990;
-      if(eee[i] < -0.99990)  eee[i]= -0.99990;
-      
-      sxy[i]=2.0*asin(eee[i])/ome;
-      
-    }
-    
-    
-    double sums  = 0.0;
-    double sumss = 0.0;
-    double sumz  = 0.0;
-    double sumzz = 0.0;
-    double sumsz = 0.0;
-    double sumw  = 0.0;
-    
-    for (int i = 0; i<npt; ++i) {
-      sumw  = sumw  +                 wzf[i];
-      sums  = sums  + sxy[i]        * wzf[i];
-      sumss = sumss + sxy[i]*sxy[i] * wzf[i];
-      sumz  = sumz  + zf[i]         * wzf[i];
-      sumzz = sumzz + zf[i]*zf[i]   * wzf[i];
-      sumsz = sumsz + zf[i]*sxy[i]  * wzf[i];
-    }
-    
-    double denom = sumw*sumss - sums*sums;
-    
-    if (fabs(denom) < eps){
-      //                        streamlog_out(ERROR) << "fabs(denom) less than or equal to zero" << std::endl;
-      ch2ph = 1.0e30;
-      ch2z  = 1.0e30;
-      return 1;
+    //
+
+    if( ! lineFit( npt, zf, wzf, sxy, vv ) ) {
+      return failed( ch2ph, ch2z ) ;
     }
-    
-    double dzds  = (sumw*sumsz-sums*sumz) /denom;
-    double zz0   = (sumss*sumz-sums*sumsz)/denom;
-    
-    vv0[1]= dzds;
-    vv0[4]= zz0;
-    
-    //  
+
+    //
     //  -----> calculation chi**2
-    //  
-    for (int i = 0 ; i<npt; ++i) {
-      
-      delz[i]= zz0+dzds*sxy[i]-zf[i];
-      ch2ph = ch2ph + sp2[i]*del[i]*del[i];
-      ch2z = ch2z + wzf[i]*delz[i]*delz[i];
-      chi2 = ch2ph + ch2z;
-      
-    }
-    
-    if(chi2 > MAX_CHI2) {
-      //                        streamlog_out(ERROR) << "Chi2 greater than " <<  MAX_CHI2 << "return 1 " << std::endl;
-      ch2ph = 1.0e30;
-      ch2z  = 1.0e30;
-      return 1;
+    //
+
+    Real chi2ph, chi2z ;
+
+    chi2( npt, zf, wzf, sp2, del, sxy, vv, delz, chi2ph, chi2z ) ;
+
+    const double chi2tot = double(chi2ph) + chi2z ;
+
+    ch2ph = chi2ph ;
+    ch2z  = chi2z ;
+
+    for( int i=0; i < 5; ++i){
+      vv0[i] = vv[i];
+    }
+
+    if(chi2tot > MAX_CHI2) {
+      return failed( ch2ph, ch2z ) ;
+    }
+
+    //
+    //  -----> inverse of the error matrix and gradient
+    //
+
+    Real ee[15] ;
+    Real grad[5] ;
+
+    errorMatrix( npt, rf, wzf, sp2, ss0, eee, sxy, del, delz, vv, aa0, ee, grad ) ;
+
+    for (int i =0; i<15; ++i) {
+      ee0[i] = ee[i];
     }
-    
-    for (int i = 0 ; i<npt; ++i) {
-      
-      double ff0 = ome*(rf[i]*rf[i]-dd0*dd0)/(2.0*rf[i]*gg0) + dd0/rf[i];
-      
-      if (ff0 >  0.99990) ff0 =  0.99990;
-      
-      if (ff0 < -0.99990) ff0 = -0.99990;
-      
-      double eta = ss0[i]/sqrt(fabs((1.0+ff0)*(1.0-ff0)));
-      double dfd = (1.0+hh0*hh0*(1.0-ome*ome*rf[i]*rf[i]))/(2.0*rf[i]);
-      double dfo = -aa0*(rf[i]*rf[i]-dd0*dd0)*hh0*hh0/(2.0*rf[i]);
-      double dpd = eta*dfd;
-      double dpo = eta*dfo;
-      
-      //        -----> derivatives of z component
-      double ggg = eee[i]/sqrt(fabs( (1.0+eee[i])*(1.0-eee[i])));
-      double dza = sxy[i];
-      check = rf[i]*rf[i]-vv0[3]*vv0[3];
-      
-      if(fabs(check) > 1.0-eps) check=2.*0.007;
-      
-      double dzd = 2.0*( vv0[1]/vv0[0] ) * fabs( ggg ) * ( 0.5*aa0*vv0[0]/( 1.0-aa0*vv0[3]*vv0[0] )-vv0[3]/check );
-      
-      double dzo = -vv0[1]*sxy[i]/vv0[0] + vv0[1] * ggg/( vv0[0]*vv0[0]) * ( 2.0+ aa0*vv0[0]*vv0[3]/(1.0-aa0*vv0[0]*vv0[3]) );
-      
-      //  -----> error martix
-      
-      ee0[0] = ee0[0] + sp2[i]*  dpo*dpo  + wzf[i] * dzo*dzo;
-      ee0[1] = ee0[1]                     + wzf[i] * dza*dzo;
-      ee0[2] = ee0[2]                     + wzf[i] * dza*dza;
-      ee0[3] = ee0[3] + sp2[i]*  dpo;
-      ee0[4] = ee0[4];
-      ee0[5] = ee0[5] + sp2[i];
-      ee0[6] = ee0[6] + sp2[i]*  dpo*dpd  + wzf[i] * dzo*dzd;
-      ee0[7] = ee0[7]                     + wzf[i] * dza*dzd;
-      ee0[8] = ee0[8] + sp2[i]*      dpd;
-      ee0[9] = ee0[9] + sp2[i]*  dpd*dpd  + wzf[i] * dzd*dzd;
-      ee0[10]= ee0[10]                    + wzf[i] * dzo;
-      ee0[11]= ee0[11]                    + wzf[i] * dza;
-      ee0[12]= ee0[12];
-      ee0[13]= ee0[13]                    + wzf[i] * dzd;
-      ee0[14]= ee0[14]                    + wzf[i];
-      
-      //        -----> gradient vector
-      grad[0]=grad[0] - del[i] *sp2[i]*dpo - delz[i]*wzf[i]*dzo;
-      grad[1]=grad[1] -                      delz[i]*wzf[i]*dza;
-      grad[2]=grad[2] - del[i] *sp2[i];
-      grad[3]=grad[3] - del[i] *sp2[i]*dpd - delz[i]*wzf[i]*dzd;
-      grad[4]=grad[4] -                      delz[i]*wzf[i];
-      
-      
-    }
-    
+
     if (iopt < 3) {
 
       streamlog_out(DEBUG1) << "HelixFit: " <<
@@ -436,114 +686,35 @@ namespace MarlinTrk{
       " z0 = " << vv0[4] <<
       " tanL = " << vv0[1] <<
       std::endl;
-      
+
       return 0 ;
     }
-    
-    // ------> NEWTONS NEXT GUESS       
-    
-    for (int i =0; i<15; ++i) {
-      cov[i]=ee0[i];
-    }
-    
-    // Convert Covariance Matrix
-    CLHEP::HepSymMatrix cov0(5) ; 
-    
-    int icov = 0 ;
-    
-    for(int irow=0; irow<5; ++irow ){
-      for(int jcol=0; jcol<irow+1; ++jcol){
-        //      std::cout << "row = " << irow << " col = " << jcol << std::endl ;
-        //      std::cout << "cov["<< icov << "] = " << _cov[icov] << std::endl ;
-        cov0[irow][jcol] = ee0[icov] ;
-        ++icov ;
-      }
-    }
-    
-    int error = 0 ;
-    cov0.invert(error);
-    
-    if( error != 0 ) {
-      streamlog_out(ERROR) << "CLHEP Matrix inversion failed" << "return 1 " << std::endl;
-      ch2ph = 1.0e30;
-      ch2z  = 1.0e30;
-      return 1;
-    }
-    
-    icov = 0 ;
-    
-    for(int irow=0; irow<5; ++irow ){
-      for(int jcol=0; jcol<irow+1; ++jcol){
-        //      std::cout << "row = " << irow << " col = " << jcol << std::endl ;
-        //      std::cout << "cov["<< icov << "] = " << _cov[icov] << std::endl ;
-        cov[icov] = cov0[irow][jcol];
-        ++icov ;
-      }
-    }
-    
-    // here we need to invert the matrix cov[15]
-    
-    
-    
-    for (int i = 0; i<5; ++i) {
-      dv[i] = 0.0 ;
-      for (int j = 0; j<5; ++j) {
-        int index = 0;
-        if ( i >= j ) {
-          index = (i*i-i)/2+j ;
-        }
-        else{
-          index = (j*j-j)/2+i;
-        }
-        dv[i] = dv[i] + cov[index] * grad[j]    ;
-      }
+
+    // ------> NEWTONS NEXT GUESS
+
+    double vv1[5] ;
+
+    if( ! newtonStep( ee, grad, vv, vv1 ) ) {
+      streamlog_out(ERROR) << "HelixFit: Matrix inversion failed" << "return 1 " << std::endl;
+      return failed( ch2ph, ch2z ) ;
     }
-    
-    
-    for (int i = 0; i<5; ++i) {
-      vv1[i] = vv0[i]+dv[i];
-    }
-    
-    gg0 = vv1[0]*vv1[3]-aa0;
-    
-    for (int i=0; i<npt; ++i) {
-      double ff0 = vv1[0]*(rf[i]*rf[i]-vv1[3]*vv1[3]) / (2.0*rf[i]*gg0) + vv1[3]/rf[i];
-      
-      if (ff0 >  1) ff0 =  1.0;
-      if (ff0 < -1) ff0 = -1.0;
-      
-      deln[i] = vv1[2] + (ss0[i]-aa0)*M_PI_2+ss0[i]*asin(ff0)-pf[i];
-      
-      if(deln[i] >  M_PI) deln[i] = deln[i] - 2*M_PI;
-      if(deln[i] < -M_PI) deln[i] = deln[i] + 2*M_PI;
-      
-      eee[i] = 0.5*vv1[0]*sqrt( fabs( (rf[i]*rf[i]-vv1[3]*vv1[3]) / (1.0-aa0*vv1[0]*vv1[3]) ) );
-      
-      if(eee[i] >  0.99990)  eee[i]=  0.99990;
-      if(eee[i] < -0.99990)  eee[i]= -0.99990;
-      
-      sxy[i] = 2.0*asin(eee[i])/vv1[0];
-      delzn[i]= vv1[4]+vv1[1]*sxy[i]-zf[i];
-      
-    }
-    
-    double chi1 = 0.0;
-    ch2ph = 0.0;
-    ch2z = 0.0;
-    
-    for (int i =0; i<5; ++i) {
-      chi1   = chi1  + sp2[i]*deln[i]*deln[i] + wzf[i]*delzn[i]*delzn[i];
-      ch2ph  = ch2ph + sp2[i]*deln[i]*deln[i];
-      ch2z   = ch2z  + wzf[i]*delzn[i]*delzn[i];        
-    }
-    
-    if (chi1<chi2) {
+
+    circleResiduals( npt, rf, pf, vv1, aa0, ss0, del, eee, sxy ) ;
+
+    Real chi1ph, chi1z ;
+
+    chi2( npt, zf, wzf, sp2, del, sxy, vv1, delz, chi1ph, chi1z ) ;
+
+    const double chi1 = double(chi1ph) + chi1z ;
+
+    if (chi1<chi2tot) {
       for (int i =0; i<5; ++i) {
         vv0[i] = vv1[i];
       }
-      chi2 = chi1;      
+      ch2ph = chi1ph ;
+      ch2z  = chi1z ;
     }
-    
+
     streamlog_out(DEBUG1) << "HelixFit: " <<
     " d0 = " << vv0[3] <<
     " phi0 = " << vv0[2] <<
@@ -552,27 +723,322 @@ namespace MarlinTrk{
     " tanL = " << vv0[1] <<
     std::endl;
 
-                                
+
     return 0;
-    
+
   }
-  
-  
-}
 
 
+  template int HelixFit::fastHelixFitT<float>(int npt, const double* xf, const double* yf, const float* rf, const float* pf, const double* wf, const float* zf , const float* wzf, int iopt,
+                                              float* vv0, float* ee0, float& ch2ph, float& ch2z);
+
+  template int HelixFit::fastHelixFitT<double>(int npt, const double* xf, const double* yf, const float* rf, const float* pf, const double* wf, const float* zf , const float* wzf, int iopt,
+                                               float* vv0, float* ee0, float& ch2ph, float& ch2z);
+
+  template int HelixFit::riemannHelixFitT<float>(int npt, const double* xf, const double* yf, const float* rf, const float* pf, const double* wf, const float* zf , const float* wzf, int iopt,
+                                                 float* vv0, float* ee0, float& ch2ph, float& ch2z);
 
+  template int HelixFit::riemannHelixFitT<double>(int npt, const double* xf, const double* yf, const float* rf, const float* pf, const double* wf, const float* zf , const float* wzf, int iopt,
+                                                  float* vv0, float* ee0, float& ch2ph, float& ch2z);
 
 
+  int HelixFit::fastHelixFit(HelixFitBatch& batch, int iopt){
 
+    const unsigned nset = batch.size() ;
 
+    batch.par.assign( 5 * nset, 0.f ) ;
+    batch.invCov.assign( 15 * nset, 0.f ) ;
+    batch.chi2rphi.assign( nset, 0.f ) ;
+    batch.chi2z.assign( nset, 0.f ) ;
+    batch.status.assign( nset, 0 ) ;
 
+    if( nset == 0 ) return 0 ;
 
+    const unsigned npt = batch.x.size() ;
 
+    if( batch.offset.front() != 0 || batch.offset.back() != npt || batch.y.size() != npt || batch.z.size() != npt
+        || batch.wrphi.size() != npt || batch.wz.size() != npt ) {
 
+      streamlog_out(ERROR) << "HelixFit: inconsistent sizes of the point arrays and offsets of the batch return " << nset << std::endl;
+
+      batch.status.assign( nset, 1 ) ;
+      batch.chi2rphi.assign( nset, 1.0e30 ) ;
+      batch.chi2z.assign( nset, 1.0e30 ) ;
+
+      return nset ;
+    }
 
+    // workspace sized from the number of points and point sets and reused by the next batch
+    const size_t nwork = size_t(NWORK_POINT) * npt + size_t(NWORK_SET) * nset ;
 
+    if( _workspaceBatch.size() < nwork ) _workspaceBatch.resize( nwork ) ;
 
+    // per point: the arrays of the single fit and the circle parameters of the point set of the point
+    double* rf    = &_workspaceBatch[0] ;
+    double* pf    = rf    + npt ;
+    double* sp2   = pf    + npt ;
+    double* ss0   = sp2   + npt ;
+    double* del   = ss0   + npt ;
+    double* eee   = del   + npt ;
+    double* sxy   = eee   + npt ;
+    double* delz  = sxy   + npt ;
+    double* pome  = delz  + npt ;
+    double* pdd0  = pome  + npt ;
+    double* pph0  = pdd0  + npt ;
+    double* paa0  = pph0  + npt ;
 
+    // per point set: parameters, Newton's next guess, orientation, chi2, inverse error matrix and gradient
+    double* vv    = paa0  + npt ;
+    double* vv1   = vv    + 5 * nset ;
+    double* aa0   = vv1   + 5 * nset ;
+    double* chi2s = aa0   + nset ;
+    double* ee    = chi2s + nset ;
+    double* grad  = ee    + 15 * nset ;
 
+    const unsigned* off = &batch.offset[0] ;
 
+    const double* xf  = &batch.x[0] ;
+    const double* yf  = &batch.y[0] ;
+    const double* zf  = &batch.z[0] ;
+    const double* wf  = &batch.wrphi[0] ;
+    const double* wzf = &batch.wz[0] ;
+
+    int* status = &batch.status[0] ;
+
+    // copy the circle parameters of point set j to its points
+    auto broadcast = [&]( unsigned j, const double* v ) {
+      for( unsigned i = off[j] ; i < off[j+1] ; ++i ) {
+        pome[i] = v[0] ;
+        pdd0[i] = v[3] ;
+        pph0[i] = v[2] ;
+        paa0[i] = aa0[j] ;
+      }
+    } ;
+
+    // phi residuals and arc lengths of the points of all point sets in one loop
+    auto residuals = [&]() {
+      for( unsigned i = 0 ; i < npt ; ++i ) {
+        circleResidual( rf[i], pf[i], pome[i], pdd0[i], pph0[i], paa0[i], ss0[i], del[i], eee[i], sxy[i] ) ;
+      }
+    } ;
+
+    //
+    //  -----> r and phi of all points
+    //
+
+    for( unsigned i = 0 ; i < npt ; ++i ) {
+      rf[i] = std::sqrt( xf[i]*xf[i] + yf[i]*yf[i] ) ;
+      pf[i] = std::atan2( yf[i], xf[i] ) ;
+    }
+
+    //
+    //  -----> circle of every point set from the weighted moments of its points
+    //
+
+    for( unsigned j = 0 ; j < nset ; ++j ) {
+
+      const unsigned o = off[j] ;
+      const int n = off[j+1] - o ;
+
+      double* v = vv + 5 * j ;
+
+      Moments m ;
+      Circle c = { 1.0, 0.0, 0.0, 1.0, 0.0, 0.0 } ;
+
+      status[j] = ( n < 3 || ! moments( n, xf + o, yf + o, rf + o, wf + o, sp2 + o, m ) || ! circleFromMoments( m, c ) ) ;
+
+      // omega, tanLambda, phi0, d0, z0
+      v[0] = c.omega ; v[1] = 0.0 ; v[2] = c.phi0 ; v[3] = c.d0 ; v[4] = 0.0 ;
+
+      aa0[j] = c.sign ;
+
+      for( unsigned i = o ; i < off[j+1] ; ++i ) {
+        ss0[i] = ( c.bet*xf[i]-c.alf*yf[i] < 0.0 ? -1.0 : 1.0 ) ;
+      }
+
+      broadcast( j, v ) ;
+    }
+
+    residuals() ;
+
+    //
+    //  -----> straight line in s-z, chi2 and inverse of the error matrix of every point set
+    //
+
+    for( unsigned j = 0 ; j < nset ; ++j ) {
+
+      if( status[j] ) continue ;
+
+      const unsigned o = off[j] ;
+      const int n = off[j+1] - o ;
+
+      double* v = vv + 5 * j ;
+
+      if( ! lineFit( n, zf + o, wzf + o, sxy + o, v ) ) {
+        status[j] = 1 ;
+        continue ;
+      }
+
+      double chi2ph, chi2z ;
+
+      chi2( n, zf + o, wzf + o, sp2 + o, del + o, sxy + o, v, delz + o, chi2ph, chi2z ) ;
+
+      chi2s[j] = chi2ph + chi2z ;
+
+      batch.chi2rphi[j] = chi2ph ;
+      batch.chi2z[j]    = chi2z ;
+
+      for( int k = 0 ; k < 5 ; ++k ) batch.par[5*j+k] = v[k] ;
+
+      if( chi2s[j] > MAX_CHI2 ) {
+        status[j] = 1 ;
+        continue ;
+      }
+
+      errorMatrix( n, rf + o, wzf + o, sp2 + o, ss0 + o, eee + o, sxy + o, del + o, delz + o, v, aa0[j], ee + 15 * j, grad + 5 * j ) ;
+
+      for( int k = 0 ; k < 15 ; ++k ) batch.invCov[15*j+k] = ee[15*j+k] ;
+    }
+
+    // ------> NEWTONS NEXT GUESS
+
+    if( iopt >= 3 ) {
+
+      for( unsigned j = 0 ; j < nset ; ++j ) {
+
+        if( status[j] ) continue ;
+
+        if( ! newtonStep( ee + 15 * j, grad + 5 * j, vv + 5 * j, vv1 + 5 * j ) ) {
+          streamlog_out(DEBUG2) << "HelixFit: Matrix inversion failed for point set " << j << std::endl;
+          status[j] = 1 ;
+          continue ;
+        }
+
+        broadcast( j, vv1 + 5 * j ) ;
+      }
+
+      residuals() ;
+
+      for( unsigned j = 0 ; j < nset ; ++j ) {
+
+        if( status[j] ) continue ;
+
+        const unsigned o = off[j] ;
+        const int n = off[j+1] - o ;
+
+        double chi1ph, chi1z ;
+
+        chi2( n, zf + o, wzf + o, sp2 + o, del + o, sxy + o, vv1 + 5 * j, delz + o, chi1ph, chi1z ) ;
+
+        if( chi1ph + chi1z < chi2s[j] ) {
+          for( int k = 0 ; k < 5 ; ++k ) batch.par[5*j+k] = vv1[5*j+k] ;
+          batch.chi2rphi[j] = chi1ph ;
+          batch.chi2z[j]    = chi1z ;
+        }
+      }
+    }
+
+    int nfailed = 0 ;
+
+    for( unsigned j = 0 ; j < nset ; ++j ) {
+
+      if( status[j] ) {
+        failed( batch.chi2rphi[j], batch.chi2z[j] ) ;
+        ++nfailed ;
+      }
+    }
+
+    streamlog_out(DEBUG1) << "HelixFit: fit " << nset << " point sets with " << npt << " points, " << nfailed << " failed" << std::endl;
+
+    return nfailed ;
+  }
+
+
+  int HelixFit::fitState(int npt, const double* xf, const double* yf, const double* zf, const double* wf, const double* wzf, bool firstToLast,
+                         FastKF::State& state, double* chi2s, double* arcs){
+
+    if (npt < 3) {
+      streamlog_out(ERROR) << "Cannot fit less than 3 points return 1" << std::endl;
+      return 1 ;
+    }
+
+    if( _workspaceState.size() < 4 * size_t(npt) ) _workspaceState.resize( 4 * size_t(npt) ) ;
+
+    // the single precision inputs of the fit
+    float* rf      = &_workspaceState[0] ;
+    float* pf      = rf + npt ;
+    float* zfloat  = pf + npt ;
+    float* wzfloat = zfloat + npt ;
+
+    for (int i = 0; i < npt; ++i) {
+      rf[i]      = std::sqrt( xf[i] * xf[i] + yf[i] * yf[i] ) ;
+      pf[i]      = std::atan2( yf[i], xf[i] ) ;
+      zfloat[i]  = zf[i] ;
+      wzfloat[i] = wzf[i] ;
+    }
+
+    float vv0[5], ee0[15], ch2ph, ch2z ;
+
+    if( this->fastHelixFitT<double>( npt, xf, yf, rf, pf, wf, zfloat, wzfloat, 3, vv0, ee0, ch2ph, ch2z ) != 0 ) return 1 ;
+
+    // vv0 holds omega, tanLambda, phi0, d0 signed with omega and z0
+    state.par[FastKF::iD0]    = ( vv0[0] < 0. ? -vv0[3] : vv0[3] ) ;
+    state.par[FastKF::iPhi]   = FastKF::toBaseRange( vv0[2] ) ;
+    state.par[FastKF::iOmega] = vv0[0] ;
+    state.par[FastKF::iZ0]    = vv0[4] ;
+    state.par[FastKF::iTanL]  = vv0[1] ;
+
+    state.ref[0] = state.ref[1] = state.ref[2] = 0. ;
+
+    // the helix of the fit runs from the origin outwards - reverse it if the momentum points the other way
+    const double first[3] = { xf[0], yf[0], zf[0] } ;
+    const double last[3]  = { xf[npt-1], yf[npt-1], zf[npt-1] } ;
+
+    FastKF::State probe = state ;
+    const double firstArc = FastKF::moveReferencePoint( probe, first, 0 ) ;
+    probe = state ;
+    const double lastArc = FastKF::moveReferencePoint( probe, last, 0 ) ;
+
+    if( firstToLast ? lastArc < firstArc : lastArc > firstArc ) {
+      state.par[FastKF::iD0]    = -state.par[FastKF::iD0] ;
+      state.par[FastKF::iPhi]   = FastKF::toBaseRange( state.par[FastKF::iPhi] + M_PI ) ;
+      state.par[FastKF::iOmega] = -state.par[FastKF::iOmega] ;
+      state.par[FastKF::iTanL]  = -state.par[FastKF::iTanL] ;
+    }
+
+    // moving the reference point to a point makes d0 and z0 its residuals, the rows of the Jacobian are their derivatives
+    FastKF::SymMatrix5 information ;
+    information.fill( 0. ) ;
+
+    for (int i = 0; i < npt; ++i) {
+
+      const double ref[3] = { xf[i], yf[i], zf[i] } ;
+
+      probe = state ;
+
+      FastKF::Matrix5 J ;
+      const double arc = FastKF::moveReferencePoint( probe, ref, &J ) ;
+
+      const double* hD0 = &J[FastKF::iD0 * 5] ;
+      const double* hZ0 = &J[FastKF::iZ0 * 5] ;
+
+      for (int a = 0; a < 5; ++a)
+        for (int b = 0; b <= a; ++b)
+          information[FastKF::symIndex( a, b )] += hD0[a] * hD0[b] * wf[i] + hZ0[a] * hZ0[b] * wzf[i] ;
+
+      if( chi2s ) chi2s[i] = probe.par[FastKF::iD0] * probe.par[FastKF::iD0] * wf[i] + probe.par[FastKF::iZ0] * probe.par[FastKF::iZ0] * wzf[i] ;
+      if( arcs ) arcs[i] = arc ;
+    }
+
+    if( ! FastKF::invert( information ) ) {
+      streamlog_out(DEBUG2) << "HelixFit: covariance matrix of the state not invertible return 1" << std::endl;
+      return 1 ;
+    }
+
+    state.cov = information ;
+
+    return 0 ;
+
+  }
+
+}
@@ -1,42 +1,114 @@
 
 #include "MarlinTrk/IMarlinTrack.h"
 #include "MarlinTrk/HelixTrack.h"
+#include "MarlinTrk/FastKFKernels.h"
 #include <cmath>
-#include <TVector3.h>
-#include <kaltest/THelicalTrack.h>
 
 #include "streamlog/streamlog.h"
 
 // defines if s of the helix increases in the direction of x2 to x3 
 bool HelixTrack::forwards = true;
 
-HelixTrack::HelixTrack( const double* x1, const double* x2, const double* x3, double Bz, bool direction ){
+namespace {
+
+  /** helix parameters d0, phi0, omega, z0, tanLambda through the three points with the reference point at x1 - 
+   *  the circle in the xy-plane is solved directly, straight lines give omega = 0 
+   */
+  inline void helixFromTriplet( const double* x1, const double* x2, const double* x3, bool direction, double* par ) {
+    
+    using namespace MarlinTrk ;
+    
+    FastKF::State st ;
+    
+    if( ! FastKF::helixFromThreePoints( x1, x2, x3, st ) ) {
+      
+      const double dx = x3[0] - x1[0] ;
+      const double dy = x3[1] - x1[1] ;
+      const double dxy = std::sqrt( dx * dx + dy * dy ) ;
+      
+      st.par[FastKF::iD0]    = 0. ;
+      st.par[FastKF::iPhi]   = std::atan2( dy, dx ) ;
+      st.par[FastKF::iOmega] = 0. ;
+      st.par[FastKF::iZ0]    = 0. ;
+      st.par[FastKF::iTanL]  = ( dxy > 0. ? ( x3[2] - x1[2] ) / dxy : 0. ) ;
+    }
+    
+    // the same helix followed from x3 to x1
+    const double sign = ( direction ? 1. : -1. ) ;
+    
+    par[0] = 0. ;
+    par[1] = ( direction ? st.par[FastKF::iPhi] : FastKF::toBaseRange( st.par[FastKF::iPhi] + M_PI ) ) ;
+    par[2] = sign * st.par[FastKF::iOmega] ;
+    par[3] = 0. ;
+    par[4] = sign * st.par[FastKF::iTanL] ;
+  }
+}
+
+
+void HelixTripletBatch::resize( unsigned n ) {
+  
+  x1.resize( n ) ; y1.resize( n ) ; z1.resize( n ) ;
+  x2.resize( n ) ; y2.resize( n ) ; z2.resize( n ) ;
+  x3.resize( n ) ; y3.resize( n ) ; z3.resize( n ) ;
+  
+  d0.resize( n ) ;
+  z0.resize( n ) ;
+  phi0.resize( n ) ;
+  omega.resize( n ) ;
+  tanLambda.resize( n ) ;
+}
 
-  // Make a KalTest THelicalTrack
-  TVector3 p1( x1[0], x1[1], x1[2] );
-  TVector3 p2( x2[0], x2[1], x2[2] );
-  TVector3 p3( x3[0], x3[1], x3[2] );
+
+HelixTrack::HelixTrack( const double* x1, const double* x2, const double* x3, double Bz, bool direction ){
 
   streamlog_out(DEBUG2) << "HelixTrack::HelixTrack Create from hits: \n " 
-  << "P1 x = " << p1.x() << " y = " << p1.y() << " z = " << p1.z() << " r = " << p1.Perp() << "\n " 
-  << "P2 x = " << p2.x() << " y = " << p2.y() << " z = " << p2.z() << " r = " << p2.Perp() << "\n " 
-  << "P3 x = " << p3.x() << " y = " << p3.y() << " z = " << p3.z() << " r = " << p3.Perp() << "\n "
+  << "P1 x = " << x1[0] << " y = " << x1[1] << " z = " << x1[2] << " r = " << std::hypot( x1[0], x1[1] ) << "\n " 
+  << "P2 x = " << x2[0] << " y = " << x2[1] << " z = " << x2[2] << " r = " << std::hypot( x2[0], x2[1] ) << "\n " 
+  << "P3 x = " << x3[0] << " y = " << x3[1] << " z = " << x3[2] << " r = " << std::hypot( x3[0], x3[1] ) << "\n "
   << "Bz = " << Bz << " direction = " << direction 
   << std::endl;
 
-  THelicalTrack helicalTrack( p1, p2, p3, Bz, direction ); 
-    
-  // Set the track parameters and convert from the KalTest system to the lcio system
+  double par[5] ;
+  helixFromTriplet( x1, x2, x3, direction, par ) ;
+  
+  _d0 = par[0] ;
+  _phi0 = par[1] ;
+  _omega = par[2] ;
+  _z0 = par[3] ;
+  _tanLambda = par[4] ;
   
-  _phi0 = toBaseRange( helicalTrack.GetPhi0() + M_PI/2. ) ;
-  _omega = 1. / helicalTrack.GetRho();
-  _z0 = helicalTrack.GetDz();
-  _d0 = - helicalTrack.GetDrho();
-  _tanLambda = helicalTrack.GetTanLambda();
+  _ref_point_x = x1[0] ;
+  _ref_point_y = x1[1] ;
+  _ref_point_z = x1[2] ;
   
-  _ref_point_x =  helicalTrack.GetPivot().X() ;
-  _ref_point_y =  helicalTrack.GetPivot().Y() ;
-  _ref_point_z =  helicalTrack.GetPivot().Z() ;
+}
+
+
+void HelixTrack::fromTriplets( HelixTripletBatch& batch, bool direction ){
+  
+  const unsigned n = batch.size() ;
+  
+  batch.d0.resize( n ) ;
+  batch.z0.resize( n ) ;
+  batch.phi0.resize( n ) ;
+  batch.omega.resize( n ) ;
+  batch.tanLambda.resize( n ) ;
+  
+  for( unsigned i = 0 ; i < n ; ++i ) {
+    
+    const double x1[3] = { batch.x1[i], batch.y1[i], batch.z1[i] } ;
+    const double x2[3] = { batch.x2[i], batch.y2[i], batch.z2[i] } ;
+    const double x3[3] = { batch.x3[i], batch.y3[i], batch.z3[i] } ;
+    
+    double par[5] ;
+    helixFromTriplet( x1, x2, x3, direction, par ) ;
+    
+    batch.d0[i]        = par[0] ;
+    batch.phi0[i]      = par[1] ;
+    batch.omega[i]     = par[2] ;
+    batch.z0[i]        = par[3] ;
+    batch.tanLambda[i] = par[4] ;
+  }
   
 }
   
@@ -1,5 +1,8 @@
 
 #include "MarlinTrk/IMarlinTrack.h"
+#include "MarlinTrk/IMarlinTrkSystem.h"
+#include "MarlinTrk/LCIOTrackPropagators.h"
+#include <cmath>
 #include <sstream>
 #include "UTIL/Operators.h"
 
@@ -37,6 +40,251 @@ namespace MarlinTrk{
     }
   }
   
+  IMarlinTrkSystem* IMarlinTrack::getTrkSystem() {
+    return 0 ;
+  }
+
+  int IMarlinTrack::restoreFitResult( const std::vector<std::pair<EVENT::TrackerHit*, double> >& /*hitsInFit*/,
+                                      const std::vector<std::pair<EVENT::TrackerHit*, double> >& /*outliers*/ ) {
+    return error ;
+  }
+
+  int IMarlinTrack::removeHit( EVENT::TrackerHit* /*hit*/ ) {
+    return error ;
+  }
+
+  int IMarlinTrack::insertHit( EVENT::TrackerHit* /*hit*/, double& /*chi2increment*/, double /*maxChi2Increment*/ ) {
+    return error ;
+  }
+
+  int IMarlinTrack::fitMassHypotheses( const std::vector<double>& /*masses*/, std::vector<IMarlinTrack*>& /*tracks*/, double /*maxChi2Increment*/ ) {
+    return error ;
+  }
+
+  int IMarlinTrack::getPathLength( EVENT::TrackerHit* /*hit*/, double& /*pathLength*/, double& /*timeOfFlight*/ ) {
+    return error ;
+  }
+
+  int IMarlinTrack::getLastPropagationLength( double& /*pathLength*/, double& /*timeOfFlight*/ ) {
+    return error ;
+  }
+
+  int IMarlinTrack::getHitPattern( std::vector<PatternCrossing>& /*crossings*/ ) {
+    return error ;
+  }
+
+  namespace {
+
+    /** propagate to a single target, either from the last site or from the site of the given hit */
+    int propagateToTarget( IMarlinTrack& trk, IMarlinTrack::PropagationTarget& t, EVENT::TrackerHit* hit ) {
+
+      switch( t.type ) {
+        case IMarlinTrack::PropagationTarget::toPoint:
+          return ( hit ? trk.propagate( t.point, hit, t.trackState, t.chi2, t.ndf ) 
+                   : trk.propagate( t.point, t.trackState, t.chi2, t.ndf ) ) ;
+        case IMarlinTrack::PropagationTarget::toLayer:
+          return ( hit ? trk.propagateToLayer( t.id, hit, t.trackState, t.chi2, t.ndf, t.detElementID, t.mode ) 
+                   : trk.propagateToLayer( t.id, t.trackState, t.chi2, t.ndf, t.detElementID, t.mode ) ) ;
+        case IMarlinTrack::PropagationTarget::toDetElement:
+          t.detElementID = t.id ;
+          return ( hit ? trk.propagateToDetElement( t.id, hit, t.trackState, t.chi2, t.ndf, t.mode ) 
+                   : trk.propagateToDetElement( t.id, t.trackState, t.chi2, t.ndf, t.mode ) ) ;
+      }
+
+      return IMarlinTrack::bad_intputs ;
+    }
+
+    int propagateToAll( IMarlinTrack& trk, std::vector<IMarlinTrack::PropagationTarget>& targets, EVENT::TrackerHit* hit ) {
+
+      int return_code = IMarlinTrack::success ;
+
+      for( unsigned i = 0 ; i < targets.size() ; ++i ) {
+
+        IMarlinTrack::PropagationTarget& t = targets[i] ;
+
+        t.status = propagateToTarget( trk, t, hit ) ;
+
+        if( t.status == IMarlinTrack::success ) trk.getLastPropagationLength( t.pathLength, t.timeOfFlight ) ;
+        else if( return_code == IMarlinTrack::success ) return_code = t.status ;
+      }
+
+      return return_code ;
+    }
+  }
+
+  int IMarlinTrack::propagateToMany( std::vector<PropagationTarget>& targets ) {
+    return propagateToAll( *this, targets, 0 ) ;
+  }
+
+  int IMarlinTrack::propagateToMany( std::vector<PropagationTarget>& targets, EVENT::TrackerHit* hit ) {
+
+    if( hit == 0 ) return bad_intputs ;
+
+    return propagateToAll( *this, targets, hit ) ;
+  }
+
+  double arcLengthToPoint( const EVENT::TrackState& ts, const Vector3D& p, int mode ) {
+
+    const float* ref = ts.getReferencePoint() ;
+
+    const double phi0  = ts.getPhi() ;
+    const double omega = ts.getOmega() ;
+
+    const double xp = ref[0] - ts.getD0() * std::sin( phi0 ) ;
+    const double yp = ref[1] + ts.getD0() * std::cos( phi0 ) ;
+
+    if( omega == 0. ) return ( p.x() - xp ) * std::cos( phi0 ) + ( p.y() - yp ) * std::sin( phi0 ) ;
+
+    // phi(s) = phi0 - omega * s
+    const double xc = xp + std::sin( phi0 ) / omega ;
+    const double yc = yp - std::cos( phi0 ) / omega ;
+
+    const double phi = std::atan2( - ( p.x() - xc ) * omega, ( p.y() - yc ) * omega ) ;
+
+    double dphi = std::fmod( ( phi0 - phi ) * ( omega > 0. ? 1. : -1. ), 2. * M_PI ) ;
+
+    if( dphi < 0. ) dphi += 2. * M_PI ;
+
+    if( mode == IMarlinTrack::modeBackward || ( mode == IMarlinTrack::modeClosest && dphi > M_PI ) ) dphi -= 2. * M_PI ;
+
+    return dphi / std::fabs( omega ) ;
+  }
+
+  namespace {
+
+    int propagateToFirst( IMarlinTrack& trk, const std::vector<int>& layerIDs, EVENT::TrackerHit* hit,
+                          IMPL::TrackStateImpl& ts, double& chi2, int& ndf, int& layerID, int& detElementID, int mode ) {
+
+      IMPL::TrackStateImpl start ;
+
+      int error_code = ( hit ? trk.getTrackState( hit, start, chi2, ndf ) : trk.getTrackState( start, chi2, ndf ) ) ;
+
+      if( error_code != IMarlinTrack::success ) return error_code ;
+
+      bool found = false ;
+      double best = 0. ;
+
+      for( unsigned i = 0 ; i < layerIDs.size() ; ++i ) {
+
+        Vector3D point ;
+        int elementID = 0 ;
+
+        const int rc = ( hit ? trk.intersectionWithLayer( layerIDs[i], hit, point, elementID, mode ) 
+                         : trk.intersectionWithLayer( layerIDs[i], point, elementID, mode ) ) ;
+
+        if( rc != IMarlinTrack::success ) continue ;
+
+        const double arc = std::fabs( arcLengthToPoint( start, point, mode ) ) ;
+
+        if( found && arc >= best ) continue ;
+
+        found = true ;
+        best = arc ;
+        layerID = layerIDs[i] ;
+      }
+
+      if( ! found ) return IMarlinTrack::no_intersection ;
+
+      return ( hit ? trk.propagateToLayer( layerID, hit, ts, chi2, ndf, detElementID, mode ) 
+               : trk.propagateToLayer( layerID, ts, chi2, ndf, detElementID, mode ) ) ;
+    }
+  }
+
+  int IMarlinTrack::propagateToFirstLayer( const std::vector<int>& layerIDs, IMPL::TrackStateImpl& ts, double& chi2, int& ndf, int& layerID, int& detElementID, int mode ) {
+    return propagateToFirst( *this, layerIDs, 0, ts, chi2, ndf, layerID, detElementID, mode ) ;
+  }
+
+  int IMarlinTrack::propagateToFirstLayer( const std::vector<int>& layerIDs, EVENT::TrackerHit* hit, IMPL::TrackStateImpl& ts, double& chi2, int& ndf, int& layerID, int& detElementID, int mode ) {
+
+    if( hit == 0 ) return bad_intputs ;
+
+    return propagateToFirst( *this, layerIDs, hit, ts, chi2, ndf, layerID, detElementID, mode ) ;
+  }
+
+  namespace {
+
+    /** extrapolate the LCIO track state from surface to surface, either from the last site or from the site of the given hit */
+    int extrapolateToSurfaces( IMarlinTrack& trk, const std::vector<double>& positions, bool zPlanes, EVENT::TrackerHit* hit,
+                               std::vector<IMPL::TrackStateImpl>& states, std::vector<int>& status, int mode ) {
+
+      states.assign( positions.size(), IMPL::TrackStateImpl() ) ;
+      status.assign( positions.size(), IMarlinTrack::no_intersection ) ;
+
+      IMPL::TrackStateImpl ts ;
+      double chi2 = 0. ;
+      int ndf = 0 ;
+
+      const int error_code = ( hit ? trk.getTrackState( hit, ts, chi2, ndf ) : trk.getTrackState( ts, chi2, ndf ) ) ;
+
+      if( error_code != IMarlinTrack::success ) {
+        status.assign( positions.size(), error_code ) ;
+        return error_code ;
+      }
+
+      IMarlinTrkSystem* trkSystem = trk.getTrkSystem() ;
+      const bool withCovariance = ! ( trkSystem && trkSystem->getOption( IMarlinTrkSystem::CFG::useParametersOnly ) ) ;
+
+      int return_code = IMarlinTrack::success ;
+
+      for( unsigned i = 0 ; i < positions.size() ; ++i ) {
+
+        IMPL::TrackStateImpl next( ts ) ;
+
+        int rc = 1 ;
+
+        if( zPlanes ) {
+
+          // the plane is crossed once - check the direction, as PropagateLCIOToZPlane does not
+          const double tanL = next.getTanLambda() ;
+          const double s = ( tanL != 0. ? ( positions[i] - next.getReferencePoint()[2] - next.getZ0() ) / tanL : 0. ) ;
+
+          if( tanL != 0. && !( mode == IMarlinTrack::modeForward && s < 0. ) && !( mode == IMarlinTrack::modeBackward && s > 0. ) ) {
+            rc = LCIOTrackPropagators::PropagateLCIOToZPlane( next, positions[i], withCovariance ) ;
+          }
+        }
+        else {
+
+          rc = LCIOTrackPropagators::PropagateLCIOToCylinder( next, positions[i], 0., 0., mode, 1.0e-8, withCovariance ) ;
+        }
+
+        if( rc == 0 ) {
+
+          states[i] = next ;
+          status[i] = IMarlinTrack::success ;
+          ts = next ;
+        }
+        else if( return_code == IMarlinTrack::success ) {
+
+          return_code = IMarlinTrack::no_intersection ;
+        }
+      }
+
+      return return_code ;
+    }
+  }
+
+  int IMarlinTrack::extrapolateToCylinders( const std::vector<double>& radii, std::vector<IMPL::TrackStateImpl>& states, std::vector<int>& status, int mode ) {
+    return extrapolateToSurfaces( *this, radii, false, 0, states, status, mode ) ;
+  }
+
+  int IMarlinTrack::extrapolateToCylinders( const std::vector<double>& radii, EVENT::TrackerHit* hit, std::vector<IMPL::TrackStateImpl>& states, std::vector<int>& status, int mode ) {
+
+    if( hit == 0 ) return bad_intputs ;
+
+    return extrapolateToSurfaces( *this, radii, false, hit, states, status, mode ) ;
+  }
+
+  int IMarlinTrack::extrapolateToZPlanes( const std::vector<double>& zPositions, std::vector<IMPL::TrackStateImpl>& states, std::vector<int>& status, int mode ) {
+    return extrapolateToSurfaces( *this, zPositions, true, 0, states, status, mode ) ;
+  }
+
+  int IMarlinTrack::extrapolateToZPlanes( const std::vector<double>& zPositions, EVENT::TrackerHit* hit, std::vector<IMPL::TrackStateImpl>& states, std::vector<int>& status, int mode ) {
+
+    if( hit == 0 ) return bad_intputs ;
+
+    return extrapolateToSurfaces( *this, zPositions, true, hit, states, status, mode ) ;
+  }
+
   std::string IMarlinTrack::toString() {
     
     std::stringstream str ;
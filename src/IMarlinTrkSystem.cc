@@ -25,6 +25,12 @@ namespace MarlinTrk{
     _cfg.registerOption( IMarlinTrkSystem::CFG::useQMS,  "useMultipleScattering", true) ;
     _cfg.registerOption( IMarlinTrkSystem::CFG::usedEdx, "useEnergyLoss", true) ;
     _cfg.registerOption( IMarlinTrkSystem::CFG::useSmoothing, "useSmoothingInFit", false) ;
+    _cfg.registerOption( IMarlinTrkSystem::CFG::useCompactSites, "useCompactSiteStorage", false) ;
+    _cfg.registerOption( IMarlinTrkSystem::CFG::useFitResultCache, "useFitResultCache", false) ;
+    _cfg.registerOption( IMarlinTrkSystem::CFG::useHitSorting, "useHitSorting", false) ;
+    _cfg.registerOption( IMarlinTrkSystem::CFG::useStraightLine, "useStraightLineModel", false) ;
+    _cfg.registerOption( IMarlinTrkSystem::CFG::useParametersOnly, "useParametersOnlyPropagation", false) ;
+    _cfg.registerOption( IMarlinTrkSystem::CFG::useWeightedPrefit, "useWeightedPrefit", false) ;
     
     
   }
@@ -1,489 +1,667 @@
 
 #include "MarlinTrk/LCIOTrackPropagators.h"
 
+#include <algorithm>
 #include <cmath>
 #include <iostream>
 
+#include "EVENT/TrackState.h"
 #include "IMPL/TrackStateImpl.h"
 
-#include "CLHEP/Matrix/Matrix.h"
-#include "CLHEP/Matrix/SymMatrix.h"
-#include "CLHEP/Vector/TwoVector.h"
+#include "MarlinTrk/FastKFKernels.h"
 
 #include "streamlog/streamlog.h"
 
 
 namespace LCIOTrackPropagators{
-  
-  int PropagateLCIOToNewRef( IMPL::TrackStateImpl& ts, double xref, double yref, double zref ) {
-    
-    //    std::cout << "PropagateLCIOToNewRef: x:y:z = " << xref << " : " << yref << " : " << zref << std::endl ;
-    
-    // Convert Parameters
-    
-    const double d0    = ts.getD0() ;
-    const double phi0  = ts.getPhi() ;
-    const double omega = ts.getOmega() ;
-    const double z0    = ts.getZ0() ;
-    const double tanL  = ts.getTanLambda() ;
-    
-    //   const double charge = omega/fabs(omega) ;
-    const float* ref = ts.getReferencePoint() ;  
-    
-    const double radius = 1.0/omega ; 
-    
-    const double sinPhi0 = sin(phi0) ;
-    const double cosPhi0 = cos(phi0) ;
-    
-    const double deltaX = xref - ref[0] ;
-    const double deltaY = yref - ref[1] ;
-    
-    double phi0Prime = atan2( sinPhi0 - (deltaX/(radius-d0)) , cosPhi0 + (deltaY/(radius-d0)) ) ;
-    
-    while ( phi0Prime < 0 )  phi0Prime += 2.0*M_PI ;
-    while ( phi0Prime >= 2.0*M_PI ) phi0Prime -= 2.0*M_PI ;
-    
-    const double d0Prime = d0 + deltaX*sinPhi0 - deltaY*cosPhi0 + ( ( deltaX*cosPhi0 + deltaY*sinPhi0 ) * tan( (phi0Prime-phi0) / 2.0) ) ;
-    
-    // In order to have terms which behave well as Omega->0 we make use of deltaX and deltaY to replace sin( phi0Prime - phi0 ) and cos( phi0Prime - phi0 )
-    
-    const double sinDeltaPhi = ( -omega / ( 1.0 - ( omega * d0Prime ) ) ) * ( deltaX * cosPhi0 + deltaY * sinPhi0 ) ;
-    
-    const double cosDeltaPhi  = 1.0 + ( omega*omega / ( 2.0 * ( 1.0 - omega * d0Prime ) ) ) * ( d0Prime*d0Prime - ( deltaX + d0 * sinPhi0 )*( deltaX + d0 * sinPhi0 ) - ( deltaY - d0 * cosPhi0 )*( deltaY - d0 * cosPhi0 ) ) ;
-    
-    const double s = atan2(-sinDeltaPhi,cosDeltaPhi) / omega ;
-    
-    const double z0Prime  = ref[2] - zref + z0 + tanL * s ;
-    
-    
-    // Convert Covariance Matrix
-    CLHEP::HepSymMatrix cov0(5) ; 
-    
-    int icov = 0 ;
-    
-    for(int irow=0; irow<5; ++irow ){
-      for(int jcol=0; jcol<irow+1; ++jcol){
-        //      std::cout << "row = " << irow << " col = " << jcol << std::endl ;
-        //      std::cout << "cov["<< icov << "] = " << _cov[icov] << std::endl ;
-        cov0[irow][jcol] = ts.getCovMatrix()[icov] ;
-        ++icov ;
+
+  using namespace MarlinTrk ;
+
+  namespace {
+
+    // Fixed size kernels used by the single track state and the batch propagators - everything is on the stack
+
+    /** move the state to the new reference point, transporting the covariance matrix if withCovariance is true
+     *  and setting it to zero otherwise. The transformation of the parameters and its Jacobian are the ones of MarlinFastKF.
+     */
+    inline void toNewRef( FastKF::State& st, const double* ref, bool withCovariance ) {
+
+      if( withCovariance ) {
+
+        FastKF::transport( st, ref ) ;
       }
+      else {
+
+        FastKF::moveReferencePoint( st, ref, 0 ) ;
+        st.cov.fill( 0. ) ;
+      }
+    }
+
+    /** arc length of the point on the circle of the helix, measured from the pca in the range given by atan2 */
+    inline double arcTo( const FastKF::State& st, const double* pca, double x, double y ) {
+
+      const double omega = st.par[FastKF::iOmega] ;
+
+      const double sinPhi0 = std::sin( st.par[FastKF::iPhi] ) ;
+      const double cosPhi0 = std::cos( st.par[FastKF::iPhi] ) ;
+
+      const double dx = x - pca[0] ;
+      const double dy = y - pca[1] ;
+
+      const double sinDeltaPhi =     - omega*dx*cosPhi0 - omega*dy*sinPhi0 ;
+      const double cosDeltaPhi = 1.0 - omega*dx*sinPhi0 + omega*dy*cosPhi0 ;
+
+      return std::atan2( -sinDeltaPhi, cosDeltaPhi ) / omega ;
     }
-    
-    CLHEP::HepMatrix propagatorMatrix(5, 5, 0) ;
-    
-    // LC_0 = { d0, phi0, omega, z0, tanLambda }
-    
-    // d d0' / d LC_0
-    propagatorMatrix(1,1) = cosDeltaPhi ;
-    propagatorMatrix(1,2) = -( radius - d0 ) * sinDeltaPhi ;
-    propagatorMatrix(1,3) = radius*radius * ( cosDeltaPhi -1 ) ;
-    
-    // d phi0' / d LC_0 
-    propagatorMatrix(2,1) = sinDeltaPhi / ( radius - d0Prime ) ;
-    propagatorMatrix(2,2) = ( ( radius - d0 ) * cosDeltaPhi ) / ( radius - d0Prime ) ;
-    propagatorMatrix(2,3) = radius*radius * sinDeltaPhi / ( radius - d0Prime ) ;
-    
-    // d omega' / d LC_0 
-    propagatorMatrix(3,3) = 1.0 ;
-    
-    // d z0' / d LC_0 
-    propagatorMatrix(4,1) = radius * tanL * sinDeltaPhi / ( d0Prime + radius ) ;
-    propagatorMatrix(4,2) = radius * tanL * ( 1.0 - ( ( d0 + radius ) * cosDeltaPhi / ( d0Prime + radius ) ) ) ;
-    propagatorMatrix(4,3) = radius*radius * tanL * ( (phi0Prime - phi0) - radius * sinDeltaPhi / ( d0Prime + radius ) ) ;
-    propagatorMatrix(4,4) = 1.0 ;
-    propagatorMatrix(4,5) = s ;
-    
-    // d tanLambda' / d LC_0 
-    propagatorMatrix(5,5) = 1.0 ;
-    
-    
-    CLHEP::HepSymMatrix covPrime =  cov0.similarity(propagatorMatrix);
-    
-    EVENT::FloatVec cov( 15 )  ; 
-    
-    icov = 0 ;
-    
-    for(int irow=0; irow<5; ++irow ){
-      for(int jcol=0; jcol<irow+1; ++jcol){
-        //      std::cout << "row = " << irow << " col = " << jcol << std::endl ;
-        cov[icov] = covPrime[irow][jcol] ;
-        //      std::cout << "lcCov["<< icov << "] = " << lcCov[icov] << std::endl ;
-        ++icov ;
+
+    /** choose between the two crossings with arc lengths s1 and s2 in the given direction and fill the crossing point into x */
+    inline void chooseCrossing( const FastKF::State& st, const double* pca, double s1, double x1, double y1, double s2, double x2, double y2,
+                                int direction, double* x ) {
+
+      if( direction != 0 ) {
+
+        const double turn = 2.0*M_PI / std::fabs( st.par[FastKF::iOmega] ) ;
+
+        if( s1 < 0.0 ) s1 += turn ;
+        if( s2 < 0.0 ) s2 += turn ;
       }
+
+      // closest crossing for direction == 0, smallest s for direction == 1 and largest s for direction == -1
+      const bool first = ( direction == 0 ? std::fabs( s1 ) < std::fabs( s2 ) : ( direction == 1 ? s1 < s2 : s1 > s2 ) ) ;
+
+      x[0] = ( first ? x1 : x2 ) ;
+      x[1] = ( first ? y1 : y2 ) ;
+      x[2] = pca[2] + ( first ? s1 : s2 ) * st.par[FastKF::iTanL] ;
     }
-    
-    while ( phi0Prime < -M_PI  ) phi0Prime += 2.0*M_PI ;
-    while ( phi0Prime >= M_PI )  phi0Prime -= 2.0*M_PI ;
-    
-    ts.setD0( d0Prime ) ;  
-    ts.setPhi( phi0Prime  ) ; 
-    ts.setOmega( omega ) ;
-    ts.setZ0( z0Prime ) ;  
-    ts.setTanLambda( tanL ) ;  
-    
-    
-    float refPointPrime[3] ;
-    refPointPrime[0] = xref ;
-    refPointPrime[1] = yref ;
-    refPointPrime[2] = zref ;
-    
-    ts.setReferencePoint(refPointPrime) ;
-    
-    ts.setCovMatrix( cov ) ;
-    
-    return 0 ;
-    
-    
-  }
-  
-  // Propagate track to a new reference point taken as its crossing point with a cylinder of infinite length centered at x0,y0, parallel to the z axis. 
-  // For direction== 0  the closest crossing point will be taken
-  // For direction== 1  the first crossing traversing in positive s will be taken
-  // For direction==-1  the first crossing traversing in negative s will be taken
-  
-  int PropagateLCIOToCylinder( IMPL::TrackStateImpl& ts, float r0, float x0, float y0, int direction, double epsilon){
-    
-    // taken from http://paulbourke.net/geometry/2circle/tvoght.c
-    
-    //    std::cout << "PropagateLCIOToCylinder: r = " << r0 << " x0:y0 = " << x0 << " : " << y0 << " direction = " << direction << std::endl ;
-    
-    
-    const double x_ref = ts.getReferencePoint()[0] ; 
-    const double y_ref = ts.getReferencePoint()[1] ; 
-    const double z_ref = ts.getReferencePoint()[2] ; 
-    
-    const double d0    = ts.getD0() ;
-    const double z0    = ts.getZ0() ;
-    const double phi0  = ts.getPhi() ;
-    const double tanl  = ts.getTanLambda() ;
-    const double omega = ts.getOmega() ;
-    
-    const double rho   = 1.0 / omega ;
-    const double x_pca = x_ref - d0 * sin(phi0) ; 
-    const double y_pca = y_ref + d0 * cos(phi0) ; 
-    const double z_pca = z_ref + z0 ;
-    
-    const double sin_phi0 = sin(phi0); 
-    const double cos_phi0 = cos(phi0); 
-    
-    const double x_c   = x_ref + ( rho - d0) * sin_phi0 ;
-    const double y_c   = y_ref - ( rho - d0) * cos_phi0 ;
-    
-    const double r1 = fabs(rho) ;
-    
-    /* dx and dy are the vertical and horizontal distances between
-     * the circle centers.
+
+    /** crossing point with a cylinder of infinite length centered at x0,y0, parallel to the z axis -
+     *  returns 1 if the circles do not intersect, 2 if one is contained in the other and 3 for a common centre
      */
-    const double dx = x_c - x0;
-    const double dy = y_c - y0;
-    
-    /* Determine the straight-line distance between the centers. */
-    const double  d = hypot(dx,dy); 
-    
-    /* Check for solvability. */
-    if (d > (r0 + r1))
-      {
-      /* no solution. circles do not intersect. */
-      return 1;
-      }
-    if (d < fabs(r0 - r1))
-      {
-      /* no solution. one circle is contained in the other */
-      return 2;
-      }
-    if (d < epsilon)
-      {
-      /* no solution. circles have common centre */
-      return 3;
-      }
-    
-    /* 'point 2' is the point where the line through the circle
-     * intersection points crosses the line between the circle
-     * centers.  
+    inline int cylinderCrossing( const FastKF::State& st, double r0, double x0, double y0, int direction, double epsilon, double* x ) {
+
+      // taken from http://paulbourke.net/geometry/2circle/tvoght.c
+
+      const double rho = 1.0 / st.par[FastKF::iOmega] ;
+
+      double pca[3] ;
+      FastKF::pca( st, pca ) ;
+
+      const double x_c = pca[0] + rho * std::sin( st.par[FastKF::iPhi] ) ;
+      const double y_c = pca[1] - rho * std::cos( st.par[FastKF::iPhi] ) ;
+
+      const double r1 = std::fabs( rho ) ;
+
+      /* dx and dy are the vertical and horizontal distances between the circle centers. */
+      const double dx = x_c - x0 ;
+      const double dy = y_c - y0 ;
+
+      /* Determine the straight-line distance between the centers. */
+      const double d = std::hypot( dx, dy ) ;
+
+      /* Check for solvability. */
+      if( d > ( r0 + r1 ) )          return 1 ;  // circles do not intersect
+      if( d < std::fabs( r0 - r1 ) ) return 2 ;  // one circle is contained in the other
+      if( d < epsilon )              return 3 ;  // circles have common centre
+
+      /* 'point 2' is the point where the line through the circle intersection points crosses the line between the circle centers. */
+      const double a = ( (r0*r0) - (r1*r1) + (d*d) ) / ( 2.0 * d ) ;
+
+      const double x2 = x0 + ( dx * a/d ) ;
+      const double y2 = y0 + ( dy * a/d ) ;
+
+      /* Determine the distance from point 2 to either of the intersection points. */
+      const double h = std::sqrt( (r0*r0) - (a*a) ) ;
+
+      const double rx = -dy * ( h/d ) ;
+      const double ry =  dx * ( h/d ) ;
+
+      const double x_ins1 = x2 + rx ;
+      const double y_ins1 = y2 + ry ;
+
+      const double x_ins2 = x2 - rx ;
+      const double y_ins2 = y2 - ry ;
+
+      chooseCrossing( st, pca, arcTo( st, pca, x_ins1, y_ins1 ), x_ins1, y_ins1, arcTo( st, pca, x_ins2, y_ins2 ), x_ins2, y_ins2, direction, x ) ;
+
+      return 0 ;
+    }
+
+    /** crossing point with an infinite plane located at z, perpendicular to the z axis - returns 1 if the helix is parallel to the plane */
+    inline int zPlaneCrossing( const FastKF::State& st, double z, double* x ) {
+
+      if( st.par[FastKF::iTanL] == 0. ) return 1 ;
+
+      double pca[3] ;
+      FastKF::pca( st, pca ) ;
+
+      // get path length to crossing point
+      const double s = ( z - pca[2] ) / st.par[FastKF::iTanL] ;
+
+      FastKF::positionAt( st, s, x ) ;
+
+      x[2] = z ;
+
+      return 0 ;
+    }
+
+    /** crossing point with a plane parallel to the z axis, containing points x1,y1 and x2,y2 -
+     *  returns 1 if there is no intersection and 2 if the circle touches the plane
      */
-    
-    /* Determine the distance from point 0 to point 2. */
-    const double a = ((r0*r0) - (r1*r1) + (d*d)) / (2.0 * d) ;
-    
-    /* Determine the coordinates of point 2. */
-    const double x2 = x0 + (dx * a/d);
-    const double y2 = y0 + (dy * a/d);
-    
-    /* Determine the distance from point 2 to either of the
-     * intersection points.
+    inline int planeParallelToZCrossing( const FastKF::State& st, double x1, double y1, double x2, double y2, int direction, double epsilon, double* x ) {
+
+      // taken from http://paulbourke.net/geometry/sphereline/raysphere.c
+
+      const double rho = 1.0 / st.par[FastKF::iOmega] ;
+
+      double pca[3] ;
+      FastKF::pca( st, pca ) ;
+
+      const double x_c = pca[0] + rho * std::sin( st.par[FastKF::iPhi] ) ;
+      const double y_c = pca[1] - rho * std::cos( st.par[FastKF::iPhi] ) ;
+
+      const double dx = x2 - x1 ;
+      const double dy = y2 - y1 ;
+
+      const double a = dx * dx + dy * dy ;
+
+      const double b = 2.0 * ( dx * (x1 - x_c) + dy * (y1 - y_c) ) ;
+
+      const double c = x_c * x_c + y_c * y_c + x1 * x1 + y1 * y1 - 2.0 * ( x_c * x1 + y_c * y1 ) - rho * rho ;
+
+      const double bb4ac = b * b - 4.0 * a * c ;
+
+      /* Check for solvability. */
+      if( bb4ac + epsilon < 0.0 ) return 1 ;  // no intersection
+      if( bb4ac - epsilon < 0.0 ) return 2 ;  // circle intersects at one point, tangential
+
+      const double u1 = ( -b + std::sqrt( bb4ac ) ) / ( 2.0 * a ) ;
+      const double u2 = ( -b - std::sqrt( bb4ac ) ) / ( 2.0 * a ) ;
+
+      const double x_ins1 = x1 + u1 * dx ;
+      const double y_ins1 = y1 + u1 * dy ;
+
+      const double x_ins2 = x1 + u2 * dx ;
+      const double y_ins2 = y1 + u2 * dy ;
+
+      chooseCrossing( st, pca, arcTo( st, pca, x_ins1, y_ins1 ), x_ins1, y_ins1, arcTo( st, pca, x_ins2, y_ins2 ), x_ins2, y_ins2, direction, x ) ;
+
+      return 0 ;
+    }
+
+
+    void fromLCIO( const EVENT::TrackState& ts, FastKF::State& st ) {
+
+      st.par[FastKF::iD0]    = ts.getD0() ;
+      st.par[FastKF::iPhi]   = ts.getPhi() ;
+      st.par[FastKF::iOmega] = ts.getOmega() ;
+      st.par[FastKF::iZ0]    = ts.getZ0() ;
+      st.par[FastKF::iTanL]  = ts.getTanLambda() ;
+
+      const float* ref = ts.getReferencePoint() ;
+
+      st.ref[0] = ref[0] ;
+      st.ref[1] = ref[1] ;
+      st.ref[2] = ref[2] ;
+
+      const EVENT::FloatVec& cov = ts.getCovMatrix() ;
+
+      for( unsigned i = 0 ; i < 15 ; ++i ) st.cov[i] = ( i < cov.size() ? cov[i] : 0. ) ;
+    }
+
+    void toLCIO( const FastKF::State& st, IMPL::TrackStateImpl& ts ) {
+
+      ts.setD0( st.par[FastKF::iD0] ) ;
+      ts.setPhi( FastKF::toBaseRange( st.par[FastKF::iPhi] ) ) ;
+      ts.setOmega( st.par[FastKF::iOmega] ) ;
+      ts.setZ0( st.par[FastKF::iZ0] ) ;
+      ts.setTanLambda( st.par[FastKF::iTanL] ) ;
+
+      const float ref[3] = { float( st.ref[0] ), float( st.ref[1] ), float( st.ref[2] ) } ;
+
+      ts.setReferencePoint( ref ) ;
+
+      EVENT::FloatVec cov( 15 ) ;
+
+      for( unsigned i = 0 ; i < 15 ; ++i ) cov[i] = st.cov[i] ;
+
+      ts.setCovMatrix( cov ) ;
+    }
+
+
+    inline void load( const TrackStateBatch& batch, unsigned i, FastKF::State& st ) {
+
+      st.par[FastKF::iD0]    = batch.d0[i] ;
+      st.par[FastKF::iPhi]   = batch.phi[i] ;
+      st.par[FastKF::iOmega] = batch.omega[i] ;
+      st.par[FastKF::iZ0]    = batch.z0[i] ;
+      st.par[FastKF::iTanL]  = batch.tanLambda[i] ;
+
+      st.ref[0] = batch.refX[i] ;
+      st.ref[1] = batch.refY[i] ;
+      st.ref[2] = batch.refZ[i] ;
+
+      for( unsigned k = 0 ; k < 15 ; ++k ) st.cov[k] = batch.cov[k][i] ;
+    }
+
+    inline void store( const FastKF::State& st, TrackStateBatch& batch, unsigned i ) {
+
+      batch.d0[i]        = st.par[FastKF::iD0] ;
+      batch.phi[i]       = FastKF::toBaseRange( st.par[FastKF::iPhi] ) ;
+      batch.omega[i]     = st.par[FastKF::iOmega] ;
+      batch.z0[i]        = st.par[FastKF::iZ0] ;
+      batch.tanLambda[i] = st.par[FastKF::iTanL] ;
+
+      batch.refX[i] = st.ref[0] ;
+      batch.refY[i] = st.ref[1] ;
+      batch.refZ[i] = st.ref[2] ;
+
+      for( unsigned k = 0 ; k < 15 ; ++k ) batch.cov[k][i] = st.cov[k] ;
+    }
+
+    /** number of track states propagated together by propagateBatch() */
+    const unsigned blockSize = 64 ;
+
+    /** a block of track states of the batch in structure of arrays layout on the stack - unlike the vectors of the batch
+     *  the arrays cannot alias each other, such that the loops over the track states of a block can be vectorised
      */
-    const double h = sqrt((r0*r0) - (a*a));
-    
-    /* Now determine the offsets of the intersection points from
-     * point 2.
+    struct Block {
+      double par[5][blockSize] ;
+      double ref[3][blockSize] ;
+      double cov[15][blockSize] ;
+      /** new reference point */
+      double x[3][blockSize] ;
+      double sinPhi0[blockSize], cosPhi0[blockSize] ;
+      double phi0New[blockSize], dPhi[blockSize], sinDPhi[blockSize], cosDPhi[blockSize] ;
+      /** the square root in the new d0 */
+      double sqrt1X[blockSize] ;
+      /** dphi/sin(dphi), 1/omega and (dphi-sin(dphi))/dphi^2 - finite also where the formulas are not used */
+      double dPhiOverSin[blockSize], invOmega[blockSize], g[blockSize] ;
+      /** 1. where the arc length is computed from sin(dphi), else 0. */
+      double near[blockSize] ;
+      /** 1. for a helix, 0. for a straight line */
+      double helix[blockSize] ;
+    } ;
+
+    /** the arguments of atan2() for the azimuthal angle at the new reference point and of the square root in the new d0,
+     *  see FastKF::moveReferencePoint()
      */
-    const double rx = -dy * (h/d);
-    const double ry =  dx * (h/d);
-    
-    /* Determine the absolute intersection points. */
-    const double x_ins1 = x2 + rx;
-    const double y_ins1 = y2 + ry;
-    
-    const double x_ins2 = x2 - rx;
-    const double y_ins2 = y2 - ry;
-    
-    //    std::cout << "PropagateLCIOToCylinder: 1st solution x:y = " << x_ins1 << " : " << y_ins1 << std::endl ;
-    //    std::cout << "PropagateLCIOToCylinder: 2nd solution x:y = " << x_ins2 << " : " << y_ins2 << std::endl ;
-    
-    // now calculate the path lengths 
-    double s_1 = 0.0 ;
-    double s_2 = 0.0 ;
-    
-    const double delta_x1 = x_ins1 - x_pca ;
-    const double delta_y1 = y_ins1 - y_pca ;
-    
-    const double sin_delta_phi1 =     - omega*delta_x1*cos_phi0 - omega*delta_y1*sin_phi0 ;
-    const double cos_delta_phi1 = 1.0 - omega*delta_x1*sin_phi0 + omega*delta_y1*cos_phi0 ;
-    
-    s_1 = atan2(-sin_delta_phi1,cos_delta_phi1) / omega ;
-    
-    
-    const double delta_x2 = x_ins2 - x_pca ;
-    const double delta_y2 = y_ins2 - y_pca ;
-    
-    const double sin_delta_phi2 =     - omega*delta_x2*cos_phi0 - omega*delta_y2*sin_phi0 ;
-    const double cos_delta_phi2 = 1.0 - omega*delta_x2*sin_phi0 + omega*delta_y2*cos_phi0 ;
-    
-    s_2 = atan2(-sin_delta_phi2,cos_delta_phi2) / omega ;
-    
-    double x=0, y=0, z=0 ;
-    
-    if( direction == 0 ) { // take closest intersection
-      if( fabs(s_1) < fabs(s_2) ) {
-        //      std::cout << "PropagateLCIOToCylinder: use 1st solution" << std::endl ;
-        x = x_ins1 ;
-        y = y_ins1 ;
-        z = z_pca + s_1 * tanl ;
-      }
-      else {
-        //      std::cout << "PropagateLCIOToCylinder: use 2nd solution" << std::endl ;
-        x = x_ins2 ;
-        y = y_ins2 ;
-        z = z_pca + s_2 * tanl ;          
+    inline void moveArguments( const Block& b, unsigned i, double& sinPhi, double& cosPhi, double& X ) {
+
+      const double omega = b.par[FastKF::iOmega][i] ;
+
+      const double dx = b.x[0][i] - b.ref[0][i] ;
+      const double dy = b.x[1][i] - b.ref[1][i] ;
+
+      const double sinPhi0 = b.sinPhi0[i] ;
+      const double cosPhi0 = b.cosPhi0[i] ;
+
+      const double w = dx * sinPhi0 - dy * cosPhi0 ;
+
+      const double f = 1. - omega * b.par[FastKF::iD0][i] ;
+      const double sf = ( f < 0. ? -1. : 1. ) ;
+
+      sinPhi = sf * ( f * sinPhi0 - omega * dx ) ;
+      cosPhi = sf * ( f * cosPhi0 + omega * dy ) ;
+
+      X = omega * ( omega * ( dx * dx + dy * dy ) - 2. * w * f ) / ( f * f ) ;
+    }
+
+    /** FastKF::transport(), or FastKF::moveReferencePoint() without the covariance matrix, of the first m track states of the
+     *  block to their new reference points, given the functions of dphi computed by propagateBatch(). The loop has neither
+     *  branches nor selects: the cases of FastKF::moveReferencePoint() are blended with the weights near and helix of the block.
+     *  For omega == 0 the helix formulas give the straight line, only the Jacobian w.r.t. omega is taken from
+     *  FastKF::moveLineReferencePoint().
+     */
+    template <bool withCovariance>
+    inline void moveToNewRef( Block& b, unsigned m ) {
+
+      for( unsigned i = 0 ; i < m ; ++i ) {
+
+        const double d0    = b.par[FastKF::iD0][i] ;
+        const double omega = b.par[FastKF::iOmega][i] ;
+        const double tanL  = b.par[FastKF::iTanL][i] ;
+
+        const double dx = b.x[0][i] - b.ref[0][i] ;
+        const double dy = b.x[1][i] - b.ref[1][i] ;
+
+        const double q = dx * b.cosPhi0[i] + dy * b.sinPhi0[i] ;
+        const double w = dx * b.sinPhi0[i] - dy * b.cosPhi0[i] ;
+
+        const double f = 1. - omega * d0 ;
+
+        const double d0New = d0 - ( omega * ( dx * dx + dy * dy ) - 2. * w * f ) / ( f * ( 1. + b.sqrt1X[i] ) ) ;
+
+        const double e = 1. - omega * d0New ;
+
+        const double sinDPhi = b.sinDPhi[i] ;
+        const double cosDPhi = b.cosDPhi[i] ;
+        const double dPhi = b.dPhi[i] ;
+
+        // arc length from the old to the new pca, stable for omega -> 0
+        const double near = b.near[i] ;
+        const double s = near * ( q / e ) * b.dPhiOverSin[i] - ( 1. - near ) * dPhi * b.invOmega[i] ;
+
+        if( withCovariance ) {
+
+          const double helix = b.helix[i] ;
+
+          // sin(dphi)/omega and (1-cos(dphi))/omega
+          const double sinOverOmega = -q / e ;
+          const double oneMinusCosOverOmega = sinDPhi * sinOverOmega / ( 1. + cosDPhi ) ;
+
+          // (dphi - sin(dphi)) / omega^2 = s^2 * (dphi - sin(dphi)) / dphi^2
+          const double g = b.g[i] ;
+
+          // the Jacobian differs from the identity in the rows of d0, phi0 and z0 only
+          const double j00 = cosDPhi ;
+          const double j01 = -f * sinOverOmega ;
+          const double j02 = -helix * sinOverOmega * sinOverOmega / ( 1. + cosDPhi ) ;
+
+          const double j10 = omega * sinDPhi / e ;
+          const double j11 = f * cosDPhi / e ;
+          const double j12 = helix * sinOverOmega / e ;
+
+          const double j30 = -tanL * sinDPhi / e ;
+          const double j31 = tanL * ( d0 - d0New + f * oneMinusCosOverOmega ) / e ;
+          const double j32 = helix * tanL * ( s * s * g - sinOverOmega * d0New / e ) ;
+          const double j34 = s ;
+
+          // cov = J * cov * J^T, written out for this Jacobian
+          const double c00 = b.cov[0][i] ;
+          const double c10 = b.cov[1][i], c11 = b.cov[2][i] ;
+          const double c20 = b.cov[3][i], c21 = b.cov[4][i], c22 = b.cov[5][i] ;
+          const double c30 = b.cov[6][i], c31 = b.cov[7][i], c32 = b.cov[8][i], c33 = b.cov[9][i] ;
+          const double c40 = b.cov[10][i], c41 = b.cov[11][i], c42 = b.cov[12][i], c43 = b.cov[13][i], c44 = b.cov[14][i] ;
+
+          const double jc00 = j00 * c00 + j01 * c10 + j02 * c20 ;
+          const double jc01 = j00 * c10 + j01 * c11 + j02 * c21 ;
+          const double jc02 = j00 * c20 + j01 * c21 + j02 * c22 ;
+
+          const double jc10 = j10 * c00 + j11 * c10 + j12 * c20 ;
+          const double jc11 = j10 * c10 + j11 * c11 + j12 * c21 ;
+          const double jc12 = j10 * c20 + j11 * c21 + j12 * c22 ;
+
+          const double jc30 = j30 * c00 + j31 * c10 + j32 * c20 + c30 + j34 * c40 ;
+          const double jc31 = j30 * c10 + j31 * c11 + j32 * c21 + c31 + j34 * c41 ;
+          const double jc32 = j30 * c20 + j31 * c21 + j32 * c22 + c32 + j34 * c42 ;
+          const double jc33 = j30 * c30 + j31 * c31 + j32 * c32 + c33 + j34 * c43 ;
+          const double jc34 = j30 * c40 + j31 * c41 + j32 * c42 + c43 + j34 * c44 ;
+
+          b.cov[0][i]  = jc00 * j00 + jc01 * j01 + jc02 * j02 ;
+          b.cov[1][i]  = jc10 * j00 + jc11 * j01 + jc12 * j02 ;
+          b.cov[2][i]  = jc10 * j10 + jc11 * j11 + jc12 * j12 ;
+          b.cov[3][i]  = c20 * j00 + c21 * j01 + c22 * j02 ;
+          b.cov[4][i]  = c20 * j10 + c21 * j11 + c22 * j12 ;
+          b.cov[6][i]  = jc30 * j00 + jc31 * j01 + jc32 * j02 ;
+          b.cov[7][i]  = jc30 * j10 + jc31 * j11 + jc32 * j12 ;
+          b.cov[8][i]  = jc32 ;
+          b.cov[9][i]  = jc30 * j30 + jc31 * j31 + jc32 * j32 + jc33 + jc34 * j34 ;
+          b.cov[10][i] = c40 * j00 + c41 * j01 + c42 * j02 ;
+          b.cov[11][i] = c40 * j10 + c41 * j11 + c42 * j12 ;
+          b.cov[13][i] = c40 * j30 + c41 * j31 + c42 * j32 + c43 + c44 * j34 ;
+        }
+
+        b.par[FastKF::iZ0][i] = b.ref[2][i] + b.par[FastKF::iZ0][i] + tanL * s - b.x[2][i] ;
+        b.par[FastKF::iD0][i] = d0New ;
+        b.par[FastKF::iPhi][i] = b.phi0New[i] ;
+
+        b.ref[0][i] = b.x[0][i] ;
+        b.ref[1][i] = b.x[1][i] ;
+        b.ref[2][i] = b.x[2][i] ;
       }
     }
-    
-    else {
-      
-      if ( s_1 < 0.0 ) s_1 +=  2.0*M_PI * r1 ;
-      if ( s_2 < 0.0 ) s_2 +=  2.0*M_PI * r1 ;
-      
-      if( direction == 1 ){ // take the intersection with smallest s
-        if( s_1 < s_2 ) {
-          x = x_ins1 ;
-          y = y_ins1 ;
-          z = z_pca + s_1 * tanl ;
+
+    /** propagate all track states of the batch to the crossing points given by the crossing kernel, in blocks of blockSize
+     *  track states - returns the number of track states that could not be propagated.
+     *  The crossing points are found track by track. The calls to the math library of the move to them are done in separate
+     *  loops, the remaining arithmetic in moveToNewRef() has no branches and can be vectorised: the track states that cannot
+     *  be propagated are moved to their own reference point and not stored.
+     */
+    template <class Crossing>
+    int propagateBatch( TrackStateBatch& batch, bool withCovariance, Crossing crossing ) {
+
+      const unsigned n = batch.size() ;
+
+      batch.status.resize( n ) ;
+
+      int failed = 0 ;
+
+      Block b ;
+
+      for( unsigned begin = 0 ; begin < n ; begin += blockSize ) {
+
+        const unsigned m = std::min( blockSize, n - begin ) ;
+
+        // load the block and find the crossing points
+        for( unsigned i = 0 ; i < m ; ++i ) {
+
+          FastKF::State st ;
+          load( batch, begin + i, st ) ;
+
+          for( unsigned k = 0 ; k < 5 ; ++k ) b.par[k][i] = st.par[k] ;
+          for( unsigned k = 0 ; k < 3 ; ++k ) b.ref[k][i] = st.ref[k] ;
+          for( unsigned k = 0 ; k < 15 ; ++k ) b.cov[k][i] = st.cov[k] ;
+
+          double x[3] ;
+
+          const int rc = crossing( st, x ) ;
+
+          batch.status[ begin + i ] = rc ;
+
+          if( rc != 0 ) ++failed ;
+
+          for( unsigned k = 0 ; k < 3 ; ++k ) b.x[k][i] = ( rc == 0 ? x[k] : st.ref[k] ) ;
         }
-        else {
-          x = x_ins2 ;
-          y = y_ins2 ;
-          z = z_pca + s_2 * tanl ;        
+
+        // the functions of the math library and the cases of the move
+        for( unsigned i = 0 ; i < m ; ++i ) {
+          b.sinPhi0[i] = std::sin( b.par[FastKF::iPhi][i] ) ;
+          b.cosPhi0[i] = std::cos( b.par[FastKF::iPhi][i] ) ;
         }
-      } 
-      else if(direction == -1) {  // else take the intersection with largest s 
-        if( s_1 > s_2 ){
-          x = x_ins1 ;
-          y = y_ins1 ;
-          z = z_pca + s_1 * tanl ;
+
+        for( unsigned i = 0 ; i < m ; ++i ) {
+
+          double sinPhi, cosPhi, X ;
+          moveArguments( b, i, sinPhi, cosPhi, X ) ;
+
+          b.sqrt1X[i] = std::sqrt( 1. + X ) ;
+
+          b.phi0New[i] = std::atan2( sinPhi, cosPhi ) ;
+
+          const double dPhi = FastKF::toBaseRange( b.phi0New[i] - b.par[FastKF::iPhi][i] ) ;
+          const double sinDPhi = std::sin( dPhi ) ;
+          const double omega = b.par[FastKF::iOmega][i] ;
+
+          b.dPhi[i] = dPhi ;
+          b.sinDPhi[i] = sinDPhi ;
+          b.cosDPhi[i] = std::cos( dPhi ) ;
+
+          // the cases of FastKF::moveReferencePoint(), with finite values also for the unused case
+          b.dPhiOverSin[i] = ( std::fabs( sinDPhi ) > 1.e-15 ? dPhi / sinDPhi : 1. ) ;
+          b.g[i] = ( std::fabs( dPhi ) > 1.e-4 ? ( dPhi - sinDPhi ) / ( dPhi * dPhi ) : dPhi / 6. ) ;
+          b.near[i] = ( std::fabs( dPhi ) < 1. ? 1. : 0. ) ;
+          b.helix[i] = ( omega != 0. ? 1. : 0. ) ;
+          b.invOmega[i] = ( omega != 0. ? 1. / omega : 0. ) ;
         }
-        else{
-          x = x_ins2 ;
-          y = y_ins2 ;
-          z = z_pca + s_2 * tanl ;
+
+        // the arithmetic of the move
+        if( withCovariance ) {
+          moveToNewRef<true>( b, m ) ;
+        }
+        else {
+          moveToNewRef<false>( b, m ) ;
+          for( unsigned k = 0 ; k < 15 ; ++k ) std::fill( b.cov[k], b.cov[k] + m, 0. ) ;
+        }
+
+        // store the propagated track states
+        for( unsigned i = 0 ; i < m ; ++i ) {
+
+          if( batch.status[ begin + i ] != 0 ) continue ;
+
+          FastKF::State st ;
+
+          for( unsigned k = 0 ; k < 5 ; ++k ) st.par[k] = b.par[k][i] ;
+          for( unsigned k = 0 ; k < 3 ; ++k ) st.ref[k] = b.ref[k][i] ;
+          for( unsigned k = 0 ; k < 15 ; ++k ) st.cov[k] = b.cov[k][i] ;
+
+          store( st, batch, begin + i ) ;
         }
       }
+
+      return failed ;
     }
-    
-    
-    return PropagateLCIOToNewRef(ts,x,y,z);
-    
   }
-  
-  int PropagateLCIOToZPlane( IMPL::TrackStateImpl& ts, float z) {
-    
-    
-    const double x_ref = ts.getReferencePoint()[0] ; 
-    const double y_ref = ts.getReferencePoint()[1] ; 
-    const double z_ref = ts.getReferencePoint()[2] ; 
-    
-    const double d0    = ts.getD0() ;
-    const double z0    = ts.getZ0() ;
-    const double phi0  = ts.getPhi() ;
-    const double tanl  = ts.getTanLambda() ;
-    const double omega = ts.getOmega() ;
-    
-    const double x_pca = x_ref - d0 * sin(phi0) ; 
-    const double y_pca = y_ref + d0 * cos(phi0) ; 
-    const double z_pca = z_ref + z0 ;
-    
-    // get path length to crossing point 
-    const double s = ( z - z_pca ) / tanl;
-    
-    const double delta_phi_half = (omega*s)/2.0 ;
-    
-    const double x = x_pca + s * ( sin(delta_phi_half) / delta_phi_half ) *  cos( phi0 - delta_phi_half ) ;
-    const double y = y_pca + s * ( sin(delta_phi_half) / delta_phi_half ) *  sin( phi0 - delta_phi_half ) ;
-    
-    return PropagateLCIOToNewRef(ts,x,y,z);
-    
+
+
+  void TrackStateBatch::resize( unsigned n ) {
+
+    d0.resize( n ) ;
+    phi.resize( n ) ;
+    omega.resize( n ) ;
+    z0.resize( n ) ;
+    tanLambda.resize( n ) ;
+
+    refX.resize( n ) ;
+    refY.resize( n ) ;
+    refZ.resize( n ) ;
+
+    for( unsigned k = 0 ; k < 15 ; ++k ) cov[k].resize( n ) ;
+
+    status.resize( n ) ;
   }
-  
-  
-  
+
+  void TrackStateBatch::set( unsigned i, const EVENT::TrackState& ts ) {
+
+    FastKF::State st ;
+    fromLCIO( ts, st ) ;
+
+    store( st, *this, i ) ;
+
+    status[i] = 0 ;
+  }
+
+  void TrackStateBatch::get( unsigned i, IMPL::TrackStateImpl& ts ) const {
+
+    FastKF::State st ;
+    load( *this, i, st ) ;
+
+    toLCIO( st, ts ) ;
+  }
+
+
+  int PropagateLCIOToNewRef( IMPL::TrackStateImpl& ts, double xref, double yref, double zref, bool withCovariance ) {
+
+    FastKF::State st ;
+    fromLCIO( ts, st ) ;
+
+    const double ref[3] = { xref, yref, zref } ;
+
+    toNewRef( st, ref, withCovariance ) ;
+
+    toLCIO( st, ts ) ;
+
+    return 0 ;
+  }
+
+  // Propagate track to a new reference point taken as its crossing point with a cylinder of infinite length centered at x0,y0, parallel to the z axis.
+  // For direction== 0  the closest crossing point will be taken
+  // For direction== 1  the first crossing traversing in positive s will be taken
+  // For direction==-1  the first crossing traversing in negative s will be taken
+
+  int PropagateLCIOToCylinder( IMPL::TrackStateImpl& ts, float r0, float x0, float y0, int direction, double epsilon, bool withCovariance){
+
+    FastKF::State st ;
+    fromLCIO( ts, st ) ;
+
+    double x[3] ;
+
+    const int rc = cylinderCrossing( st, r0, x0, y0, direction, epsilon, x ) ;
+
+    if( rc != 0 ) return rc ;
+
+    toNewRef( st, x, withCovariance ) ;
+
+    toLCIO( st, ts ) ;
+
+    return 0 ;
+  }
+
+  int PropagateLCIOToZPlane( IMPL::TrackStateImpl& ts, float z, bool withCovariance) {
+
+    FastKF::State st ;
+    fromLCIO( ts, st ) ;
+
+    double x[3] ;
+
+    const int rc = zPlaneCrossing( st, z, x ) ;
+
+    if( rc != 0 ) return rc ;
+
+    toNewRef( st, x, withCovariance ) ;
+
+    toLCIO( st, ts ) ;
+
+    return 0 ;
+  }
+
+
+
   // Propagate track to a new reference point taken as its crossing point with a plane parallel to the z axis, containing points x1,x2 and y1,y2. Tolerance for intersection determined by epsilon.
   // For direction ==  0  the closest crossing point will be taken
   // For direction ==  1  the first crossing traversing in positive s will be taken
   // For direction == -1  the first crossing traversing in negative s will be taken
-  int PropagateLCIOToPlaneParralelToZ( IMPL::TrackStateImpl& ts, float x1, float y1, float x2, float y2, int direction, double epsilon) {
-    
+  int PropagateLCIOToPlaneParralelToZ( IMPL::TrackStateImpl& ts, float x1, float y1, float x2, float y2, int direction, double epsilon, bool withCovariance) {
+
     // check that direction has one of the correct values
     if( !( direction == 0 || direction == 1 || direction == -1) ) return -1 ;
-    
-    // taken from http://paulbourke.net/geometry/sphereline/raysphere.c
-    
-    const double x_ref = ts.getReferencePoint()[0] ; 
-    const double y_ref = ts.getReferencePoint()[1] ; 
-    const double z_ref = ts.getReferencePoint()[2] ; 
-    
-    const double d0    = ts.getD0() ;
-    const double z0    = ts.getZ0() ;
-    const double phi0  = ts.getPhi() ;
-    const double tanl  = ts.getTanLambda() ;
-    const double omega = ts.getOmega() ;
-    
-    const double rho   = 1.0 / omega ;
-    const double x_pca = x_ref - d0 * sin(phi0) ; 
-    const double y_pca = y_ref + d0 * cos(phi0) ; 
-    const double z_pca = z_ref + z0 ;
-    
-    const double sin_phi0 = sin(phi0); 
-    const double cos_phi0 = cos(phi0); 
-    
-    const double x_c   = x_ref + ( rho - d0) * sin_phi0 ;
-    const double y_c   = y_ref - ( rho - d0) * cos_phi0 ;
-    
-    const double dx = x2 - x1 ;
-    const double dy = y2 - y1 ;
-    
-    const double a = dx * dx + dy * dy ;
-    
-    const double b = 2.0 * ( dx * (x1 - x_c) + dy * (y1 - y_c) ) ;
-    
-    double c = x_c * x_c + y_c * y_c;
-    c += x1 * x1 + y1 * y1 ;
-    
-    c -= 2.0 * ( x_c * x1 + y_c * y1 );
-    c -= rho * rho;
-    
-    const double bb4ac = b * b - 4.0 * a * c;
-    
-    double u1 ; // first solution
-    double u2 ; // second solution
-    
-    /* Check for solvability. */
-    if (bb4ac + epsilon < 0.0 ) { // no intersection
-      return(1);
-    }
-    else if(bb4ac - epsilon < 0.0) { // circle intersects at one point, tangential 
-      return(2);
-    }
-    else{
-      u1 = (-b + sqrt(bb4ac)) / (2.0 * a);
-      u2 = (-b - sqrt(bb4ac)) / (2.0 * a);
-    }
-    
-    const double x_ins1 = x1 + u1 * (dx) ;
-    const double y_ins1 = y1 + u1 * (dy) ;
-    
-    const double x_ins2 = x1 + u2 * (dx) ;
-    const double y_ins2 = y1 + u2 * (dy) ;
-    
-    //    std::cout << "PropagateLCIOToPlaneParralelToZ: 1st solution u = " << u1 << " : " << u1 * dx << " " << u1 * dy << std::endl ;  
-    //    std::cout << "PropagateLCIOToPlaneParralelToZ: 2nd solution u = " << u2 << " : " << u2 * dx << " " << u2 * dy << std::endl ;
-    //    std::cout << "PropagateLCIOToPlaneParralelToZ: 1st solution x:y = " << x_ins1 << " : " << y_ins1 << std::endl ;
-    //    std::cout << "PropagateLCIOToPlaneParralelToZ: 2nd solution x:y = " << x_ins2 << " : " << y_ins2 << std::endl ;
-    
-    // now calculate the path lengths 
-    double s_1 = 0.0 ;
-    double s_2 = 0.0 ;
-    
-    const double delta_x1 = x_ins1 - x_pca ;
-    const double delta_y1 = y_ins1 - y_pca ;
-    
-    const double sin_delta_phi1 =     - omega*delta_x1*cos_phi0 - omega*delta_y1*sin_phi0 ;
-    const double cos_delta_phi1 = 1.0 - omega*delta_x1*sin_phi0 + omega*delta_y1*cos_phi0 ;
-    
-    s_1 = atan2(-sin_delta_phi1,cos_delta_phi1) / omega ;
-    
-    const double delta_x2 = x_ins2 - x_pca ;
-    const double delta_y2 = y_ins2 - y_pca ;
-    
-    const double sin_delta_phi2 =     - omega*delta_x2*cos_phi0 - omega*delta_y2*sin_phi0 ;
-    const double cos_delta_phi2 = 1.0 - omega*delta_x2*sin_phi0 + omega*delta_y2*cos_phi0 ;
-    
-    s_2 = atan2(-sin_delta_phi2,cos_delta_phi2) / omega ;
-    
-    double x(0.0), y(0.0), z(0.0) ;
-    
-    if( direction == 0 ) { // take closest intersection
-      if( fabs(s_1) < fabs(s_2) ) {
-        //      std::cout << "PropagateLCIOToPlaneParralelToZ: take 1st solution " << std::endl;
-        x = x_ins1 ;
-        y = y_ins1 ;
-        z = z_pca + s_1 * tanl ;
-      }
-      else {
-        //      std::cout << "PropagateLCIOToPlaneParralelToZ: take 2nd solution " << std::endl;
-        x = x_ins2 ;
-        y = y_ins2 ;
-        z = z_pca + s_2 * tanl ;          
-      }
-    }
-    
-    else{
-      
-      if ( s_1 < 0.0 ) s_1 +=  2.0*M_PI * fabs(rho) ;
-      if ( s_2 < 0.0 ) s_2 +=  2.0*M_PI * fabs(rho) ;
-      
-      if( direction == 1 ){ // take the intersection with smallest s
-        if( s_1 < s_2 ) {
-          //      std::cout << "PropagateLCIOToPlaneParralelToZ: take 1st solution " << std::endl;
-          x = x_ins1 ;
-          y = y_ins1 ;
-          z = z_pca + s_1 * tanl ;
-        }
-        else {
-          //      std::cout << "PropagateLCIOToPlaneParralelToZ: take 2nd solution " << std::endl;
-          x = x_ins2 ;
-          y = y_ins2 ;
-          z = z_pca + s_2 * tanl ;        
-        }
-      } 
-      else if( direction == -1 ) {  // else take the intersection with largest s 
-        if( s_1 > s_2 ){
-          //      std::cout << "PropagateLCIOToPlaneParralelToZ: take 1st solution " << std::endl;
-          x = x_ins1 ;
-          y = y_ins1 ;
-          z = z_pca + s_1 * tanl ;
-        }
-        else{
-          //      std::cout << "PropagateLCIOToPlaneParralelToZ: take 2nd solution " << std::endl;
-          x = x_ins2 ;
-          y = y_ins2 ;
-          z = z_pca + s_2 * tanl ;
-        }
-      }
-    }
-    
-    return PropagateLCIOToNewRef(ts,x,y,z);
-    
+
+    FastKF::State st ;
+    fromLCIO( ts, st ) ;
+
+    double x[3] ;
+
+    const int rc = planeParallelToZCrossing( st, x1, y1, x2, y2, direction, epsilon, x ) ;
+
+    if( rc != 0 ) return rc ;
+
+    toNewRef( st, x, withCovariance ) ;
+
+    toLCIO( st, ts ) ;
+
+    return 0 ;
   }
-  
-  
+
+
+  int PropagateToNewRef( TrackStateBatch& batch, double xref, double yref, double zref, bool withCovariance ) {
+
+    return propagateBatch( batch, withCovariance, [xref, yref, zref]( const FastKF::State&, double* x ) {
+        x[0] = xref ; x[1] = yref ; x[2] = zref ;
+        return 0 ;
+      } ) ;
+  }
+
+  int PropagateToCylinder( TrackStateBatch& batch, double r, double x0, double y0, int direction, double epsilon, bool withCovariance ) {
+
+    return propagateBatch( batch, withCovariance, [r, x0, y0, direction, epsilon]( const FastKF::State& st, double* x ) {
+        return cylinderCrossing( st, r, x0, y0, direction, epsilon, x ) ;
+      } ) ;
+  }
+
+  int PropagateToZPlane( TrackStateBatch& batch, double z, bool withCovariance ) {
+
+    return propagateBatch( batch, withCovariance, [z]( const FastKF::State& st, double* x ) {
+        return zPlaneCrossing( st, z, x ) ;
+      } ) ;
+  }
+
+  int PropagateToPlaneParralelToZ( TrackStateBatch& batch, double x1, double y1, double x2, double y2, int direction, double epsilon, bool withCovariance ) {
+
+    if( !( direction == 0 || direction == 1 || direction == -1) ) return -1 ;
+
+    return propagateBatch( batch, withCovariance, [x1, y1, x2, y2, direction, epsilon]( const FastKF::State& st, double* x ) {
+        return planeParallelToZCrossing( st, x1, y1, x2, y2, direction, epsilon, x ) ;
+      } ) ;
+  }
+
+
 } // end of TrackPropagators
@@ -54,6 +54,8 @@ namespace MarlinTrk{
     _useQMS =  getOption( IMarlinTrkSystem::CFG::useQMS )  ;  
     
     _usedEdx =  getOption( IMarlinTrkSystem::CFG::usedEdx ) ; 
+
+    _useWeightedPrefit =  getOption( IMarlinTrkSystem::CFG::useWeightedPrefit ) ; 
     
     streamlog_out( DEBUG5 ) << " -------------------------------------------------------------------------------- " << std::endl ;
     streamlog_out( DEBUG5 ) << "  MarlinAidaTT::init() called with the following options :                        " << std::endl ;
@@ -76,7 +78,9 @@ namespace MarlinTrk{
     double origin[3] = { 0., 0., 0. }, bfield[3] ;
     theDetector.field().magneticField( origin , bfield  ) ;
 
-    _bfield = new aidaTT::ConstantSolenoidBField( bfield[2] / dd4hep::tesla ) ; 
+    _bz = bfield[2] / dd4hep::tesla ;
+
+    _bfield = new aidaTT::ConstantSolenoidBField( _bz ) ; 
 
     _propagation = new aidaTT::analyticalPropagation();
     //_propagation = new aidaTT::simplifiedPropagation();
@@ -2,6 +2,7 @@
 
 #include "MarlinTrk/MarlinAidaTT.h"
 #include "MarlinTrk/IMarlinTrkSystem.h"
+#include "MarlinTrk/MarlinTrkUtils.h"
 
 
 
@@ -47,6 +48,20 @@ namespace MarlinTrk {
       bf.setValue( detElementID ) ;
       return bf.valueString() ;
     }
+
+    void toKalmanState( const EVENT::TrackState& ts, FastKF::State& state ) {
+
+      state.par[ FastKF::iD0 ]    = ts.getD0() ;
+      state.par[ FastKF::iPhi ]   = ts.getPhi() ;
+      state.par[ FastKF::iOmega ] = ts.getOmega() ;
+      state.par[ FastKF::iZ0 ]    = ts.getZ0() ;
+      state.par[ FastKF::iTanL ]  = ts.getTanLambda() ;
+
+      const EVENT::FloatVec& cov = ts.getCovMatrix() ;
+      for( unsigned i = 0 ; i < 15 ; ++i ) state.cov[i] = cov[i] ;
+
+      for( unsigned i = 0 ; i < 3 ; ++i ) state.ref[i] = ts.getReferencePoint()[i] ;
+    }
   }
   //---------------------------------------------------------------------------------------------------------------
   
@@ -66,6 +81,8 @@ namespace MarlinTrk {
   
   double MarlinAidaTTTrack::getMass() { return _mass ; }
 
+  IMarlinTrkSystem* MarlinAidaTTTrack::getTrkSystem() { return _aidaTT ; }
+
 
   int MarlinAidaTTTrack::addHit( EVENT::TrackerHit * trkhit) {
     _lcioHits.push_back( trkhit ) ;
@@ -85,6 +102,28 @@ namespace MarlinTrk {
       return error ;
     }
     
+    //--------- the weighted helix fit of all 2D hits replaces the GBL prefit
+    if( _aidaTT->_useWeightedPrefit ) {
+
+      IMPL::TrackStateImpl preFit ;
+
+      if( createWeightedPrefit( _lcioHits, &preFit, _aidaTT->_bz, IMarlinTrack::forward ) == success ) {
+
+	// the covariance matrix is kept, loosened as the same hits are filtered and fitted again
+	EVENT::FloatVec cov = preFit.getCovMatrix() ;
+	for( unsigned i = 0 ; i < cov.size() ; ++i ) cov[i] *= weightedPrefitCovarianceScale ;
+	preFit.setCovMatrix( cov ) ;
+
+	_initialTrackParams = aidaTT::readLCIO( &preFit ) ;
+
+	streamlog_out( DEBUG3 )  << "  start helix from weighted helix fit : " <<  _initialTrackParams << std::endl ;
+
+	return myInit( &preFit ) ;
+      }
+
+      streamlog_out( DEBUG3 )  << "MarlinAidaTTTrack::initialise: weighted helix fit failed - using the GBL prefit " << std::endl ;
+    }
+
       //--------- get the start helix from three points
     bool backwards = false ;
     
@@ -135,17 +174,19 @@ namespace MarlinTrk {
 
   }
 
-  int MarlinAidaTTTrack::myInit() {
+  int MarlinAidaTTTrack::myInit( const EVENT::TrackState* preFit ) {
     
     moveHelixTo( _initialTrackParams, aidaTT::Vector3D()  ) ; // move to origin
     
-    // --- set some large errors to the covariance matrix ( might not be needed for GBL ) 
-    _initialTrackParams.covarianceMatrix().Unit() ;
-    _initialTrackParams.covarianceMatrix()( aidaTT::OMEGA, aidaTT::OMEGA ) = 1.e-2 ;
-    _initialTrackParams.covarianceMatrix()( aidaTT::TANL , aidaTT::TANL  ) = 1.e2 ;
-    _initialTrackParams.covarianceMatrix()( aidaTT::PHI0 , aidaTT::PHI0  ) = 1.e2 ;
-    _initialTrackParams.covarianceMatrix()( aidaTT::D0   , aidaTT::D0    ) = 1.e5 ;
-    _initialTrackParams.covarianceMatrix()( aidaTT::Z0   , aidaTT::Z0    ) = 1.e5 ;
+    // --- set some large errors to the covariance matrix ( might not be needed for GBL ) - unless the prefit has one
+    if( ! preFit ) {
+      _initialTrackParams.covarianceMatrix().Unit() ;
+      _initialTrackParams.covarianceMatrix()( aidaTT::OMEGA, aidaTT::OMEGA ) = 1.e-2 ;
+      _initialTrackParams.covarianceMatrix()( aidaTT::TANL , aidaTT::TANL  ) = 1.e2 ;
+      _initialTrackParams.covarianceMatrix()( aidaTT::PHI0 , aidaTT::PHI0  ) = 1.e2 ;
+      _initialTrackParams.covarianceMatrix()( aidaTT::D0   , aidaTT::D0    ) = 1.e5 ;
+      _initialTrackParams.covarianceMatrix()( aidaTT::Z0   , aidaTT::Z0    ) = 1.e5 ;
+    }
 
     _fitTrajectory = new aidaTT::trajectory( _initialTrackParams, _aidaTT->_fitter, //_aidaTT->_bfield, 
 					     _aidaTT->_propagation, _aidaTT->_geom );
@@ -157,21 +198,140 @@ namespace MarlinTrk {
     // _fitTrajectory->addElement( aidaTT::Vector3D(), &ID);
     //done internally in trajectory ...
 
+    seedKalmanState( preFit ) ;
+
     _initialised = true ;
 
     return success ;
   } 
+
+
+  void MarlinAidaTTTrack::seedKalmanState( const EVENT::TrackState* preFit ) {
+
+    if( preFit ) {
+
+      // --- the prefit is at the origin already and brings its covariance matrix, in LCIO units
+      toKalmanState( *preFit, _kalmanState ) ;
+
+    } else {
+
+      IMPL::TrackStateImpl* ts = aidaTT::createLCIO( _initialTrackParams ) ;
+      toKalmanState( *ts, _kalmanState ) ;
+      delete ts ;
+
+      // --- the same large errors as for the initial track parameters, in LCIO units
+      _kalmanState.cov.fill( 0. ) ;
+      _kalmanState.cov[ FastKF::symIndex( FastKF::iD0   , FastKF::iD0    ) ] = 1.e7 ;
+      _kalmanState.cov[ FastKF::symIndex( FastKF::iPhi  , FastKF::iPhi   ) ] = 1.e2 ;
+      _kalmanState.cov[ FastKF::symIndex( FastKF::iOmega, FastKF::iOmega ) ] = 1.e-4 ;
+      _kalmanState.cov[ FastKF::symIndex( FastKF::iZ0   , FastKF::iZ0    ) ] = 1.e7 ;
+      _kalmanState.cov[ FastKF::symIndex( FastKF::iTanL , FastKF::iTanL  ) ] = 1.e2 ;
+    }
+
+    // --- the hits added before initialise() are the start of the filter
+    double chi2 ;
+    for( unsigned i = 0, N = _lcioHits.size() ; i < N ; ++i ) {
+      filterHit( _lcioHits[i], _kalmanState, DBL_MAX, chi2 ) ;
+    }
+  }
+
+
+  int MarlinAidaTTTrack::filterHit( EVENT::TrackerHit* trkhit, FastKF::State& state, double maxChi2Increment, double& chi2increment ) const {
+
+    double varRPhi, varZ ;
+
+    const int error_code = getHitVariancesRPhiZ( trkhit, varRPhi, varZ ) ;
+
+    if( error_code != success ) {
+      streamlog_out( DEBUG2 ) << "MarlinAidaTTTrack::filterHit: only 2D hits can be filtered - hit " << cellIDString( trkhit->getCellID0() ) << std::endl ;
+      return error_code ;
+    }
+
+    FastKF::State predicted = state ;
+
+    // --- with the hit as reference point d0 and z0 are the ( negative ) residuals in r-phi and z
+    FastKF::transport( predicted, trkhit->getPosition() ) ;
+
+    // --- multiple scattering in the material of the hit surface, the GBL fit adds all scatterers
+    SurfMap::const_iterator it = _aidaTT->_surfMap.find( trkhit->getCellID0() ) ;
+
+    if( _aidaTT->_useQMS && _aidaTT->_bz != 0. && it != _aidaTT->_surfMap.end() ) {
+
+      const aidaTT::ISurface* surf = it->second ;
+
+      double dir[3] ;
+      FastKF::directionAt( predicted, 0., dir ) ;
+
+      const double norm = std::sqrt( dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2] ) ;
+      const aidaTT::Vector3D n = surf->normal( aidaTT::Vector3D( trkhit->getPosition()[0] * dd4hep::mm, trkhit->getPosition()[1] * dd4hep::mm,
+                                                                 trkhit->getPosition()[2] * dd4hep::mm ) ) ;
+
+      const double cosAlpha = std::max( std::fabs( n[0] * dir[0] + n[1] * dir[1] + n[2] * dir[2] ) / norm, 1.e-3 ) ;
+
+      double pathOverX0 = 0. ;
+      if( surf->innerMaterial().radiationLength() > 0. ) pathOverX0 += surf->innerThickness() / surf->innerMaterial().radiationLength() ;
+      if( surf->outerMaterial().radiationLength() > 0. ) pathOverX0 += surf->outerThickness() / surf->outerMaterial().radiationLength() ;
+
+      FastKF::addMultipleScattering( predicted, _aidaTT->_bz, _mass, pathOverX0 / cosAlpha ) ;
+    }
+
+    const double H[2][5] = { { 1., 0., 0., 0., 0. }, { 0., 0., 0., 1., 0. } } ;
+    const double residual[2] = { -predicted.par[ FastKF::iD0 ], -predicted.par[ FastKF::iZ0 ] } ;
+    const double V[3] = { varRPhi, 0., varZ } ;
+
+    chi2increment = 0. ;
+
+    if( ! FastKF::filter( predicted, H, residual, V, 2, maxChi2Increment, chi2increment ) ) {
+
+      streamlog_out( DEBUG2 ) << "MarlinAidaTTTrack::filterHit: hit rejected " << cellIDString( trkhit->getCellID0() )
+			      << " chi2increment = " << chi2increment << " maxChi2Increment = " << maxChi2Increment << std::endl ;
+
+      return ( chi2increment > maxChi2Increment ? site_fails_chi2_cut : error ) ;
+    }
+
+    state = predicted ;
+
+    return success ;
+  }
+
   
-  int MarlinAidaTTTrack::addAndFit( EVENT::TrackerHit*, double&, double ) {
+  int MarlinAidaTTTrack::addAndFit( EVENT::TrackerHit* trkhit, double& chi2increment, double maxChi2Increment ) {
     
-    streamlog_out( DEBUG ) << "MarlinAidaTTTrack::addAndFit: nothing to be done ... " << std::endl ;
-    return success ;
+    if( ! trkhit ) {
+      streamlog_out( ERROR) << "MarlinAidaTTTrack::addAndFit(EVENT::TrackerHit* trkhit, double& chi2increment, double maxChi2Increment): trkhit == 0" << std::endl;
+      return bad_intputs ;
+    }
+
+    if ( ! _initialised ) {
+      throw MarlinTrk::Exception("Track fit not initialised");   
+    }
+
+    const int error_code = filterHit( trkhit, _kalmanState, maxChi2Increment, chi2increment ) ;
+
+    if( error_code == site_fails_chi2_cut ) {
+      _outliers.push_back( std::make_pair( trkhit, chi2increment ) ) ;
+    }
+    else if( error_code == success ) {
+      _lcioHits.push_back( trkhit ) ;
+    }
+
+    return error_code ;
   }
   
-  int MarlinAidaTTTrack::testChi2Increment( EVENT::TrackerHit* , double&  ) {
+  int MarlinAidaTTTrack::testChi2Increment( EVENT::TrackerHit* trkhit, double& chi2increment ) {
 
-    streamlog_out( DEBUG ) << "MarlinAidaTTTrack::testChi2Increment: nothing to be done ... " << std::endl ;
-    return success ;
+    if( ! trkhit ) {
+      streamlog_out( ERROR) << "MarlinAidaTTTrack::testChi2Increment(EVENT::TrackerHit* trkhit, double &chi2increment): trkhit == 0" << std::endl;
+      return bad_intputs ;
+    }
+
+    if ( ! _initialised ) {
+      throw MarlinTrk::Exception("Track fit not initialised");   
+    }
+
+    FastKF::State probe = _kalmanState ;
+
+    return filterHit( trkhit, probe, DBL_MAX, chi2increment ) ;
   }
   
   int MarlinAidaTTTrack::fit( double ) {
@@ -189,6 +349,16 @@ namespace MarlinTrk {
       return error ;
     }
     
+    if( _fitted ) { // refit including the hits added with addAndFit() - start from a new trajectory
+
+      delete _fitTrajectory ;
+
+      _fitTrajectory = new aidaTT::trajectory( _initialTrackParams, _aidaTT->_fitter, _aidaTT->_propagation, _aidaTT->_geom ) ;
+      _fitTrajectory->setMass( _mass ) ;
+
+      _indexMap.clear() ;
+    }
+
     // ==== store hits in a map ===============
     std::map< int, EVENT::TrackerHit*> hitMap ;
     for(unsigned i=0 ; i < nHits ; ++i){
@@ -247,9 +417,24 @@ namespace MarlinTrk {
     _fitTrajectory->prepareForFitting();
     
     int fit_ok = _fitTrajectory->fit();
+
+    _fitted = true ;
     
     streamlog_out( DEBUG4 )  << "MarlinAidaTTTrack::fit() - fit worked  " << fit_ok  
 			     << std::endl ;
+
+    // continue addAndFit() from the GBL result at the last hit
+    for( int i = nHits-1 ; fit_ok && i >= 0 ; --i ) {
+
+      IMPL::TrackStateImpl ts ;
+      double chi2 ;
+      int ndf ;
+
+      if( getTrackState( _lcioHits[i], ts, chi2, ndf ) == success ) {
+	toKalmanState( ts, _kalmanState ) ;
+	break ;
+      }
+    }
    
 
 #if 0 // ---------------- try to run a refit --- does not work really ....
@@ -493,8 +678,28 @@ namespace MarlinTrk {
     return success ;
   }
   
-  int MarlinAidaTTTrack::getOutliers( std::vector<std::pair<EVENT::TrackerHit*, double> >&  ) {
-    streamlog_out( DEBUG2 )  << "MarlinAidaTTTrack::getOutliers() - nothing to do ..." << std::endl ;
+  int MarlinAidaTTTrack::getOutliers( std::vector<std::pair<EVENT::TrackerHit*, double> >& hits ) {
+
+    hits.insert( hits.end(), _outliers.begin(), _outliers.end() ) ;
+
+    return success ;
+  }
+
+
+  int MarlinAidaTTTrack::restoreFitResult( const std::vector<std::pair<EVENT::TrackerHit*, double> >& hitsInFit,
+                                           const std::vector<std::pair<EVENT::TrackerHit*, double> >& outliers ) {
+
+    if( _initialised ) {
+      streamlog_out( ERROR ) << "MarlinAidaTTTrack::restoreFitResult: track already initialised - not restoring the fit result" << std::endl ;
+      return error ;
+    }
+
+    _lcioHits.clear() ;
+
+    for( unsigned i = 0 ; i < hitsInFit.size() ; ++i ) _lcioHits.push_back( hitsInFit[i].first ) ;
+
+    _outliers = outliers ;
+
     return success ;
   }
   
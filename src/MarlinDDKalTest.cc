@@ -4,6 +4,7 @@
 #include "kaltest/TKalDetCradle.h"
 #include "kaltest/TVKalDetector.h"
 #include "kaltest/THelicalTrack.h"
+#include "kaltest/TStraightTrack.h"
 
 #include "DDKalTest/DDVMeasLayer.h"
 #include "DDKalTest/DDKalDetector.h"
@@ -17,12 +18,14 @@
 #include "UTIL/LCTrackerConf.h"
 
 #include "DDRec/SurfaceManager.h"
+#include "DD4hep/DD4hepUnits.h"
 
 #include <algorithm>
 #include <string>
 #include <math.h>
 #include <cmath>
 #include <fstream>
+#include <memory>
 
 #include <utility>
 
@@ -30,6 +33,65 @@
 
 //#include "DDKalTest/DDMeasurementSurfaceStoreFiller.h"
 
+
+namespace{
+
+  const double twopi = 2.*M_PI ;
+
+  /** largest turning angle of the helix between the z-planes of a disk layer for which the phi index is used */
+  const double maxDiskArc = 0.5 ;
+
+  /** radial tolerance in mm when selecting disk modules */
+  const double radialTolerance = 1. ;
+
+  /** set the bins covering the shorter arc between phi1 and phi2, widened by margin bins on each side */
+  void setPhiBins( double phi1, double phi2, int margin, std::vector<bool>& bins ) {
+
+    const int nBins = bins.size() ;
+    const double width = twopi / nBins ;
+
+    double dphi = std::remainder( phi2 - phi1, twopi ) ;
+    double phiLo = ( dphi < 0. ? phi2 : phi1 ) ;
+    dphi = std::fabs( dphi ) ;
+
+    phiLo = std::fmod( phiLo, twopi ) ;
+    if( phiLo < 0. ) phiLo += twopi ;
+
+    const int first = int( phiLo / width ) - margin ;
+    const int n = std::min( int( dphi / width ) + 2 + 2*margin, nBins ) ;
+
+    for( int i = 0 ; i < n ; ++i ) {
+      bins[ ( ( first + i ) % nBins + nBins ) % nBins ] = true ;
+    }
+  }
+
+  /** azimuths of the two crossings of the circle ( xc, yc, R ) with the circle of radius r around the z-axis, 
+   *  the first (second) crossing lies on the left (right) of the line from the origin to the centre - false if there is no crossing
+   */
+  bool circleCrossings( double xc, double yc, double R, double r, double phi[2] ) {
+
+    const double d = std::hypot( xc, yc ) ;
+
+    if( d < 1.e-9 ) return false ;
+
+    const double a  = ( r*r - R*R + d*d ) / ( 2.*d ) ;
+    const double h2 = r*r - a*a ;
+
+    if( h2 < 0. ) return false ;
+
+    const double h  = std::sqrt( h2 ) ;
+    const double ux = xc / d ;
+    const double uy = yc / d ;
+
+    phi[0] = std::atan2( a*uy + h*ux, a*ux - h*uy ) ;
+    phi[1] = std::atan2( a*uy - h*ux, a*ux + h*uy ) ;
+
+    return true ;
+  }
+
+}
+
+
 namespace MarlinTrk{
   
   
@@ -70,7 +132,10 @@ namespace MarlinTrk{
     case IMarlinTrkSystem::CFG::usedEdx :
       this->includeEnergyLoss( val ) ;
       break ;
-      // IMarlinTrkSystem::CFG::useSmoothing handled directly in MarlinDDKalTestTrack
+      // IMarlinTrkSystem::CFG::useSmoothing, CFG::useCompactSites and CFG::useHitSorting handled directly in MarlinDDKalTestTrack
+      // IMarlinTrkSystem::CFG::useStraightLine handled directly in MarlinDDKalTestTrack
+      // IMarlinTrkSystem::CFG::useParametersOnly handled directly in MarlinDDKalTestTrack
+      // IMarlinTrkSystem::CFG::useFitResultCache and CFG::useWeightedPrefit handled in createFinalisedLCIOTrack
     }
 
   }
@@ -87,7 +152,13 @@ namespace MarlinTrk{
     streamlog_out( DEBUG5 ) << "  MarlinDDKalTest::init() called with the following options :                     " << std::endl ;
     streamlog_out( DEBUG5 ) <<    this->getOptions() ;
     streamlog_out( DEBUG5 ) << " -------------------------------------------------------------------------------- " << std::endl ;
-    
+
+    if( getOption( IMarlinTrkSystem::CFG::useStraightLine ) ) {
+      // KalTest moves a TStraightTrack between sites whose hits see no field and a THelicalTrack otherwise
+      streamlog_out( MESSAGE ) << "  MarlinDDKalTest::init() - straight lines are fitted: in a non-zero field as helices with pinned kappa, "
+                               << "without multiple scattering and energy loss " << std::endl ;
+    }
+
     if( is_initialised ) {
       
       streamlog_out( DEBUG5 ) << "  MarlinDDKalTest::init()  - already initialized - only options are set .. " << std::endl ;
@@ -191,6 +262,8 @@ namespace MarlinTrk{
 
 
     _det->Close() ;          // close the cradle
+    
+    this->buildLayerPhiIndex() ;
     //done in Close()    _det->Sort() ;           // sort meas. layers from inside to outside
     
     streamlog_out( DEBUG4 ) << "  MarlinDDKalTest - number of layers = " << _det->GetEntriesFast() << std::endl ;
@@ -296,6 +369,248 @@ namespace MarlinTrk{
     
   }
   
+  void MarlinDDKalTest::getSensitiveMeasurementModulesForLayer( int layerID, const TVTrack& track, std::vector< const DDVMeasLayer *>& measmodules) const {
+    
+    if( ! measmodules.empty() ) {
+      
+      std::stringstream errorMsg;
+      errorMsg << "MarlinDDKalTest::getSensitiveMeasurementModulesForLayer vector passed as third argument is not empty " << std::endl ; 
+      throw MarlinTrk::Exception(errorMsg.str());
+      
+    }
+    
+    // the phi ranges below are computed for the helix circle - straight lines in a vanishing field try all modules
+    const THelicalTrack* pHelix = dynamic_cast<const THelicalTrack*>( &track ) ;
+    
+    if( ! pHelix ) {
+      this->getSensitiveMeasurementModulesForLayer( layerID, measmodules ) ;
+      return ;
+    }
+    
+    const THelicalTrack& helix = *pHelix ;
+    
+    lcio::BitField64 bf(  UTIL::LCTrackerCellID::encoding_string() ) ;
+    bf.setValue( layerID ) ;
+    bf[lcio::LCTrackerCellID::module()] = 0 ;
+    bf[lcio::LCTrackerCellID::sensor()] = 0 ;
+    
+    std::map<int, LayerPhiIndex>::const_iterator it = _layerPhiIndex.find( bf.lowWord() ) ;
+    
+    if( it == _layerPhiIndex.end() ) {
+      this->getSensitiveMeasurementModulesForLayer( layerID, measmodules ) ;
+      return ;
+    }
+    
+    const LayerPhiIndex& index = it->second ;
+    
+    std::vector<bool> bins( index.bins.size(), false ) ;
+    
+    double rLo = 0. ;
+    double rHi = 0. ;
+    
+    if( ! index.isDisk ) {
+      
+      // the modules are crossed on the arc of the helix circle between the radii rMin and rMax - on either side
+      const double xc = helix.GetXc() ;
+      const double yc = helix.GetYc() ;
+      const double R  = std::fabs( helix.GetRho() ) ;
+      
+      double phiIn[2], phiOut[2] ;
+      
+      if( ! circleCrossings( xc, yc, R, index.rMin, phiIn ) || ! circleCrossings( xc, yc, R, index.rMax, phiOut ) ) {
+        this->getSensitiveMeasurementModulesForLayer( layerID, measmodules ) ;
+        return ;
+      }
+      
+      // the azimuth along the arc turns at the tangent point seen from the origin
+      const double d2 = xc*xc + yc*yc ;
+      const double rTangent = ( d2 > R*R ? std::sqrt( d2 - R*R ) : 0. ) ;
+      
+      double phiTangent[2] ;
+      const bool hasTangent = ( rTangent > index.rMin && rTangent < index.rMax && circleCrossings( xc, yc, R, rTangent, phiTangent ) ) ;
+      
+      for( unsigned side = 0 ; side < 2 ; ++side ) {
+        
+        setPhiBins( phiIn[side], phiOut[side], 1, bins ) ;
+        
+        if( hasTangent ) {
+          setPhiBins( phiIn[side], phiTangent[side], 1, bins ) ;
+          setPhiBins( phiTangent[side], phiOut[side], 1, bins ) ;
+        }
+      }
+      
+    } else {
+      
+      // the modules are crossed between the z-planes zMin and zMax, z = z0 + dz - rho * tanLambda * phi
+      const double rhoTanL = helix.GetRho() * helix.GetTanLambda() ;
+      const double zRef = helix.GetPivot().Z() + helix.GetDz() ;
+      
+      const double phi1 = ( std::fabs( rhoTanL ) > 1.e-9 ? ( zRef - index.zMin ) / rhoTanL : 0. ) ;
+      const double phi2 = ( std::fabs( rhoTanL ) > 1.e-9 ? ( zRef - index.zMax ) / rhoTanL : 0. ) ;
+      
+      const TVector3 x1 = helix.CalcXAt( phi1 ) ;
+      const TVector3 x2 = helix.CalcXAt( phi2 ) ;
+      
+      rLo = std::min( x1.Perp(), x2.Perp() ) - radialTolerance ;
+      rHi = std::max( x1.Perp(), x2.Perp() ) + radialTolerance ;
+      
+      if( std::fabs( rhoTanL ) <= 1.e-9 || std::fabs( phi2 - phi1 ) > maxDiskArc || rLo < radialTolerance ) {
+        this->getSensitiveMeasurementModulesForLayer( layerID, measmodules ) ;
+        return ;
+      }
+      
+      setPhiBins( x1.Phi(), x2.Phi(), 1, bins ) ;
+    }
+    
+    std::vector<bool> selected( index.modules.size(), false ) ;
+    
+    for( unsigned i = 0 ; i < bins.size() ; ++i ) {
+      
+      if( ! bins[i] ) continue ;
+      
+      for( unsigned m : index.bins[i] ) selected[m] = true ;
+    }
+    
+    for( unsigned m = 0 ; m < index.modules.size() ; ++m ) {
+      
+      if( ! selected[m] ) continue ;
+      
+      if( index.isDisk && ( index.moduleR[m].first > rHi || index.moduleR[m].second < rLo ) ) continue ;
+      
+      measmodules.push_back( index.modules[m] ) ;
+    }
+    
+    streamlog_out( DEBUG0 ) << "MarlinDDKalTest::getSensitiveMeasurementModulesForLayer: layerID = " << layerID 
+                            << " selected " << measmodules.size() << " of " << index.modules.size() << " modules " << std::endl;
+    
+  }
+  
+  
+  void MarlinDDKalTest::buildLayerPhiIndex() {
+    
+    _layerPhiIndex.clear() ;
+    
+    typedef std::multimap<int, const DDVMeasLayer *>::const_iterator ModuleIt ;
+    
+    for( ModuleIt it = _active_measurement_modules_by_layer.begin() ; it != _active_measurement_modules_by_layer.end() ; ) {
+      
+      std::pair<ModuleIt, ModuleIt> range = _active_measurement_modules_by_layer.equal_range( it->first ) ;
+      it = range.second ;
+      
+      LayerPhiIndex index ;
+      index.rMin = index.zMin =  1.e30 ;
+      index.rMax = index.zMax = -1.e30 ;
+      
+      // phi range of each module: first azimuth and width, a width of 2pi for modules enclosing the z-axis
+      std::vector< std::pair<double,double> > phiRanges ;
+      
+      unsigned nDisks = 0 ;
+      bool indexable = true ;
+      
+      for( ModuleIt im = range.first ; im != range.second && indexable ; ++im ) {
+        
+        const dd4hep::rec::ISurface* surf = im->second->surface() ;
+        
+        if( surf == 0 || ! surf->type().isPlane() ) { 
+          indexable = false ; 
+          break ; 
+        }
+        
+        const dd4hep::rec::Vector3D o = ( 1./dd4hep::mm ) * surf->origin() ;
+        const dd4hep::rec::Vector3D u = surf->u() ;
+        const dd4hep::rec::Vector3D v = surf->v() ;
+        const dd4hep::rec::Vector3D n = surf->normal() ;
+        
+        const double hu = 0.5 * surf->length_along_u() / dd4hep::mm ;
+        const double hv = 0.5 * surf->length_along_v() / dd4hep::mm ;
+        
+        if( hu <= 0. || hv <= 0. ) { 
+          indexable = false ; 
+          break ; 
+        }
+        
+        const bool isDisk = std::fabs( n.z() ) > 0.9 ;
+        if( isDisk ) ++nDisks ;
+        
+        double rMin = 1.e30, rMax = 0., phiFirst = 0., phiLo = 0., phiHi = 0. ;
+        
+        for( int i = 0 ; i < 4 ; ++i ) {
+          
+          const dd4hep::rec::Vector3D c = o + ( ( i & 1 ? 1. : -1. ) * hu ) * u + ( ( i & 2 ? 1. : -1. ) * hv ) * v ;
+          
+          rMin = std::min( rMin, c.rho() ) ;
+          rMax = std::max( rMax, c.rho() ) ;
+          
+          index.zMin = std::min( index.zMin, c.z() ) ;
+          index.zMax = std::max( index.zMax, c.z() ) ;
+          
+          if( i == 0 ) {
+            phiFirst = c.phi() ;
+          } else {
+            const double dphi = std::remainder( c.phi() - phiFirst, twopi ) ;
+            phiLo = std::min( phiLo, dphi ) ;
+            phiHi = std::max( phiHi, dphi ) ;
+          }
+        }
+        
+        if( isDisk ) {
+          
+          // closest point of the module to the z-axis
+          const double a = std::max( -hu, std::min( hu, -( o.x()*u.x() + o.y()*u.y() ) ) ) ;
+          const double b = std::max( -hv, std::min( hv, -( o.x()*v.x() + o.y()*v.y() ) ) ) ;
+          const dd4hep::rec::Vector3D p = o + a * u + b * v ;
+          
+          rMin = std::min( rMin, p.rho() ) ;
+          
+        } else {
+          
+          // distance of the module plane to the z-axis is a lower bound for the radius on the module
+          const double nxy = std::hypot( n.x(), n.y() ) ;
+          rMin = std::min( rMin, std::fabs( o.x()*n.x() + o.y()*n.y() ) / nxy ) ;
+        }
+        
+        const bool enclosesAxis = ( rMin < radialTolerance || phiHi - phiLo > M_PI ) ;
+        
+        phiRanges.push_back( enclosesAxis ? std::make_pair( 0., twopi ) : std::make_pair( phiFirst + phiLo, phiHi - phiLo ) ) ;
+        
+        index.modules.push_back( im->second ) ;
+        index.moduleR.push_back( std::make_pair( rMin, rMax ) ) ;
+        
+        index.rMin = std::min( index.rMin, rMin ) ;
+        index.rMax = std::max( index.rMax, rMax ) ;
+      }
+      
+      // only layers of several modules of the same orientation gain from the index
+      if( ! indexable || index.modules.size() < 2 || ( nDisks != 0 && nDisks != index.modules.size() ) ) continue ;
+      
+      index.isDisk = ( nDisks != 0 ) ;
+      
+      const unsigned nBins = std::max( 8u, std::min( 512u, unsigned( 2 * index.modules.size() ) ) ) ;
+      index.bins.resize( nBins ) ;
+      
+      for( unsigned m = 0 ; m < index.modules.size() ; ++m ) {
+        
+        std::vector<bool> bins( nBins, false ) ;
+        
+        if( phiRanges[m].second >= twopi ) {
+          bins.assign( nBins, true ) ;
+        } else {
+          setPhiBins( phiRanges[m].first, phiRanges[m].first + phiRanges[m].second, 0, bins ) ;
+        }
+        
+        for( unsigned i = 0 ; i < nBins ; ++i ) {
+          if( bins[i] ) index.bins[i].push_back( m ) ;
+        }
+      }
+      
+      _layerPhiIndex[ range.first->first ] = index ;
+    }
+    
+    streamlog_out( DEBUG4 ) << "  MarlinDDKalTest - phi index built for " << _layerPhiIndex.size() << " layers " << std::endl ;
+    
+  }
+  
+  
   void MarlinDDKalTest::getSensitiveMeasurementModules( int moduleID , std::vector< const DDVMeasLayer *>& measmodules ) const {
     
     if( ! measmodules.empty() ) {
@@ -370,14 +685,28 @@ namespace MarlinTrk{
     
   }
   
-  const DDVMeasLayer*  MarlinDDKalTest::getLastMeasLayer(THelicalTrack const& hel, TVector3 const& point) const {
+  TVTrack* MarlinDDKalTest::cloneTrack( TVTrack const& track ) {
     
-    THelicalTrack helix = hel;
+    const THelicalTrack* helix = dynamic_cast<const THelicalTrack*>( &track ) ;
+    
+    if( helix ) return new THelicalTrack( *helix ) ;
+    
+    return new TStraightTrack( dynamic_cast<const TStraightTrack&>( track ) ) ;
+  }
+  
+  const DDVMeasLayer*  MarlinDDKalTest::getLastMeasLayer(TVTrack const& track, TVector3 const& point) const {
+    
+    std::unique_ptr<TVTrack> pHelix( cloneTrack( track ) ) ;
+    TVTrack& helix = *pHelix ;
     
     double deflection_to_point = 0 ;
     helix.MoveTo(  point, deflection_to_point , 0 , 0) ;
     
-    bool isfwd = ((helix.GetKappa() > 0 && deflection_to_point < 0) || (helix.GetKappa() <= 0 && deflection_to_point > 0)) ? true : false;
+    // the deflection of a straight line is its path length in the xy-plane along the momentum
+    const bool isLine = ( dynamic_cast<const TStraightTrack*>( &helix ) != 0 ) ;
+    
+    bool isfwd = ( isLine ? deflection_to_point > 0 :
+                   ((helix.GetKappa() > 0 && deflection_to_point < 0) || (helix.GetKappa() <= 0 && deflection_to_point > 0)) ) ;
     
     int mode = isfwd ? -1 : +1 ;
     
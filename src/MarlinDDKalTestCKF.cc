@@ -0,0 +1,303 @@
+#include "MarlinTrk/MarlinDDKalTestCKF.h"
+
+#include "MarlinTrk/MarlinDDKalTest.h"
+#include "MarlinTrk/MarlinDDKalTestTrack.h"
+#include "MarlinTrk/IMarlinTrkSystem.h"
+
+#include <kaltest/TKalTrack.h>
+#include "kaltest/TKalTrackSite.h"
+#include "TKalFilterCond.h"
+
+#include "DDKalTest/DDVMeasLayer.h"
+#include "DDKalTest/DDVTrackHit.h"
+
+#include <algorithm>
+
+#include "streamlog/streamlog.h"
+
+
+namespace {
+
+  /** filter condition rejecting sites with a chi2 increment above the given maximum */
+  class MaxChi2Filter : public TKalFilterCond {
+
+  public:
+
+    MaxChi2Filter( double maxDeltaChi2 ) : _maxDeltaChi2( maxDeltaChi2 ) {}
+
+    virtual Bool_t IsAccepted( const TKalTrackSite& site ) { return site.GetDeltaChi2() < _maxDeltaChi2 ; }
+
+  protected:
+
+    double _maxDeltaChi2 ;
+  } ;
+
+}
+
+
+namespace MarlinTrk {
+
+
+  MarlinDDKalTestCKF::MarlinDDKalTestCKF( MarlinDDKalTest* ktest ) :
+    _ktest( ktest ),
+    _filterTrack( new TKalTrack ) {
+
+    _filterTrack->SetOwner( false ) ;
+  }
+
+
+  MarlinDDKalTestCKF::~MarlinDDKalTestCKF() {
+
+    this->clearNodes() ;
+    this->clear() ;
+
+    delete _filterTrack ;
+  }
+
+
+  void MarlinDDKalTestCKF::clear() {
+
+    for( std::map< EVENT::TrackerHit*, DDVTrackHit* >::iterator it = _kalHits.begin() ; it != _kalHits.end() ; ++it ) {
+      delete it->second ;
+    }
+
+    _kalHits.clear() ;
+  }
+
+
+  void MarlinDDKalTestCKF::clearNodes() {
+
+    for( unsigned i = 0 ; i < _nodes.size() ; ++i ) {
+
+      if( _nodes[i]->ownsSite ) delete _nodes[i]->site ;
+
+      delete _nodes[i] ;
+    }
+
+    _nodes.clear() ;
+  }
+
+
+  bool MarlinDDKalTestCKF::betterCandidate( const Node* lhs, const Node* rhs ) {
+
+    if( lhs->nHits != rhs->nHits ) return lhs->nHits > rhs->nHits ;
+
+    return lhs->chi2 < rhs->chi2 ;
+  }
+
+
+  DDVTrackHit* MarlinDDKalTestCKF::getKalHit( EVENT::TrackerHit* hit ) {
+
+    std::map< EVENT::TrackerHit*, DDVTrackHit* >::iterator it = _kalHits.find( hit ) ;
+
+    if( it != _kalHits.end() ) return it->second ;
+
+    // hits without measurement layer are remembered as well, so that they are not searched for again
+    const DDVMeasLayer* ml = _ktest->findMeasLayer( hit ) ;
+
+    DDVTrackHit* kalhit = ( ml ? ml->ConvertLCIOTrkHit( hit ) : 0 ) ;
+
+    if( ! kalhit ) {
+      streamlog_out( DEBUG2 ) << "MarlinDDKalTestCKF::getKalHit: no measurement layer found for hit " << hit << std::endl ;
+    }
+
+    _kalHits[ hit ] = kalhit ;
+
+    return kalhit ;
+  }
+
+
+  MarlinDDKalTestCKF::Node* MarlinDDKalTestCKF::filter( const Node& parent, EVENT::TrackerHit* hit ) {
+
+    DDVTrackHit* kalhit = this->getKalHit( hit ) ;
+
+    if( ! kalhit ) return 0 ;
+
+    TKalTrackSite* site = new TKalTrackSite( *kalhit ) ;
+
+    MaxChi2Filter filter( _maxChi2Increment ) ;
+
+    site->SetFilterCond( &filter ) ;
+
+    // the parent site is the current site of the filter track, i.e. the site is filtered on top of the branch
+    _filterTrack->Add( parent.site ) ;
+
+    const bool accepted = _filterTrack->AddAndFilter( *site ) ;
+
+    // the site outlives the local filter condition
+    site->SetFilterCond( 0 ) ;
+
+    _filterTrack->Clear() ;
+
+    if( ! accepted ) {
+
+      streamlog_out( DEBUG1 ) << "MarlinDDKalTestCKF::filter: hit " << hit << " rejected with chi2 increment " << site->GetDeltaChi2() << std::endl ;
+
+      delete site ;
+
+      return 0 ;
+    }
+
+    Node* node = new Node{ &parent, site, hit, true, parent.chi2 + site->GetDeltaChi2(), parent.nHits + 1, parent.nHoles } ;
+
+    _nodes.push_back( node ) ;
+
+    return node ;
+  }
+
+
+  int MarlinDDKalTestCKF::findTracks( IMarlinTrack* seed, const std::vector<int>& layers, const LayerHitMap& layerHits,
+				      std::vector<IMarlinTrack*>& tracks ) {
+
+    MarlinDDKalTestTrack* seedTrk = dynamic_cast<MarlinDDKalTestTrack*>( seed ) ;
+
+    if( ! seedTrk ) {
+      streamlog_out( ERROR ) << "MarlinDDKalTestCKF::findTracks: the seed is not a MarlinDDKalTestTrack" << std::endl ;
+      return IMarlinTrack::bad_intputs ;
+    }
+
+    if( ! seedTrk->_initialised ) {
+
+      throw MarlinTrk::Exception("Track fit not initialised");
+
+    }
+
+    _filterTrack->SetMass( seedTrk->_kaltrack->GetMass() ) ;
+
+    // the branches start from the last filtered site of the seed, which stays owned by the seed
+    Node* root = new Node{ 0, static_cast<TKalTrackSite*>( seedTrk->_kaltrack->Last() ), 0, false, 0., 0, 0 } ;
+
+    _nodes.push_back( root ) ;
+
+    std::vector<const Node*> candidates( 1, root ) ;
+    std::vector<const Node*> finished ;
+    std::vector<const Node*> next ;
+    std::vector<Node*> branches ;
+
+    for( unsigned l = 0 ; l < layers.size() && ! candidates.empty() ; ++l ) {
+
+      LayerHitMap::const_iterator itHits = layerHits.find( layers[l] ) ;
+
+      next.clear() ;
+
+      for( unsigned c = 0 ; c < candidates.size() ; ++c ) {
+
+	const Node& cand = *candidates[c] ;
+
+	branches.clear() ;
+
+	if( itHits != layerHits.end() ) {
+
+	  const EVENT::TrackerHitVec& hits = itHits->second ;
+
+	  for( unsigned h = 0 ; h < hits.size() ; ++h ) {
+
+	    Node* branch = this->filter( cand, hits[h] ) ;
+
+	    if( branch ) branches.push_back( branch ) ;
+	  }
+	}
+
+	// only the best hits on the layer are followed - the other nodes are released with the tree
+	if( branches.size() > _maxBranchesPerLayer ) {
+	  std::partial_sort( branches.begin(), branches.begin() + _maxBranchesPerLayer, branches.end(), betterCandidate ) ;
+	  branches.resize( _maxBranchesPerLayer ) ;
+	}
+
+	next.insert( next.end(), branches.begin(), branches.end() ) ;
+
+	// the candidate may also miss the layer, sharing the site of its last hit
+	if( cand.nHoles < _maxHoles ) {
+
+	  Node* hole = new Node{ &cand, cand.site, 0, false, cand.chi2, cand.nHits, cand.nHoles + 1 } ;
+
+	  _nodes.push_back( hole ) ;
+
+	  next.push_back( hole ) ;
+	}
+	else if( branches.empty() ) {
+
+	  finished.push_back( &cand ) ;
+	}
+      }
+
+      if( next.size() > _beamWidth ) {
+	std::partial_sort( next.begin(), next.begin() + _beamWidth, next.end(), betterCandidate ) ;
+	next.resize( _beamWidth ) ;
+      }
+
+      candidates.swap( next ) ;
+
+      streamlog_out( DEBUG2 ) << "MarlinDDKalTestCKF::findTracks: " << candidates.size() << " candidates after layer " << layers[l] << std::endl ;
+    }
+
+    candidates.insert( candidates.end(), finished.begin(), finished.end() ) ;
+
+    std::sort( candidates.begin(), candidates.end(), betterCandidate ) ;
+
+    if( candidates.size() > _beamWidth ) candidates.resize( _beamWidth ) ;
+
+    int error_code = IMarlinTrack::no_intersection ;
+
+    for( unsigned c = 0 ; c < candidates.size() ; ++c ) {
+
+      // a candidate without any hit is the seed itself
+      if( candidates[c]->nHits == 0 ) continue ;
+
+      int refit_error = IMarlinTrack::success ;
+
+      IMarlinTrack* trk = this->createTrack( *seedTrk, *candidates[c], refit_error ) ;
+
+      if( trk ) {
+	tracks.push_back( trk ) ;
+	error_code = IMarlinTrack::success ;
+      }
+      else if( error_code != IMarlinTrack::success ) {
+	error_code = refit_error ;
+      }
+    }
+
+    this->clearNodes() ;
+
+    return error_code ;
+  }
+
+
+  IMarlinTrack* MarlinDDKalTestCKF::createTrack( const MarlinDDKalTestTrack& seed, const Node& leaf, int& error_code ) {
+
+    MarlinDDKalTestTrack* trk = new MarlinDDKalTestTrack( _ktest ) ;
+
+    error_code = seed.copyInitialisedTrack( *trk ) ;
+
+    if( error_code != IMarlinTrack::success ) {
+      delete trk ;
+      return 0 ;
+    }
+
+    trk->setMass( seed._kaltrack->GetMass() ) ;
+
+    // the hits of the candidate, from the last layer back to the seed
+    std::vector<EVENT::TrackerHit*> hits ;
+
+    for( const Node* node = &leaf ; node ; node = node->parent ) {
+      if( node->hit ) hits.push_back( node->hit ) ;
+    }
+
+    for( std::vector<EVENT::TrackerHit*>::reverse_iterator it = hits.rbegin() ; it != hits.rend() ; ++it ) {
+      trk->insertKalHit( *it, MarlinDDKalTestTrack::cloneKalHit( *_kalHits[ *it ] ), 0 ) ;
+    }
+
+    error_code = trk->fit( _maxChi2Increment ) ;
+
+    streamlog_out( DEBUG2 ) << "MarlinDDKalTestCKF::createTrack: candidate with " << leaf.nHits << " hits, chi2 " << leaf.chi2
+			    << " refitted : " << errorCode( error_code ) << std::endl ;
+
+    if( error_code != IMarlinTrack::success ) {
+      delete trk ;
+      return 0 ;
+    }
+
+    return trk ;
+  }
+
+} // end of namespace MarlinTrk
@@ -6,6 +6,8 @@
 #include <kaltest/TKalDetCradle.h>
 #include <kaltest/TKalTrack.h>
 #include <kaltest/TKalTrackState.h>
+#include <kaltest/THelicalTrack.h>
+#include <kaltest/TStraightTrack.h>
 #include "kaltest/TKalTrackSite.h"
 #include "TKalFilterCond.h"
 
@@ -22,6 +24,9 @@
 #include "DDKalTest/DDPlanarHit.h"
 //#include "DDKalTest/DDPlanarStripHit.h"
 
+#include <algorithm>
+#include <memory>
+#include <set>
 #include <sstream>
 
 #include "streamlog/streamlog.h"
@@ -57,9 +62,54 @@ protected:
   
   double _maxDeltaChi2 ;
   bool _passed_last_filter_step;
-  
+
 } ;
 
+namespace {
+
+  /** the sorting policy of the measurement layer of the hit, i.e. its position along an outgoing track */
+  double sortingPolicy( const TVTrackHit& hit ) {
+    return dynamic_cast<const TVSurface&>( hit.GetMeasLayer() ).GetSortingPolicy() ;
+  }
+
+  /** the helix of the state or, if the field at its site vanishes, the straight line - owned by the caller */
+  std::unique_ptr<TVTrack> createTrack( const TKalTrackState& state ) {
+    return std::unique_ptr<TVTrack>( &state.CreateTrack() ) ;
+  }
+
+  /** kappa of the straight lines fitted with IMarlinTrkSystem::CFG::useStraightLine in a non-zero field, where KalTest moves
+   *  helices: in 3.5 T the helix deviates from the line by less than 0.1 micron over 2 m. Kappa is pinned by its small error.
+   */
+  const double pinnedKappa = 1.e-7 ;
+
+  /** true for the straight line model that KalTest uses in a vanishing field */
+  bool isStraightLine( const TVTrack& track ) {
+    return dynamic_cast<const TStraightTrack*>( &track ) != 0 ;
+  }
+
+  /** signed path length along the helix for the change dPhi of the turning angle - positive along the momentum.
+   *  The deflection of a straight line is already its path length in the xy-plane. 
+   */
+  double pathLength( const TVTrack& helix, double dPhi ) {
+    const double scale = std::sqrt( 1. + helix.GetTanLambda() * helix.GetTanLambda() ) ;
+    return ( isStraightLine( helix ) ? dPhi * scale : -helix.GetRho() * dPhi * scale ) ;
+  }
+
+  /** time of flight in ns along the path length in mm for a particle with the given mass on the helix -
+   *  kappa of a straight line is set from the momentum assumed for the multiple scattering
+   */
+  double timeOfFlight( const TVTrack& helix, double path, double mass ) {
+
+    const double kappa = std::fabs( helix.GetKappa() ) ;
+    const double p = std::sqrt( 1. + helix.GetTanLambda() * helix.GetTanLambda() ) / kappa ;
+    const double beta = ( kappa > 0. ? p / std::sqrt( p * p + mass * mass ) : 1. ) ;
+
+    // speed of light in mm / ns
+    return path / ( beta * 299.792458 ) ;
+  }
+
+}
+
 namespace MarlinTrk {
   
   //---------------------------------------------------------------------------------------------------------------
@@ -74,7 +124,7 @@ namespace MarlinTrk {
   
   
   MarlinDDKalTestTrack::MarlinDDKalTestTrack( MarlinDDKalTest* ktest) 
-  : _ktest(ktest) {
+  : _ktest(ktest), _compactSites( kSdim ) {
     
     _kaltrack = new TKalTrack() ;
     _kaltrack->SetOwner() ;
@@ -107,9 +157,14 @@ namespace MarlinTrk {
     delete _kalhits ;
   }
   
-  void MarlinDDKalTestTrack::setMass(double mass) {  _kaltrack->SetMass( mass ) ;  } 
+  void MarlinDDKalTestTrack::setMass(double mass) {  
+    _transportMemo.clear() ; // the material effects depend on the mass
+    _kaltrack->SetMass( mass ) ;  
+  } 
   
   double MarlinDDKalTestTrack::getMass() { return _kaltrack->GetMass() ; }
+
+  IMarlinTrkSystem* MarlinDDKalTestTrack::getTrkSystem() { return _ktest ; }
   
   
   int MarlinDDKalTestTrack::addHit( EVENT::TrackerHit * trkhit) {
@@ -154,6 +209,8 @@ namespace MarlinTrk {
   
   
   int MarlinDDKalTestTrack::initialise( bool fitDirection ) {; 
+    // memoised transports start from the sites and are invalid once they change
+    _transportMemo.clear() ;
     
     
     //SJA:FIXME: check here if the track is already initialised, and for now don't allow it to be re-initialised
@@ -172,6 +229,8 @@ namespace MarlinTrk {
       
     }
     
+    if( _ktest->getOption( MarlinTrk::IMarlinTrkSystem::CFG::useHitSorting ) ) this->sortHits() ;
+
     _fitDirection =  fitDirection ; 
     
     // establish the hit order
@@ -249,8 +308,30 @@ namespace MarlinTrk {
     << "Bz = " << h1.GetBfield() << " direction = " << _fitDirection
     << std::endl;
     
-    // create helix using 3 global space points 
-    THelicalTrack helstart(x1, x2, x3, h1.GetBfield(), _fitDirection); // initial helix 
+    _straightLine = ( h1.GetBfield() == 0. || _ktest->getOption( IMarlinTrkSystem::CFG::useStraightLine ) ) ;
+    
+    // create helix using 3 global space points - for a straight line a line through the innermost and outermost hit:
+    // in a vanishing field kappa is set from the momentum assumed for the multiple scattering, else it is pinned
+    std::unique_ptr<TVTrack> pHelstart ;
+    
+    if( _straightLine ) {
+      
+      const TVector3 dx = ( _fitDirection == kIterBackward ? x1 - x3 : x3 - x1 ) ;
+      const double tanL = dx.Z() / dx.Perp() ;
+      
+      if( h1.GetBfield() == 0. ) {
+        const double kappa = std::sqrt( 1. + tanL * tanL ) / _ktest->getStraightLineMomentum() ;
+        pHelstart.reset( new TStraightTrack( 0., toBaseRange( dx.Phi() - M_PI/2. ), kappa, 0., tanL, x1.X(), x1.Y(), x1.Z(), 0. ) ) ;
+      } else {
+        pHelstart.reset( new THelicalTrack( 0., toBaseRange( dx.Phi() - M_PI/2. ), pinnedKappa, 0., tanL, x1.X(), x1.Y(), x1.Z(), h1.GetBfield() ) ) ;
+      }
+      
+    } else {
+      
+      pHelstart.reset( new THelicalTrack(x1, x2, x3, h1.GetBfield(), _fitDirection) ) ; // initial helix 
+    }
+    
+    const TVTrack& helstart = *pHelstart ;
     
     // ---------------------------
     //  Set up initial track state ... could try to use lcio track parameters ...
@@ -286,7 +367,7 @@ namespace MarlinTrk {
     
     Cov(0,0) = 1.e6 ; // d0
     Cov(1,1) = 1.e2 ; // dphi0
-    Cov(2,2) = 1.e1 ; // dkappa
+    Cov(2,2) = ( _straightLine ? 1.e-2 * helstart.GetKappa() * helstart.GetKappa() : 1.e1 ) ; // dkappa - not measured by a straight line
     Cov(3,3) = 1.e6 ; // dz
     Cov(4,4) = 1.e1 ; // dtanL
     if (kSdim == 6) Cov(5,5) = 1.e2;  // t0
@@ -304,7 +385,7 @@ namespace MarlinTrk {
     streamlog_out( DEBUG2 ) << " track parameters used for init : " << std::scientific << std::setprecision(6) 
 			    << "\t D0 "          <<  0.0
 			    << "\t Phi :"        <<  toBaseRange( helstart.GetPhi0() + M_PI/2. )
-			    << "\t Omega "       <<  1. /helstart.GetRho() 
+			    << "\t Omega "       <<  ( _straightLine ? 0. : 1. /helstart.GetRho() )
 			    << "\t Z0 "          <<  0.0
 			    << "\t tan(Lambda) " <<  helstart.GetTanLambda()
       
@@ -318,7 +399,7 @@ namespace MarlinTrk {
     
     double d0        =    0.0 ;
     double phi       =    toBaseRange( helstart.GetPhi0() + M_PI/2. );
-    double omega     =    1. /helstart.GetRho()  ;              
+    double omega     =    ( _straightLine ? 0. : 1. /helstart.GetRho() ) ;              
     double z0        =    0.0 ;
     double tanLambda =    helstart.GetTanLambda()  ;
     
@@ -344,6 +425,7 @@ namespace MarlinTrk {
   }
   
   int MarlinDDKalTestTrack::initialise(  const EVENT::TrackState& ts, double /*bfield_z*/, bool fitDirection ) {
+    _transportMemo.clear() ;
 
     // the bfield_z is not taken from the argument but from the first hit 
     // should consider changing the interface ...
@@ -375,31 +457,50 @@ namespace MarlinTrk {
     << std::endl ;
 
     
+    if( _ktest->getOption( MarlinTrk::IMarlinTrkSystem::CFG::useHitSorting ) ) this->sortHits() ;
+
     _fitDirection = fitDirection ;
     
     // get Bz from first hit
     TVTrackHit &h1 = *dynamic_cast<TVTrackHit *>(_kalhits->At(0)); 
     double Bz  =  h1.GetBfield() ;
 
+    _straightLine = ( Bz == 0. || _ktest->getOption( IMarlinTrkSystem::CFG::useStraightLine ) ) ;
+
     // for GeV, Tesla, R in mm  
     double alpha = Bz * 2.99792458E-4 ;
 
-    double kappa = ( Bz == 0.0 ?  DBL_MAX : ts.getOmega() / alpha  ) ;
+    // omega of the track state is ignored for a straight line: KalTest moves straight lines in a vanishing field and kappa is set 
+    // from the momentum assumed for the multiple scattering, in a non-zero field kappa is pinned
+    const double kappa = ( _straightLine ? 
+                           ( Bz == 0. ? std::sqrt( 1. + ts.getTanLambda() * ts.getTanLambda() ) / _ktest->getStraightLineMomentum() : pinnedKappa ) : 
+                           ts.getOmega() / alpha  ) ;
+    
+    std::unique_ptr<TVTrack> pHelix ;
+    
+    if( Bz == 0. ) {
+      pHelix.reset( new TStraightTrack( -ts.getD0(), toBaseRange( ts.getPhi() - M_PI/2. ), kappa, ts.getZ0(), ts.getTanLambda(),
+                                        ts.getReferencePoint()[0], ts.getReferencePoint()[1], ts.getReferencePoint()[2], Bz ) ) ;
+    } else {
+      pHelix.reset( new THelicalTrack( -ts.getD0(), toBaseRange( ts.getPhi() - M_PI/2. ), kappa, ts.getZ0(), ts.getTanLambda(),
+                                       ts.getReferencePoint()[0], ts.getReferencePoint()[1], ts.getReferencePoint()[2], Bz ) ) ;
+    }
     
-    THelicalTrack helix( -ts.getD0(),
-                        toBaseRange( ts.getPhi() - M_PI/2. ) ,
-                        kappa,
-                        ts.getZ0(),
-                        ts.getTanLambda(),
-                        ts.getReferencePoint()[0],
-                        ts.getReferencePoint()[1],
-                        ts.getReferencePoint()[2],
-                        Bz );
+    TVTrack& helix = *pHelix ;
     
-    TMatrixD cov(5,5) ;   
+    TKalMatrix cov(5,5) ;   
 
     EVENT::FloatVec covLCIO = ts.getCovMatrix();
     
+    // the curvature is not measured by a straight line: the omega entries are replaced by an uncorrelated 
+    // kappa with a fixed relative error, which needs no conversion
+    if( _straightLine ) {
+      for( int i = 3 ; i < 6 ; ++i ) covLCIO[i] = 0. ;
+      covLCIO[ 8] = covLCIO[12] = 0. ;
+      alpha = 1. ;
+      covLCIO[ 5] = 1.e-2 * kappa * kappa ;
+    }
+    
     cov( 0 , 0 ) =   covLCIO[ 0] ;                   //   d0, d0
     cov( 0 , 1 ) = - covLCIO[ 1] ;                   //   d0, phi
     cov( 0 , 2 ) = - covLCIO[ 3] / alpha ;           //   d0, kappa
@@ -559,7 +660,7 @@ namespace MarlinTrk {
     
     double d0        =  - helix.GetDrho() ;
     double phi       =    toBaseRange( helix.GetPhi0() + M_PI/2. );
-    double omega     =    1. /helix.GetRho()  ;              
+    double omega     =    ( _straightLine ? 0. : 1. /helix.GetRho() ) ;              
     double z0        =    helix.GetDz()   ;
     double tanLambda =    helix.GetTanLambda()  ;
         
@@ -582,6 +683,7 @@ namespace MarlinTrk {
   } 
   
   int MarlinDDKalTestTrack::addAndFit( DDVTrackHit* kalhit, double& chi2increment, TKalTrackSite*& site, double maxChi2Increment) {
+    _transportMemo.clear() ;
     
     streamlog_out(DEBUG1) << "MarlinDDKalTestTrack::addAndFit called : maxChi2Increment = "  << std::scientific << maxChi2Increment << std::endl ;
     
@@ -733,29 +835,62 @@ namespace MarlinTrk {
       return error_code ;
     }
     else {
-      this->addHit( trkhit, kalhit, ml ) ; 
-      _hit_used_for_sites[trkhit] = site ;
-      _hit_chi2_values.push_back(std::make_pair(trkhit, chi2increment));
+      this->addHit( trkhit, kalhit, ml ) ;
+      this->recordSite( trkhit, site, chi2increment ) ;
     }
-    
-    // set the values for the point at which the fit becomes constained 
-    if( _trackHitAtPositiveNDF == 0 && _kaltrack->GetNDF() >= 0){
+
+    return success ;
+
+  }
+
+
+  void MarlinDDKalTestTrack::recordSite( EVENT::TrackerHit* trkhit, TKalTrackSite* site, double chi2increment ) {
+
+    _hit_used_for_sites[trkhit] = site ;
+    _hit_chi2_values.push_back(std::make_pair(trkhit, chi2increment));
+
+    // accumulate the path from the previous site, moving a copy of its helix to the pivot of the new site
+    std::pair<double, double> path( 0., 0. ) ;
+
+    const int index = _kaltrack->IndexOf( site ) ;
+
+    if( index > 1 ) {
+
+      const TKalTrackSite& previous = this->getSite( index - 1 ) ;
+
+      EVENT::TrackerHit* previousHit = static_cast<const DDVTrackHit&>( previous.GetHit() ).getLCIOTrackerHit() ;
+
+      std::map<EVENT::TrackerHit*, std::pair<double, double> >::const_iterator it = _hit_path_lengths.find( previousHit ) ;
+      if( it != _hit_path_lengths.end() ) path = it->second ;
+
+      std::unique_ptr<TVTrack> helix = createTrack( static_cast<const TKalTrackState&>( previous.GetCurState() ) ) ;
+      double dPhi = 0. ;
+      helix->MoveTo( site->GetPivot(), dPhi, 0, 0 ) ;
+
+      const double step = std::fabs( pathLength( *helix, dPhi ) ) ;
+
+      path.first  += step ;
+      path.second += timeOfFlight( *helix, step, _kaltrack->GetMass() ) ;
+    }
+
+    _hit_path_lengths[trkhit] = path ;
+
+    // set the values for the point at which the fit becomes constained
+    if( _trackHitAtPositiveNDF == 0 && this->kalTrackNDF() >= 0){
 
       _trackHitAtPositiveNDF = trkhit;
       _hitIndexAtPositiveNDF = _kaltrack->IndexOf( site );
-      
+
       streamlog_out( DEBUG2 ) << ">>>>>>>>>>>  Fit is now constrained at : "
-      << cellIDString( trkhit->getCellID0() ) 
+      << cellIDString( trkhit->getCellID0() )
       << " pos " << Vector3D( trkhit->getPosition() )
       << " trkhit = " << _trackHitAtPositiveNDF
       << " index of kalhit = " << _hitIndexAtPositiveNDF
-      << " NDF = " << _kaltrack->GetNDF() 
-      <<  std::endl; 
-    
+      << " NDF = " << this->kalTrackNDF()
+      <<  std::endl;
+
     }
 
-    return success ;
-    
   }
   
   
@@ -790,208 +925,627 @@ namespace MarlinTrk {
     
     TKalTrackSite* site = 0 ;
     int error_code = this->addAndFit( kalhit, chi2increment, site, -DBL_MAX); // using -DBL_MAX here ensures the hit will never be added to the fit
-    
-    delete kalhit;  
-    
+
+    delete kalhit;
+
     return error_code;
-    
+
   }
-  
-  
-  
-  int MarlinDDKalTestTrack::fit( double maxChi2Increment ) {
-    
-    // SJA:FIXME: what do we do about calling fit after we have already added hits and filtered
-    // I guess this would created new sites when addAndFit is called 
-    // one option would be to remove the sites 
-    // need to check where the sites are stored ...  probably in the KalTrackSystem
-    // 
-    
-    streamlog_out(DEBUG2) << "MarlinDDKalTestTrack::fit() called " << std::endl ;
-    
-    if ( ! _initialised ) {
-      
-      throw MarlinTrk::Exception("Track fit not initialised");   
-      
-    }
-    
-    // ---------------------------
-    //  Prepare hit iterrator for adding hits to kaltrack
-    // ---------------------------
-    
-    TIter next(_kalhits, _fitDirection); 
-    
-    // ---------------------------
-    //  Start Kalman Filter
-    // ---------------------------
-    
-    DDVTrackHit *kalhit = 0;
-    
-    while ( (kalhit = dynamic_cast<DDVTrackHit *>( next() ) ) ) {
-      
-      double chi2increment;
-      TKalTrackSite* site=nullptr;
-      int error_code = this->addAndFit( kalhit, chi2increment, site, maxChi2Increment );
-      
-      
-      EVENT::TrackerHit* trkhit = kalhit->getLCIOTrackerHit();
-      
-      if( error_code == 0 ){ // add trkhit to map associating trkhits and sites
-        _hit_used_for_sites[trkhit] = site;
-        _hit_chi2_values.push_back(std::make_pair(trkhit, chi2increment));
 
-        // set the values for the point at which the fit becomes constained 
-        if( _trackHitAtPositiveNDF == 0 && _kaltrack->GetNDF() >= 0){
-          
-          _trackHitAtPositiveNDF = trkhit;
-          _hitIndexAtPositiveNDF = _kaltrack->IndexOf( site );
-          
-          streamlog_out( DEBUG2 ) << ">>>>>>>>>>>  Fit is now constrained at : "
-          << cellIDString( trkhit->getCellID0() ) 
-          << " pos " << Vector3D( trkhit->getPosition() )
-          << " trkhit = " << _trackHitAtPositiveNDF
-          << " index of kalhit = " << _hitIndexAtPositiveNDF
-          << " NDF = " << _kaltrack->GetNDF() 
-          <<  std::endl; 
-          
-        }
-            
-      } 
-      else { // hit rejected by the filter, so store in the list of rejected hits
 
-        // if the hit fails for any reason other than the Chi2 cut record the Chi2 contibution as DBL_MAX
-        if( error_code != site_fails_chi2_cut ) {
-          chi2increment = DBL_MAX;
-        }
-        
-        _outlier_chi2_values.push_back(std::make_pair(trkhit, chi2increment));
-        streamlog_out( DEBUG2 ) << ">>>>>>>>>>>  fit(): Number of Outliers : "
-        << _outlier_chi2_values.size() << std::endl;
+  int MarlinDDKalTestTrack::removeHit( EVENT::TrackerHit* trkhit ) {
+    _transportMemo.clear() ;
 
-        _hit_not_used_for_sites.push_back(trkhit) ;
-        
-      }
-      
-    } // end of Kalman filter
-    
-    if( _ktest->getOption(  MarlinTrk::IMarlinTrkSystem::CFG::useSmoothing ) ){
-      streamlog_out( DEBUG2 )  << "Perform Smoothing for All Previous Measurement Sites " << std::endl ;
-      int error = this->smooth() ;
-      
-      if( error != success ) return error ;
-      
+    streamlog_out(DEBUG2) << "MarlinDDKalTestTrack::removeHit( EVENT::TrackerHit* " << trkhit << " ) called " << std::endl ;
+
+    if( ! trkhit ) {
+      streamlog_out( ERROR) << "MarlinDDKalTestTrack::removeHit( EVENT::TrackerHit* trkhit ): trkhit == 0"  << std::endl;
+      return bad_intputs ;
     }
-    
-    //return _hit_used_for_sites.empty() == false ? success : all_sites_fail_fit ;
-    if( _hit_used_for_sites.empty() == false )
-    {
-        return success ;
+
+    if ( ! _initialised ) {
+
+      throw MarlinTrk::Exception("Track fit not initialised");
+
     }
-    else{
-        return all_sites_fail_fit ;
+
+    if( _compactSites.size() ) {
+      streamlog_out( ERROR) << "MarlinDDKalTestTrack::removeHit: the sites of the track have been compacted - cannot refit" << std::endl;
+      return error ;
     }
-    
-  }
-  
-  
-  /** smooth all track states 
-   */
-  int MarlinDDKalTestTrack::smooth(){
-    
-    streamlog_out( DEBUG2 )  << "MarlinDDKalTestTrack::smooth() " << std::endl ;
-    
-    //fg: we should actually smooth all sites - it is then up to the user which smoothed tracks state to take 
-    //    for any furthter extrapolation/propagation ...
- 
-    if( !_smoothed ) 
-      _kaltrack->SmoothAll() ;
-    
-    //SJA:FIXME: in the current implementation it is only possible to smooth back to the 4th site.
-    // This is due to the fact that the covariance matrix is not well defined at the first 3 measurement sites filtered.
-    
-    //    _kaltrack->SmoothBackTo( _hitIndexAtPositiveNDF + 1 ) ;
-    
-   _smoothed = true ;
 
-    return success ;
-    
-  }
-  
-  
-  /** smooth track states from the last filtered hit back to the measurement site associated with the given hit 
-   */
-  int MarlinDDKalTestTrack::smooth( EVENT::TrackerHit* trkhit ) {
-    
-    streamlog_out( DEBUG2 )  << "MarlinDDKalTestTrack::smooth( EVENT::TrackerHit* " << trkhit << "  ) " << std::endl ;
+    // a hit rejected by the filter does not contribute to any site, so it only has to be forgotten
+    std::vector<EVENT::TrackerHit*>::iterator itNotUsed = std::find( _hit_not_used_for_sites.begin(), _hit_not_used_for_sites.end(), trkhit ) ;
 
-    
-    if ( !trkhit ) {
-      return bad_intputs ;
+    std::vector< std::pair<EVENT::TrackerHit*, double> >::iterator itOutlier = _outlier_chi2_values.begin() ;
+    while( itOutlier != _outlier_chi2_values.end() && itOutlier->first != trkhit ) ++itOutlier ;
+
+    if( itNotUsed != _hit_not_used_for_sites.end() || itOutlier != _outlier_chi2_values.end() ) {
+
+      if( itNotUsed != _hit_not_used_for_sites.end() ) _hit_not_used_for_sites.erase( itNotUsed ) ;
+      if( itOutlier != _outlier_chi2_values.end()    ) _outlier_chi2_values.erase( itOutlier ) ;
+
+      this->removeKalHit( trkhit ) ;
+
+      return success ;
     }
-    
-    
-    std::map<EVENT::TrackerHit*,TKalTrackSite*>::const_iterator it;
-    
-    
-    TKalTrackSite* site = 0 ;
-    int error_code = getSiteFromLCIOHit(trkhit, site);
-    
-    if( error_code != success ) return error_code ;
-    
-    int index = _kaltrack->IndexOf( site );
-    
-    _kaltrack->SmoothBackTo( index ) ;
-    
-    _smoothed = true ;
-    
-    return success ;
-    
-  }
-  
-  
-  int  MarlinDDKalTestTrack::getTrackState( IMPL::TrackStateImpl& ts, double& chi2, int& ndf ) {
-    
-    streamlog_out( DEBUG2 )  << "MarlinDDKalTestTrack::getTrackState( IMPL::TrackStateImpl& ts ) " << std::endl ;
-    
-    // use the last filtered track state 
-    const TKalTrackSite& site = *(dynamic_cast<const TKalTrackSite*>(_kaltrack->Last())) ;
-    
-    this->ToLCIOTrackState( site, ts, chi2, ndf );
-    
-    return success ;
-    
-    
-  }
-  
-  
-  int MarlinDDKalTestTrack::getTrackState( EVENT::TrackerHit* trkhit, IMPL::TrackStateImpl& ts, double& chi2, int& ndf ) {
-    
-    streamlog_out( DEBUG2 )  << "MarlinDDKalTestTrack::getTrackState( EVENT::TrackerHit* trkhit, IMPL::TrackStateImpl& ts ) using hit: " << trkhit << " with cellID0 = " << trkhit->getCellID0() << std::endl ;
-    
+
     TKalTrackSite* site = 0 ;
-    int error_code = getSiteFromLCIOHit(trkhit, site);
-    
+    int error_code = getSiteFromLCIOHit( trkhit, site ) ;
+
     if( error_code != success ) return error_code ;
-    
-    streamlog_out( DEBUG1 )  << "MarlinDDKalTestTrack::getTrackState: site " << site << std::endl;
-    
-    this->ToLCIOTrackState( *site, ts, chi2, ndf );
-    
-    return success ;
-  }
-  
-  
-  int MarlinDDKalTestTrack::getHitsInFit( std::vector<std::pair<EVENT::TrackerHit*, double> >& hits ) {
-    
-    std::copy( _hit_chi2_values.begin() , _hit_chi2_values.end() , std::back_inserter(  hits  )  ) ;
 
-    // this needs more thought. What about when the hits are added using addAndFit?
+    const bool wasSmoothed = _smoothed ;
 
-    // need to check the order so that we can return the list ordered in time
-    // as they will be added to _hit_chi2_values in the order of fitting 
-    // not in the order of time
-//    
-//    if( _fitDirection == IMarlinTrack::backward ){    
+    // the sites in front of the hit are not affected, the hit itself and all hits behind it are taken off the track ...
+    std::vector<EVENT::TrackerHit*> refitHits ;
+    this->truncateSites( _kaltrack->IndexOf( site ), refitHits ) ;
+
+    refitHits.erase( refitHits.begin() ) ;
+    this->removeKalHit( trkhit ) ;
+
+    // ... and the hits behind it are filtered again, without having to find and convert them again
+    this->refilterHits( refitHits ) ;
+
+    streamlog_out(DEBUG2) << "MarlinDDKalTestTrack::removeHit: hit removed, " << refitHits.size() << " sites re-filtered " << std::endl ;
+
+    return wasSmoothed ? this->smooth() : success ;
+
+  }
+
+
+  int MarlinDDKalTestTrack::insertHit( EVENT::TrackerHit* trkhit, double& chi2increment, double maxChi2Increment ) {
+    _transportMemo.clear() ;
+
+    streamlog_out(DEBUG2) << "MarlinDDKalTestTrack::insertHit( EVENT::TrackerHit* " << trkhit << " ) called : maxChi2Increment = "  << std::scientific << maxChi2Increment << std::endl ;
+
+    if( ! trkhit ) {
+      streamlog_out( ERROR) << "MarlinDDKalTestTrack::insertHit( EVENT::TrackerHit* trkhit, double& chi2increment, double maxChi2Increment): trkhit == 0"  << std::endl;
+      return bad_intputs ;
+    }
+
+    if ( ! _initialised ) {
+
+      throw MarlinTrk::Exception("Track fit not initialised");
+
+    }
+
+    if( _compactSites.size() ) {
+      streamlog_out( ERROR) << "MarlinDDKalTestTrack::insertHit: the sites of the track have been compacted - cannot refit" << std::endl;
+      return error ;
+    }
+
+    if( _lcio_hits_to_kaltest_hits.find( trkhit ) != _lcio_hits_to_kaltest_hits.end() ) {
+      streamlog_out( DEBUG2 ) << "MarlinDDKalTestTrack::insertHit: hit " << trkhit << " is already part of the track" << std::endl ;
+      return bad_intputs ;
+    }
+
+    const DDVMeasLayer* ml = _ktest->findMeasLayer( trkhit ) ;
+
+    if( ml == 0 ){
+
+      streamlog_out( ERROR ) << ">>>>>>>>>>>  no measurment layer found for trkhit cellid0 : "
+      << cellIDString( trkhit->getCellID0() ) << " at "
+      << Vector3D( trkhit->getPosition() ) << std::endl ;
+
+      return  IMarlinTrack::bad_intputs ;
+    }
+
+    DDVTrackHit* kalhit = ml->ConvertLCIOTrkHit(trkhit) ;
+
+    if( kalhit == 0 ){  //fg: ml->ConvertLCIOTrkHit returns 0 if hit not on surface !!!
+      return IMarlinTrack::bad_intputs ;
+    }
+
+    // find the first site that has to be filtered after the new hit:
+    // the sorting policy increases along the fit for IMarlinTrack::forward and decreases for IMarlinTrack::backward
+    const bool increasing = ( _fitDirection == IMarlinTrack::forward ) ;
+    const double key = sortingPolicy( *kalhit ) ;
+
+    int index = _kaltrack->GetEntriesFast() ;
+
+    // the first site is the initial site, which is never replaced
+    for( int i = 1, n = _kaltrack->GetEntriesFast() ; i < n ; ++i ) {
+
+      const double siteKey = sortingPolicy( static_cast<TKalTrackSite*>( _kaltrack->At( i ) )->GetHit() ) ;
+
+      if( increasing ? key < siteKey : key > siteKey ) {
+        index = i ;
+        break ;
+      }
+    }
+
+    const bool wasSmoothed = _smoothed ;
+
+    std::vector<EVENT::TrackerHit*> refitHits ;
+    this->truncateSites( index, refitHits ) ;
+
+    TKalTrackSite* site = 0 ;
+    int error_code = this->addAndFit( kalhit, chi2increment, site, maxChi2Increment );
+
+    if( error_code == success ) {
+
+      this->insertKalHit( trkhit, kalhit, refitHits.empty() ? 0 : refitHits.front() ) ;
+      this->recordSite( trkhit, site, chi2increment ) ;
+
+    }
+    else {
+
+      delete kalhit;
+
+      // if the hit fails for any reason other than the Chi2 cut record the Chi2 contibution as DBL_MAX
+      if( error_code != site_fails_chi2_cut ) {
+        chi2increment = DBL_MAX;
+      }
+
+      _outlier_chi2_values.push_back(std::make_pair(trkhit, chi2increment));
+    }
+
+    this->refilterHits( refitHits ) ;
+
+    streamlog_out(DEBUG2) << "MarlinDDKalTestTrack::insertHit: " << errorCode( error_code ) << " at site index " << index
+    << ", " << refitHits.size() << " sites re-filtered " << std::endl ;
+
+    if( wasSmoothed ) {
+
+      int smooth_error = this->smooth() ;
+
+      if( smooth_error != success ) return smooth_error ;
+    }
+
+    return error_code ;
+
+  }
+
+
+  int MarlinDDKalTestTrack::fitMassHypotheses( const std::vector<double>& masses, std::vector<IMarlinTrack*>& tracks, double maxChi2Increment ) {
+
+    streamlog_out(DEBUG2) << "MarlinDDKalTestTrack::fitMassHypotheses called for " << masses.size() << " masses" << std::endl ;
+
+    if ( ! _initialised ) {
+
+      throw MarlinTrk::Exception("Track fit not initialised");
+
+    }
+
+    int error_code = success ;
+
+    tracks.reserve( tracks.size() + masses.size() ) ;
+
+    for( unsigned i = 0 ; i < masses.size() ; ++i ) {
+
+      MarlinDDKalTestTrack* trk = new MarlinDDKalTestTrack( _ktest ) ;
+
+      int trk_error = this->copyInitialisedTrack( *trk ) ;
+
+      if( trk_error != success ) {
+        delete trk ;
+        return trk_error ;
+      }
+
+      // only the material effects differ between the hypotheses
+      trk->setMass( masses[i] ) ;
+
+      trk_error = trk->fit( maxChi2Increment ) ;
+
+      streamlog_out(DEBUG2) << "MarlinDDKalTestTrack::fitMassHypotheses: mass " << masses[i] << " : " << errorCode( trk_error ) << std::endl ;
+
+      if( trk_error != success && error_code == success ) error_code = trk_error ;
+
+      tracks.push_back( trk ) ;
+    }
+
+    return error_code ;
+
+  }
+
+
+  DDVTrackHit* MarlinDDKalTestTrack::cloneKalHit( const TVTrackHit& hit ) {
+
+    if( const DDCylinderHit* cylhit = dynamic_cast<const DDCylinderHit*>( &hit ) ) return new DDCylinderHit( *cylhit ) ;
+    if( const DDPlanarHit* planehit = dynamic_cast<const DDPlanarHit*>( &hit ) ) return new DDPlanarHit( *planehit ) ;
+
+    return 0 ;
+  }
+
+
+  int MarlinDDKalTestTrack::copyInitialisedTrack( MarlinDDKalTestTrack& trk ) const {
+
+    const TKalTrackSite& initialSite = *static_cast<const TKalTrackSite*>( _kaltrack->At( 0 ) ) ;
+
+    if( initialSite.GetLast() < TVKalSite::kFiltered ) {
+      streamlog_out( ERROR) << "MarlinDDKalTestTrack::copyInitialisedTrack: the initial site has been compacted" << std::endl;
+      return error ;
+    }
+
+    // the kaltest hits keep their measurement layer, i.e. no navigation and conversion is needed for the copies
+    TIter next( _kalhits ) ;
+
+    while( const DDVTrackHit* kalhit = dynamic_cast<const DDVTrackHit*>( next() ) ) {
+
+      DDVTrackHit* hit = cloneKalHit( *kalhit ) ;
+
+      if( ! hit ) {
+        streamlog_out( ERROR) << "MarlinDDKalTestTrack::copyInitialisedTrack: unsupported hit type" << std::endl;
+        return error ;
+      }
+
+      trk._kalhits->Add( hit ) ;
+      trk._lcio_hits_to_kaltest_hits[ hit->getLCIOTrackerHit() ] = hit ;
+    }
+
+    // the initial site with copies of its dummy hit and of its initial predicted and filtered states
+    DDVTrackHit* dummyHit = cloneKalHit( initialSite.GetHit() ) ;
+
+    if( ! dummyHit ) {
+      streamlog_out( ERROR) << "MarlinDDKalTestTrack::copyInitialisedTrack: unsupported hit type" << std::endl;
+      return error ;
+    }
+
+    TKalTrackSite& site = *new TKalTrackSite( *dummyHit ) ;
+
+    site.SetHitOwner();// site owns hit
+    site.SetOwner();   // site owns states
+
+    site.SetPivot( initialSite.GetPivot() ) ;
+
+    for( int type = TVKalSite::kPredicted ; type <= TVKalSite::kFiltered ; ++type ) {
+
+      const TVKalState& state = *static_cast<const TVKalState*>( initialSite.At( type ) ) ;
+
+      site.Add( new TKalTrackState( state, state.GetCovMat(), site, type ) ) ;
+    }
+
+    trk._kaltrack->Add( &site ) ;
+
+    trk._fitDirection = _fitDirection ;
+    trk._initialised = true ;
+
+    return success ;
+  }
+
+
+  void MarlinDDKalTestTrack::truncateSites( int index, std::vector<EVENT::TrackerHit*>& removedHits ) {
+    _transportMemo.clear() ;
+
+    // the filtered states in front of index do not depend on the removed sites but the smoothed states do
+    if( _smoothed ) this->removeSmoothedStates() ;
+
+    const int last = _kaltrack->GetLast() ;
+
+    // never remove the initial site
+    if( index < 1 ) index = 1 ;
+
+    if( index > last ) return ;
+
+    removedHits.reserve( last - index + 1 ) ;
+
+    for( int i = index ; i <= last ; ++i ) {
+      removedHits.push_back( static_cast<const DDVTrackHit&>( static_cast<TKalTrackSite*>( _kaltrack->At( i ) )->GetHit() ).getLCIOTrackerHit() ) ;
+    }
+
+    for( int i = last ; i >= index ; --i ) {
+
+      delete _kaltrack->RemoveAt( i ) ;
+
+      EVENT::TrackerHit* trkhit = removedHits[ i - index ] ;
+
+      _hit_used_for_sites.erase( trkhit ) ;
+      _hit_path_lengths.erase( trkhit ) ;
+
+      // take the chi2 increment of the site off the track
+      for( unsigned j = _hit_chi2_values.size() ; j > 0 ; --j ) {
+
+        if( _hit_chi2_values[ j-1 ].first == trkhit ) {
+
+          _kaltrack->IncreaseChi2( - _hit_chi2_values[ j-1 ].second ) ;
+          _hit_chi2_values.erase( _hit_chi2_values.begin() + ( j-1 ) ) ;
+          break ;
+        }
+      }
+    }
+
+    // make the last remaining site the current site of the track again, so that filtering continues from it
+    _kaltrack->Add( _kaltrack->RemoveAt( index - 1 ) ) ;
+
+    if( _hitIndexAtPositiveNDF >= index ) {
+      _trackHitAtPositiveNDF = 0 ;
+      _hitIndexAtPositiveNDF = 0 ;
+    }
+
+  }
+
+
+  void MarlinDDKalTestTrack::refilterHits( const std::vector<EVENT::TrackerHit*>& trkhits ) {
+
+    for( unsigned i = 0 ; i < trkhits.size() ; ++i ) {
+
+      EVENT::TrackerHit* trkhit = trkhits[i] ;
+
+      double chi2increment = 0. ;
+      TKalTrackSite* site = 0 ;
+
+      // these hits have already been accepted, so no chi2 cut is applied again
+      int error_code = this->addAndFit( _lcio_hits_to_kaltest_hits[trkhit], chi2increment, site, DBL_MAX ) ;
+
+      if( error_code == success ) {
+        this->recordSite( trkhit, site, chi2increment ) ;
+      }
+      else {
+
+        streamlog_out( DEBUG2 ) << "MarlinDDKalTestTrack::refilterHits: hit " << trkhit << " discarded by the filter " << std::endl ;
+
+        _outlier_chi2_values.push_back(std::make_pair(trkhit, DBL_MAX));
+        _hit_not_used_for_sites.push_back(trkhit) ;
+      }
+    }
+
+  }
+
+
+  void MarlinDDKalTestTrack::removeSmoothedStates() {
+    _transportMemo.clear() ;
+
+    for( int i = 0, n = _kaltrack->GetEntriesFast() ; i < n ; ++i ) {
+
+      TVKalSite* site = static_cast<TVKalSite*>( _kaltrack->At( i ) ) ;
+
+      if( site->GetLast() < TVKalSite::kSmoothed ) continue ;
+
+      // the site owns its states, smoothed and inverse filtered states are stored after the filtered one
+      for( int st = site->GetLast() ; st >= TVKalSite::kSmoothed ; --st ) {
+        delete site->RemoveAt( st ) ;
+      }
+
+      // adding the filtered state again makes it the current state of the site
+      site->Add( site->RemoveAt( TVKalSite::kFiltered ) ) ;
+    }
+
+    _smoothed = false ;
+
+  }
+
+
+  void MarlinDDKalTestTrack::insertKalHit( EVENT::TrackerHit* trkhit, DDVTrackHit* kalhit, EVENT::TrackerHit* nextInFit ) {
+
+    // _kalhits is ordered in time, the fit runs through it in the direction given by _fitDirection
+    const int n = _kalhits->GetEntriesFast() ;
+
+    int index = ( _fitDirection == IMarlinTrack::forward ? n : 0 ) ;
+
+    if( nextInFit ) {
+
+      int next = _kalhits->IndexOf( _lcio_hits_to_kaltest_hits[nextInFit] ) ;
+
+      if( next >= 0 ) index = ( _fitDirection == IMarlinTrack::forward ? next : next + 1 ) ;
+    }
+
+    for( int i = n ; i > index ; --i ) {
+      _kalhits->AddAtAndExpand( _kalhits->At( i-1 ), i ) ;
+    }
+
+    _kalhits->AddAtAndExpand( kalhit, index ) ;
+
+    _lcio_hits_to_kaltest_hits[trkhit] = kalhit ;
+
+  }
+
+
+  void MarlinDDKalTestTrack::removeKalHit( EVENT::TrackerHit* trkhit ) {
+
+    std::map<EVENT::TrackerHit*,DDVTrackHit*>::iterator it = _lcio_hits_to_kaltest_hits.find( trkhit ) ;
+
+    if( it == _lcio_hits_to_kaltest_hits.end() ) return ;
+
+    _kalhits->Remove( it->second ) ;
+    _kalhits->Compress() ;
+
+    delete it->second ;
+
+    _lcio_hits_to_kaltest_hits.erase( it ) ;
+
+  }
+
+  
+  
+  int MarlinDDKalTestTrack::fit( double maxChi2Increment ) {
+    _transportMemo.clear() ;
+    
+    // SJA:FIXME: what do we do about calling fit after we have already added hits and filtered
+    // I guess this would created new sites when addAndFit is called 
+    // one option would be to remove the sites 
+    // need to check where the sites are stored ...  probably in the KalTrackSystem
+    // 
+    
+    streamlog_out(DEBUG2) << "MarlinDDKalTestTrack::fit() called " << std::endl ;
+    
+    if ( ! _initialised ) {
+      
+      throw MarlinTrk::Exception("Track fit not initialised");   
+      
+    }
+    
+    // ---------------------------
+    //  Prepare hit iterrator for adding hits to kaltrack
+    // ---------------------------
+    
+    TIter next(_kalhits, _fitDirection); 
+    
+    // ---------------------------
+    //  Start Kalman Filter
+    // ---------------------------
+    
+    DDVTrackHit *kalhit = 0;
+    
+    while ( (kalhit = dynamic_cast<DDVTrackHit *>( next() ) ) ) {
+      
+      double chi2increment;
+      TKalTrackSite* site=nullptr;
+      int error_code = this->addAndFit( kalhit, chi2increment, site, maxChi2Increment );
+      
+      
+      EVENT::TrackerHit* trkhit = kalhit->getLCIOTrackerHit();
+      
+      if( error_code == 0 ){ // add trkhit to map associating trkhits and sites
+        this->recordSite( trkhit, site, chi2increment ) ;
+      }
+      else { // hit rejected by the filter, so store in the list of rejected hits
+
+        // if the hit fails for any reason other than the Chi2 cut record the Chi2 contibution as DBL_MAX
+        if( error_code != site_fails_chi2_cut ) {
+          chi2increment = DBL_MAX;
+        }
+        
+        _outlier_chi2_values.push_back(std::make_pair(trkhit, chi2increment));
+        streamlog_out( DEBUG2 ) << ">>>>>>>>>>>  fit(): Number of Outliers : "
+        << _outlier_chi2_values.size() << std::endl;
+
+        _hit_not_used_for_sites.push_back(trkhit) ;
+        
+      }
+      
+    } // end of Kalman filter
+    
+    if( _ktest->getOption(  MarlinTrk::IMarlinTrkSystem::CFG::useSmoothing ) ){
+      streamlog_out( DEBUG2 )  << "Perform Smoothing for All Previous Measurement Sites " << std::endl ;
+      int error = this->smooth() ;
+      
+      if( error != success ) return error ;
+      
+    }
+    
+    //return _hit_used_for_sites.empty() == false ? success : all_sites_fail_fit ;
+    if( _hit_used_for_sites.empty() == false )
+    {
+        return success ;
+    }
+    else{
+        return all_sites_fail_fit ;
+    }
+    
+  }
+  
+  
+  /** smooth all track states 
+   */
+  int MarlinDDKalTestTrack::smooth(){
+    _transportMemo.clear() ;
+    
+    streamlog_out( DEBUG2 )  << "MarlinDDKalTestTrack::smooth() " << std::endl ;
+    
+    //fg: we should actually smooth all sites - it is then up to the user which smoothed tracks state to take 
+    //    for any furthter extrapolation/propagation ...
+ 
+    if( !_smoothed ) {
+
+      if( _compactSites.size() ) {
+        streamlog_out( ERROR) << "MarlinDDKalTestTrack::smooth: the sites of the track have been compacted - cannot smooth" << std::endl;
+        return error ;
+      }
+
+      _kaltrack->SmoothAll() ;
+    }
+    
+    //SJA:FIXME: in the current implementation it is only possible to smooth back to the 4th site.
+    // This is due to the fact that the covariance matrix is not well defined at the first 3 measurement sites filtered.
+    
+    //    _kaltrack->SmoothBackTo( _hitIndexAtPositiveNDF + 1 ) ;
+    
+   _smoothed = true ;
+
+    if( _ktest->getOption( MarlinTrk::IMarlinTrkSystem::CFG::useCompactSites ) ) this->compactSites() ;
+
+    return success ;
+    
+  }
+  
+  
+  /** smooth track states from the last filtered hit back to the measurement site associated with the given hit 
+   */
+  int MarlinDDKalTestTrack::smooth( EVENT::TrackerHit* trkhit ) {
+    _transportMemo.clear() ;
+    
+    streamlog_out( DEBUG2 )  << "MarlinDDKalTestTrack::smooth( EVENT::TrackerHit* " << trkhit << "  ) " << std::endl ;
+
+    
+    if ( !trkhit ) {
+      return bad_intputs ;
+    }
+    
+    
+    std::map<EVENT::TrackerHit*,TKalTrackSite*>::const_iterator it;
+    
+    
+    TKalTrackSite* site = 0 ;
+    int error_code = getSiteFromLCIOHit(trkhit, site);
+    
+    if( error_code != success ) return error_code ;
+    
+    int index = _kaltrack->IndexOf( site );
+    
+    if( index < (int)_compactSites.size() ) {
+
+      // compacted sites keep the state they had - only fine if that was already smoothed
+      if( _compactSites.isSmoothed( index ) ) return success ;
+
+      streamlog_out( ERROR) << "MarlinDDKalTestTrack::smooth: the site of hit " << trkhit << " has been compacted before smoothing" << std::endl;
+      return error ;
+    }
+
+    _kaltrack->SmoothBackTo( index ) ;
+    
+    _smoothed = true ;
+    
+    if( _ktest->getOption( MarlinTrk::IMarlinTrkSystem::CFG::useCompactSites ) ) this->compactSites() ;
+
+    return success ;
+    
+  }
+  
+  
+  int  MarlinDDKalTestTrack::getTrackState( IMPL::TrackStateImpl& ts, double& chi2, int& ndf ) {
+    
+    streamlog_out( DEBUG2 )  << "MarlinDDKalTestTrack::getTrackState( IMPL::TrackStateImpl& ts ) " << std::endl ;
+    
+    // use the last filtered track state 
+    const TKalTrackSite& site = *(dynamic_cast<const TKalTrackSite*>(_kaltrack->Last())) ;
+    
+    this->ToLCIOTrackState( site, ts, chi2, ndf );
+    
+    return success ;
+    
+    
+  }
+  
+  
+  int MarlinDDKalTestTrack::getTrackState( EVENT::TrackerHit* trkhit, IMPL::TrackStateImpl& ts, double& chi2, int& ndf ) {
+    
+    streamlog_out( DEBUG2 )  << "MarlinDDKalTestTrack::getTrackState( EVENT::TrackerHit* trkhit, IMPL::TrackStateImpl& ts ) using hit: " << trkhit << " with cellID0 = " << trkhit->getCellID0() << std::endl ;
+    
+    TKalTrackSite* site = 0 ;
+    int error_code = getSiteFromLCIOHit(trkhit, site);
+    
+    if( error_code != success ) return error_code ;
+    
+    streamlog_out( DEBUG1 )  << "MarlinDDKalTestTrack::getTrackState: site " << site << std::endl;
+    
+    this->ToLCIOTrackState( *site, ts, chi2, ndf );
+    
+    return success ;
+  }
+  
+  
+  int MarlinDDKalTestTrack::getHitsInFit( std::vector<std::pair<EVENT::TrackerHit*, double> >& hits ) {
+    
+    std::copy( _hit_chi2_values.begin() , _hit_chi2_values.end() , std::back_inserter(  hits  )  ) ;
+
+    // this needs more thought. What about when the hits are added using addAndFit?
+
+    // need to check the order so that we can return the list ordered in time
+    // as they will be added to _hit_chi2_values in the order of fitting 
+    // not in the order of time
+//    
+//    if( _fitDirection == IMarlinTrack::backward ){    
 //      std::reverse_copy( _hit_chi2_values.begin() , _hit_chi2_values.end() , std::back_inserter(  hits  )  ) ;
 //    } else {
 //      std::copy( _hit_chi2_values.begin() , _hit_chi2_values.end() , std::back_inserter(  hits  )  ) ;
@@ -1020,27 +1574,144 @@ namespace MarlinTrk {
         
     return success ;
     
-  }
-  
-  
-  int MarlinDDKalTestTrack::getNDF( int& ndf ){
+  }
+  
+  
+  int MarlinDDKalTestTrack::restoreFitResult( const std::vector<std::pair<EVENT::TrackerHit*, double> >& hitsInFit,
+                                              const std::vector<std::pair<EVENT::TrackerHit*, double> >& outliers ) {
+    
+    if( _initialised ) {
+      streamlog_out(ERROR) << "MarlinDDKalTestTrack::restoreFitResult: track already initialised - not restoring the fit result" << std::endl ;
+      return error ;
+    }
+    
+    _hit_chi2_values = hitsInFit ;
+    _outlier_chi2_values = outliers ;
+    
+    return success ;
+  }
+  
+  
+  int MarlinDDKalTestTrack::getNDF( int& ndf ){
+    
+    if( _initialised == false ) { 
+      return error;
+    } else {
+      
+      ndf = this->kalTrackNDF();
+      return success;
+      
+    }
+    
+  }
+  
+  int MarlinDDKalTestTrack::getTrackerHitAtPositiveNDF( EVENT::TrackerHit*& trkhit ) {
+
+      trkhit = _trackHitAtPositiveNDF;
+      return success;
+
+  }
+
+
+  int MarlinDDKalTestTrack::getPathLength( EVENT::TrackerHit* trkhit, double& pathLength, double& timeOfFlight ) {
+
+    std::map<EVENT::TrackerHit*, std::pair<double, double> >::const_iterator it = _hit_path_lengths.find( trkhit ) ;
+
+    if( it == _hit_path_lengths.end() ) {
+      streamlog_out( DEBUG2 ) << "MarlinDDKalTestTrack::getPathLength: hit " << trkhit << " not in fit" << std::endl ;
+      return bad_intputs ;
+    }
+
+    pathLength = it->second.first ;
+    timeOfFlight = it->second.second ;
+
+    return success ;
+  }
+
+
+  int MarlinDDKalTestTrack::getLastPropagationLength( double& pathLength, double& timeOfFlight ) {
+
+    if( ! _hasPropagated ) return error ;
+
+    pathLength = _lastPathLength ;
+    timeOfFlight = _lastTimeOfFlight ;
+
+    return success ;
+  }
+  
+  
+  int MarlinDDKalTestTrack::getHitPattern( std::vector<PatternCrossing>& crossings ) {
+    
+    crossings.clear() ;
+    
+    // the first site is the dummy site of the initial state
+    if( _kaltrack->GetEntriesFast() < 2 ) return error ;
+    
+    // the first site may have been compacted after smoothing
+    const TKalTrackSite& first = this->getSite( 1 ) ;
+    const TKalTrackSite& last  = *static_cast<const TKalTrackSite*>( _kaltrack->Last() ) ;
+    
+    const TKalTrackSite& inner = ( first.GetPivot().Perp() <= last.GetPivot().Perp() ? first : last ) ;
+    
+    std::unique_ptr<TVTrack> pHelix = createTrack( (TKalTrackState&) inner.GetCurState() ) ;
+    TVTrack& helix = *pHelix ;
+    
+    double dPhi = 0. ;
+    helix.MoveTo( TVector3( 0., 0., 0. ), dPhi, 0, 0 ) ;
+    
+    std::map<int, EVENT::TrackerHit*> hitsByElement ;
+    
+    for( unsigned i = 0 ; i < _hit_chi2_values.size() ; ++i ) {
+      hitsByElement[ _hit_chi2_values[i].first->getCellID0() ] = _hit_chi2_values[i].first ;
+    }
+    
+    // ( |dphi|, crossing ) of all modules crossed going outwards
+    std::vector< std::pair<double, PatternCrossing> > found ;
+    std::set<const DDVMeasLayer*> seen ;
+    
+    const std::multimap<int, const DDVMeasLayer*>& layers = _ktest->_active_measurement_modules_by_layer ;
     
-    if( _initialised == false ) { 
-      return error;
-    } else {
+    for( std::multimap<int, const DDVMeasLayer*>::const_iterator it = layers.begin() ; it != layers.end() ; it = layers.upper_bound( it->first ) ) {
       
-      ndf = _kaltrack->GetNDF();
-      return success;
+      std::vector<const DDVMeasLayer*> modules ;
+      _ktest->getSensitiveMeasurementModulesForLayer( it->first, helix, modules ) ;
       
+      for( unsigned i = 0 ; i < modules.size() ; ++i ) {
+        
+        // modules with several cellIDs are stored once per cellID
+        if( ! seen.insert( modules[i] ).second ) continue ;
+        
+        TVector3 xx ;
+        double phi = 0. ;
+        int cellID = 0 ;
+        
+        if( ! modules[i]->getIntersectionAndCellID( helix, xx, phi, cellID, modeForward ) ) continue ;
+        
+        PatternCrossing crossing ;
+        crossing.detElementID = cellID ;
+        crossing.point = Vector3D( xx.X(), xx.Y(), xx.Z() ) ;
+        
+        std::map<int, EVENT::TrackerHit*>::const_iterator ih = hitsByElement.find( cellID ) ;
+        crossing.hit = ( ih != hitsByElement.end() ? ih->second : 0 ) ;
+        
+        found.push_back( std::make_pair( std::fabs( phi ), crossing ) ) ;
+      }
     }
     
-  }
-  
-  int MarlinDDKalTestTrack::getTrackerHitAtPositiveNDF( EVENT::TrackerHit*& trkhit ) {
-
-      trkhit = _trackHitAtPositiveNDF;
-      return success;    
-
+    std::stable_sort( found.begin(), found.end(), 
+                      []( const std::pair<double, PatternCrossing>& lhs, const std::pair<double, PatternCrossing>& rhs ) { return lhs.first < rhs.first ; } ) ;
+    
+    unsigned nHoles = 0 ;
+    
+    for( unsigned i = 0 ; i < found.size() ; ++i ) {
+      crossings.push_back( found[i].second ) ;
+      if( found[i].second.isHole() ) ++nHoles ;
+    }
+    
+    streamlog_out(DEBUG2) << "MarlinDDKalTestTrack::getHitPattern: " << crossings.size() << " modules crossed, " << nHoles << " holes " << std::endl ;
+    
+    return success ;
+    
   }
   
   
@@ -1069,7 +1740,8 @@ namespace MarlinTrk {
     
     TKalTrackState& trkState = (TKalTrackState&) site.GetCurState(); // this segfaults if no hits are present
     
-    THelicalTrack helix = trkState.GetHelix() ;
+    std::unique_ptr<TVTrack> pHelix = createTrack( trkState ) ;
+    TVTrack& helix = *pHelix ;
     double dPhi ;
     
     const TVector3 tpoint( point.x(), point.y(), point.z() ) ;
@@ -1077,17 +1749,28 @@ namespace MarlinTrk {
     Int_t sdim = trkState.GetDimension();  // dimensions of the track state, it will be 5 or 6
     TKalMatrix sv(sdim,1);
     
-    // now move to the point
-    TKalMatrix  DF(sdim,sdim);  
-    DF.UnitMatrix();                           
-    helix.MoveTo(  tpoint , dPhi , &DF , 0) ;  // move helix to desired point, and get propagator matrix
-    
     TMatrixD c0(trkState.GetCovMat());  
     
-    TKalMatrix DFt  = TKalMatrix(TMatrixD::kTransposed, DF);
-    c0 = DF * c0 * DFt ;                 // update the covariance matrix 
+    if( this->parametersOnly() ) {
+      
+      helix.MoveTo(  tpoint , dPhi , 0 , 0) ;  // move helix to desired point only
+      
+    } else {
+      
+      // now move to the point
+      TKalMatrix  DF(sdim,sdim);  
+      DF.UnitMatrix();                           
+      helix.MoveTo(  tpoint , dPhi , &DF , 0) ;  // move helix to desired point, and get propagator matrix
+      
+      TKalMatrix DFt  = TKalMatrix(TMatrixD::kTransposed, DF);
+      c0 = DF * c0 * DFt ;                 // update the covariance matrix 
+    }
     
-    this->ToLCIOTrackState( helix, c0, ts, chi2, ndf );
+    this->ToLCIOTrackState( helix, c0, ts, chi2, ndf, ! this->parametersOnly() );
+
+    _lastPathLength = pathLength( helix, dPhi ) ;
+    _lastTimeOfFlight = timeOfFlight( helix, _lastPathLength, _kaltrack->GetMass() ) ;
+    _hasPropagated = true ;
     
     return success;
     
@@ -1126,7 +1809,15 @@ namespace MarlinTrk {
     
     if( error_code != 0 ) return error_code ;
     
-    return this->extrapolate( crossing_point, site, ts, chi2, ndf ) ;
+    TransportMemo* memo = this->findTransportMemo( site, PropagationTarget::toLayer, layerID, mode ) ;
+    
+    if( memo && this->fromMemo( memo->extrapolated, ts, chi2, ndf ) ) return success ;
+    
+    error_code = this->extrapolate( crossing_point, site, ts, chi2, ndf ) ;
+    
+    if( memo && error_code == success ) this->toMemo( memo->extrapolated, ts, chi2, ndf ) ;
+    
+    return error_code ;
     
   } 
   
@@ -1163,7 +1854,15 @@ namespace MarlinTrk {
     
     if( error_code != 0 ) return error_code ;
     
-    return this->extrapolate( crossing_point, site, ts, chi2, ndf ) ;
+    TransportMemo* memo = this->findTransportMemo( site, PropagationTarget::toDetElement, detElementID, mode ) ;
+    
+    if( memo && this->fromMemo( memo->extrapolated, ts, chi2, ndf ) ) return success ;
+    
+    error_code = this->extrapolate( crossing_point, site, ts, chi2, ndf ) ;
+    
+    if( memo && error_code == success ) this->toMemo( memo->extrapolated, ts, chi2, ndf ) ;
+    
+    return error_code ;
     
   } 
   
@@ -1202,7 +1901,16 @@ namespace MarlinTrk {
     
   }
   
-  int MarlinDDKalTestTrack::propagate( const Vector3D& point, const TKalTrackSite& site, IMPL::TrackStateImpl& ts, double& chi2, int& ndf, const DDVMeasLayer* ml ){
+  struct MarlinDDKalTestTrack::LayerTransport {
+    std::shared_ptr<const TVTrack> helix ;
+    TMatrixD c0 ;
+    TVector3 x0 ;
+    double dPhi ;
+  } ;
+  
+  
+  int MarlinDDKalTestTrack::propagate( const Vector3D& point, const TKalTrackSite& site, IMPL::TrackStateImpl& ts, double& chi2, int& ndf, const DDVMeasLayer* ml,
+                                       std::map<const DDVMeasLayer*, LayerTransport>* transports ){
     
     streamlog_out(DEBUG2) << "MarlinDDKalTestTrack::propagate( const Vector3D& point, const TKalTrackSite& site, IMPL::TrackStateImpl& ts, double& chi2, int& ndf ) called " << std::endl ;
     
@@ -1210,8 +1918,10 @@ namespace MarlinTrk {
     
     TKalTrackState& trkState = (TKalTrackState&) site.GetCurState(); // this segfaults if no hits are present
     
-    THelicalTrack helix = trkState.GetHelix() ;
+    // the helix is replaced by the one stored at the last layer if the transport is reused below
+    std::unique_ptr<TVTrack> helix = createTrack( trkState ) ;
     double dPhi = 0.0;
+    double dPhiToLayer = 0.0;
     
     
     Int_t sdim = trkState.GetDimension();  // dimensions of the track state, it will be 5 or 6
@@ -1226,25 +1936,56 @@ namespace MarlinTrk {
     
     TMatrixD c0(trkState.GetCovMat());  
     
+    if( this->parametersOnly() ) {
+      
+      // the helix is moved to the last layer and on to the point without energy loss below, 
+      // so the transport through the material only changes the cov matrix and can be skipped 
+      helix->MoveTo(  tpoint , dPhi , 0 , 0) ;
+      
+      this->ToLCIOTrackState( *helix, c0, ts, chi2, ndf, false );
+      
+      _lastPathLength = pathLength( *helix, dPhi ) ;
+      _lastTimeOfFlight = timeOfFlight( *helix, _lastPathLength, _kaltrack->GetMass() ) ;
+      _hasPropagated = true ;
+      
+      return success;
+    }
+    
     // the last layer crossed by the track before point 
     if( ! ml ){
-      ml = _ktest->getLastMeasLayer(helix, tpoint);
+      ml = _ktest->getLastMeasLayer(*helix, tpoint);
     }
     
     if ( ml ) {
       
-      _ktest->_det->Transport(site, *ml, x0, sv, F, Q ) ;      // transport to last layer cross before point 
+      // the transport to this layer may already have been done for another target from the same site
+      std::map<const DDVMeasLayer*, LayerTransport>::const_iterator it ;
       
-      // given that we are sure to have intersected the layer ml as this was provided via getLastMeasLayer, x0 will lie on the layer
-      // this could be checked with the method isOnSurface 
-      // so F will be the propagation matrix from the current location to the last surface and Q will be the noise matrix up to this point 
-      
-      
-      TKalMatrix Ft  = TKalMatrix(TMatrixD::kTransposed, F);
-      c0 = F * c0 * Ft + Q; // update covaraince matrix and add the MS assosiated with moving to tvml
-      
-      helix.MoveTo(  x0 , dPhi , 0 , 0 ) ;  // move the helix to tvml
+      if( transports && ( it = transports->find( ml ) ) != transports->end() ) {
+        
+        helix.reset( MarlinDDKalTest::cloneTrack( *it->second.helix ) ) ;
+        c0 = it->second.c0 ;
+        x0 = it->second.x0 ;
+        dPhi = it->second.dPhi ;
+        
+      } else {
+        
+        _ktest->_det->Transport(site, *ml, x0, sv, F, Q ) ;      // transport to last layer cross before point 
+        
+        // given that we are sure to have intersected the layer ml as this was provided via getLastMeasLayer, x0 will lie on the layer
+        // this could be checked with the method isOnSurface 
+        // so F will be the propagation matrix from the current location to the last surface and Q will be the noise matrix up to this point 
+        
+        
+        TKalMatrix Ft  = TKalMatrix(TMatrixD::kTransposed, F);
+        c0 = F * c0 * Ft + Q; // update covaraince matrix and add the MS assosiated with moving to tvml
+        
+        helix->MoveTo(  x0 , dPhi , 0 , 0 ) ;  // move the helix to tvml
+        
+        if( transports ) transports->insert( std::make_pair( ml, LayerTransport{ std::shared_ptr<const TVTrack>( MarlinDDKalTest::cloneTrack( *helix ) ), c0, x0, dPhi } ) ) ;
+      }
       
+      dPhiToLayer = dPhi ;
       
     }
     else { // the current site is at the last surface before the point to propagate to 
@@ -1256,7 +1997,7 @@ namespace MarlinTrk {
     // get whether the track is incomming or outgoing at the last surface
     const TVSurface *sfp = dynamic_cast<const TVSurface *>(ml);   // last surface
     
-    TMatrixD dxdphi = helix.CalcDxDphi(0);                        // tangent vector at last surface                       
+    TMatrixD dxdphi = helix->CalcDxDphi(0);                        // tangent vector at last surface                       
     TVector3 dxdphiv(dxdphi(0,0),dxdphi(1,0),dxdphi(2,0));        // convert matirix diagonal to vector
 //    Double_t cpa = helix.GetKappa();                              // get pt 
 
@@ -1265,16 +2006,20 @@ namespace MarlinTrk {
     // now move to the point
     TKalMatrix  DF(sdim,sdim);  
     DF.UnitMatrix();                           
-    helix.MoveTo(  tpoint , dPhi , &DF , 0) ;  // move helix to desired point, and get propagator matrix
+    helix->MoveTo(  tpoint , dPhi , &DF , 0) ;  // move helix to desired point, and get propagator matrix
 
     TKalMatrix Qms(sdim, sdim);
-    ml->CalcQms(isout, helix, dPhi, Qms);     // calculate MS for the final step through the present material 
+    ml->CalcQms(isout, *helix, dPhi, Qms);     // calculate MS for the final step through the present material 
     
     TKalMatrix DFt  = TKalMatrix(TMatrixD::kTransposed, DF);
     c0 = DF * c0 * DFt + Qms ;                 // update the covariance matrix 
     
     
-    this->ToLCIOTrackState( helix, c0, ts, chi2, ndf );
+    this->ToLCIOTrackState( *helix, c0, ts, chi2, ndf );
+
+    _lastPathLength = pathLength( *helix, dPhiToLayer + dPhi ) ;
+    _lastTimeOfFlight = timeOfFlight( *helix, _lastPathLength, _kaltrack->GetMass() ) ;
+    _hasPropagated = true ;
     
     return success;
     
@@ -1314,7 +2059,15 @@ namespace MarlinTrk {
     
     if( error_code != success ) return error_code ;
     
-    return this->propagate( crossing_point, site, ts, chi2, ndf , ml) ;
+    TransportMemo* memo = this->findTransportMemo( site, PropagationTarget::toLayer, layerID, mode ) ;
+    
+    if( memo && this->fromMemo( memo->propagated, ts, chi2, ndf ) ) return success ;
+    
+    error_code = this->propagate( crossing_point, site, ts, chi2, ndf , ml) ;
+    
+    if( memo && error_code == success ) this->toMemo( memo->propagated, ts, chi2, ndf ) ;
+    
+    return error_code ;
     
   } 
   
@@ -1351,11 +2104,190 @@ namespace MarlinTrk {
     
     if( error_code != 0 ) return error_code ;
     
-    return this->propagate( crossing_point, site, ts, chi2, ndf, ml ) ;
+    TransportMemo* memo = this->findTransportMemo( site, PropagationTarget::toDetElement, detElementID, mode ) ;
+    
+    if( memo && this->fromMemo( memo->propagated, ts, chi2, ndf ) ) return success ;
+    
+    error_code = this->propagate( crossing_point, site, ts, chi2, ndf, ml ) ;
+    
+    if( memo && error_code == success ) this->toMemo( memo->propagated, ts, chi2, ndf ) ;
+    
+    return error_code ;
     
   } 
   
   
+  int MarlinDDKalTestTrack::propagateToFirstLayer( const std::vector<int>& layerIDs, IMPL::TrackStateImpl& ts, double& chi2, int& ndf, int& layerID, int& detElementID, int mode ) {
+    
+    const TKalTrackSite& site = *(dynamic_cast<const TKalTrackSite*>(_kaltrack->Last())) ;
+    
+    return this->propagateToFirstLayer( layerIDs, site, ts, chi2, ndf, layerID, detElementID, mode ) ;
+    
+  }
+  
+  
+  int MarlinDDKalTestTrack::propagateToFirstLayer( const std::vector<int>& layerIDs, EVENT::TrackerHit* trkhit, IMPL::TrackStateImpl& ts, double& chi2, int& ndf, int& layerID, int& detElementID, int mode ) {
+    
+    TKalTrackSite* site = 0;
+    int error_code = getSiteFromLCIOHit(trkhit, site);
+    
+    if( error_code != success ) return error_code ;
+    
+    return this->propagateToFirstLayer( layerIDs, *site, ts, chi2, ndf, layerID, detElementID, mode ) ;
+    
+  }
+  
+  
+  int MarlinDDKalTestTrack::propagateToFirstLayer( const std::vector<int>& layerIDs, const TKalTrackSite& site, IMPL::TrackStateImpl& ts, double& chi2, int& ndf, int& layerID, int& detElementID, int mode ) {
+    
+    streamlog_out(DEBUG2) << "MarlinDDKalTestTrack::propagateToFirstLayer( const std::vector<int>& layerIDs, const TKalTrackSite& site, ... ) called for " 
+                          << layerIDs.size() << " layers " << std::endl ;
+    
+    std::unique_ptr<TVTrack> helix = createTrack( (TKalTrackState&) site.GetCurState() ) ;
+    
+    // the modules in reach of all layers, together with the layer they belong to
+    std::vector<DDVMeasLayer const*> meas_modules ;
+    std::vector<int> module_layers ;
+    
+    for( unsigned i = 0 ; i < layerIDs.size() ; ++i ) {
+      
+      std::vector<DDVMeasLayer const*> modules ;
+      _ktest->getSensitiveMeasurementModulesForLayer( layerIDs[i], *helix, modules ) ;
+      
+      meas_modules.insert( meas_modules.end(), modules.begin(), modules.end() ) ;
+      module_layers.resize( meas_modules.size(), layerIDs[i] ) ;
+    }
+    
+    if( meas_modules.empty() ) {
+      
+      streamlog_out(DEBUG5)<< "MarlinDDKalTestTrack::propagateToFirstLayer no module in reach of any of the " << layerIDs.size() << " layers " << std::endl ;
+      return no_intersection ;
+      
+    }
+    
+    Vector3D crossing_point ;
+    const DDVMeasLayer* ml = 0 ;
+    
+    int error_code = this->findIntersection( meas_modules, site, crossing_point, detElementID, ml, mode ) ;
+    
+    if( error_code != success ) return error_code ;
+    
+    layerID = module_layers[ std::find( meas_modules.begin(), meas_modules.end(), ml ) - meas_modules.begin() ] ;
+    
+    streamlog_out(DEBUG1) << "MarlinDDKalTestTrack::propagateToFirstLayer first crossing with layerID = " << cellIDString( layerID ) 
+                          << " at r = " << crossing_point.rho() << " z = " << crossing_point.z() << std::endl ;
+    
+    return this->propagate( crossing_point, site, ts, chi2, ndf, ml ) ;
+    
+  }
+  
+  
+  int MarlinDDKalTestTrack::propagateToMany( std::vector<PropagationTarget>& targets ) {
+    
+    const TKalTrackSite& site = *(dynamic_cast<const TKalTrackSite*>(_kaltrack->Last())) ;
+    
+    return this->propagateToMany( targets, site ) ;
+    
+  }
+  
+  
+  int MarlinDDKalTestTrack::propagateToMany( std::vector<PropagationTarget>& targets, EVENT::TrackerHit* trkhit ) {
+    
+    TKalTrackSite* site = 0;
+    int error_code = getSiteFromLCIOHit(trkhit, site);
+    
+    if( error_code != success ) return error_code ;
+    
+    return this->propagateToMany( targets, *site ) ;
+    
+  }
+  
+  
+  int MarlinDDKalTestTrack::propagateToMany( std::vector<PropagationTarget>& targets, const TKalTrackSite& site ) {
+    
+    streamlog_out(DEBUG2) << "MarlinDDKalTestTrack::propagateToMany( std::vector<PropagationTarget>& targets, const TKalTrackSite& site ) called for " 
+                          << targets.size() << " targets" << std::endl ;
+    
+    TKalTrackState& trkState = (TKalTrackState&) site.GetCurState();
+    
+    std::unique_ptr<TVTrack> helix = createTrack( trkState ) ;
+    
+    std::vector<Vector3D> points( targets.size() ) ;
+    std::vector<const DDVMeasLayer*> layers( targets.size(), 0 ) ;
+    
+    // (path length, target index) of the targets that can be reached
+    std::vector<std::pair<double, unsigned> > order ;
+    order.reserve( targets.size() ) ;
+    
+    for( unsigned i = 0 ; i < targets.size() ; ++i ) {
+      
+      PropagationTarget& t = targets[i] ;
+      
+      switch( t.type ) {
+          
+        case PropagationTarget::toPoint:
+          
+          points[i] = t.point ;
+          // same treatment of points inside the beampipe as in propagate()
+          if( _ktest->getIPLayer() && t.point.r() < _ktest->getIPLayer()->GetR() ) layers[i] = _ktest->getIPLayer() ;
+          t.status = success ;
+          break ;
+          
+        case PropagationTarget::toLayer:
+          
+          t.status = this->intersectionWithLayer( t.id, site, points[i], t.detElementID, layers[i], t.mode ) ;
+          break ;
+          
+        case PropagationTarget::toDetElement:
+          
+          t.detElementID = t.id ;
+          t.status = this->intersectionWithDetElement( t.id, site, points[i], layers[i], t.mode ) ;
+          break ;
+          
+        default:
+          
+          t.status = bad_intputs ;
+      }
+      
+      if( t.status != success ) continue ;
+      
+      std::unique_ptr<TVTrack> probe( MarlinDDKalTest::cloneTrack( *helix ) ) ;
+      double dPhi = 0.0 ;
+      probe->MoveTo( TVector3( points[i].x(), points[i].y(), points[i].z() ), dPhi, 0, 0 ) ;
+      
+      order.push_back( std::make_pair( std::fabs( pathLength( *helix, dPhi ) ), i ) ) ;
+    }
+    
+    std::stable_sort( order.begin(), order.end() ) ;
+    
+    std::map<const DDVMeasLayer*, LayerTransport> transports ;
+    
+    for( unsigned j = 0 ; j < order.size() ; ++j ) {
+      
+      const unsigned i = order[j].second ;
+      
+      PropagationTarget& t = targets[i] ;
+      
+      t.status = this->propagate( points[i], site, t.trackState, t.chi2, t.ndf, layers[i], &transports ) ;
+      
+      if( t.status != success ) continue ;
+      
+      t.pathLength = _lastPathLength ;
+      t.timeOfFlight = _lastTimeOfFlight ;
+    }
+    
+    streamlog_out(DEBUG2) << "MarlinDDKalTestTrack::propagateToMany: " << order.size() << " targets reached with " 
+                          << transports.size() << " layer transports" << std::endl ;
+    
+    for( unsigned i = 0 ; i < targets.size() ; ++i ) {
+      if( targets[i].status != success ) return targets[i].status ;
+    }
+    
+    return success ;
+    
+  }
+  
+  
   int MarlinDDKalTestTrack::intersectionWithDetElement( int detElementID, Vector3D& point, int mode ) {  
     
     const TKalTrackSite& site = *(dynamic_cast<const TKalTrackSite*>(_kaltrack->Last())) ;
@@ -1382,6 +2314,12 @@ namespace MarlinTrk {
     
     streamlog_out(DEBUG2) << "MarlinDDKalTestTrack::intersectionWithDetElement( int detElementID, const TKalTrackSite& site, Vector3D& point, const DDVMeasLayer*& ml, int mode) called " << std::endl;
     
+    if( TransportMemo* memo = this->findTransportMemo( site, PropagationTarget::toDetElement, detElementID, mode ) ) {
+      point = memo->point ;
+      ml = memo->ml ;
+      return memo->status ;
+    }
+    
     std::vector<const DDVMeasLayer*> meas_modules ;
     _ktest->getSensitiveMeasurementModules( detElementID, meas_modules ) ;  
     
@@ -1419,6 +2357,12 @@ namespace MarlinTrk {
       
     }
     
+    TransportMemo& memo = _transportMemo[ TransportMemoKey( &site, PropagationTarget::toDetElement, detElementID, mode ) ] ;
+    memo.status = error_code ;
+    memo.point = point ;
+    memo.detElementID = detElementID ;
+    memo.ml = ml ;
+    
     return error_code ;
     
   }
@@ -1449,12 +2393,20 @@ namespace MarlinTrk {
     
     streamlog_out(DEBUG2) << "MarlinDDKalTestTrack::intersectionWithLayer( int layerID, const TKalTrackSite& site, Vector3D& point, int& detElementID, int mode) called layerID = " << layerID << std::endl;
     
+    if( TransportMemo* memo = this->findTransportMemo( site, PropagationTarget::toLayer, layerID, mode ) ) {
+      point = memo->point ;
+      detElementID = memo->detElementID ;
+      ml = memo->ml ;
+      return memo->status ;
+    }
+    
+    // only the modules in the phi range crossed by the helix are tried 
     std::vector<DDVMeasLayer const*> meas_modules ;
-    _ktest->getSensitiveMeasurementModulesForLayer( layerID, meas_modules ) ;  
+    _ktest->getSensitiveMeasurementModulesForLayer( layerID, *createTrack( (TKalTrackState&) site.GetCurState() ), meas_modules ) ;  
     
     if( meas_modules.size() == 0 ) {
       
-      streamlog_out(DEBUG5)<< "MarlinDDKalTestTrack::intersectionWithLayer layer id unknown: layerID = " << cellIDString( layerID ) << std::endl ;
+      streamlog_out(DEBUG5)<< "MarlinDDKalTestTrack::intersectionWithLayer layer id unknown or no module in reach: layerID = " << cellIDString( layerID ) << std::endl ;
       return no_intersection;
       
     } 
@@ -1486,12 +2438,68 @@ namespace MarlinTrk {
       
     }
     
+    TransportMemo& memo = _transportMemo[ TransportMemoKey( &site, PropagationTarget::toLayer, layerID, mode ) ] ;
+    memo.status = error_code ;
+    memo.point = point ;
+    memo.detElementID = detElementID ;
+    memo.ml = ml ;
+    
     return error_code ;
     
     
   } 
   
   
+  bool MarlinDDKalTestTrack::parametersOnly() const {
+    
+    return _ktest->getOption( MarlinTrk::IMarlinTrkSystem::CFG::useParametersOnly ) ;
+    
+  }
+  
+  
+  MarlinDDKalTestTrack::TransportMemo* MarlinDDKalTestTrack::findTransportMemo( const TKalTrackSite& site, int type, int id, int mode ) {
+    
+    std::map<TransportMemoKey, TransportMemo>::iterator it = _transportMemo.find( TransportMemoKey( &site, type, id, mode ) ) ;
+    
+    return ( it != _transportMemo.end() ? &it->second : 0 ) ;
+    
+  }
+  
+  
+  bool MarlinDDKalTestTrack::fromMemo( const MemoState& memo, IMPL::TrackStateImpl& ts, double& chi2, int& ndf ) {
+    
+    if( ! memo.valid ) return false ;
+    
+    ts = memo.ts ;
+    chi2 = memo.chi2 ;
+    ndf = memo.ndf ;
+    
+    _lastPathLength = memo.pathLength ;
+    _lastTimeOfFlight = memo.timeOfFlight ;
+    _hasPropagated = true ;
+    
+    streamlog_out(DEBUG1) << "MarlinDDKalTestTrack::fromMemo: using memoised track state " << std::endl ;
+    
+    return true ;
+    
+  }
+  
+  
+  void MarlinDDKalTestTrack::toMemo( MemoState& memo, const IMPL::TrackStateImpl& ts, double chi2, int ndf ) const {
+    
+    // a memoised state has to be valid for all later requests
+    if( this->parametersOnly() ) return ;
+    
+    memo.valid = true ;
+    memo.ts = ts ;
+    memo.chi2 = chi2 ;
+    memo.ndf = ndf ;
+    memo.pathLength = _lastPathLength ;
+    memo.timeOfFlight = _lastTimeOfFlight ;
+    
+  }
+  
+  
   int MarlinDDKalTestTrack::findIntersection( const DDVMeasLayer& meas_module, const TKalTrackSite& site, Vector3D& point, double& dphi, int& detElementID, int mode ) {
     
     
@@ -1511,11 +2519,11 @@ namespace MarlinTrk {
     // //------------------------------
     
     
-    THelicalTrack helix = trkState.GetHelix() ;
+    std::unique_ptr<TVTrack> helix = createTrack( trkState ) ;
     
     TVector3 xto;       // reference point at destination to be returned by CalcXinPointWith  
     
-    int crossing_exist = meas_module.getIntersectionAndCellID(helix, xto, dphi, detElementID, mode);
+    int crossing_exist = meas_module.getIntersectionAndCellID(*helix, xto, dphi, detElementID, mode);
     //  int crossing_exist = surf->CalcXingPointWith(helix, xto, dphi, mode) ;
     
     streamlog_out(DEBUG1) << "MarlinDDKalTestTrack::intersectionWithLayer crossing_exist = " << crossing_exist << " dphi " << dphi << " with detElementIDs: " <<  detElementID ;
@@ -1591,19 +2599,21 @@ namespace MarlinTrk {
   
   
   
-  void MarlinDDKalTestTrack::ToLCIOTrackState( const THelicalTrack& helix, const TMatrixD& cov, IMPL::TrackStateImpl& ts, double& chi2, int& ndf) const {
+  void MarlinDDKalTestTrack::ToLCIOTrackState( const TVTrack& helix, const TMatrixD& cov, IMPL::TrackStateImpl& ts, double& chi2, int& ndf, bool withCovariance) const {
     
     chi2 = _kaltrack->GetChi2();
-    ndf  = _kaltrack->GetNDF();
+    ndf  = this->kalTrackNDF();
     
     //============== convert parameters to LCIO convention ====
     
     // fill 5x5 covariance matrix from the 6x6 covariance matrix above
-    TMatrixD covK(5,5) ;  for(int i=0;i<5;++i) for(int j=0;j<5;++j) covK[i][j] = cov[i][j] ;
+    TMatrixD covK(5,5) ;  
+    if( withCovariance ) for(int i=0;i<5;++i) for(int j=0;j<5;++j) covK[i][j] = cov[i][j] ;
     
     //  this is for incomming tracks ...
     double phi       =    toBaseRange( helix.GetPhi0() + M_PI/2. ) ;
-    double omega     =    1. /helix.GetRho()  ;              
+    // a straight line has no curvature: kappa only carries the momentum assumed for the multiple scattering or is pinned
+    double omega     =    ( _straightLine || isStraightLine( helix ) ? 0. : 1. /helix.GetRho() ) ;              
     double d0        =  - helix.GetDrho() ; 
     double z0        =    helix.GetDz()   ;
     double tanLambda =    helix.GetTanLambda()  ;
@@ -1615,7 +2625,7 @@ namespace MarlinTrk {
     ts.setTanLambda( tanLambda ) ;  
     
     Double_t cpa  = helix.GetKappa();
-    double alpha = omega / cpa  ; // conversion factor for omega (1/R) to kappa (1/Pt) 
+    double alpha = omega / cpa  ; // conversion factor for omega (1/R) to kappa (1/Pt) - zero for a straight line 
     
     EVENT::FloatVec covLCIO( 15 )  ; 
     covLCIO[ 0] =   covK( 0 , 0 )   ; //   d0,   d0
@@ -1671,6 +2681,13 @@ namespace MarlinTrk {
   }
   
   
+  int MarlinDDKalTestTrack::kalTrackNDF() const {
+    
+    return _kaltrack->GetNDF() + ( _straightLine ? 1 : 0 ) ;
+    
+  }
+  
+  
   void MarlinDDKalTestTrack::ToLCIOTrackState( const TKalTrackSite& site, IMPL::TrackStateImpl& ts, double& chi2, int& ndf ) const {
     
     TKalTrackState& trkState = (TKalTrackState&) site.GetCurState(); // GetCutState will return the last added state to this site
@@ -1681,11 +2698,11 @@ namespace MarlinTrk {
     // streamlog_out( DEBUG3 ) << " MarlinDDKalTestTrack::ToLCIOTrackState : " << std::endl ;
     // trkState.DebugPrint() ;
 
-    THelicalTrack helix = trkState.GetHelix() ;
+    std::unique_ptr<TVTrack> helix = createTrack( trkState ) ;
     
     TMatrixD c0(trkState.GetCovMat());  
     
-    this->ToLCIOTrackState( helix, c0, ts, chi2, ndf );
+    this->ToLCIOTrackState( *helix, c0, ts, chi2, ndf );
     
   }
 
@@ -1696,7 +2713,11 @@ namespace MarlinTrk {
     
     str << IMarlinTrack::toString() ;
     
-    str << _kaltrack->toString()  ;
+    // the compacted sites have no kaltest states left to print
+    if( _compactSites.size() ) 
+      str << " compacted sites: " << _compactSites.size() << std::endl ;
+    else
+      str << _kaltrack->toString()  ;
     
     str << " --------------------- " << std::endl ;
 
@@ -1727,12 +2748,81 @@ namespace MarlinTrk {
       }
     } 
     
-    site = it->second;
-    
+    site = &this->getSite( _kaltrack->IndexOf( it->second ) ) ;
     
     streamlog_out( DEBUG1 )  << "MarlinDDKalTestTrack::getSiteFromLCIOHit: site " << site << " found for hit " << trkhit << std::endl ;
     return success ;
     
   }
+
+
+  void MarlinDDKalTestTrack::sortHits() {
+
+    const int n = _kalhits->GetEntriesFast() ;
+
+    // the keys are computed once per hit - stable_sort keeps the order of addHit() for hits on the same layer
+    std::vector< std::pair<double, TObject*> > keys ;
+    keys.reserve( n ) ;
+
+    for( int i = 0 ; i < n ; ++i ) {
+      TObject* hit = _kalhits->At( i ) ;
+      keys.push_back( std::make_pair( sortingPolicy( *static_cast<TVTrackHit*>( hit ) ), hit ) ) ;
+    }
+
+    std::stable_sort( keys.begin(), keys.end(),
+                      []( const std::pair<double, TObject*>& lhs, const std::pair<double, TObject*>& rhs ) { return lhs.first < rhs.first ; } ) ;
+
+    for( int i = 0 ; i < n ; ++i ) _kalhits->AddAt( keys[i].second, i ) ;
+
+    streamlog_out( DEBUG1 ) << "MarlinDDKalTestTrack::sortHits: " << n << " hits ordered by the sorting policy of their measurement layers" << std::endl ;
+  }
+
+
+  void MarlinDDKalTestTrack::compactSites() {
+    _transportMemo.clear() ;
+
+    // the last site keeps its full states, so that the fit can still be continued with addAndFit
+    const int last = _kaltrack->GetLast() ;
+
+    for( int i = _compactSites.size() ; i < last ; ++i ) {
+
+      TKalTrackSite* site = static_cast<TKalTrackSite*>( _kaltrack->At( i ) ) ;
+
+      const TVKalState& state = site->GetCurState() ;
+
+      _compactSites.push_back( state.GetMatrixArray(), state.GetCovMat().GetMatrixArray(), site->GetLast() >= TVKalSite::kSmoothed ) ;
+
+      // the site itself, with its hit and pivot, is kept - only the states are released
+      site->Delete() ;
+    }
+
+    streamlog_out( DEBUG2 )  << "MarlinDDKalTestTrack::compactSites: " << _compactSites.size() << " sites compacted " << std::endl ;
+  }
+
+
+  TKalTrackSite& MarlinDDKalTestTrack::getSite( int index ) const {
+
+    TKalTrackSite& site = *static_cast<TKalTrackSite*>( _kaltrack->At( index ) ) ;
+
+    // a compacted site has no states left and its current state pointer is dangling - give it its state back first
+    if( index < (int)_compactSites.size() && site.GetLast() < 0 ) this->restoreCompactSite( site, index ) ;
+
+    return site ;
+  }
+
+
+  void MarlinDDKalTestTrack::restoreCompactSite( TKalTrackSite& site, int index ) const {
+
+    TKalMatrix sv( kSdim, 1 ) ;
+    TKalMatrix cov( kSdim, kSdim ) ;
+
+    _compactSites.get( index, sv.GetMatrixArray(), cov.GetMatrixArray() ) ;
+
+    const int type = _compactSites.isSmoothed( index ) ? TVKalSite::kSmoothed : TVKalSite::kFiltered ;
+
+    // only the current state is kept in the store: the slots in front of it get copies, such that the state is at the index
+    // of its type, as for any other site, and adding it last makes it the current state of the site
+    for( int st = TVKalSite::kPredicted ; st <= type ; ++st ) site.Add( new TKalTrackState( sv, cov, site, st ) ) ;
+  }
   
 } // end of namespace MarlinTrk 
@@ -0,0 +1,50 @@
+#include "MarlinTrk/MarlinFastHelix.h"
+#include "MarlinTrk/MarlinFastHelixTrack.h"
+
+#include <sstream>
+
+#include "streamlog/streamlog.h"
+
+
+namespace MarlinTrk{
+
+
+  MarlinFastHelix::MarlinFastHelix() {
+
+    this->registerOptions() ;
+
+    streamlog_out( DEBUG4 ) << "  MarlinFastHelix - constructed " << std::endl ;
+  }
+
+
+  MarlinFastHelix::~MarlinFastHelix() {}
+
+
+  void MarlinFastHelix::init() {
+
+    _parametersOnly = getOption( IMarlinTrkSystem::CFG::useParametersOnly ) ;
+
+    streamlog_out( DEBUG5 ) << " -------------------------------------------------------------------------------- " << std::endl ;
+    streamlog_out( DEBUG5 ) << "  MarlinFastHelix::init() called with the following options :                     " << std::endl ;
+    streamlog_out( DEBUG5 ) <<    this->getOptions() ;
+    streamlog_out( DEBUG5 ) << " -------------------------------------------------------------------------------- " << std::endl ;
+
+    _is_initialised = true ;
+  }
+
+
+  MarlinTrk::IMarlinTrack* MarlinFastHelix::createTrack() {
+
+    if ( ! _is_initialised ) {
+
+      std::stringstream errorMsg ;
+
+      errorMsg << "MarlinFastHelix::createTrack: Fitter not initialised. MarlinFastHelix::init() must be called before MarlinFastHelix::createTrack()" << std::endl ;
+      throw MarlinTrk::Exception( errorMsg.str() ) ;
+
+    }
+
+    return new MarlinFastHelixTrack( this ) ;
+  }
+
+} // end of namespace MarlinTrk
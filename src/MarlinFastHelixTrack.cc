@@ -0,0 +1,634 @@
+#include "MarlinTrk/MarlinFastHelixTrack.h"
+
+#include "MarlinTrk/MarlinFastHelix.h"
+#include "MarlinTrk/MarlinTrkUtils.h"
+#include "MarlinTrk/LCIOTrackPropagators.h"
+
+#include <lcio.h>
+#include <EVENT/TrackerHit.h>
+#include <IMPL/TrackStateImpl.h>
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+#include "streamlog/streamlog.h"
+
+
+namespace MarlinTrk {
+
+
+  MarlinFastHelixTrack::MarlinFastHelixTrack( MarlinFastHelix* fastHelix )
+    : _fastHelix( fastHelix ), _mass( 0.13957018 ) {
+
+    _currentState.par.fill( 0. ) ;
+    _currentState.cov.fill( 0. ) ;
+    _currentState.ref[0] = _currentState.ref[1] = _currentState.ref[2] = 0. ;
+
+    _fitState = _currentState ;
+  }
+
+
+  MarlinFastHelixTrack::~MarlinFastHelixTrack() {}
+
+
+  void MarlinFastHelixTrack::setMass( double mass ) { _mass = mass ; }
+
+  double MarlinFastHelixTrack::getMass() { return _mass ; }
+
+  IMarlinTrkSystem* MarlinFastHelixTrack::getTrkSystem() { return _fastHelix ; }
+
+
+  int MarlinFastHelixTrack::addHit( EVENT::TrackerHit* trkhit ) {
+
+    if( ! trkhit ) {
+      streamlog_out( ERROR ) << "MarlinFastHelixTrack::addHit: trkhit == 0" << std::endl ;
+      return bad_intputs ;
+    }
+
+    double varRPhi, varZ ;
+
+    const int error_code = getHitVariancesRPhiZ( trkhit, varRPhi, varZ ) ;
+
+    if( error_code != success ) return error_code ;
+
+    _lcioHits.push_back( trkhit ) ;
+
+    return success ;
+  }
+
+
+  int MarlinFastHelixTrack::initialise( bool fitDirection ) {
+
+    if ( _initialised ) {
+      throw MarlinTrk::Exception("Track fit already initialised") ;
+    }
+
+    const unsigned nHits = _lcioHits.size() ;
+
+    if( nHits < 3 ) {
+
+      streamlog_out( ERROR ) << "<<<<<< MarlinFastHelixTrack::initialise: Shortage of Hits! nhits = "
+                             << nHits << " >>>>>>>" << std::endl ;
+      return error ;
+    }
+
+    _fitDirection = fitDirection ;
+
+    _initialised = true ;
+
+    return success ;
+  }
+
+
+  int MarlinFastHelixTrack::initialise( const EVENT::TrackState& ts, double /*bfield_z*/, bool fitDirection ) {
+
+    if ( _initialised ) {
+      throw MarlinTrk::Exception("Track fit already initialised") ;
+    }
+
+    _fitDirection = fitDirection ;
+
+    _currentState.par[ FastKF::iD0 ]    = ts.getD0() ;
+    _currentState.par[ FastKF::iPhi ]   = ts.getPhi() ;
+    _currentState.par[ FastKF::iOmega ] = ts.getOmega() ;
+    _currentState.par[ FastKF::iZ0 ]    = ts.getZ0() ;
+    _currentState.par[ FastKF::iTanL ]  = ts.getTanLambda() ;
+
+    const EVENT::FloatVec& cov = ts.getCovMatrix() ;
+    for( unsigned i = 0 ; i < 15 ; ++i ) _currentState.cov[i] = cov[i] ;
+
+    for( unsigned i = 0 ; i < 3 ; ++i ) _currentState.ref[i] = ts.getReferencePoint()[i] ;
+
+    _hasState = true ;
+
+    _initialised = true ;
+
+    return success ;
+  }
+
+
+  int MarlinFastHelixTrack::findSite( EVENT::TrackerHit* trkhit ) const {
+
+    for( unsigned i = 0 ; i < _sites.size() ; ++i )
+      if( _sites[i].hit == trkhit ) return i ;
+
+    return -1 ;
+  }
+
+
+  int MarlinFastHelixTrack::fitHits( const std::vector< EVENT::TrackerHit* >& hits, FastKF::State& state, std::vector< Site >& sites, double& chi2 ) {
+
+    const unsigned nHits = hits.size() ;
+
+    if( nHits < 3 ) return error ;
+
+    _xf.resize( nHits ) ; _yf.resize( nHits ) ; _zf.resize( nHits ) ; _wf.resize( nHits ) ; _wzf.resize( nHits ) ;
+    _chi2s.resize( nHits ) ; _arcs.resize( nHits ) ;
+
+    for( unsigned i = 0 ; i < nHits ; ++i ) {
+
+      double varRPhi, varZ ;
+
+      const int error_code = getHitVariancesRPhiZ( hits[i], varRPhi, varZ ) ;
+
+      if( error_code != success ) return error_code ;
+
+      const double* pos = hits[i]->getPosition() ;
+
+      _xf[i]  = pos[0] ;
+      _yf[i]  = pos[1] ;
+      _zf[i]  = pos[2] ;
+      _wf[i]  = 1. / varRPhi ;
+      _wzf[i] = 1. / varZ ;
+    }
+
+    // the time order of the hits is the order of the fit for IMarlinTrack::forward
+    if( _helixFit.fitState( nHits, _xf.data(), _yf.data(), _zf.data(), _wf.data(), _wzf.data(), _fitDirection == IMarlinTrack::forward,
+                            state, _chi2s.data(), _arcs.data() ) != 0 ) {
+
+      streamlog_out( DEBUG2 ) << "MarlinFastHelixTrack::fitHits: helix fit failed for " << nHits << " hits" << std::endl ;
+      return error ;
+    }
+
+    sites.resize( nHits ) ;
+    chi2 = 0. ;
+
+    for( unsigned i = 0 ; i < nHits ; ++i ) {
+
+      sites[i].hit = hits[i] ;
+      sites[i].deltaChi2 = _chi2s[i] ;
+      sites[i].arc = _arcs[i] ;
+
+      chi2 += _chi2s[i] ;
+    }
+
+    return success ;
+  }
+
+
+  void MarlinFastHelixTrack::setFit( const FastKF::State& state, std::vector< Site >& sites, double chi2 ) {
+
+    _fitState = state ;
+
+    _sites.swap( sites ) ;
+
+    _chi2 = chi2 ;
+    _ndf  = 2 * _sites.size() - 5 ;
+
+    _currentState = _fitState ;
+    FastKF::transport( _currentState, _sites.back().hit->getPosition() ) ;
+
+    _hasState = true ;
+  }
+
+
+  int MarlinFastHelixTrack::fit( double maxChi2Increment ) {
+
+    streamlog_out( DEBUG2 ) << "MarlinFastHelixTrack::fit() called " << std::endl ;
+
+    if ( ! _initialised ) {
+      throw MarlinTrk::Exception("Track fit not initialised") ;
+    }
+
+    const unsigned nHits = _lcioHits.size() ;
+
+    std::vector< EVENT::TrackerHit* > hits( nHits ) ;
+
+    for( unsigned i = 0 ; i < nHits ; ++i )
+      hits[i] = _lcioHits[ _fitDirection == IMarlinTrack::backward ? nHits - 1 - i : i ] ;
+
+    _outliers.clear() ;
+
+    FastKF::State state ;
+    std::vector< Site > sites ;
+    double chi2 = 0. ;
+
+    // remove the hit with the largest chi2 contribution above the cut until all hits pass
+    while( true ) {
+
+      const int error_code = this->fitHits( hits, state, sites, chi2 ) ;
+
+      if( error_code != success ) return error_code ;
+
+      std::vector< Site >::iterator worst = std::max_element( sites.begin(), sites.end(),
+                                                                   []( const Site& lhs, const Site& rhs ) { return lhs.deltaChi2 < rhs.deltaChi2 ; } ) ;
+
+      if( worst->deltaChi2 <= maxChi2Increment ) break ;
+
+      streamlog_out( DEBUG2 ) << "MarlinFastHelixTrack::fit: outlier with chi2 contribution " << worst->deltaChi2
+                              << " maxChi2Increment = " << maxChi2Increment << std::endl ;
+
+      if( hits.size() == 3 ) {
+
+        for( unsigned i = 0 ; i < sites.size() ; ++i ) _outliers.push_back( std::make_pair( sites[i].hit, sites[i].deltaChi2 ) ) ;
+
+        return all_sites_fail_fit ;
+      }
+
+      _outliers.push_back( std::make_pair( worst->hit, worst->deltaChi2 ) ) ;
+
+      hits.erase( hits.begin() + ( worst - sites.begin() ) ) ;
+    }
+
+    this->setFit( state, sites, chi2 ) ;
+
+    return success ;
+  }
+
+
+  int MarlinFastHelixTrack::addAndFit( EVENT::TrackerHit* trkhit, double& chi2increment, double maxChi2Increment ) {
+
+    if( ! trkhit ) {
+      streamlog_out( ERROR ) << "MarlinFastHelixTrack::addAndFit: trkhit == 0" << std::endl ;
+      return bad_intputs ;
+    }
+
+    if ( ! _initialised ) {
+      throw MarlinTrk::Exception("Track fit not initialised") ;
+    }
+
+    double varRPhi, varZ ;
+
+    int error_code = getHitVariancesRPhiZ( trkhit, varRPhi, varZ ) ;
+
+    if( error_code != success ) return error_code ;
+
+    chi2increment = 0. ;
+
+    // the helix needs three hits
+    if( _sites.size() < 2 ) {
+
+      Site site = { trkhit, 0., 0. } ;
+      _sites.push_back( site ) ;
+
+      _ndf += 2 ;
+
+      return success ;
+    }
+
+    std::vector< EVENT::TrackerHit* > hits ;
+    hits.reserve( _sites.size() + 1 ) ;
+
+    for( unsigned i = 0 ; i < _sites.size() ; ++i ) hits.push_back( _sites[i].hit ) ;
+    hits.push_back( trkhit ) ;
+
+    FastKF::State state ;
+    std::vector< Site > sites ;
+    double chi2 = 0. ;
+
+    error_code = this->fitHits( hits, state, sites, chi2 ) ;
+
+    if( error_code != success ) return error_code ;
+
+    chi2increment = chi2 - _chi2 ;
+
+    if( chi2increment > maxChi2Increment ) {
+
+      streamlog_out( DEBUG2 ) << "MarlinFastHelixTrack::addAndFit: hit rejected with chi2increment = " << chi2increment
+                              << " maxChi2Increment = " << maxChi2Increment << std::endl ;
+
+      return site_fails_chi2_cut ;
+    }
+
+    this->setFit( state, sites, chi2 ) ;
+
+    return success ;
+  }
+
+
+  int MarlinFastHelixTrack::testChi2Increment( EVENT::TrackerHit* trkhit, double& chi2increment ) {
+
+    if( ! trkhit ) {
+      streamlog_out( ERROR ) << "MarlinFastHelixTrack::testChi2Increment: trkhit == 0" << std::endl ;
+      return bad_intputs ;
+    }
+
+    if ( ! _initialised ) {
+      throw MarlinTrk::Exception("Track fit not initialised") ;
+    }
+
+    if( ! _hasState ) return error ;
+
+    double varRPhi, varZ ;
+
+    const int error_code = getHitVariancesRPhiZ( trkhit, varRPhi, varZ ) ;
+
+    if( error_code != success ) return error_code ;
+
+    FastKF::State probe = _currentState ;
+
+    FastKF::Matrix5 J ;
+    FastKF::moveReferencePoint( probe, trkhit->getPosition(), &J ) ;
+
+    // covariance of the residuals: V + H C H^T with the rows of d0 and z0 at the hit
+    const int rows[2] = { FastKF::iD0, FastKF::iZ0 } ;
+    double R[3] = { varRPhi, 0., varZ } ;
+
+    for( int m = 0 ; m < 2 ; ++m )
+      for( int n = 0 ; n <= m ; ++n )
+        for( int a = 0 ; a < 5 ; ++a )
+          for( int b = 0 ; b < 5 ; ++b )
+            R[ FastKF::symIndex( m, n ) ] += J[ rows[m] * 5 + a ] * probe.cov[ FastKF::symIndex( a, b ) ] * J[ rows[n] * 5 + b ] ;
+
+    const double det = R[0] * R[2] - R[1] * R[1] ;
+
+    if( ! ( det > 0. ) ) return error ;
+
+    const double rD0 = probe.par[ FastKF::iD0 ] ;
+    const double rZ0 = probe.par[ FastKF::iZ0 ] ;
+
+    chi2increment = ( rD0 * rD0 * R[2] - 2. * rD0 * rZ0 * R[1] + rZ0 * rZ0 * R[0] ) / det ;
+
+    return success ;
+  }
+
+
+  int MarlinFastHelixTrack::smooth() {
+
+    return ( _sites.size() < 3 ? error : success ) ;
+  }
+
+
+  int MarlinFastHelixTrack::smooth( EVENT::TrackerHit* trkhit ) {
+
+    if( _sites.size() < 3 ) return error ;
+
+    return ( this->findSite( trkhit ) < 0 ? bad_intputs : success ) ;
+  }
+
+
+  void MarlinFastHelixTrack::toLCIOTrackState( const FastKF::State& state, IMPL::TrackStateImpl& ts, bool withCovariance ) const {
+
+    ts.setD0( state.par[ FastKF::iD0 ] ) ;
+    ts.setPhi( state.par[ FastKF::iPhi ] ) ;
+    ts.setOmega( state.par[ FastKF::iOmega ] ) ;
+    ts.setZ0( state.par[ FastKF::iZ0 ] ) ;
+    ts.setTanLambda( state.par[ FastKF::iTanL ] ) ;
+
+    const float ref[3] = { float( state.ref[0] ), float( state.ref[1] ), float( state.ref[2] ) } ;
+    ts.setReferencePoint( ref ) ;
+
+    EVENT::FloatVec cov( 15 ) ;
+    if( withCovariance ) for( unsigned i = 0 ; i < 15 ; ++i ) cov[i] = state.cov[i] ;
+
+    ts.setCovMatrix( cov ) ;
+  }
+
+
+  int MarlinFastHelixTrack::getSiteState( EVENT::TrackerHit* trkhit, FastKF::State& state ) const {
+
+    const int index = this->findSite( trkhit ) ;
+
+    if( index < 0 || _sites.size() < 3 ) {
+      streamlog_out( DEBUG2 ) << "MarlinFastHelixTrack::getSiteState: hit " << trkhit << " not in fit" << std::endl ;
+      return bad_intputs ;
+    }
+
+    state = _fitState ;
+    FastKF::transport( state, trkhit->getPosition() ) ;
+
+    return success ;
+  }
+
+
+  int MarlinFastHelixTrack::getTrackState( IMPL::TrackStateImpl& ts, double& chi2, int& ndf ) {
+
+    if( ! _hasState ) return error ;
+
+    this->toLCIOTrackState( _currentState, ts ) ;
+
+    chi2 = _chi2 ;
+    ndf  = _ndf ;
+
+    return success ;
+  }
+
+
+  int MarlinFastHelixTrack::getTrackState( EVENT::TrackerHit* trkhit, IMPL::TrackStateImpl& ts, double& chi2, int& ndf ) {
+
+    FastKF::State state ;
+
+    const int error_code = this->getSiteState( trkhit, state ) ;
+
+    if( error_code != success ) return error_code ;
+
+    this->toLCIOTrackState( state, ts ) ;
+
+    chi2 = _chi2 ;
+    ndf  = _ndf ;
+
+    return success ;
+  }
+
+
+  int MarlinFastHelixTrack::getHitsInFit( std::vector<std::pair<EVENT::TrackerHit*, double> >& hits ) {
+
+    for( unsigned i = 0 ; i < _sites.size() ; ++i ) hits.push_back( std::make_pair( _sites[i].hit, _sites[i].deltaChi2 ) ) ;
+
+    return success ;
+  }
+
+
+  int MarlinFastHelixTrack::getOutliers( std::vector<std::pair<EVENT::TrackerHit*, double> >& hits ) {
+
+    hits.insert( hits.end(), _outliers.begin(), _outliers.end() ) ;
+
+    return success ;
+  }
+
+
+  int MarlinFastHelixTrack::getNDF( int& ndf ) {
+
+    if( _sites.empty() ) return error ;
+
+    ndf = _ndf ;
+
+    return success ;
+  }
+
+
+  int MarlinFastHelixTrack::getTrackerHitAtPositiveNDF( EVENT::TrackerHit*& trkhit ) {
+
+    // two measurements per hit for five parameters
+    if( _sites.size() < 3 ) return error ;
+
+    trkhit = _sites[2].hit ;
+
+    return success ;
+  }
+
+
+  int MarlinFastHelixTrack::getPathLength( EVENT::TrackerHit* trkhit, double& pathLength, double& timeOfFlight ) {
+
+    const int index = this->findSite( trkhit ) ;
+
+    if( index < 0 ) return bad_intputs ;
+
+    if( _sites.size() < 3 ) return error ;
+
+    pathLength = std::fabs( FastKF::pathLength( _fitState, _sites[ index ].arc - _sites[0].arc ) ) ;
+    timeOfFlight = FastKF::timeOfFlight( _fitState, _fastHelix->_bz, _mass, pathLength ) ;
+
+    return success ;
+  }
+
+
+  int MarlinFastHelixTrack::getLastPropagationLength( double& pathLength, double& timeOfFlight ) {
+
+    if( ! _hasPropagated ) return error ;
+
+    pathLength = _lastPathLength ;
+    timeOfFlight = _lastTimeOfFlight ;
+
+    return success ;
+  }
+
+
+  //---------------------------------------------------------------------------------------------------------------
+  // propagation and extrapolation - the same without material
+
+  int MarlinFastHelixTrack::propagate( const FastKF::State& start, const Vector3D& point, IMPL::TrackStateImpl& ts, double& chi2, int& ndf ) {
+
+    const double ref[3] = { point.x(), point.y(), point.z() } ;
+
+    FastKF::State probe = start ;
+    const double path = FastKF::pathLength( start, FastKF::moveReferencePoint( probe, ref, 0 ) ) ;
+
+    this->toLCIOTrackState( start, ts ) ;
+
+    if( LCIOTrackPropagators::PropagateLCIOToNewRef( ts, ref[0], ref[1], ref[2], ! _fastHelix->_parametersOnly ) != 0 ) return error ;
+
+    _lastPathLength = path ;
+    _lastTimeOfFlight = FastKF::timeOfFlight( start, _fastHelix->_bz, _mass, path ) ;
+    _hasPropagated = true ;
+
+    chi2 = _chi2 ;
+    ndf  = _ndf ;
+
+    return success ;
+  }
+
+
+  int MarlinFastHelixTrack::propagate( const Vector3D& point, IMPL::TrackStateImpl& ts, double& chi2, int& ndf ) {
+
+    if( ! _hasState ) return error ;
+
+    return this->propagate( _currentState, point, ts, chi2, ndf ) ;
+  }
+
+
+  int MarlinFastHelixTrack::propagate( const Vector3D& point, EVENT::TrackerHit* trkhit, IMPL::TrackStateImpl& ts, double& chi2, int& ndf ) {
+
+    FastKF::State state ;
+
+    const int error_code = this->getSiteState( trkhit, state ) ;
+
+    if( error_code != success ) return error_code ;
+
+    return this->propagate( state, point, ts, chi2, ndf ) ;
+  }
+
+
+  int MarlinFastHelixTrack::extrapolate( const Vector3D& point, IMPL::TrackStateImpl& ts, double& chi2, int& ndf ) {
+    return this->propagate( point, ts, chi2, ndf ) ;
+  }
+
+
+  int MarlinFastHelixTrack::extrapolate( const Vector3D& point, EVENT::TrackerHit* trkhit, IMPL::TrackStateImpl& ts, double& chi2, int& ndf ) {
+    return this->propagate( point, trkhit, ts, chi2, ndf ) ;
+  }
+
+
+  //---------------------------------------------------------------------------------------------------------------
+  // layers and detector elements
+
+  int MarlinFastHelixTrack::noGeometry( const char* method ) const {
+
+    streamlog_out( DEBUG2 ) << "MarlinFastHelixTrack::" << method << ": no geometry - layers and detector elements are not supported" << std::endl ;
+
+    return error ;
+  }
+
+
+  int MarlinFastHelixTrack::propagateToLayer( int /*layerID*/, IMPL::TrackStateImpl& /*ts*/, double& /*chi2*/, int& /*ndf*/, int& /*detElementID*/, int /*mode*/ ) {
+    return this->noGeometry( "propagateToLayer" ) ;
+  }
+
+
+  int MarlinFastHelixTrack::propagateToLayer( int /*layerID*/, EVENT::TrackerHit* /*trkhit*/, IMPL::TrackStateImpl& /*ts*/, double& /*chi2*/, int& /*ndf*/,
+                                              int& /*detElementID*/, int /*mode*/ ) {
+    return this->noGeometry( "propagateToLayer" ) ;
+  }
+
+
+  int MarlinFastHelixTrack::propagateToDetElement( int /*detElementID*/, IMPL::TrackStateImpl& /*ts*/, double& /*chi2*/, int& /*ndf*/, int /*mode*/ ) {
+    return this->noGeometry( "propagateToDetElement" ) ;
+  }
+
+
+  int MarlinFastHelixTrack::propagateToDetElement( int /*detElementID*/, EVENT::TrackerHit* /*trkhit*/, IMPL::TrackStateImpl& /*ts*/, double& /*chi2*/,
+                                                   int& /*ndf*/, int /*mode*/ ) {
+    return this->noGeometry( "propagateToDetElement" ) ;
+  }
+
+
+  int MarlinFastHelixTrack::extrapolateToLayer( int /*layerID*/, IMPL::TrackStateImpl& /*ts*/, double& /*chi2*/, int& /*ndf*/, int& /*detElementID*/, int /*mode*/ ) {
+    return this->noGeometry( "extrapolateToLayer" ) ;
+  }
+
+
+  int MarlinFastHelixTrack::extrapolateToLayer( int /*layerID*/, EVENT::TrackerHit* /*trkhit*/, IMPL::TrackStateImpl& /*ts*/, double& /*chi2*/, int& /*ndf*/,
+                                                int& /*detElementID*/, int /*mode*/ ) {
+    return this->noGeometry( "extrapolateToLayer" ) ;
+  }
+
+
+  int MarlinFastHelixTrack::extrapolateToDetElement( int /*detElementID*/, IMPL::TrackStateImpl& /*ts*/, double& /*chi2*/, int& /*ndf*/, int /*mode*/ ) {
+    return this->noGeometry( "extrapolateToDetElement" ) ;
+  }
+
+
+  int MarlinFastHelixTrack::extrapolateToDetElement( int /*detElementID*/, EVENT::TrackerHit* /*trkhit*/, IMPL::TrackStateImpl& /*ts*/, double& /*chi2*/,
+                                                     int& /*ndf*/, int /*mode*/ ) {
+    return this->noGeometry( "extrapolateToDetElement" ) ;
+  }
+
+
+  int MarlinFastHelixTrack::intersectionWithLayer( int /*layerID*/, Vector3D& /*point*/, int& /*detElementID*/, int /*mode*/ ) {
+    return this->noGeometry( "intersectionWithLayer" ) ;
+  }
+
+
+  int MarlinFastHelixTrack::intersectionWithLayer( int /*layerID*/, EVENT::TrackerHit* /*trkhit*/, Vector3D& /*point*/, int& /*detElementID*/, int /*mode*/ ) {
+    return this->noGeometry( "intersectionWithLayer" ) ;
+  }
+
+
+  int MarlinFastHelixTrack::intersectionWithDetElement( int /*detElementID*/, Vector3D& /*point*/, int /*mode*/ ) {
+    return this->noGeometry( "intersectionWithDetElement" ) ;
+  }
+
+
+  int MarlinFastHelixTrack::intersectionWithDetElement( int /*detElementID*/, EVENT::TrackerHit* /*trkhit*/, Vector3D& /*point*/, int /*mode*/ ) {
+    return this->noGeometry( "intersectionWithDetElement" ) ;
+  }
+
+
+  std::string MarlinFastHelixTrack::toString() {
+
+    std::stringstream s ;
+
+    s << "MarlinFastHelixTrack - number of hits: " << _lcioHits.size() << ", hits in fit: " << _sites.size()
+      << ", outliers: " << _outliers.size() << ", chi2: " << _chi2 << ", ndf: " << _ndf << std::endl ;
+
+    const FastKF::State& state = _currentState ;
+
+    s << "  current state: d0 " << state.par[ FastKF::iD0 ] << " phi0 " << state.par[ FastKF::iPhi ] << " omega " << state.par[ FastKF::iOmega ]
+      << " z0 " << state.par[ FastKF::iZ0 ] << " tanL " << state.par[ FastKF::iTanL ]
+      << " ref ( " << state.ref[0] << ", " << state.ref[1] << ", " << state.ref[2] << " )" << std::endl ;
+
+    return s.str() ;
+  }
+
+} // end of namespace MarlinTrk
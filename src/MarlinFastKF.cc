@@ -0,0 +1,208 @@
+#include "MarlinTrk/MarlinFastKF.h"
+#include "MarlinTrk/MarlinFastKFTrack.h"
+
+#include "DD4hep/Detector.h"
+#include "DD4hep/Fields.h"
+#include "DD4hep/DD4hepUnits.h"
+
+#include "DDRec/SurfaceManager.h"
+#include "DDRec/ISurface.h"
+
+#include <UTIL/BitField64.h>
+#include "UTIL/LCTrackerConf.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+#include "streamlog/streamlog.h"
+
+namespace {
+
+  /** cylinders are ordered in radius */
+  bool smallerRadius( const dd4hep::rec::ISurface* lhs, const dd4hep::rec::ISurface* rhs ) {
+    return dynamic_cast<const dd4hep::rec::ICylinder*>( lhs )->radius() < dynamic_cast<const dd4hep::rec::ICylinder*>( rhs )->radius() ;
+  }
+
+  /** surfaces without material, e.g. virtual surfaces inside the beam pipe, are ignored for material effects */
+  bool hasMaterial( const dd4hep::rec::ISurface* surf ) {
+    return ! ( surf->innerMaterial().density() < 1e-6 && surf->outerMaterial().density() < 1e-6 ) ;
+  }
+}
+
+
+namespace MarlinTrk{
+
+
+  MarlinFastKF::MarlinFastKF() {
+
+    this->registerOptions() ;
+
+    streamlog_out( DEBUG4 ) << "  MarlinFastKF - constructed " << std::endl ;
+  }
+
+
+  MarlinFastKF::~MarlinFastKF() {}
+
+
+  void MarlinFastKF::init() {
+
+    _useQMS = getOption( IMarlinTrkSystem::CFG::useQMS ) ;
+
+    _usedEdx = getOption( IMarlinTrkSystem::CFG::usedEdx ) ;
+
+    _straightLine = getOption( IMarlinTrkSystem::CFG::useStraightLine ) || ( _is_initialised && _bz == 0. ) ;
+
+    _parametersOnly = getOption( IMarlinTrkSystem::CFG::useParametersOnly ) ;
+
+    streamlog_out( DEBUG5 ) << " -------------------------------------------------------------------------------- " << std::endl ;
+    streamlog_out( DEBUG5 ) << "  MarlinFastKF::init() called with the following options :                        " << std::endl ;
+    streamlog_out( DEBUG5 ) <<    this->getOptions() ;
+    streamlog_out( DEBUG5 ) << " -------------------------------------------------------------------------------- " << std::endl ;
+
+    if( _is_initialised ) {
+
+      streamlog_out( DEBUG5 ) << "  MarlinFastKF::init()  - already initialized - only options are set .. " << std::endl ;
+
+      return ;
+    }
+
+    streamlog_out( DEBUG5 ) << " ##################### MarlinFastKF::init()  - initializing  " << std::endl ;
+
+    dd4hep::Detector& theDetector = dd4hep::Detector::getInstance() ;
+
+    double origin[3] = { 0., 0., 0. }, bfield[3] ;
+    theDetector.field().magneticField( origin , bfield ) ;
+
+    _bz = bfield[2] / dd4hep::tesla ;
+
+    if( _bz == 0. ) _straightLine = true ;
+
+    dd4hep::rec::SurfaceManager* surfMan = theDetector.extension< dd4hep::rec::SurfaceManager >() ;
+
+    UTIL::BitField64 encoder( UTIL::LCTrackerCellID::encoding_string() ) ;
+
+    // compute a mask for the layerID
+    long long mask = 0 ;
+    mask |= encoder[ UTIL::LCTrackerCellID::subdet() ].mask() ;
+    mask |= encoder[ UTIL::LCTrackerCellID::side()   ].mask() ;
+    mask |= encoder[ UTIL::LCTrackerCellID::layer()  ].mask() ;
+
+    const char* mapNames[2] = { "tracker", "passive" } ;
+
+    // the material of cones and other shapes has no intersection code in FastKFKernels.h
+    unsigned nIgnored = 0 ;
+
+    std::vector< std::pair< double, const dd4hep::rec::ISurface* > > planes ;
+
+    // the radial and z range of a plane, bounded by the sphere around its origin that contains it
+    auto planeExtent = []( const dd4hep::rec::ISurface* surf ) {
+
+      const dd4hep::rec::Vector3D& o = surf->origin() ;
+
+      const double halfDiagonal = 0.5 * std::sqrt( surf->length_along_u() * surf->length_along_u() +
+                                                   surf->length_along_v() * surf->length_along_v() ) / dd4hep::mm ;
+      const double r = o.rho() / dd4hep::mm ;
+      const double z = o.z() / dd4hep::mm ;
+
+      PlaneExtent extent ;
+      extent.rMin = std::max( r - halfDiagonal, 0. ) ;
+      extent.rMax = r + halfDiagonal ;
+      extent.zMin = z - halfDiagonal ;
+      extent.zMax = z + halfDiagonal ;
+
+      return extent ;
+    } ;
+
+    for( unsigned m = 0 ; m < 2 ; ++m ) {
+
+      const dd4hep::rec::SurfaceMap* surfMap = surfMan->map( mapNames[m] ) ;
+
+      if( ! surfMap ) {
+        streamlog_out( DEBUG5 ) << "  MarlinFastKF::init() - no surfaces found for " << mapNames[m] << std::endl ;
+        continue ;
+      }
+
+      for( dd4hep::rec::SurfaceMap::const_iterator it = surfMap->begin() ; it != surfMap->end() ; ++it ) {
+
+        const dd4hep::rec::ISurface* surf = it->second ;
+
+        if( surf->type().isSensitive() ) {
+
+          const int cellID0 = surf->id() ;
+
+          _surfMap[ cellID0 ] = surf ;
+          _layerMap.insert( std::make_pair( int( cellID0 & mask ), surf ) ) ;
+        }
+
+        if( ! hasMaterial( surf ) ) continue ;
+
+        if( surf->type().isZCylinder() && dynamic_cast<const dd4hep::rec::ICylinder*>( surf ) )
+          _materialCylinders.push_back( surf ) ;
+        else if( surf->type().isPlane() )
+          planes.push_back( std::make_pair( planeExtent( surf ).rMin, surf ) ) ;
+        else
+          ++nIgnored ;
+      }
+    }
+
+    std::sort( _materialCylinders.begin(), _materialCylinders.end(), smallerRadius ) ;
+
+    for( unsigned i = 0 ; i < _materialCylinders.size() ; ++i )
+      _materialRadii.push_back( dynamic_cast<const dd4hep::rec::ICylinder*>( _materialCylinders[i] )->radius() / dd4hep::mm ) ;
+
+    std::stable_sort( planes.begin(), planes.end(),
+                      []( const std::pair< double, const dd4hep::rec::ISurface* >& lhs, const std::pair< double, const dd4hep::rec::ISurface* >& rhs ) { return lhs.first < rhs.first ; } ) ;
+
+    for( unsigned i = 0 ; i < planes.size() ; ++i ) {
+      _materialPlanes.push_back( planes[i].second ) ;
+      _materialPlaneExtents.push_back( planeExtent( planes[i].second ) ) ;
+    }
+
+    if( nIgnored ) {
+      streamlog_out( WARNING ) << "  MarlinFastKF::init() - the material of " << nIgnored << " surfaces that are neither z-cylinders nor planes (e.g. cones) "
+                               << "is ignored - multiple scattering and energy loss are underestimated for tracks crossing them " << std::endl ;
+    }
+
+    streamlog_out( DEBUG5 ) << "  MarlinFastKF - Bz = " << _bz << " T" << ( _straightLine ? " - straight line model" : "" )
+                            << ", number of sensitive surfaces = " << _surfMap.size()
+                            << ", number of material cylinders = " << _materialCylinders.size()
+                            << ", number of material planes = " << _materialPlanes.size() << std::endl ;
+
+    _is_initialised = true ;
+  }
+
+
+  MarlinTrk::IMarlinTrack* MarlinFastKF::createTrack() {
+
+    if ( ! _is_initialised ) {
+
+      std::stringstream errorMsg ;
+
+      errorMsg << "MarlinFastKF::createTrack: Fitter not initialised. MarlinFastKF::init() must be called before MarlinFastKF::createTrack()" << std::endl ;
+      throw MarlinTrk::Exception( errorMsg.str() ) ;
+
+    }
+
+    return new MarlinFastKFTrack( this ) ;
+  }
+
+
+  const dd4hep::rec::ISurface* MarlinFastKF::findSurface( int cellID0 ) const {
+
+    std::map< int, const dd4hep::rec::ISurface* >::const_iterator it = _surfMap.find( cellID0 ) ;
+
+    return ( it != _surfMap.end() ? it->second : 0 ) ;
+  }
+
+
+  void MarlinFastKF::getSurfacesForLayer( int layerID, std::vector<const dd4hep::rec::ISurface*>& surfaces ) const {
+
+    typedef std::multimap< int, const dd4hep::rec::ISurface* >::const_iterator It ;
+
+    std::pair<It,It> range = _layerMap.equal_range( layerID ) ;
+
+    for( It it = range.first ; it != range.second ; ++it ) surfaces.push_back( it->second ) ;
+  }
+
+} // end of namespace MarlinTrk
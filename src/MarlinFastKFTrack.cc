@@ -0,0 +1,1586 @@
+#include "MarlinTrk/MarlinFastKFTrack.h"
+
+#include "MarlinTrk/MarlinFastKF.h"
+#include "MarlinTrk/IMarlinTrkSystem.h"
+
+#include "DD4hep/DD4hepUnits.h"
+#include "DDRec/ISurface.h"
+
+#include <lcio.h>
+#include <EVENT/TrackerHit.h>
+#include <EVENT/TrackerHitPlane.h>
+#include <IMPL/TrackStateImpl.h>
+
+#include <UTIL/BitField64.h>
+#include "UTIL/LCTrackerConf.h"
+
+#include <algorithm>
+#include <sstream>
+
+#include "streamlog/streamlog.h"
+
+
+namespace MarlinTrk {
+
+  //---------------------------------------------------------------------------------------------------------------
+
+  namespace{
+
+    std::string cellIDString( int detElementID ) {
+      lcio::BitField64 bf( UTIL::LCTrackerCellID::encoding_string() ) ;
+      bf.setValue( detElementID ) ;
+      return bf.valueString() ;
+    }
+
+    /** position in mm to DDRec units */
+    dd4hep::rec::Vector3D toDD( const double* pos ) {
+      return dd4hep::rec::Vector3D( pos[0] * dd4hep::mm, pos[1] * dd4hep::mm, pos[2] * dd4hep::mm ) ;
+    }
+
+    double dot( const dd4hep::rec::Vector3D& v, const double* a ) {
+      return v.x() * a[0] + v.y() * a[1] + v.z() * a[2] ;
+    }
+
+    /** select the arc length according to the mode - returns false if the arc is not allowed */
+    bool betterArc( double arc, double best, bool found, int mode ) {
+
+      if( mode == IMarlinTrack::modeForward  && arc <= 0. ) return false ;
+      if( mode == IMarlinTrack::modeBackward && arc >= 0. ) return false ;
+
+      return ( ! found || std::fabs( arc ) < std::fabs( best ) ) ;
+    }
+
+    bool closerArc( const std::pair< double, const dd4hep::rec::ISurface* >& lhs, const std::pair< double, const dd4hep::rec::ISurface* >& rhs ) {
+      return std::fabs( lhs.first ) < std::fabs( rhs.first ) ;
+    }
+
+    /** crossings closer than this to the start or the target of a transport, in mm, are with the surfaces there */
+    const double onSurface = 0.1 ;
+  }
+
+  //---------------------------------------------------------------------------------------------------------------
+
+
+  MarlinFastKFTrack::MarlinFastKFTrack( MarlinFastKF* fastKF )
+    : _fastKF( fastKF ), _mass( 0.13957018 ) {
+
+    _initialState.par.fill( 0. ) ;
+    _initialState.cov.fill( 0. ) ;
+    _initialState.ref[0] = _initialState.ref[1] = _initialState.ref[2] = 0. ;
+
+    _ndf = -this->nParameters() ;
+  }
+
+
+  MarlinFastKFTrack::~MarlinFastKFTrack() {}
+
+
+  void MarlinFastKFTrack::setMass( double mass ) { _mass = mass ; }
+
+  double MarlinFastKFTrack::getMass() { return _mass ; }
+
+  IMarlinTrkSystem* MarlinFastKFTrack::getTrkSystem() { return _fastKF ; }
+
+
+  int MarlinFastKFTrack::addHit( EVENT::TrackerHit* trkhit ) {
+
+    if( ! trkhit ) {
+      streamlog_out( ERROR ) << "MarlinFastKFTrack::addHit: trkhit == 0" << std::endl ;
+      return bad_intputs ;
+    }
+
+    if( ! _fastKF->findSurface( trkhit->getCellID0() ) ) {
+
+      streamlog_out( ERROR ) << "MarlinFastKFTrack::addHit: no surface found for trkhit cellid0 : "
+                             << cellIDString( trkhit->getCellID0() ) << std::endl ;
+      return bad_intputs ;
+    }
+
+    _lcioHits.push_back( trkhit ) ;
+
+    return success ;
+  }
+
+
+  int MarlinFastKFTrack::initialise( bool fitDirection ) {
+
+    if ( _initialised ) {
+      throw MarlinTrk::Exception("Track fit already initialised") ;
+    }
+
+    const unsigned nHits = _lcioHits.size() ;
+
+    if( nHits < 3 ) {
+
+      streamlog_out( ERROR ) << "<<<<<< MarlinFastKFTrack::initialise: Shortage of Hits! nhits = "
+                             << nHits << " >>>>>>>" << std::endl ;
+      return error ;
+    }
+
+    _fitDirection = fitDirection ;
+
+    if( _fastKF->_straightLine ) {
+
+      // the line through the first and the last hit - in time order, i.e. in the direction of the momentum
+      const double* x1 = _lcioHits[0]->getPosition() ;
+      const double* x3 = _lcioHits[ nHits - 1 ]->getPosition() ;
+
+      const double dxy = std::sqrt( ( x3[0] - x1[0] ) * ( x3[0] - x1[0] ) + ( x3[1] - x1[1] ) * ( x3[1] - x1[1] ) ) ;
+
+      if( dxy == 0. ) {
+        streamlog_out( ERROR ) << "<<<<<< MarlinFastKFTrack::initialise: first and last hit at the same position in the xy-plane >>>>>>>" << std::endl ;
+        return error ;
+      }
+
+      _initialState.par[ FastKF::iD0 ]    = 0. ;
+      _initialState.par[ FastKF::iPhi ]   = std::atan2( x3[1] - x1[1], x3[0] - x1[0] ) ;
+      _initialState.par[ FastKF::iOmega ] = 0. ;
+      _initialState.par[ FastKF::iZ0 ]    = 0. ;
+      _initialState.par[ FastKF::iTanL ]  = ( x3[2] - x1[2] ) / dxy ;
+
+      for( unsigned i = 0 ; i < 3 ; ++i ) _initialState.ref[i] = x1[i] ;
+    }
+    // the helix through the first, middle and last hit - in time order, i.e. in the direction of the momentum
+    else if( ! FastKF::helixFromThreePoints( _lcioHits[0]->getPosition(), _lcioHits[ nHits / 2 ]->getPosition(),
+                                             _lcioHits[ nHits - 1 ]->getPosition(), _initialState ) ) {
+
+      streamlog_out( ERROR ) << "<<<<<< MarlinFastKFTrack::initialise: hits are on a straight line in the xy-plane >>>>>>>" << std::endl ;
+      return error ;
+    }
+
+    // the reference point is at the first hit of the fit
+    if( _fitDirection == IMarlinTrack::backward )
+      FastKF::moveReferencePoint( _initialState, _lcioHits[ nHits - 1 ]->getPosition(), 0 ) ;
+
+    // very large errors - prefer translation over rotation of the track state early in the fit
+    const double cB = FastKF::c_light * _fastKF->_bz ;
+
+    _initialState.cov.fill( 0. ) ;
+    _initialState.cov[ FastKF::symIndex( FastKF::iD0,    FastKF::iD0 ) ]    = 1.e6 ;
+    _initialState.cov[ FastKF::symIndex( FastKF::iPhi,   FastKF::iPhi ) ]   = 1.e2 ;
+    _initialState.cov[ FastKF::symIndex( FastKF::iOmega, FastKF::iOmega ) ] = 1.e1 * cB * cB ;
+    _initialState.cov[ FastKF::symIndex( FastKF::iZ0,    FastKF::iZ0 ) ]    = 1.e6 ;
+    _initialState.cov[ FastKF::symIndex( FastKF::iTanL,  FastKF::iTanL ) ]  = 1.e1 ;
+
+    if( _fastKF->_straightLine ) this->fixCurvature( _initialState ) ;
+
+    _initialised = true ;
+
+    streamlog_out( DEBUG2 ) << "MarlinFastKFTrack::initialise: track parameters used for init : "
+                            << "\t Phi :"        << _initialState.par[ FastKF::iPhi ]
+                            << "\t Omega "       << _initialState.par[ FastKF::iOmega ]
+                            << "\t tan(Lambda) " << _initialState.par[ FastKF::iTanL ] << std::endl ;
+
+    return success ;
+  }
+
+
+  int MarlinFastKFTrack::initialise( const EVENT::TrackState& ts, double /*bfield_z*/, bool fitDirection ) {
+
+    if ( _initialised ) {
+      throw MarlinTrk::Exception("Track fit already initialised") ;
+    }
+
+    _fitDirection = fitDirection ;
+
+    _initialState.par[ FastKF::iD0 ]    = ts.getD0() ;
+    _initialState.par[ FastKF::iPhi ]   = ts.getPhi() ;
+    _initialState.par[ FastKF::iOmega ] = ts.getOmega() ;
+    _initialState.par[ FastKF::iZ0 ]    = ts.getZ0() ;
+    _initialState.par[ FastKF::iTanL ]  = ts.getTanLambda() ;
+
+    const EVENT::FloatVec& cov = ts.getCovMatrix() ;
+    for( unsigned i = 0 ; i < 15 ; ++i ) _initialState.cov[i] = cov[i] ;
+
+    for( unsigned i = 0 ; i < 3 ; ++i ) _initialState.ref[i] = ts.getReferencePoint()[i] ;
+
+    if( _fastKF->_straightLine ) this->fixCurvature( _initialState ) ;
+
+    _initialised = true ;
+
+    return success ;
+  }
+
+
+  int MarlinFastKFTrack::nParameters() const { return ( _fastKF->_straightLine ? 4 : 5 ) ; }
+
+
+  void MarlinFastKFTrack::fixCurvature( FastKF::State& state ) const {
+
+    state.par[ FastKF::iOmega ] = 0. ;
+
+    // without covariance omega is not changed by the filter and the kernels follow straight lines
+    for( int i = 0 ; i < 5 ; ++i ) state.cov[ FastKF::symIndex( FastKF::iOmega, i ) ] = 0. ;
+  }
+
+
+  int MarlinFastKFTrack::findSite( EVENT::TrackerHit* trkhit ) const {
+
+    for( unsigned i = 0 ; i < _sites.size() ; ++i ) {
+      if( _sites[i].hit == trkhit ) return i ;
+    }
+
+    return -1 ;
+  }
+
+
+  void MarlinFastKFTrack::findCrossings( const FastKF::State& state, const double* ref ) {
+
+    _crossings.clear() ;
+
+    // arc length to the target and the radial range covered on the way
+    FastKF::State probe = state ;
+    const double arcTarget = FastKF::moveReferencePoint( probe, ref, 0 ) ;
+
+    double start[3], end[3], dirStart[3], dirEnd[3] ;
+    FastKF::pca( state, start ) ;
+    FastKF::pca( probe, end ) ;
+    FastKF::directionAt( state, 0., dirStart ) ;
+    FastKF::directionAt( probe, 0., dirEnd ) ;
+
+    const double r0 = std::sqrt( start[0] * start[0] + start[1] * start[1] ) ;
+    const double r1 = std::sqrt( end[0] * end[0] + end[1] * end[1] ) ;
+
+    double rMin = std::min( r0, r1 ), rMax = std::max( r0, r1 ) ;
+
+    // the helix passes a radial extremum between the two points
+    const double dr0 = ( start[0] * dirStart[0] + start[1] * dirStart[1] ) * arcTarget ;
+    const double dr1 = ( end[0] * dirEnd[0] + end[1] * dirEnd[1] ) * arcTarget ;
+
+    if( state.par[ FastKF::iOmega ] == 0. ) {
+
+      // a straight line only passes its distance of closest approach to the z-axis
+      if( dr0 < 0. && dr1 > 0. ) rMin = std::fabs( start[0] * dirStart[1] - start[1] * dirStart[0] ) ;
+
+    } else {
+
+      const double rho = std::fabs( 1. / state.par[ FastKF::iOmega ] ) ;
+      const double xc = start[0] + std::sin( state.par[ FastKF::iPhi ] ) / state.par[ FastKF::iOmega ] ;
+      const double yc = start[1] - std::cos( state.par[ FastKF::iPhi ] ) / state.par[ FastKF::iOmega ] ;
+      const double dc = std::sqrt( xc * xc + yc * yc ) ;
+
+      if( dr0 > 0. && dr1 < 0. ) rMax = dc + rho ;
+      if( dr0 < 0. && dr1 > 0. ) rMin = std::fabs( dc - rho ) ;
+    }
+
+    const std::vector<double>& radii = _fastKF->_materialRadii ;
+
+    const unsigned first = std::lower_bound( radii.begin(), radii.end(), rMin - 1. ) - radii.begin() ;
+    const unsigned last  = std::upper_bound( radii.begin(), radii.end(), rMax + 1. ) - radii.begin() ;
+
+    for( unsigned i = first ; i < last ; ++i ) {
+
+      const dd4hep::rec::ISurface* surf = _fastKF->_materialCylinders[i] ;
+      const dd4hep::rec::Vector3D axis = dynamic_cast<const dd4hep::rec::ICylinder*>( surf )->center() ;
+
+      double arcs[2] ;
+      const int n = FastKF::intersectZCylinder( state, axis.x() / dd4hep::mm, axis.y() / dd4hep::mm, radii[i], arcs ) ;
+
+      for( int j = 0 ; j < n ; ++j ) {
+
+        // crossings strictly between the start and the target, both of which may be on a surface themselves
+        if( arcs[j] * arcTarget <= 0. || std::fabs( arcs[j] ) < onSurface || std::fabs( arcs[j] ) > std::fabs( arcTarget ) - onSurface ) continue ;
+
+        double pos[3] ;
+        FastKF::positionAt( state, arcs[j], pos ) ;
+
+        if( surf->insideBounds( toDD( pos ) ) ) _crossings.push_back( std::make_pair( arcs[j], surf ) ) ;
+      }
+    }
+
+    // z is linear in the arc length, so the z range of the step is given by its end points
+    const double zMin = std::min( start[2], end[2] ) - 1. ;
+    const double zMax = std::max( start[2], end[2] ) + 1. ;
+
+    const std::vector<MarlinFastKF::PlaneExtent>& extents = _fastKF->_materialPlaneExtents ;
+
+    for( unsigned i = 0 ; i < extents.size() && extents[i].rMin <= rMax + 1. ; ++i ) {
+
+      if( extents[i].rMax < rMin - 1. || extents[i].zMax < zMin || extents[i].zMin > zMax ) continue ;
+
+      const dd4hep::rec::ISurface* surf = _fastKF->_materialPlanes[i] ;
+
+      const dd4hep::rec::Vector3D& o = surf->origin() ;
+      const dd4hep::rec::Vector3D nv = surf->normal() ;
+
+      const double origin[3] = { o.x() / dd4hep::mm, o.y() / dd4hep::mm, o.z() / dd4hep::mm } ;
+      const double normal[3] = { nv.x(), nv.y(), nv.z() } ;
+
+      double arc = 0. ;
+      if( ! FastKF::intersectPlane( state, origin, normal, arc ) ) continue ;
+
+      if( arc * arcTarget <= 0. || std::fabs( arc ) < onSurface || std::fabs( arc ) > std::fabs( arcTarget ) - onSurface ) continue ;
+
+      double pos[3] ;
+      FastKF::positionAt( state, arc, pos ) ;
+
+      if( surf->insideBounds( toDD( pos ) ) ) _crossings.push_back( std::make_pair( arc, surf ) ) ;
+    }
+
+    std::sort( _crossings.begin(), _crossings.end(), closerArc ) ;
+  }
+
+
+  int MarlinFastKFTrack::transportTo( FastKF::State& state, const double* ref, bool withMaterial, FastKF::Matrix5* jacobian, FastKF::SymMatrix5* noise,
+                                      bool withCovariance ) {
+
+    FastKF::Matrix5 J, tmp ;
+
+    if( withMaterial && ( _fastKF->_useQMS || _fastKF->_usedEdx ) && ( ! _fastKF->_materialCylinders.empty() || ! _fastKF->_materialPlanes.empty() ) ) {
+
+      this->findCrossings( state, ref ) ;
+
+      // the crossing points are computed on the initial helix - the material changes it only slightly
+      const FastKF::State initial = state ;
+      double travelled = 0. ;
+
+      for( unsigned i = 0 ; i < _crossings.size() ; ++i ) {
+
+        double pos[3] ;
+        FastKF::positionAt( initial, _crossings[i].first, pos ) ;
+
+        const double arc = ( withCovariance ? FastKF::transport( state, pos, &J ) : FastKF::moveReferencePoint( state, pos, 0 ) ) ;
+        travelled += arc ;
+
+        if( jacobian ) {
+          FastKF::multiply( J, *jacobian, tmp ) ;
+          *jacobian = tmp ;
+        }
+
+        if( noise ) FastKF::similarity( J, *noise ) ;
+
+        const int error_code = this->addMaterial( state, _crossings[i].second, arc, jacobian, noise, withCovariance ) ;
+
+        if( error_code != success ) return error_code ;
+      }
+
+      streamlog_out( DEBUG0 ) << "MarlinFastKFTrack::transportTo: " << _crossings.size() << " material surfaces crossed along "
+                              << travelled << " mm" << std::endl ;
+    }
+
+    if( ! withCovariance ) {
+      FastKF::moveReferencePoint( state, ref, 0 ) ;
+      return success ;
+    }
+
+    FastKF::transport( state, ref, &J ) ;
+
+    if( jacobian ) {
+      FastKF::multiply( J, *jacobian, tmp ) ;
+      *jacobian = tmp ;
+    }
+
+    if( noise ) FastKF::similarity( J, *noise ) ;
+
+    return success ;
+  }
+
+
+  int MarlinFastKFTrack::addMaterial( FastKF::State& state, const dd4hep::rec::ISurface* surf, double arc, FastKF::Matrix5* jacobian, FastKF::SymMatrix5* noise,
+                                      bool withCovariance ) {
+
+    if( ! _fastKF->_useQMS && ! _fastKF->_usedEdx ) return success ;
+
+    double pos[3], dir[3] ;
+    FastKF::pca( state, pos ) ;
+    FastKF::directionAt( state, 0., dir ) ;
+
+    const double norm = std::sqrt( dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2] ) ;
+
+    // path length through the surface per unit thickness
+    const double cosAlpha = std::max( std::fabs( dot( surf->normal( toDD( pos ) ), dir ) ) / norm, 1.e-3 ) ;
+
+    const dd4hep::rec::IMaterial& inner = surf->innerMaterial() ;
+    const dd4hep::rec::IMaterial& outer = surf->outerMaterial() ;
+
+    const double tInner = surf->innerThickness() / dd4hep::mm / cosAlpha ;
+    const double tOuter = surf->outerThickness() / dd4hep::mm / cosAlpha ;
+
+    if( _fastKF->_useQMS && withCovariance ) {
+
+      double pathOverX0 = 0. ;
+      if( inner.radiationLength() > 0. ) pathOverX0 += tInner / ( inner.radiationLength() / dd4hep::mm ) ;
+      if( outer.radiationLength() > 0. ) pathOverX0 += tOuter / ( outer.radiationLength() / dd4hep::mm ) ;
+
+      // the scattering covariance alone, to be added to the state and to the process noise
+      FastKF::State scattering = state ;
+      scattering.cov.fill( 0. ) ;
+
+      const double p = ( _fastKF->_straightLine ? _fastKF->_straightLineMomentum : FastKF::momentum( state, _fastKF->_bz ) ) ;
+
+      FastKF::addMultipleScatteringAtMomentum( scattering, p, _mass, pathOverX0 ) ;
+
+      for( int i = 0 ; i < 15 ; ++i ) {
+        state.cov[i] += scattering.cov[i] ;
+        if( noise ) ( *noise )[i] += scattering.cov[i] ;
+      }
+    }
+
+    // the straight line model does not measure the momentum
+    if( _fastKF->_usedEdx && ! _fastKF->_straightLine ) {
+
+      const double p = FastKF::momentum( state, _fastKF->_bz ) ;
+      const double density = dd4hep::g / dd4hep::cm3 ;
+
+      double deltaE = ( FastKF::dEdx( p, _mass, inner.Z(), inner.A() / ( dd4hep::g / dd4hep::mole ), inner.density() / density ) * tInner +
+                        FastKF::dEdx( p, _mass, outer.Z(), outer.A() / ( dd4hep::g / dd4hep::mole ), outer.density() / density ) * tOuter ) ;
+
+      // the particle gains energy when going back in time
+      if( arc < 0. ) deltaE = -deltaE ;
+
+      double factor ;
+      if( ! FastKF::applyEnergyLoss( state, _fastKF->_bz, _mass, deltaE, factor ) ) {
+
+        streamlog_out( DEBUG2 ) << "MarlinFastKFTrack::addMaterial: particle stopped in surface " << cellIDString( surf->id() ) << std::endl ;
+        return error ;
+      }
+
+      if( jacobian ) {
+        for( int j = 0 ; j < 5 ; ++j ) ( *jacobian )[ FastKF::iOmega * 5 + j ] *= factor ;
+      }
+
+      if( noise ) {
+        for( int i = 0 ; i < 5 ; ++i ) ( *noise )[ FastKF::symIndex( FastKF::iOmega, i ) ] *= factor ;
+        ( *noise )[ FastKF::symIndex( FastKF::iOmega, FastKF::iOmega ) ] *= factor ;
+      }
+    }
+
+    return success ;
+  }
+
+
+  bool MarlinFastKFTrack::intersect( const FastKF::State& state, const dd4hep::rec::ISurface* surf, int mode, bool checkBounds,
+                                     double& arc, double* point ) const {
+
+    double arcs[2] ;
+    int n = 0 ;
+
+    if( surf->type().isZCylinder() ) {
+
+      const dd4hep::rec::ICylinder* cyl = dynamic_cast<const dd4hep::rec::ICylinder*>( surf ) ;
+
+      if( ! cyl ) return false ;
+
+      const dd4hep::rec::Vector3D axis = cyl->center() ;
+
+      n = FastKF::intersectZCylinder( state, axis.x() / dd4hep::mm, axis.y() / dd4hep::mm, cyl->radius() / dd4hep::mm, arcs ) ;
+    }
+    else if( surf->type().isPlane() ) {
+
+      const dd4hep::rec::Vector3D& o = surf->origin() ;
+      const dd4hep::rec::Vector3D nv = surf->normal() ;
+
+      const double origin[3] = { o.x() / dd4hep::mm, o.y() / dd4hep::mm, o.z() / dd4hep::mm } ;
+      const double normal[3] = { nv.x(), nv.y(), nv.z() } ;
+
+      if( FastKF::intersectPlane( state, origin, normal, arcs[0] ) ) n = 1 ;
+    }
+
+    bool found = false ;
+
+    for( int i = 0 ; i < n ; ++i ) {
+
+      if( ! betterArc( arcs[i], arc, found, mode ) ) continue ;
+
+      double pos[3] ;
+      FastKF::positionAt( state, arcs[i], pos ) ;
+
+      if( checkBounds && ! surf->insideBounds( toDD( pos ) ) ) continue ;
+
+      arc = arcs[i] ;
+      point[0] = pos[0] ; point[1] = pos[1] ; point[2] = pos[2] ;
+      found = true ;
+    }
+
+    return found ;
+  }
+
+
+  int MarlinFastKFTrack::intersectLayer( const FastKF::State& state, int layerID, int mode, double* point, int& detElementID ) const {
+
+    std::vector<const dd4hep::rec::ISurface*> surfaces ;
+    _fastKF->getSurfacesForLayer( layerID, surfaces ) ;
+
+    if( surfaces.empty() ) {
+      streamlog_out( DEBUG2 ) << "MarlinFastKFTrack::intersectLayer: no surfaces found for layerID " << cellIDString( layerID ) << std::endl ;
+      return bad_intputs ;
+    }
+
+    bool found = false ;
+    double best = 0. ;
+
+    for( unsigned i = 0 ; i < surfaces.size() ; ++i ) {
+
+      double arc, pos[3] ;
+
+      if( ! this->intersect( state, surfaces[i], mode, true, arc, pos ) ) continue ;
+
+      if( ! betterArc( arc, best, found, mode ) ) continue ;
+
+      best = arc ;
+      point[0] = pos[0] ; point[1] = pos[1] ; point[2] = pos[2] ;
+      detElementID = surfaces[i]->id() ;
+      found = true ;
+    }
+
+    return ( found ? success : no_intersection ) ;
+  }
+
+
+  int MarlinFastKFTrack::filterHit( const FastKF::State& start, EVENT::TrackerHit* trkhit, double maxChi2Increment, Site& site ) {
+
+    const dd4hep::rec::ISurface* surf = _fastKF->findSurface( trkhit->getCellID0() ) ;
+
+    if( ! surf ) {
+
+      streamlog_out( ERROR ) << "MarlinFastKFTrack::filterHit: no surface found for trkhit cellid0 : "
+                             << cellIDString( trkhit->getCellID0() ) << std::endl ;
+      return bad_intputs ;
+    }
+
+    site.deltaChi2 = 0. ;
+
+    // ---- prediction
+    FastKF::State state = start ;
+
+    double arc = 0., point[3] ;
+
+    if( ! this->intersect( state, surf, modeClosest, false, arc, point ) ) {
+
+      streamlog_out( DEBUG2 ) << "MarlinFastKFTrack::filterHit: no intersection with surface " << cellIDString( surf->id() ) << std::endl ;
+      return site_discarded ;
+    }
+
+    FastKF::setIdentity( site.jacobian ) ;
+    site.noise.fill( 0. ) ;
+
+    int error_code = this->transportTo( state, point, true, &site.jacobian, &site.noise ) ;
+
+    if( error_code == success ) error_code = this->addMaterial( state, surf, arc, &site.jacobian, &site.noise ) ;
+
+    if( error_code != success ) return site_discarded ;
+
+    site.predicted = state ;
+
+    // ---- measurement: the residual is measured along u and v on the surface, the projection onto the
+    //      surface along the track direction gives the derivatives w.r.t. d0 and z0 at the reference point
+
+    const dd4hep::rec::Vector3D ddPoint = toDD( point ) ;
+    const dd4hep::rec::Vector3D u = surf->u( ddPoint ) ;
+    const dd4hep::rec::Vector3D v = surf->v( ddPoint ) ;
+    const dd4hep::rec::Vector3D n = surf->normal( ddPoint ) ;
+
+    double dir[3] ;
+    FastKF::directionAt( state, 0., dir ) ;
+
+    const double nDir = dot( n, dir ) ;
+
+    if( std::fabs( nDir ) < 1.e-6 ) return site_discarded ;
+
+    const double sinPhi = std::sin( state.par[ FastKF::iPhi ] ) ;
+    const double cosPhi = std::cos( state.par[ FastKF::iPhi ] ) ;
+
+    const double dD0[3] = { -sinPhi, cosPhi, 0. } ;
+    const double dZ0[3] = { 0., 0., 1. } ;
+
+    double trackPos[3] ;
+    FastKF::pca( state, trackPos ) ;
+
+    const double* hitPos = trkhit->getPosition() ;
+    const double diff[3] = { hitPos[0] - trackPos[0], hitPos[1] - trackPos[1], hitPos[2] - trackPos[2] } ;
+
+    const int dim = ( surf->type().isMeasurement1D() ? 1 : 2 ) ;
+
+    double H[2][5] = { { 0. } } ;
+    double residual[2] = { 0., 0. } ;
+
+    for( int m = 0 ; m < dim ; ++m ) {
+
+      const dd4hep::rec::Vector3D& axis = ( m == 0 ? u : v ) ;
+
+      const double aDir = dot( axis, dir ) ;
+
+      H[m][ FastKF::iD0 ] = dot( axis, dD0 ) - aDir * dot( n, dD0 ) / nDir ;
+      H[m][ FastKF::iZ0 ] = dot( axis, dZ0 ) - aDir * dot( n, dZ0 ) / nDir ;
+
+      residual[m] = dot( axis, diff ) ;
+    }
+
+    // ---- the hit errors
+    double du, dv ;
+
+    const EVENT::TrackerHitPlane* planarhit = dynamic_cast<const EVENT::TrackerHitPlane*>( trkhit ) ;
+
+    if( planarhit ) {
+
+      du = planarhit->getdU() ;
+      dv = planarhit->getdV() ;
+
+    } else { // we have a TPC hit which is not yet using the CylinderTrackerHit ...
+
+      const EVENT::FloatVec& cov = trkhit->getCovMatrix() ;
+
+      du = std::sqrt( cov[0] + cov[2] ) ;
+      dv = std::sqrt( cov[5] ) ;
+    }
+
+    const double V[3] = { du * du, 0., dv * dv } ;
+
+    // ---- update
+    double chi2 = 0. ;
+
+    if( ! FastKF::filter( state, H, residual, V, dim, maxChi2Increment, chi2 ) ) {
+
+      site.deltaChi2 = chi2 ;
+
+      streamlog_out( DEBUG2 ) << "MarlinFastKFTrack::filterHit: site discarded for " << cellIDString( trkhit->getCellID0() )
+                              << " chi2increment = " << chi2 << " maxChi2Increment = " << maxChi2Increment << std::endl ;
+
+      return ( chi2 > maxChi2Increment ? site_fails_chi2_cut : site_discarded ) ;
+    }
+
+    // the path from the start, which addAndFit() accumulates over the sites
+    site.pathLength = std::fabs( FastKF::pathLength( start, arc ) ) ;
+    site.timeOfFlight = FastKF::timeOfFlight( start, _fastKF->_bz, _mass, site.pathLength ) ;
+
+    site.hit = trkhit ;
+    site.filtered = state ;
+    site.deltaChi2 = chi2 ;
+    site.dim = dim ;
+    site.isSmoothed = false ;
+
+    return success ;
+  }
+
+
+  int MarlinFastKFTrack::fit( double maxChi2Increment ) {
+
+    streamlog_out( DEBUG2 ) << "MarlinFastKFTrack::fit() called " << std::endl ;
+
+    if ( ! _initialised ) {
+      throw MarlinTrk::Exception("Track fit not initialised") ;
+    }
+
+    _sites.reserve( _sites.size() + _lcioHits.size() ) ;
+
+    const int nHits = _lcioHits.size() ;
+
+    for( int i = 0 ; i < nHits ; ++i ) {
+
+      EVENT::TrackerHit* trkhit = _lcioHits[ _fitDirection == IMarlinTrack::backward ? nHits - 1 - i : i ] ;
+
+      double chi2increment = 0. ;
+
+      int error_code = this->addAndFit( trkhit, chi2increment, maxChi2Increment ) ;
+
+      if( error_code != success ) {
+
+        // if the hit fails for any reason other than the Chi2 cut record the Chi2 contibution as DBL_MAX
+        if( error_code != site_fails_chi2_cut ) chi2increment = DBL_MAX ;
+
+        _outliers.push_back( std::make_pair( trkhit, chi2increment ) ) ;
+      }
+    }
+
+    if( _fastKF->getOption( MarlinTrk::IMarlinTrkSystem::CFG::useSmoothing ) ) {
+
+      int error_code = this->smooth() ;
+
+      if( error_code != success ) return error_code ;
+    }
+
+    return ( _sites.empty() ? all_sites_fail_fit : success ) ;
+  }
+
+
+  int MarlinFastKFTrack::addAndFit( EVENT::TrackerHit* trkhit, double& chi2increment, double maxChi2Increment ) {
+
+    if( ! trkhit ) {
+      streamlog_out( ERROR ) << "MarlinFastKFTrack::addAndFit: trkhit == 0" << std::endl ;
+      return bad_intputs ;
+    }
+
+    if ( ! _initialised ) {
+      throw MarlinTrk::Exception("Track fit not initialised") ;
+    }
+
+    Site site ;
+
+    const int error_code = this->filterHit( this->currentState(), trkhit, maxChi2Increment, site ) ;
+
+    chi2increment = site.deltaChi2 ;
+
+    if( error_code != success ) return error_code ;
+
+    if( _sites.empty() ) {
+      site.pathLength = 0. ;
+      site.timeOfFlight = 0. ;
+    } else {
+      site.pathLength += _sites.back().pathLength ;
+      site.timeOfFlight += _sites.back().timeOfFlight ;
+    }
+
+    _sites.push_back( site ) ;
+
+    _chi2 += site.deltaChi2 ;
+    _ndf  += site.dim ;
+
+    return success ;
+  }
+
+
+  int MarlinFastKFTrack::testChi2Increment( EVENT::TrackerHit* trkhit, double& chi2increment ) {
+
+    if( ! trkhit ) {
+      streamlog_out( ERROR ) << "MarlinFastKFTrack::testChi2Increment: trkhit == 0" << std::endl ;
+      return bad_intputs ;
+    }
+
+    if ( ! _initialised ) {
+      throw MarlinTrk::Exception("Track fit not initialised") ;
+    }
+
+    Site site ;
+
+    const int error_code = this->filterHit( this->currentState(), trkhit, DBL_MAX, site ) ;
+
+    chi2increment = site.deltaChi2 ;
+
+    return error_code ;
+  }
+
+
+  int MarlinFastKFTrack::smoothBackTo( int index ) {
+
+    if( _sites.empty() ) return error ;
+
+    Site& last = _sites.back() ;
+    last.smoothed = last.filtered ;
+    last.isSmoothed = true ;
+
+    for( int k = _sites.size() - 2 ; k >= index ; --k ) {
+
+      Site& site = _sites[k] ;
+      const Site& next = _sites[ k + 1 ] ;
+
+      // With C_p = F C_f F^T + Q the gain A = C_f F^T C_p^-1 equals F^-1 B with B = 1 - Q C_p^-1 and
+      // C_s = F^-1 ( B C_s,k+1 B^T + Q - Q C_p^-1 Q ) F^-T. Unlike C_f + A ( C_s,k+1 - C_p ) A^T this does
+      // not subtract large numbers for the first sites, where C_f is still dominated by the initial errors.
+      FastKF::SymMatrix5 predInv = next.predicted.cov ;
+
+      // the fixed curvature of the straight line model, without covariance, is excluded from the inversion
+      const int omegaIndex = FastKF::symIndex( FastKF::iOmega, FastKF::iOmega ) ;
+      const bool fixedOmega = ( predInv[ omegaIndex ] == 0. ) ;
+
+      if( fixedOmega ) predInv[ omegaIndex ] = 1. ;
+
+      if( ! FastKF::invert( predInv ) ) {
+        streamlog_out( DEBUG2 ) << "MarlinFastKFTrack::smoothBackTo: predicted covariance not invertible at site " << k + 1 << std::endl ;
+        return error ;
+      }
+
+      if( fixedOmega ) predInv[ omegaIndex ] = 0. ;
+
+      FastKF::Matrix5 jacInv = next.jacobian ;
+
+      if( ! FastKF::invert( jacInv ) ) {
+        streamlog_out( DEBUG2 ) << "MarlinFastKFTrack::smoothBackTo: Jacobian not invertible at site " << k + 1 << std::endl ;
+        return error ;
+      }
+
+      FastKF::Matrix5 QPinv, B, A ;
+
+      for( int i = 0 ; i < 5 ; ++i )
+        for( int j = 0 ; j < 5 ; ++j ) {
+          double sum = 0. ;
+          for( int l = 0 ; l < 5 ; ++l ) sum += next.noise[ FastKF::symIndex( i, l ) ] * predInv[ FastKF::symIndex( l, j ) ] ;
+          QPinv[ i * 5 + j ] = sum ;
+          B[ i * 5 + j ] = ( i == j ? 1. : 0. ) - sum ;
+        }
+
+      FastKF::multiply( jacInv, B, A ) ;
+
+      // x_s = x_f + A ( x_s,k+1 - x_p,k+1 )
+      FastKF::Vector5 dPar ;
+      for( int i = 0 ; i < 5 ; ++i ) dPar[i] = next.smoothed.par[i] - next.predicted.par[i] ;
+      dPar[ FastKF::iPhi ] = FastKF::toBaseRange( dPar[ FastKF::iPhi ] ) ;
+
+      FastKF::SymMatrix5 cov = next.smoothed.cov ;
+
+      FastKF::similarity( B, cov ) ;
+
+      for( int i = 0 ; i < 5 ; ++i )
+        for( int j = 0 ; j <= i ; ++j ) {
+          double sum = 0. ;
+          for( int l = 0 ; l < 5 ; ++l ) sum += QPinv[ i * 5 + l ] * next.noise[ FastKF::symIndex( l, j ) ] ;
+          cov[ FastKF::symIndex( i, j ) ] += next.noise[ FastKF::symIndex( i, j ) ] - sum ;
+        }
+
+      FastKF::similarity( jacInv, cov ) ;
+
+      site.smoothed = site.filtered ;
+
+      for( int i = 0 ; i < 5 ; ++i )
+        for( int j = 0 ; j < 5 ; ++j ) site.smoothed.par[i] += A[ i * 5 + j ] * dPar[j] ;
+
+      site.smoothed.par[ FastKF::iPhi ] = FastKF::toBaseRange( site.smoothed.par[ FastKF::iPhi ] ) ;
+
+      site.smoothed.cov = cov ;
+
+      site.isSmoothed = true ;
+    }
+
+    return success ;
+  }
+
+
+  int MarlinFastKFTrack::smooth() {
+
+    streamlog_out( DEBUG2 ) << "MarlinFastKFTrack::smooth() " << std::endl ;
+
+    return this->smoothBackTo( 0 ) ;
+  }
+
+
+  int MarlinFastKFTrack::smooth( EVENT::TrackerHit* trkhit ) {
+
+    streamlog_out( DEBUG2 ) << "MarlinFastKFTrack::smooth( EVENT::TrackerHit* " << trkhit << "  ) " << std::endl ;
+
+    if ( ! trkhit ) return bad_intputs ;
+
+    const int index = this->findSite( trkhit ) ;
+
+    if( index < 0 ) return bad_intputs ;
+
+    return this->smoothBackTo( index ) ;
+  }
+
+
+  void MarlinFastKFTrack::toLCIOTrackState( const FastKF::State& state, IMPL::TrackStateImpl& ts, bool withCovariance ) const {
+
+    ts.setD0( state.par[ FastKF::iD0 ] ) ;
+    ts.setPhi( state.par[ FastKF::iPhi ] ) ;
+    ts.setOmega( state.par[ FastKF::iOmega ] ) ;
+    ts.setZ0( state.par[ FastKF::iZ0 ] ) ;
+    ts.setTanLambda( state.par[ FastKF::iTanL ] ) ;
+
+    const float ref[3] = { float( state.ref[0] ), float( state.ref[1] ), float( state.ref[2] ) } ;
+    ts.setReferencePoint( ref ) ;
+
+    EVENT::FloatVec cov( 15 ) ;
+    if( withCovariance ) for( unsigned i = 0 ; i < 15 ; ++i ) cov[i] = state.cov[i] ;
+
+    ts.setCovMatrix( cov ) ;
+  }
+
+
+  int MarlinFastKFTrack::getSiteState( EVENT::TrackerHit* trkhit, const FastKF::State*& state ) const {
+
+    const int index = this->findSite( trkhit ) ;
+
+    if( index < 0 ) {
+      streamlog_out( DEBUG2 ) << "MarlinFastKFTrack::getSiteState: hit " << trkhit << " not in fit" << std::endl ;
+      return bad_intputs ;
+    }
+
+    state = &this->siteState( _sites[ index ] ) ;
+
+    return success ;
+  }
+
+
+  int MarlinFastKFTrack::getTrackState( IMPL::TrackStateImpl& ts, double& chi2, int& ndf ) {
+
+    this->toLCIOTrackState( this->currentState(), ts ) ;
+
+    chi2 = _chi2 ;
+    ndf  = _ndf ;
+
+    return success ;
+  }
+
+
+  int MarlinFastKFTrack::getTrackState( EVENT::TrackerHit* trkhit, IMPL::TrackStateImpl& ts, double& chi2, int& ndf ) {
+
+    const FastKF::State* state = 0 ;
+
+    const int error_code = this->getSiteState( trkhit, state ) ;
+
+    if( error_code != success ) return error_code ;
+
+    this->toLCIOTrackState( *state, ts ) ;
+
+    chi2 = _chi2 ;
+    ndf  = _ndf ;
+
+    return success ;
+  }
+
+
+  int MarlinFastKFTrack::getHitsInFit( std::vector<std::pair<EVENT::TrackerHit*, double> >& hits ) {
+
+    for( unsigned i = 0 ; i < _sites.size() ; ++i ) hits.push_back( std::make_pair( _sites[i].hit, _sites[i].deltaChi2 ) ) ;
+
+    return success ;
+  }
+
+
+  int MarlinFastKFTrack::getOutliers( std::vector<std::pair<EVENT::TrackerHit*, double> >& hits ) {
+
+    hits.insert( hits.end(), _outliers.begin(), _outliers.end() ) ;
+
+    return success ;
+  }
+
+
+  int MarlinFastKFTrack::getNDF( int& ndf ) {
+
+    if( _sites.empty() ) return error ;
+
+    ndf = _ndf ;
+
+    return success ;
+  }
+
+
+  int MarlinFastKFTrack::getTrackerHitAtPositiveNDF( EVENT::TrackerHit*& trkhit ) {
+
+    int ndf = -this->nParameters() ;
+
+    for( unsigned i = 0 ; i < _sites.size() ; ++i ) {
+
+      ndf += _sites[i].dim ;
+
+      if( ndf >= 0 ) {
+        trkhit = _sites[i].hit ;
+        return success ;
+      }
+    }
+
+    return error ;
+  }
+
+
+  int MarlinFastKFTrack::getPathLength( EVENT::TrackerHit* trkhit, double& pathLength, double& timeOfFlight ) {
+
+    const int index = this->findSite( trkhit ) ;
+
+    if( index < 0 ) return bad_intputs ;
+
+    pathLength = _sites[ index ].pathLength ;
+    timeOfFlight = _sites[ index ].timeOfFlight ;
+
+    return success ;
+  }
+
+
+  int MarlinFastKFTrack::getLastPropagationLength( double& pathLength, double& timeOfFlight ) {
+
+    if( ! _hasPropagated ) return error ;
+
+    pathLength = _lastPathLength ;
+    timeOfFlight = _lastTimeOfFlight ;
+
+    return success ;
+  }
+
+
+  int MarlinFastKFTrack::getHitPattern( std::vector<PatternCrossing>& crossings ) {
+
+    crossings.clear() ;
+
+    if( _sites.empty() ) return error ;
+
+    const FastKF::State& first = this->siteState( _sites.front() ) ;
+    const FastKF::State& last  = this->siteState( _sites.back() ) ;
+
+    const double rFirst = first.ref[0] * first.ref[0] + first.ref[1] * first.ref[1] ;
+    const double rLast  = last.ref[0] * last.ref[0] + last.ref[1] * last.ref[1] ;
+
+    FastKF::State state = ( rFirst <= rLast ? first : last ) ;
+
+    const double origin[3] = { 0., 0., 0. } ;
+    FastKF::moveReferencePoint( state, origin, 0 ) ;
+
+    std::map<int, EVENT::TrackerHit*> hitsByElement ;
+
+    for( unsigned i = 0 ; i < _sites.size() ; ++i ) hitsByElement[ _sites[i].hit->getCellID0() ] = _sites[i].hit ;
+
+    // ( arc length, crossing ) of all surfaces crossed going outwards
+    std::vector< std::pair<double, PatternCrossing> > found ;
+
+    typedef std::map< int, const dd4hep::rec::ISurface* >::const_iterator SurfIt ;
+
+    for( SurfIt it = _fastKF->_surfMap.begin() ; it != _fastKF->_surfMap.end() ; ++it ) {
+
+      double arc, point[3] ;
+
+      if( ! this->intersect( state, it->second, modeForward, true, arc, point ) ) continue ;
+
+      PatternCrossing crossing ;
+      crossing.detElementID = it->first ;
+      crossing.point = Vector3D( point[0], point[1], point[2] ) ;
+
+      std::map<int, EVENT::TrackerHit*>::const_iterator ih = hitsByElement.find( it->first ) ;
+      crossing.hit = ( ih != hitsByElement.end() ? ih->second : 0 ) ;
+
+      found.push_back( std::make_pair( arc, crossing ) ) ;
+    }
+
+    std::stable_sort( found.begin(), found.end(),
+                      []( const std::pair<double, PatternCrossing>& lhs, const std::pair<double, PatternCrossing>& rhs ) { return lhs.first < rhs.first ; } ) ;
+
+    for( unsigned i = 0 ; i < found.size() ; ++i ) crossings.push_back( found[i].second ) ;
+
+    streamlog_out( DEBUG2 ) << "MarlinFastKFTrack::getHitPattern: " << crossings.size() << " surfaces crossed" << std::endl ;
+
+    return success ;
+  }
+
+
+  //---------------------------------------------------------------------------------------------------------------
+  // propagation
+
+  int MarlinFastKFTrack::propagate( const FastKF::State& start, const Vector3D& point, bool withMaterial,
+                                    IMPL::TrackStateImpl& ts, double& chi2, int& ndf ) {
+
+    FastKF::State state = start ;
+
+    const double ref[3] = { point.x(), point.y(), point.z() } ;
+
+    // the arc length on the helix of the start state, before the material changes it
+    FastKF::State probe = start ;
+    const double path = FastKF::pathLength( start, FastKF::moveReferencePoint( probe, ref, 0 ) ) ;
+
+    const bool withCovariance = ! _fastKF->_parametersOnly ;
+
+    const int error_code = this->transportTo( state, ref, withMaterial, 0, 0, withCovariance ) ;
+
+    if( error_code != success ) return error_code ;
+
+    _lastPathLength = path ;
+    _lastTimeOfFlight = FastKF::timeOfFlight( start, _fastKF->_bz, _mass, path ) ;
+    _hasPropagated = true ;
+
+    this->toLCIOTrackState( state, ts, withCovariance ) ;
+
+    chi2 = _chi2 ;
+    ndf  = _ndf ;
+
+    return success ;
+  }
+
+
+  int MarlinFastKFTrack::propagateToLayer( const FastKF::State& start, int layerID, bool withMaterial,
+                                           IMPL::TrackStateImpl& ts, double& chi2, int& ndf, int& detElementID, int mode ) {
+
+    double point[3] ;
+
+    const int error_code = this->intersectLayer( start, layerID, mode, point, detElementID ) ;
+
+    if( error_code != success ) return error_code ;
+
+    return this->propagate( start, Vector3D( point[0], point[1], point[2] ), withMaterial, ts, chi2, ndf ) ;
+  }
+
+
+  int MarlinFastKFTrack::propagateToDetElement( const FastKF::State& start, int detElementID, bool withMaterial,
+                                                IMPL::TrackStateImpl& ts, double& chi2, int& ndf, int mode ) {
+
+    const dd4hep::rec::ISurface* surf = _fastKF->findSurface( detElementID ) ;
+
+    if( ! surf ) return bad_intputs ;
+
+    double arc, point[3] ;
+
+    if( ! this->intersect( start, surf, mode, true, arc, point ) ) return no_intersection ;
+
+    return this->propagate( start, Vector3D( point[0], point[1], point[2] ), withMaterial, ts, chi2, ndf ) ;
+  }
+
+
+  int MarlinFastKFTrack::propagate( const Vector3D& point, IMPL::TrackStateImpl& ts, double& chi2, int& ndf ) {
+    return this->propagate( this->currentState(), point, true, ts, chi2, ndf ) ;
+  }
+
+
+  int MarlinFastKFTrack::propagate( const Vector3D& point, EVENT::TrackerHit* trkhit, IMPL::TrackStateImpl& ts, double& chi2, int& ndf ) {
+
+    const FastKF::State* state = 0 ;
+
+    const int error_code = this->getSiteState( trkhit, state ) ;
+
+    if( error_code != success ) return error_code ;
+
+    return this->propagate( *state, point, true, ts, chi2, ndf ) ;
+  }
+
+
+  int MarlinFastKFTrack::propagateToLayer( int layerID, IMPL::TrackStateImpl& ts, double& chi2, int& ndf, int& detElementID, int mode ) {
+    return this->propagateToLayer( this->currentState(), layerID, true, ts, chi2, ndf, detElementID, mode ) ;
+  }
+
+
+  int MarlinFastKFTrack::propagateToLayer( int layerID, EVENT::TrackerHit* trkhit, IMPL::TrackStateImpl& ts, double& chi2, int& ndf, int& detElementID, int mode ) {
+
+    const FastKF::State* state = 0 ;
+
+    const int error_code = this->getSiteState( trkhit, state ) ;
+
+    if( error_code != success ) return error_code ;
+
+    return this->propagateToLayer( *state, layerID, true, ts, chi2, ndf, detElementID, mode ) ;
+  }
+
+
+  int MarlinFastKFTrack::propagateToDetElement( int detElementID, IMPL::TrackStateImpl& ts, double& chi2, int& ndf, int mode ) {
+    return this->propagateToDetElement( this->currentState(), detElementID, true, ts, chi2, ndf, mode ) ;
+  }
+
+
+  int MarlinFastKFTrack::propagateToDetElement( int detElementID, EVENT::TrackerHit* trkhit, IMPL::TrackStateImpl& ts, double& chi2, int& ndf, int mode ) {
+
+    const FastKF::State* state = 0 ;
+
+    const int error_code = this->getSiteState( trkhit, state ) ;
+
+    if( error_code != success ) return error_code ;
+
+    return this->propagateToDetElement( *state, detElementID, true, ts, chi2, ndf, mode ) ;
+  }
+
+
+  int MarlinFastKFTrack::propagateToMany( const FastKF::State& start, std::vector<PropagationTarget>& targets ) {
+
+    std::vector<double> refs( 3 * targets.size() ) ;
+
+    // (|arc length|, target index) in front of and behind the start
+    std::vector<std::pair<double, unsigned> > front, behind ;
+
+    for( unsigned i = 0 ; i < targets.size() ; ++i ) {
+
+      PropagationTarget& t = targets[i] ;
+      double* ref = &refs[ 3 * i ] ;
+
+      if( t.type == PropagationTarget::toPoint ) {
+
+        ref[0] = t.point.x() ; ref[1] = t.point.y() ; ref[2] = t.point.z() ;
+        t.status = success ;
+      }
+      else if( t.type == PropagationTarget::toLayer ) {
+
+        t.status = this->intersectLayer( start, t.id, t.mode, ref, t.detElementID ) ;
+      }
+      else {
+
+        const dd4hep::rec::ISurface* surf = _fastKF->findSurface( t.id ) ;
+
+        double arc = 0. ;
+
+        t.detElementID = t.id ;
+        t.status = ( ! surf ? bad_intputs : this->intersect( start, surf, t.mode, true, arc, ref ) ? success : no_intersection ) ;
+      }
+
+      if( t.status != success ) continue ;
+
+      FastKF::State probe = start ;
+      const double arc = FastKF::moveReferencePoint( probe, ref, 0 ) ;
+
+      ( arc < 0. ? behind : front ).push_back( std::make_pair( std::fabs( arc ), i ) ) ;
+    }
+
+    std::stable_sort( front.begin(), front.end() ) ;
+    std::stable_sort( behind.begin(), behind.end() ) ;
+
+    this->walkTargets( start, behind, refs, targets ) ;
+    this->walkTargets( start, front, refs, targets ) ;
+
+    streamlog_out( DEBUG2 ) << "MarlinFastKFTrack::propagateToMany: " << front.size() << " targets in front of and "
+                            << behind.size() << " targets behind the start" << std::endl ;
+
+    for( unsigned i = 0 ; i < targets.size() ; ++i ) {
+      if( targets[i].status != success ) return targets[i].status ;
+    }
+
+    return success ;
+  }
+
+
+  void MarlinFastKFTrack::walkTargets( FastKF::State state, const std::vector<std::pair<double, unsigned> >& order, const std::vector<double>& refs,
+                                       std::vector<PropagationTarget>& targets ) {
+
+    if( order.empty() ) return ;
+
+    // one navigation for all targets: the material crossed up to the farthest one, merged with the targets in arc length
+    _crossings.clear() ;
+
+    if( _fastKF->_useQMS || _fastKF->_usedEdx ) this->findCrossings( state, &refs[ 3 * order.back().second ] ) ;
+
+    const FastKF::State initial = state ;
+    const bool withCovariance = ! _fastKF->_parametersOnly ;
+
+    double path = 0., tof = 0. ;
+    unsigned c = 0 ;
+
+    for( unsigned j = 0 ; j < order.size() ; ++j ) {
+
+      PropagationTarget& t = targets[ order[j].second ] ;
+
+      // a target on a surface is reached before its material is added, as in propagate()
+      while( t.status == success && c < _crossings.size() && std::fabs( _crossings[c].first ) < order[j].first - onSurface ) {
+
+        double pos[3] ;
+        FastKF::positionAt( initial, _crossings[c].first, pos ) ;
+
+        const double arc = ( withCovariance ? FastKF::transport( state, pos, 0 ) : FastKF::moveReferencePoint( state, pos, 0 ) ) ;
+        const double step = FastKF::pathLength( state, arc ) ;
+
+        tof += FastKF::timeOfFlight( state, _fastKF->_bz, _mass, step ) ;
+        path += step ;
+
+        // the step to a surface just passed by the previous target can be slightly negative
+        t.status = this->addMaterial( state, _crossings[c].second, _crossings[c].first, 0, 0, withCovariance ) ;
+        ++c ;
+      }
+
+      if( t.status != success ) {
+
+        // the particle has been stopped - none of the further targets can be reached
+        for( ++j ; j < order.size() ; ++j ) targets[ order[j].second ].status = t.status ;
+        break ;
+      }
+
+      const double* ref = &refs[ 3 * order[j].second ] ;
+      const double step = FastKF::pathLength( state, ( withCovariance ? FastKF::transport( state, ref, 0 ) : FastKF::moveReferencePoint( state, ref, 0 ) ) ) ;
+
+      tof += FastKF::timeOfFlight( state, _fastKF->_bz, _mass, step ) ;
+      path += step ;
+
+      this->toLCIOTrackState( state, t.trackState, withCovariance ) ;
+
+      t.chi2 = _chi2 ;
+      t.ndf  = _ndf ;
+      t.pathLength = path ;
+      t.timeOfFlight = tof ;
+
+      _lastPathLength = path ;
+      _lastTimeOfFlight = tof ;
+      _hasPropagated = true ;
+    }
+  }
+
+
+  int MarlinFastKFTrack::propagateToFirstLayer( const FastKF::State& start, const std::vector<int>& layerIDs, IMPL::TrackStateImpl& ts, double& chi2, int& ndf,
+                                                int& layerID, int& detElementID, int mode ) {
+
+    bool found = false ;
+    double best = 0. ;
+    double point[3] ;
+
+    for( unsigned l = 0 ; l < layerIDs.size() ; ++l ) {
+
+      std::vector<const dd4hep::rec::ISurface*> surfaces ;
+      _fastKF->getSurfacesForLayer( layerIDs[l], surfaces ) ;
+
+      for( unsigned i = 0 ; i < surfaces.size() ; ++i ) {
+
+        double arc, pos[3] ;
+
+        if( ! this->intersect( start, surfaces[i], mode, true, arc, pos ) ) continue ;
+
+        if( ! betterArc( arc, best, found, mode ) ) continue ;
+
+        best = arc ;
+        point[0] = pos[0] ; point[1] = pos[1] ; point[2] = pos[2] ;
+        layerID = layerIDs[l] ;
+        detElementID = surfaces[i]->id() ;
+        found = true ;
+      }
+    }
+
+    if( ! found ) return no_intersection ;
+
+    streamlog_out( DEBUG2 ) << "MarlinFastKFTrack::propagateToFirstLayer: first crossing with layer " << cellIDString( layerID )
+                            << " at arc length " << best << std::endl ;
+
+    return this->propagate( start, Vector3D( point[0], point[1], point[2] ), true, ts, chi2, ndf ) ;
+  }
+
+
+  int MarlinFastKFTrack::propagateToFirstLayer( const std::vector<int>& layerIDs, IMPL::TrackStateImpl& ts, double& chi2, int& ndf, int& layerID, int& detElementID, int mode ) {
+    return this->propagateToFirstLayer( this->currentState(), layerIDs, ts, chi2, ndf, layerID, detElementID, mode ) ;
+  }
+
+
+  int MarlinFastKFTrack::propagateToFirstLayer( const std::vector<int>& layerIDs, EVENT::TrackerHit* trkhit, IMPL::TrackStateImpl& ts, double& chi2, int& ndf,
+                                                int& layerID, int& detElementID, int mode ) {
+
+    const FastKF::State* state = 0 ;
+
+    const int error_code = this->getSiteState( trkhit, state ) ;
+
+    if( error_code != success ) return error_code ;
+
+    return this->propagateToFirstLayer( *state, layerIDs, ts, chi2, ndf, layerID, detElementID, mode ) ;
+  }
+
+
+  int MarlinFastKFTrack::propagateToMany( std::vector<PropagationTarget>& targets ) {
+    return this->propagateToMany( this->currentState(), targets ) ;
+  }
+
+
+  int MarlinFastKFTrack::propagateToMany( std::vector<PropagationTarget>& targets, EVENT::TrackerHit* trkhit ) {
+
+    const FastKF::State* state = 0 ;
+
+    const int error_code = this->getSiteState( trkhit, state ) ;
+
+    if( error_code != success ) return error_code ;
+
+    return this->propagateToMany( *state, targets ) ;
+  }
+
+
+  //---------------------------------------------------------------------------------------------------------------
+  // extrapolation: propagation without material effects
+
+  int MarlinFastKFTrack::extrapolate( const Vector3D& point, IMPL::TrackStateImpl& ts, double& chi2, int& ndf ) {
+    return this->propagate( this->currentState(), point, false, ts, chi2, ndf ) ;
+  }
+
+
+  int MarlinFastKFTrack::extrapolate( const Vector3D& point, EVENT::TrackerHit* trkhit, IMPL::TrackStateImpl& ts, double& chi2, int& ndf ) {
+
+    const FastKF::State* state = 0 ;
+
+    const int error_code = this->getSiteState( trkhit, state ) ;
+
+    if( error_code != success ) return error_code ;
+
+    return this->propagate( *state, point, false, ts, chi2, ndf ) ;
+  }
+
+
+  int MarlinFastKFTrack::extrapolateToLayer( int layerID, IMPL::TrackStateImpl& ts, double& chi2, int& ndf, int& detElementID, int mode ) {
+    return this->propagateToLayer( this->currentState(), layerID, false, ts, chi2, ndf, detElementID, mode ) ;
+  }
+
+
+  int MarlinFastKFTrack::extrapolateToLayer( int layerID, EVENT::TrackerHit* trkhit, IMPL::TrackStateImpl& ts, double& chi2, int& ndf, int& detElementID, int mode ) {
+
+    const FastKF::State* state = 0 ;
+
+    const int error_code = this->getSiteState( trkhit, state ) ;
+
+    if( error_code != success ) return error_code ;
+
+    return this->propagateToLayer( *state, layerID, false, ts, chi2, ndf, detElementID, mode ) ;
+  }
+
+
+  int MarlinFastKFTrack::extrapolateToDetElement( int detElementID, IMPL::TrackStateImpl& ts, double& chi2, int& ndf, int mode ) {
+    return this->propagateToDetElement( this->currentState(), detElementID, false, ts, chi2, ndf, mode ) ;
+  }
+
+
+  int MarlinFastKFTrack::extrapolateToDetElement( int detElementID, EVENT::TrackerHit* trkhit, IMPL::TrackStateImpl& ts, double& chi2, int& ndf, int mode ) {
+
+    const FastKF::State* state = 0 ;
+
+    const int error_code = this->getSiteState( trkhit, state ) ;
+
+    if( error_code != success ) return error_code ;
+
+    return this->propagateToDetElement( *state, detElementID, false, ts, chi2, ndf, mode ) ;
+  }
+
+
+  int MarlinFastKFTrack::extrapolateToSurfaces( const FastKF::State& start, const std::vector<double>& positions, bool zPlanes,
+                                                std::vector<IMPL::TrackStateImpl>& states, std::vector<int>& status, int mode ) {
+
+    states.assign( positions.size(), IMPL::TrackStateImpl() ) ;
+    status.assign( positions.size(), no_intersection ) ;
+
+    const bool withCovariance = ! _fastKF->_parametersOnly ;
+
+    FastKF::State state = start ;
+
+    double path = 0., tof = 0. ;
+    int return_code = success ;
+
+    for( unsigned i = 0 ; i < positions.size() ; ++i ) {
+
+      double arcs[2] ;
+      int n = 0 ;
+
+      if( zPlanes ) {
+
+        const double origin[3] = { 0., 0., positions[i] } ;
+        const double normal[3] = { 0., 0., 1. } ;
+
+        if( FastKF::intersectPlane( state, origin, normal, arcs[0] ) ) n = 1 ;
+
+      } else {
+
+        n = FastKF::intersectZCylinder( state, 0., 0., positions[i], arcs ) ;
+      }
+
+      bool found = false ;
+      double arc = 0. ;
+
+      for( int j = 0 ; j < n ; ++j ) {
+
+        if( ! betterArc( arcs[j], arc, found, mode ) ) continue ;
+
+        arc = arcs[j] ;
+        found = true ;
+      }
+
+      if( ! found ) {
+        if( return_code == success ) return_code = no_intersection ;
+        continue ;
+      }
+
+      double pos[3] ;
+      FastKF::positionAt( state, arc, pos ) ;
+
+      const double step = FastKF::pathLength( state, ( withCovariance ? FastKF::transport( state, pos, 0 ) : FastKF::moveReferencePoint( state, pos, 0 ) ) ) ;
+
+      tof += FastKF::timeOfFlight( state, _fastKF->_bz, _mass, step ) ;
+      path += step ;
+
+      this->toLCIOTrackState( state, states[i], withCovariance ) ;
+      status[i] = success ;
+
+      _lastPathLength = path ;
+      _lastTimeOfFlight = tof ;
+      _hasPropagated = true ;
+    }
+
+    return return_code ;
+  }
+
+
+  int MarlinFastKFTrack::extrapolateToCylinders( const std::vector<double>& radii, std::vector<IMPL::TrackStateImpl>& states, std::vector<int>& status, int mode ) {
+    return this->extrapolateToSurfaces( this->currentState(), radii, false, states, status, mode ) ;
+  }
+
+
+  int MarlinFastKFTrack::extrapolateToCylinders( const std::vector<double>& radii, EVENT::TrackerHit* trkhit, std::vector<IMPL::TrackStateImpl>& states, std::vector<int>& status, int mode ) {
+
+    const FastKF::State* state = 0 ;
+
+    const int error_code = this->getSiteState( trkhit, state ) ;
+
+    if( error_code != success ) return error_code ;
+
+    return this->extrapolateToSurfaces( *state, radii, false, states, status, mode ) ;
+  }
+
+
+  int MarlinFastKFTrack::extrapolateToZPlanes( const std::vector<double>& zPositions, std::vector<IMPL::TrackStateImpl>& states, std::vector<int>& status, int mode ) {
+    return this->extrapolateToSurfaces( this->currentState(), zPositions, true, states, status, mode ) ;
+  }
+
+
+  int MarlinFastKFTrack::extrapolateToZPlanes( const std::vector<double>& zPositions, EVENT::TrackerHit* trkhit, std::vector<IMPL::TrackStateImpl>& states, std::vector<int>& status, int mode ) {
+
+    const FastKF::State* state = 0 ;
+
+    const int error_code = this->getSiteState( trkhit, state ) ;
+
+    if( error_code != success ) return error_code ;
+
+    return this->extrapolateToSurfaces( *state, zPositions, true, states, status, mode ) ;
+  }
+
+
+  //---------------------------------------------------------------------------------------------------------------
+  // intersection
+
+  int MarlinFastKFTrack::intersectionWithLayer( int layerID, Vector3D& point, int& detElementID, int mode ) {
+
+    double pos[3] ;
+
+    const int error_code = this->intersectLayer( this->currentState(), layerID, mode, pos, detElementID ) ;
+
+    if( error_code == success ) point = Vector3D( pos[0], pos[1], pos[2] ) ;
+
+    return error_code ;
+  }
+
+
+  int MarlinFastKFTrack::intersectionWithLayer( int layerID, EVENT::TrackerHit* trkhit, Vector3D& point, int& detElementID, int mode ) {
+
+    const FastKF::State* state = 0 ;
+
+    int error_code = this->getSiteState( trkhit, state ) ;
+
+    if( error_code != success ) return error_code ;
+
+    double pos[3] ;
+
+    error_code = this->intersectLayer( *state, layerID, mode, pos, detElementID ) ;
+
+    if( error_code == success ) point = Vector3D( pos[0], pos[1], pos[2] ) ;
+
+    return error_code ;
+  }
+
+
+  int MarlinFastKFTrack::intersectionWithDetElement( int detElementID, Vector3D& point, int mode ) {
+
+    const dd4hep::rec::ISurface* surf = _fastKF->findSurface( detElementID ) ;
+
+    if( ! surf ) return bad_intputs ;
+
+    double arc, pos[3] ;
+
+    if( ! this->intersect( this->currentState(), surf, mode, true, arc, pos ) ) return no_intersection ;
+
+    point = Vector3D( pos[0], pos[1], pos[2] ) ;
+
+    return success ;
+  }
+
+
+  int MarlinFastKFTrack::intersectionWithDetElement( int detElementID, EVENT::TrackerHit* trkhit, Vector3D& point, int mode ) {
+
+    const FastKF::State* state = 0 ;
+
+    const int error_code = this->getSiteState( trkhit, state ) ;
+
+    if( error_code != success ) return error_code ;
+
+    const dd4hep::rec::ISurface* surf = _fastKF->findSurface( detElementID ) ;
+
+    if( ! surf ) return bad_intputs ;
+
+    double arc, pos[3] ;
+
+    if( ! this->intersect( *state, surf, mode, true, arc, pos ) ) return no_intersection ;
+
+    point = Vector3D( pos[0], pos[1], pos[2] ) ;
+
+    return success ;
+  }
+
+
+  std::string MarlinFastKFTrack::toString() {
+
+    std::stringstream s ;
+
+    s << "MarlinFastKFTrack - number of hits: " << _lcioHits.size() << ", sites: " << _sites.size()
+      << ", outliers: " << _outliers.size() << ", chi2: " << _chi2 << ", ndf: " << _ndf << std::endl ;
+
+    const FastKF::State& state = this->currentState() ;
+
+    s << "  current state: d0 " << state.par[ FastKF::iD0 ] << " phi0 " << state.par[ FastKF::iPhi ] << " omega " << state.par[ FastKF::iOmega ]
+      << " z0 " << state.par[ FastKF::iZ0 ] << " tanL " << state.par[ FastKF::iTanL ]
+      << " ref ( " << state.ref[0] << ", " << state.ref[1] << ", " << state.ref[2] << " )" << std::endl ;
+
+    return s.str() ;
+  }
+
+} // end of namespace MarlinTrk
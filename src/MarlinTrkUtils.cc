@@ -7,7 +7,9 @@
 
 #include "MarlinTrk/IMarlinTrack.h"
 #include "MarlinTrk/IMarlinTrkSystem.h"
+#include "MarlinTrk/FitResultCache.h"
 #include "MarlinTrk/HelixTrack.h"
+#include "MarlinTrk/HelixFit.h"
 #include "MarlinTrk/Factory.h"
 
 #include "MarlinTrk/MarlinDDKalTest.h"
@@ -16,6 +18,7 @@
 #include <IMPL/TrackImpl.h>
 #include <IMPL/TrackStateImpl.h>
 #include <EVENT/TrackerHit.h>
+#include <EVENT/TrackerHitPlane.h>
 
 #include <UTIL/BitField64.h>
 #include "UTIL/LCTrackerConf.h"
@@ -35,6 +38,42 @@ namespace MarlinTrk {
   using namespace lcio ;
   using namespace UTIL ;
 
+  namespace {
+
+    /** the layer IDs of the ECAL barrel face and of the ECAL endcap face on the side given by tanLambda */
+    void caloFaceLayerIDs( bool tanL_is_positive, std::vector<int>& layerIDs ) {
+
+      UTIL::BitField64 encoder( lcio::LCTrackerCellID::encoding_string() ) ; 
+      encoder.reset() ;  // reset to 0
+
+      encoder[lcio::LCTrackerCellID::subdet()] = lcio::ILDDetID::ECAL ;
+      encoder[lcio::LCTrackerCellID::side()]   = lcio::ILDDetID::barrel;
+      encoder[lcio::LCTrackerCellID::layer()]  = 0 ;
+
+      layerIDs.push_back( encoder.lowWord() ) ;
+
+      encoder[lcio::LCTrackerCellID::subdet()] = lcio::ILDDetID::ECAL_ENDCAP ;
+      encoder[lcio::LCTrackerCellID::side()]   = ( tanL_is_positive ? lcio::ILDDetID::fwd : lcio::ILDDetID::bwd ) ;
+
+      layerIDs.push_back( encoder.lowWord() ) ;
+    }
+
+    /** the calorimeter face reached first of the barrel and endcap targets, going forward along the helix of the track state
+     *  at the site the targets were propagated from - the rule of IMarlinTrack::propagateToFirstLayer(), which is used by
+     *  createTrackStateAtCaloFace(). Returns 0 if neither was reached. */
+    const IMarlinTrack::PropagationTarget* firstCaloFace( const IMarlinTrack::PropagationTarget& barrel, const IMarlinTrack::PropagationTarget& endcap,
+                                                          const EVENT::TrackState& start ) {
+
+      if( barrel.status != IMarlinTrack::success ) return ( endcap.status == IMarlinTrack::success ? &endcap : 0 ) ;
+      if( endcap.status != IMarlinTrack::success ) return &barrel ;
+
+      const double arcBarrel = std::fabs( arcLengthToPoint( start, Vector3D( barrel.trackState.getReferencePoint() ), IMarlinTrack::modeForward ) ) ;
+      const double arcEndcap = std::fabs( arcLengthToPoint( start, Vector3D( endcap.trackState.getReferencePoint() ), IMarlinTrack::modeForward ) ) ;
+
+      return ( arcBarrel <= arcEndcap ? &barrel : &endcap ) ;
+    }
+  }
+
 //  // Check if a square matrix is Positive Definite 
 //  bool Matrix_Is_Positive_Definite(const EVENT::FloatVec& matrix){
 //    
@@ -120,9 +159,23 @@ namespace MarlinTrk {
     
     IMPL::TrackStateImpl pre_fit ;
     
-    return_error = createPrefit(hit_list, &pre_fit, bfield_z, fit_direction);
+    IMarlinTrkSystem* trkSystem = ( marlinTrk ? marlinTrk->getTrkSystem() : 0 ) ;
     
-    pre_fit.setCovMatrix(initial_cov_for_prefit);
+    if( trkSystem && trkSystem->getOption( IMarlinTrkSystem::CFG::useWeightedPrefit ) ) {
+      
+      // the prefit brings its own covariance matrix - loosened as the fit uses the same hits again
+      return_error = createWeightedPrefit(hit_list, &pre_fit, bfield_z, fit_direction);
+      
+      EVENT::FloatVec cov = pre_fit.getCovMatrix() ;
+      for (unsigned i=0; i<cov.size(); ++i) cov[i] *= weightedPrefitCovarianceScale ;
+      pre_fit.setCovMatrix(cov);
+      
+    } else {
+      
+      return_error = createPrefit(hit_list, &pre_fit, bfield_z, fit_direction);
+      
+      pre_fit.setCovMatrix(initial_cov_for_prefit);
+    }
 
     streamlog_out( DEBUG3 ) << " **** createFinalisedLCIOTrack - created pre-fit: " <<  toString( &pre_fit )  << std::endl ;
 
@@ -160,6 +213,27 @@ namespace MarlinTrk {
     //   throw EVENT::Exception( std::string("MarlinTrk::finaliseLCIOTrack: TrackStateImpl == NULL ")  ) ;
     // }
     
+    ///////////////////////////////////////////////////////
+    // reuse the result of an identical fit, see fitResultCache()
+    ///////////////////////////////////////////////////////
+    
+    IMarlinTrkSystem* trkSystem = ( marlinTrk ? marlinTrk->getTrkSystem() : 0 ) ;
+    
+    FitResultCache* cache = ( trkSystem && trkSystem->getOption( IMarlinTrkSystem::CFG::useFitResultCache ) ? &fitResultCache() : 0 ) ;
+    
+    FitResultCache::Key key ;
+    
+    if( cache ) {
+      
+      key = FitResultCache::makeKey( *trkSystem, *marlinTrk, hit_list, pre_fit, fit_direction, bfield_z, maxChi2Increment ) ;
+      
+      int cached_status = 0 ;
+      
+      if( cache->find( key, *marlinTrk, track, cached_status ) ) {
+        streamlog_out(DEBUG3) << "MarlinTrk::createFinalisedLCIOTrack: result taken from the fit result cache, status = " << cached_status << std::endl;
+        return cached_status ;
+      }
+    }
     
     int fit_status = createFit(hit_list, marlinTrk, pre_fit, bfield_z, fit_direction, maxChi2Increment);
     
@@ -167,12 +241,23 @@ namespace MarlinTrk {
       
       streamlog_out(DEBUG3) << "MarlinTrk::createFinalisedLCIOTrack fit failed: fit_status = " << fit_status << std::endl; 
       
+      if( cache ) cache->insert( key, track, FitResultCache::HitList(), FitResultCache::HitList(), fit_status ) ;
+      
       return fit_status;
       
     } 
     
     int error = finaliseLCIOTrack(marlinTrk, track, hit_list, fit_direction );
     
+    if( cache ) {
+      
+      FitResultCache::HitList hits_in_fit, outliers ;
+      
+      marlinTrk->getHitsInFit( hits_in_fit ) ;
+      marlinTrk->getOutliers( outliers ) ;
+      
+      cache->insert( key, track, hits_in_fit, outliers, error ) ;
+    }
     
     return error;
     
@@ -396,6 +481,161 @@ namespace MarlinTrk {
     
   }
   
+  int createWeightedPrefit( std::vector<EVENT::TrackerHit*>& hit_list, IMPL::TrackStateImpl* pre_fit, float bfield_z, bool fit_direction){
+    
+    ///////////////////////////////////////////////////////
+    // check inputs 
+    ///////////////////////////////////////////////////////
+    if ( hit_list.empty() ) return IMarlinTrack::bad_intputs ;
+    
+    if( pre_fit == 0 ){
+      throw EVENT::Exception( std::string("MarlinTrk::createWeightedPrefit: TrackStateImpl == NULL ")  ) ;
+    }
+    
+    ///////////////////////////////////////////////////////
+    // the positions and weights of all 2D hits
+    ///////////////////////////////////////////////////////
+    
+    std::vector<double> x, y, z, wrphi, wz ;
+    
+    x.reserve( hit_list.size() ) ; y.reserve( hit_list.size() ) ; z.reserve( hit_list.size() ) ;
+    wrphi.reserve( hit_list.size() ) ; wz.reserve( hit_list.size() ) ;
+    
+    for (unsigned ihit=0; ihit < hit_list.size(); ++ihit) {
+      
+      if( UTIL::BitSet32( hit_list[ihit]->getType() )[ UTIL::ILDTrkHitTypeBit::ONE_DIMENSIONAL ] ) continue ;
+      
+      double varRPhi, varZ ;
+      
+      const int error = getHitVariancesRPhiZ( hit_list[ihit], varRPhi, varZ ) ;
+      
+      if( error != IMarlinTrack::success ) return error ;
+      
+      const double* pos = hit_list[ihit]->getPosition() ;
+      
+      x.push_back( pos[0] ) ;
+      y.push_back( pos[1] ) ;
+      z.push_back( pos[2] ) ;
+      wrphi.push_back( 1. / varRPhi ) ;
+      wz.push_back( 1. / varZ ) ;
+    }
+    
+    if (x.size() < 3) { // no chance to initialise print warning and return
+      streamlog_out(WARNING) << "MarlinTrk::createWeightedPrefit Cannot create helix from less than 3 2-D hits" << std::endl;
+      return IMarlinTrack::bad_intputs;
+    }
+    
+    ///////////////////////////////////////////////////////
+    // fit all of them, the hits are ordered in time
+    ///////////////////////////////////////////////////////
+    
+    HelixFit helixFit ;
+    FastKF::State state ;
+    
+    if( helixFit.fitState( x.size(), &x[0], &y[0], &z[0], &wrphi[0], &wz[0], true, state ) != 0 ) {
+      streamlog_out(DEBUG3) << "MarlinTrk::createWeightedPrefit: helix fit failed for " << x.size() << " hits" << std::endl;
+      return IMarlinTrack::error;
+    }
+    
+    // in a vanishing field the track is a straight line, the curvature of the fit is noise
+    if( bfield_z == 0. ) {
+      
+      state.par[FastKF::iOmega] = 0. ;
+      
+      for (int i = 0; i < 5; ++i) {
+        if( i != FastKF::iOmega ) state.cov[ FastKF::symIndex( i, FastKF::iOmega ) ] = 0. ;
+      }
+    }
+    
+    ///////////////////////////////////////////////////////
+    // move the prefit to the hit the fit starts from
+    ///////////////////////////////////////////////////////
+    
+    const bool forward = ( fit_direction == IMarlinTrack::forward ) ;
+    
+    const double* start = ( forward ? hit_list.front() : hit_list.back() )->getPosition() ;
+    
+    FastKF::transport( state, start ) ;
+    
+    pre_fit->setLocation( forward ? lcio::TrackState::AtFirstHit : lcio::TrackState::AtLastHit ) ;
+    
+    const float referencePoint[3] = { float(state.ref[0]), float(state.ref[1]), float(state.ref[2]) };
+    
+    pre_fit->setD0(state.par[FastKF::iD0]) ;
+    pre_fit->setPhi(state.par[FastKF::iPhi]) ;
+    pre_fit->setOmega(state.par[FastKF::iOmega]) ;
+    pre_fit->setZ0(state.par[FastKF::iZ0]) ;
+    pre_fit->setTanLambda(state.par[FastKF::iTanL]) ;
+    
+    pre_fit->setReferencePoint(referencePoint) ;
+    
+    pre_fit->setCovMatrix( EVENT::FloatVec( state.cov.begin(), state.cov.end() ) ) ;
+    
+    return IMarlinTrack::success;
+    
+  }
+  
+  int getHitVariancesRPhiZ( EVENT::TrackerHit* trkhit, double& varRPhi, double& varZ ){
+
+    if( UTIL::BitSet32( trkhit->getType() )[ UTIL::ILDTrkHitTypeBit::ONE_DIMENSIONAL ] ) {
+      streamlog_out( ERROR ) << "MarlinTrk::getHitVariancesRPhiZ: one dimensional hit without a position in r-phi and z" << std::endl ;
+      return IMarlinTrack::bad_intputs ;
+    }
+
+    const double* pos = trkhit->getPosition() ;
+    const double r = std::sqrt( pos[0] * pos[0] + pos[1] * pos[1] ) ;
+
+    if( r == 0. ) {
+      streamlog_out( ERROR ) << "MarlinTrk::getHitVariancesRPhiZ: hit on the z-axis" << std::endl ;
+      return IMarlinTrack::bad_intputs ;
+    }
+
+    const EVENT::TrackerHitPlane* planarhit = dynamic_cast<const EVENT::TrackerHitPlane*>( trkhit ) ;
+
+    if( planarhit ) {
+
+      // project the errors along u and v onto the r-phi, radial and z directions at the hit
+      const double phiDir[2] = { -pos[1] / r, pos[0] / r } ;
+
+      const float* axes[2] = { planarhit->getU(), planarhit->getV() } ;
+      const double sigmas[2] = { planarhit->getdU(), planarhit->getdV() } ;
+
+      double varR = 0. ;
+      varRPhi = varZ = 0. ;
+
+      for( int m = 0 ; m < 2 ; ++m ) {
+
+        const double sinTheta = std::sin( axes[m][0] ) ;
+        const double dir[3] = { sinTheta * std::cos( axes[m][1] ), sinTheta * std::sin( axes[m][1] ), std::cos( axes[m][0] ) } ;
+
+        const double aPhi = dir[0] * phiDir[0] + dir[1] * phiDir[1] ;
+        const double aR   = dir[0] * phiDir[1] - dir[1] * phiDir[0] ;
+        const double var  = sigmas[m] * sigmas[m] ;
+
+        varRPhi += aPhi * aPhi * var ;
+        varR    += aR * aR * var ;
+        varZ    += dir[2] * dir[2] * var ;
+      }
+
+      // a radial error, e.g. on a disk, moves the hit along a track from the origin by dz = dr * z / r
+      varZ += varR * ( pos[2] / r ) * ( pos[2] / r ) ;
+
+    } else { // we have a TPC hit which is not yet using the CylinderTrackerHit ...
+
+      const EVENT::FloatVec& cov = trkhit->getCovMatrix() ;
+
+      varRPhi = cov[0] + cov[2] ;
+      varZ = cov[5] ;
+    }
+
+    if( ! ( varRPhi > 0. && varZ > 0. ) ) {
+      streamlog_out( ERROR ) << "MarlinTrk::getHitVariancesRPhiZ: hit without errors in r-phi or z: " << varRPhi << " " << varZ << std::endl ;
+      return IMarlinTrack::bad_intputs ;
+    }
+
+    return IMarlinTrack::success ;
+  }
+  
   int finaliseLCIOTrack( IMarlinTrack* marlintrk, IMPL::TrackImpl* track, std::vector<EVENT::TrackerHit*>& hit_list, bool fit_direction, IMPL::TrackStateImpl* atLastHit, IMPL::TrackStateImpl* atCaloFace){
     
     ///////////////////////////////////////////////////////
@@ -707,25 +947,47 @@ namespace MarlinTrk {
     if ( atLastHit == 0 && atCaloFace == 0 ) {
     
       ///////////////////////////////////////////////////////
-      // @ last hit
+      // the last hit and the calo faces are all reached from the last constrained hit - in one go
       ///////////////////////////////////////////////////////  
       
-      streamlog_out( DEBUG5 ) << "  >>>>>>>>>>> MarlinTrk::finaliseLCIOTrack: create TrackState AtLastHit : using trkhit " << last_constrained_hit << std::endl ;
+      streamlog_out( DEBUG5 ) << "  >>>>>>>>>>> MarlinTrk::finaliseLCIOTrack: create TrackStates AtLastHit and AtCalorimeter : using trkhit " << last_constrained_hit << std::endl ;
       
       Vector3D last_hit_pos(lastHit->getPosition());
       
-      IMPL::TrackStateImpl* trkStateAtLastHit = new IMPL::TrackStateImpl() ;
-
-      return_error = marlintrk->propagate(last_hit_pos, last_constrained_hit, *trkStateAtLastHit, chi2, ndf);
-            
-//      return_error = marlintrk->getTrackState(lastHit, *trkStateAtLastHit, chi2, ndf ) ;
+      std::vector<int> caloLayerIDs ;
+      caloFaceLayerIDs( trkStateIP->getTanLambda() > 0, caloLayerIDs ) ;
+      
+      std::vector<IMarlinTrack::PropagationTarget> targets ;
+      targets.push_back( IMarlinTrack::PropagationTarget::atPoint( last_hit_pos ) ) ;
+      targets.push_back( IMarlinTrack::PropagationTarget::atLayer( caloLayerIDs[0], IMarlinTrack::modeForward ) ) ;
+      targets.push_back( IMarlinTrack::PropagationTarget::atLayer( caloLayerIDs[1], IMarlinTrack::modeForward ) ) ;
+      
+      const int many_error = marlintrk->propagateToMany( targets, last_constrained_hit ) ;
+      
+      // an unreachable calo face is normal, every target has its own status
+      if( many_error != IMarlinTrack::success ) {
+        streamlog_out( DEBUG5 ) << "  >>>>>>>>>>> MarlinTrk::finaliseLCIOTrack:  not all targets reached from " << last_constrained_hit
+                                << " : return_error = " << MarlinTrk::errorCode( many_error ) << std::endl ;
+      }
+      
+      ///////////////////////////////////////////////////////
+      // @ last hit
+      ///////////////////////////////////////////////////////  
+      
+      return_error = targets[0].status ;
+      
+      if ( return_error != IMarlinTrack::success ) {
+        // fall back to the single propagation
+        return_error = marlintrk->propagate( last_hit_pos, last_constrained_hit, targets[0].trackState, targets[0].chi2, targets[0].ndf ) ;
+      }
       
       if ( return_error == IMarlinTrack::success ) {
+        IMPL::TrackStateImpl* trkStateAtLastHit = new IMPL::TrackStateImpl( targets[0].trackState ) ;
         trkStateAtLastHit->setLocation(  lcio::TrackState::AtLastHit ) ;
         track->trackStates().push_back(trkStateAtLastHit);
       } else {
-        streamlog_out( DEBUG5 ) << "  >>>>>>>>>>> MarlinTrk::finaliseLCIOTrack:  could not get TrackState at Last Hit " << last_constrained_hit << std::endl ;
-        delete trkStateAtLastHit;
+        streamlog_out( WARNING ) << "  >>>>>>>>>>> MarlinTrk::finaliseLCIOTrack:  could not get TrackState at Last Hit " << last_constrained_hit 
+                                 << " : return_error = " << MarlinTrk::errorCode( return_error ) << std::endl ;
       }
       
 //      const EVENT::FloatVec& ma = trkStateAtLastHit->getCovMatrix();
@@ -738,18 +1000,50 @@ namespace MarlinTrk {
       // set the track state at Calo Face 
       ///////////////////////////////////////////////////////
       
-      IMPL::TrackStateImpl* trkStateCalo = new IMPL::TrackStateImpl;
-      bool tanL_is_positive = trkStateIP->getTanLambda()>0 ;
+      IMPL::TrackStateImpl trkStateAtSite ;
+      
+      const IMarlinTrack::PropagationTarget* caloFace = 0 ;
+      
+      if( marlintrk->getTrackState( last_constrained_hit, trkStateAtSite, chi2, ndf ) == IMarlinTrack::success ) {
+        caloFace = firstCaloFace( targets[1], targets[2], trkStateAtSite ) ;
+      }
       
-      return_error = createTrackStateAtCaloFace(marlintrk, trkStateCalo, last_constrained_hit, tanL_is_positive);
-      //      return_error = createTrackStateAtCaloFace(marlintrk, trkStateCalo, lastHit, tanL_is_positive);
+      IMPL::TrackStateImpl* trkStateCalo = 0 ;
+      
+      if( caloFace ) {
+        
+        return_error = IMarlinTrack::success ;
+        
+        trkStateCalo = new IMPL::TrackStateImpl( caloFace->trackState ) ;
+        //bd: d0 and z0 of the track state at the calorimeter must be 0 by definition for all tracks.
+        trkStateCalo->setD0( 0. ) ;
+        trkStateCalo->setZ0( 0. ) ;
+        
+      } else if( targets[1].status == IMarlinTrack::no_intersection && targets[2].status == IMarlinTrack::no_intersection ) {
+        
+        // the track does not reach the calorimeter
+        return_error = IMarlinTrack::no_intersection ;
+        
+      } else {
+        
+        // the propagation failed - fall back to the single propagation to the face reached first
+        trkStateCalo = new IMPL::TrackStateImpl ;
+        
+        return_error = createTrackStateAtCaloFace( marlintrk, trkStateCalo, last_constrained_hit, trkStateIP->getTanLambda() > 0 ) ;
+        
+        if( return_error != IMarlinTrack::success ) {
+          streamlog_out( WARNING ) << "  >>>>>>>>>>> MarlinTrk::finaliseLCIOTrack:  propagation to the Calo Face failed : return_error = " 
+                                   << MarlinTrk::errorCode( return_error ) << std::endl ;
+          delete trkStateCalo ;
+          trkStateCalo = 0 ;
+        }
+      }
       
       if ( return_error == IMarlinTrack::success ) {
         trkStateCalo->setLocation(  lcio::TrackState::AtCalorimeter ) ;
         track->trackStates().push_back(trkStateCalo);
       } else {
         streamlog_out( DEBUG9 ) << "  >>>>>>>>>>> MarlinTrk::finaliseLCIOTrack:  could not get TrackState at Calo Face "  << std::endl ;
-        delete trkStateCalo;
 
 	//FIXME: ignore track state at Calo face for debugging new tracking ...
 #if 0
@@ -801,70 +1095,22 @@ namespace MarlinTrk {
     }
         
     int return_error = 0;
-    int return_error_barrel = 0;
-    int return_error_endcap = 0;
-    
-    double chi2 = -DBL_MAX;
-    int ndf = 0;
-    
-    UTIL::BitField64 encoder( lcio::LCTrackerCellID::encoding_string() ) ; 
-    encoder.reset() ;  // reset to 0
-    
-    // ================== need to get the correct ID(s) for the calorimeter face  ============================
-
-    unsigned ecal_barrel_face_ID = lcio::ILDDetID::ECAL ;
-    unsigned ecal_endcap_face_ID = lcio::ILDDetID::ECAL_ENDCAP ;
-
-    //=========================================================================================================
-
-    encoder[lcio::LCTrackerCellID::subdet()] = ecal_barrel_face_ID ;
-    encoder[lcio::LCTrackerCellID::side()]   = lcio::ILDDetID::barrel;
-    encoder[lcio::LCTrackerCellID::layer()]  = 0 ;
     
-    int detElementID = 0;
+    // the barrel layer and the endcap layer
+    std::vector<int> layerIDs ;
+    caloFaceLayerIDs( tanL_is_positive, layerIDs ) ;
     
-    TrackStateImpl tsBarrel;
-    TrackStateImpl tsEndcap;
+    // the face the track reaches first going outwards from the hit
+    double chi2 = 0. ;
+    int ndf = 0 ;
+    int layerID = 0 ;
+    int detElementID = 0 ;
     
-    // propagate to the barrel layer
-    return_error_barrel = marlintrk->propagateToLayer(encoder.lowWord(), trkhit, tsBarrel, chi2, ndf, detElementID, IMarlinTrack::modeForward ) ;
+    return_error = marlintrk->propagateToFirstLayer( layerIDs, trkhit, *trkStateCalo, chi2, ndf, layerID, detElementID, IMarlinTrack::modeForward ) ;
     
-    // propagate to the endcap layer
-    encoder[lcio::LCTrackerCellID::subdet()] = ecal_endcap_face_ID ;
-    if (tanL_is_positive) {
-        encoder[lcio::LCTrackerCellID::side()] = lcio::ILDDetID::fwd;
-    }
-    else{
-        encoder[lcio::LCTrackerCellID::side()] = lcio::ILDDetID::bwd;
-    }
-    return_error_endcap = marlintrk->propagateToLayer(encoder.lowWord(), trkhit, tsEndcap, chi2, ndf, detElementID, IMarlinTrack::modeForward ) ;
-
-    // check which is the right intersection / closer to the trkhit
-    if ( return_error_barrel == IMarlinTrack::no_intersection ){
-        //if barrel fails just return ts at the Endcap if exists
-        return_error = return_error_endcap;
-        *trkStateCalo = tsEndcap;
-    }
-    else if( return_error_endcap == IMarlinTrack::no_intersection ){
-        //if barrel succeeded and endcap fails return ts at the barrel
-        return_error = return_error_barrel;
-        *trkStateCalo = tsBarrel;
-    }
-    else{
-        //this means both barrel and endcap have intersections. Return closest to the tracker hit
-        Vector3D hitPos ( trkhit->getPosition() );
-        Vector3D barrelPos ( tsBarrel.getReferencePoint() );
-        Vector3D endcapPos ( tsEndcap.getReferencePoint() );
-        double dToBarrel = (hitPos-barrelPos).r();
-        double dToendcap = (hitPos-endcapPos).r();
-        if ( dToBarrel < dToendcap ){
-            return_error = return_error_barrel;
-            *trkStateCalo = tsBarrel;
-        }
-        else{
-            return_error = return_error_endcap;
-            *trkStateCalo = tsEndcap;
-        }   
+    if( return_error == IMarlinTrack::success ) {
+      streamlog_out( DEBUG2 ) << "  >>>>>>>>>>> createTrackStateAtCaloFace : reached " << ( layerID == layerIDs[0] ? "barrel" : "endcap" ) 
+                              << " face first " << std::endl ;
     }
     
     //bd: d0 and z0 of the track state at the calorimeter must be 0 by definition for all tracks.
@@ -959,4 +1205,11 @@ namespace MarlinTrk {
     
   }
   
+  FitResultCache& fitResultCache(){
+    
+    static FitResultCache cache ;
+    
+    return cache ;
+  }
+  
 }
@@ -0,0 +1,289 @@
+#ifndef MarlinTrk_TestUtils_h
+#define MarlinTrk_TestUtils_h
+
+#include "MarlinTrk/Factory.h"
+#include "MarlinTrk/IMarlinTrack.h"
+#include "MarlinTrk/IMarlinTrkSystem.h"
+#include "MarlinTrk/MarlinTrkUtils.h"
+
+#include "DD4hep/Detector.h"
+#include "DD4hep/DD4hepUnits.h"
+
+#include "lcio.h"
+#include "IO/LCReader.h"
+#include "IOIMPL/LCFactory.h"
+#include "EVENT/LCEvent.h"
+#include "EVENT/LCCollection.h"
+#include "EVENT/Track.h"
+#include "EVENT/TrackerHit.h"
+#include "IMPL/TrackStateImpl.h"
+#include "UTIL/BitField64.h"
+#include "UTIL/LCTrackerConf.h"
+
+#include "streamlog/streamlog.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/** Helpers shared by the tests and benchmarks that refit the tracks of an LCIO file in a DD4hep detector.
+ *  They are called with the compact file, the LCIO file and the name of the track collection.
+ */
+namespace MarlinTrkTest{
+
+  /** count and report failed checks */
+  class Checks {
+  public:
+
+    /** record the check under the given name, printing the message if it failed */
+    bool operator()( bool passed, const std::string& name, const std::string& message="" ) {
+
+      ++_counts[name].first ;
+
+      if( ! passed ) {
+        ++_counts[name].second ;
+        if( _counts[name].second <= 10 ) std::cout << "  FAILED " << name << " " << message << std::endl ;
+      }
+
+      return passed ;
+    }
+
+    /** print a summary of all checks and return the number of failures - at most maxFraction of the entries of a check may fail */
+    unsigned summary( double maxFraction=0. ) const {
+
+      unsigned failed = 0 ;
+
+      for( std::map<std::string, std::pair<unsigned, unsigned> >::const_iterator it = _counts.begin() ; it != _counts.end() ; ++it ) {
+
+        const bool ok = ( it->second.second <= maxFraction * it->second.first ) ;
+        if( ! ok ) ++failed ;
+
+        std::cout << ( ok ? "  ok     " : "  FAILED " ) << it->first << ": " << it->second.second << " of " << it->second.first << " failed" << std::endl ;
+      }
+
+      return failed ;
+    }
+
+  private:
+    std::map<std::string, std::pair<unsigned, unsigned> > _counts{} ;
+  } ;
+
+
+  /** load the detector and set the streamlog level - returns Bz at the origin in Tesla */
+  inline double initDetector( const std::string& compactFile, const std::string& logLevel="WARNING" ) {
+
+    streamlog::out.init( std::cout , "MarlinTrkTest" ) ;
+    streamlog::out.addLevelName<streamlog::DEBUG>() ;
+    streamlog::out.addLevelName<streamlog::MESSAGE>() ;
+    streamlog::out.addLevelName<streamlog::WARNING>() ;
+    streamlog::out.addLevelName<streamlog::ERROR>() ;
+    streamlog::out.setLevel( logLevel ) ;
+
+    dd4hep::Detector& theDetector = dd4hep::Detector::getInstance() ;
+    theDetector.fromCompact( compactFile ) ;
+
+    double origin[3] = { 0., 0., 0. }, bfield[3] ;
+    theDetector.field().magneticField( origin, bfield ) ;
+
+    return bfield[2] / dd4hep::tesla ;
+  }
+
+
+  /** set the options used by the ILD and CLIC track fits and initialise the track system */
+  inline void initTrkSystem( MarlinTrk::IMarlinTrkSystem* trkSystem, bool smoothing=false ) {
+
+    trkSystem->setOption( MarlinTrk::IMarlinTrkSystem::CFG::useQMS, true ) ;
+    trkSystem->setOption( MarlinTrk::IMarlinTrkSystem::CFG::usedEdx, true ) ;
+    trkSystem->setOption( MarlinTrk::IMarlinTrkSystem::CFG::useSmoothing, smoothing ) ;
+    trkSystem->init() ;
+  }
+
+
+  /** create the track system through the Factory, which owns it, and initialise it with initTrkSystem() */
+  inline MarlinTrk::IMarlinTrkSystem* createTrkSystem( const std::string& type, bool smoothing=false ) {
+
+    MarlinTrk::IMarlinTrkSystem* trkSystem = MarlinTrk::Factory::createMarlinTrkSystem( type, 0, "" ) ;
+
+    initTrkSystem( trkSystem, smoothing ) ;
+
+    return trkSystem ;
+  }
+
+
+  /** the covariance matrix used to initialise the fit from the prefit */
+  inline EVENT::FloatVec initialCovariance() {
+
+    EVENT::FloatVec cov( 15, 0. ) ;
+    cov[ 0] = 1.e6 ; // d0
+    cov[ 2] = 1.e2 ; // phi0
+    cov[ 5] = 1.e-4 ; // omega
+    cov[ 9] = 1.e6 ; // z0
+    cov[14] = 1.e2 ; // tanL
+
+    return cov ;
+  }
+
+
+  /** the hits of the track ordered in radius, i.e. outgoing */
+  inline std::vector<EVENT::TrackerHit*> sortedHits( const EVENT::Track* track ) {
+
+    std::vector<EVENT::TrackerHit*> hits = track->getTrackerHits() ;
+
+    std::sort( hits.begin(), hits.end(), []( const EVENT::TrackerHit* lhs, const EVENT::TrackerHit* rhs ) {
+        const double* a = lhs->getPosition() ;
+        const double* b = rhs->getPosition() ;
+        return a[0]*a[0] + a[1]*a[1] < b[0]*b[0] + b[1]*b[1] ; } ) ;
+
+    return hits ;
+  }
+
+
+  /** the layerID ( subdet, side and layer ) of the hit */
+  inline int layerID( const EVENT::TrackerHit* hit ) {
+
+    UTIL::BitField64 encoder( UTIL::LCTrackerCellID::encoding_string() ) ;
+    encoder.setValue( hit->getCellID0() ) ;
+    encoder[ UTIL::LCTrackerCellID::module() ] = 0 ;
+    encoder[ UTIL::LCTrackerCellID::sensor() ] = 0 ;
+
+    return encoder.lowWord() ;
+  }
+
+
+  /** the prefit of the hits for a fit in the forward direction, with the covariance matrix of initialCovariance() */
+  inline int createPrefit( std::vector<EVENT::TrackerHit*> hits, double bz, IMPL::TrackStateImpl& prefit ) {
+
+    const int status = MarlinTrk::createPrefit( hits, &prefit, bz, MarlinTrk::IMarlinTrack::forward ) ;
+    prefit.setCovMatrix( initialCovariance() ) ;
+
+    return status ;
+  }
+
+
+  /** a new track of the system fitted in the forward direction to the hits, initialised with the prefit - 0 if the fit failed */
+  inline MarlinTrk::IMarlinTrack* fitHits( MarlinTrk::IMarlinTrkSystem* trkSystem, std::vector<EVENT::TrackerHit*> hits,
+                                           IMPL::TrackStateImpl& prefit, double bz, double maxChi2Increment=DBL_MAX ) {
+
+    std::unique_ptr<MarlinTrk::IMarlinTrack> trk( trkSystem->createTrack() ) ;
+
+    if( MarlinTrk::createFit( hits, trk.get(), &prefit, bz, MarlinTrk::IMarlinTrack::forward, maxChi2Increment ) != MarlinTrk::IMarlinTrack::success )
+      return 0 ;
+
+    return trk.release() ;
+  }
+
+
+  /** the parameters of the two states differ by less than tolerance times the errors of the reference and
+   *  the errors by less than the fraction tolerance
+   */
+  inline bool sameState( const EVENT::TrackState& ts, const EVENT::TrackState& ref, double tolerance, std::string& message ) {
+
+    const double d[5] = { ts.getD0() - ref.getD0(), std::remainder( ts.getPhi() - ref.getPhi(), 2. * M_PI ), ts.getOmega() - ref.getOmega(),
+                          ts.getZ0() - ref.getZ0(), ts.getTanLambda() - ref.getTanLambda() } ;
+    const int diag[5] = { 0, 2, 5, 9, 14 } ;
+    const char* names[5] = { "d0", "phi0", "omega", "z0", "tanL" } ;
+
+    std::stringstream msg ;
+
+    for( int i = 0 ; i < 5 ; ++i ) {
+
+      const double var = ts.getCovMatrix()[ diag[i] ] ;
+      const double refVar = ref.getCovMatrix()[ diag[i] ] ;
+
+      if( ! ( std::fabs( d[i] ) <= tolerance * std::sqrt( refVar ) ) || ! ( std::fabs( var - refVar ) <= tolerance * refVar ) )
+        msg << names[i] << " differs by " << d[i] << " with error " << std::sqrt( refVar ) << " instead of " << std::sqrt( var ) << " " ;
+    }
+
+    message = msg.str() ;
+
+    return message.empty() ;
+  }
+
+
+  /** check that the track has the same chi2, ndf and states at the given hits and at the IP as the reference */
+  inline void compareFits( Checks& check, const std::string& name, MarlinTrk::IMarlinTrack& trk, MarlinTrk::IMarlinTrack& ref,
+                           const std::vector<EVENT::TrackerHit*>& hits, double tolerance ) {
+
+    IMPL::TrackStateImpl ts, refTS ;
+    double chi2 = 0., refChi2 = 0. ;
+    int ndf = 0, refNdf = 0 ;
+    std::string message ;
+
+    trk.getTrackState( ts, chi2, ndf ) ;
+    ref.getTrackState( refTS, refChi2, refNdf ) ;
+
+    std::stringstream msg ;
+    msg << "chi2 " << chi2 << " ndf " << ndf << " instead of " << refChi2 << " " << refNdf ;
+
+    check( ndf == refNdf && std::fabs( chi2 - refChi2 ) <= tolerance * std::max( 1., refChi2 ), name + " chi2 and ndf", msg.str() ) ;
+
+    for( unsigned i = 0 ; i < hits.size() ; ++i ) {
+
+      const int st = trk.getTrackState( hits[i], ts, chi2, ndf ) ;
+      const int refSt = ref.getTrackState( hits[i], refTS, refChi2, refNdf ) ;
+
+      check( st == MarlinTrk::IMarlinTrack::success && refSt == MarlinTrk::IMarlinTrack::success && sameState( ts, refTS, tolerance, message ),
+             name + " state at the hits", message ) ;
+    }
+
+    const int st = trk.propagate( MarlinTrk::Vector3D( 0., 0., 0. ), ts, chi2, ndf ) ;
+    const int refSt = ref.propagate( MarlinTrk::Vector3D( 0., 0., 0. ), refTS, refChi2, refNdf ) ;
+
+    check( st == MarlinTrk::IMarlinTrack::success && refSt == MarlinTrk::IMarlinTrack::success && sameState( ts, refTS, tolerance, message ),
+           name + " state at the IP", message ) ;
+  }
+
+
+  /** call process with the hit lists of the tracks with at least minHits hits in the collection of the first maxEvents events -
+   *  the hits are valid during the call only. Returns the number of tracks.
+   */
+  inline unsigned forEachTrack( const std::string& lcioFile, const std::string& collection, unsigned maxEvents, unsigned minHits,
+                                const std::function<void( std::vector<EVENT::TrackerHit*>& )>& process ) {
+
+    IO::LCReader* reader = IOIMPL::LCFactory::getInstance()->createLCReader() ;
+    reader->open( lcioFile ) ;
+
+    unsigned nTracks = 0 ;
+    unsigned nEvents = 0 ;
+
+    EVENT::LCEvent* evt = 0 ;
+
+    while( nEvents < maxEvents && ( evt = reader->readNextEvent() ) != 0 ) {
+
+      ++nEvents ;
+
+      EVENT::LCCollection* col = 0 ;
+      try {
+        col = evt->getCollection( collection ) ;
+      }
+      catch( lcio::DataNotAvailableException& ) {
+        continue ;
+      }
+
+      for( int i = 0 ; i < col->getNumberOfElements() ; ++i ) {
+
+        std::vector<EVENT::TrackerHit*> hits = sortedHits( static_cast<EVENT::Track*>( col->getElementAt( i ) ) ) ;
+
+        if( hits.size() < minHits ) continue ;
+
+        ++nTracks ;
+        process( hits ) ;
+      }
+    }
+
+    reader->close() ;
+    delete reader ;
+
+    return nTracks ;
+  }
+
+} // end of namespace MarlinTrkTest
+
+#endif
@@ -0,0 +1,138 @@
+/** Throughput and heap allocations per track of the track systems: the tracks of an LCIO file are refit repeatedly
+ *  with createFinalisedLCIOTrack(), as in the track finding processors. The allocations are counted by replacing
+ *  the global operator new.
+ *
+ *  usage: benchmark_fitters compact.xml file.slcio [collection] [maxEvents] [repetitions] [systems...]
+ *         default: SiTracks 10 5 DDKalTest FastKF
+ */
+
+#include "TestUtils.h"
+
+#include "MarlinTrk/IMarlinTrack.h"
+#include "MarlinTrk/MarlinTrkUtils.h"
+#include "MarlinTrk/MarlinAidaTT.h"
+#include "MarlinTrk/MarlinDDKalTest.h"
+#include "MarlinTrk/MarlinFastHelix.h"
+#include "MarlinTrk/MarlinFastKF.h"
+
+#include "IMPL/TrackImpl.h"
+
+#include <cfloat>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <new>
+
+namespace {
+
+  /** the allocations are only counted while a fit is timed */
+  bool counting = false ;
+  unsigned long long nAllocations = 0 ;
+  unsigned long long nBytes = 0 ;
+
+
+  /** a track system of the given type owned by the benchmark - not shared through the Factory, so that every
+   *  system is benchmarked from a fresh state and deleted after its benchmark
+   */
+  std::unique_ptr<MarlinTrk::IMarlinTrkSystem> newTrkSystem( const std::string& type ) {
+
+    std::unique_ptr<MarlinTrk::IMarlinTrkSystem> trkSystem ;
+
+    if( type == "DDKalTest" )      trkSystem.reset( new MarlinTrk::MarlinDDKalTest ) ;
+    else if( type == "AidaTT" )    trkSystem.reset( new MarlinTrk::MarlinAidaTT ) ;
+    else if( type == "FastKF" )    trkSystem.reset( new MarlinTrk::MarlinFastKF ) ;
+    else if( type == "FastHelix" ) trkSystem.reset( new MarlinTrk::MarlinFastHelix ) ;
+    else throw MarlinTrk::Exception( "benchmark_fitters: unknown track system type " + type ) ;
+
+    MarlinTrkTest::initTrkSystem( trkSystem.get() ) ;
+
+    return trkSystem ;
+  }
+}
+
+void* operator new( std::size_t size ) {
+
+  if( counting ) {
+    ++nAllocations ;
+    nBytes += size ;
+  }
+
+  if( void* p = std::malloc( size ? size : 1 ) ) return p ;
+
+  throw std::bad_alloc() ;
+}
+
+void operator delete( void* p ) noexcept { std::free( p ) ; }
+
+void operator delete( void* p, std::size_t ) noexcept { std::free( p ) ; }
+
+
+using namespace MarlinTrk ;
+
+int main( int argc, char** argv ) {
+
+  if( argc < 3 ) {
+    std::cout << "usage: " << argv[0] << " compact.xml file.slcio [collection] [maxEvents] [repetitions] [systems...]" << std::endl ;
+    return 1 ;
+  }
+
+  const std::string collection = ( argc > 3 ? argv[3] : "SiTracks" ) ;
+  const unsigned maxEvents = ( argc > 4 ? std::atoi( argv[4] ) : 10 ) ;
+  const unsigned repetitions = ( argc > 5 ? std::atoi( argv[5] ) : 5 ) ;
+
+  std::vector<std::string> types ;
+  for( int i = 6 ; i < argc ; ++i ) types.push_back( argv[i] ) ;
+  if( types.empty() ) types = { "DDKalTest", "FastKF" } ;
+
+  const double bz = MarlinTrkTest::initDetector( argv[1], "ERROR" ) ;
+
+  const EVENT::FloatVec cov = MarlinTrkTest::initialCovariance() ;
+
+  std::printf( "%-12s %8s %8s %12s %14s %14s\n", "system", "tracks", "failed", "us/track", "allocs/track", "bytes/track" ) ;
+
+  for( unsigned s = 0 ; s < types.size() ; ++s ) {
+
+    std::unique_ptr<IMarlinTrkSystem> trkSystem = newTrkSystem( types[s] ) ;
+
+    unsigned nFits = 0 ;
+    unsigned nFailed = 0 ;
+    double time = 0. ;
+    nAllocations = nBytes = 0 ;
+
+    MarlinTrkTest::forEachTrack( argv[2], collection, maxEvents, 4, [&]( std::vector<EVENT::TrackerHit*>& hits ) {
+
+        for( unsigned r = 0 ; r < repetitions ; ++r ) {
+
+          std::vector<EVENT::TrackerHit*> hitList = hits ;
+
+          counting = true ;
+          const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now() ;
+
+          int status = IMarlinTrack::error ;
+          {
+            std::unique_ptr<IMarlinTrack> trk( trkSystem->createTrack() ) ;
+            IMPL::TrackImpl track ;
+
+            status = createFinalisedLCIOTrack( trk.get(), hitList, &track, IMarlinTrack::backward, cov, bz, DBL_MAX ) ;
+          }
+
+          time += std::chrono::duration<double, std::micro>( std::chrono::steady_clock::now() - start ).count() ;
+          counting = false ;
+
+          ++nFits ;
+          if( status != IMarlinTrack::success ) ++nFailed ;
+        }
+      } ) ;
+
+    if( nFits == 0 ) {
+      std::cout << " no tracks found in collection " << collection << std::endl ;
+      return 1 ;
+    }
+
+    std::printf( "%-12s %8u %8u %12.1f %14.1f %14.0f\n", types[s].c_str(), nFits, nFailed, time / nFits,
+                 double( nAllocations ) / nFits, double( nBytes ) / nFits ) ;
+  }
+
+  return 0 ;
+}
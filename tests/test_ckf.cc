@@ -0,0 +1,108 @@
+/** Checks of the combinatorial Kalman filter MarlinDDKalTestCKF: the inner hits of the tracks of an LCIO file are fit
+ *  as seed, which is followed through the layers of the remaining hits of the track. The best candidate has to pick up
+ *  the hits of the track and have the same chi2, ndf and track states at the hits and at the IP as the full refit of
+ *  its hits.
+ *
+ *  usage: test_ckf compact.xml file.slcio [collection] [maxEvents]
+ *         default: SiTracks 10
+ */
+
+#include "TestUtils.h"
+
+#include "MarlinTrk/MarlinDDKalTest.h"
+#include "MarlinTrk/MarlinDDKalTestCKF.h"
+
+#include <cstdlib>
+
+using namespace MarlinTrk ;
+
+int main( int argc, char** argv ) {
+
+  if( argc < 3 ) {
+    std::cout << "usage: " << argv[0] << " compact.xml file.slcio [collection] [maxEvents]" << std::endl ;
+    return 1 ;
+  }
+
+  const std::string collection = ( argc > 3 ? argv[3] : "SiTracks" ) ;
+  const unsigned maxEvents = ( argc > 4 ? std::atoi( argv[4] ) : 10 ) ;
+
+  const unsigned nSeedHits = 4 ;
+  const double maxChi2Increment = 35. ;
+  const unsigned maxHoles = 2 ;
+  const double tolerance = 1.e-4 ;
+
+  const double bz = MarlinTrkTest::initDetector( argv[1] ) ;
+
+  IMarlinTrkSystem* trkSystem = MarlinTrkTest::createTrkSystem( "DDKalTest" ) ;
+
+  MarlinDDKalTestCKF ckf( dynamic_cast<MarlinDDKalTest*>( trkSystem ) ) ;
+  ckf.setMaxChi2Increment( maxChi2Increment ) ;
+  ckf.setMaxHoles( maxHoles ) ;
+
+  MarlinTrkTest::Checks check ;
+
+  const unsigned nTracks = MarlinTrkTest::forEachTrack( argv[2], collection, maxEvents, 8, [&]( std::vector<EVENT::TrackerHit*>& hits ) {
+
+      IMPL::TrackStateImpl prefit ;
+      if( ! check( MarlinTrkTest::createPrefit( hits, bz, prefit ) == IMarlinTrack::success, "prefit" ) ) return ;
+
+      std::unique_ptr<IMarlinTrack> full( MarlinTrkTest::fitHits( trkSystem, hits, prefit, bz ) ) ;
+      if( ! check( full != 0, "full fit" ) ) return ;
+
+      // the hits used in the fit, in the order of the fit and with the composite space points split into their strips
+      std::vector<std::pair<EVENT::TrackerHit*, double> > hitsInFit ;
+      full->getHitsInFit( hitsInFit ) ;
+
+      if( hitsInFit.size() < nSeedHits + 4 ) return ;
+
+      std::vector<EVENT::TrackerHit*> seedHits ;
+      for( unsigned i = 0 ; i < nSeedHits ; ++i ) seedHits.push_back( hitsInFit[i].first ) ;
+
+      // the layers of the remaining hits in the order of the fit
+      std::vector<int> layers ;
+      MarlinDDKalTestCKF::LayerHitMap layerHits ;
+
+      for( unsigned i = nSeedHits ; i < hitsInFit.size() ; ++i ) {
+
+        const int layer = MarlinTrkTest::layerID( hitsInFit[i].first ) ;
+
+        if( layerHits.find( layer ) == layerHits.end() ) layers.push_back( layer ) ;
+        layerHits[ layer ].push_back( hitsInFit[i].first ) ;
+      }
+
+      std::unique_ptr<IMarlinTrack> seed( MarlinTrkTest::fitHits( trkSystem, seedHits, prefit, bz, maxChi2Increment ) ) ;
+      if( ! check( seed != 0, "seed fit" ) ) return ;
+
+      std::vector<IMarlinTrack*> tracks ;
+      const int st = ckf.findTracks( seed.get(), layers, layerHits, tracks ) ;
+
+      if( check( st == IMarlinTrack::success && ! tracks.empty() && tracks.front() != 0, "findTracks", errorCode( st ) ) ) {
+
+        IMarlinTrack& best = *tracks.front() ;
+
+        hitsInFit.clear() ;
+        best.getHitsInFit( hitsInFit ) ;
+
+        std::vector<EVENT::TrackerHit*> candidateHits ;
+        for( unsigned i = 0 ; i < hitsInFit.size() ; ++i ) candidateHits.push_back( hitsInFit[i].first ) ;
+
+        std::stringstream msg ;
+        msg << candidateHits.size() - nSeedHits << " hits on " << layers.size() << " layers" ;
+
+        check( candidateHits.size() + maxHoles >= nSeedHits + layers.size(), "hits of the track found", msg.str() ) ;
+
+        std::unique_ptr<IMarlinTrack> reference( MarlinTrkTest::fitHits( trkSystem, candidateHits, prefit, bz, maxChi2Increment ) ) ;
+
+        if( check( reference != 0, "refit of the best candidate" ) )
+          MarlinTrkTest::compareFits( check, "best candidate", best, *reference, candidateHits, tolerance ) ;
+      }
+
+      for( unsigned i = 0 ; i < tracks.size() ; ++i ) delete tracks[i] ;
+
+      ckf.clear() ;
+    } ) ;
+
+  std::cout << " " << nTracks << " tracks followed " << std::endl ;
+
+  return ( nTracks == 0 || check.summary( 0.02 ) ? 1 : 0 ) ;
+}
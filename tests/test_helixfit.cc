@@ -0,0 +1,501 @@
+/** Comparison of the Riemann helix fit with the fast helix fit of Chernov and Ososkov on generated helices with
+ *  Gaussian r-phi and z resolutions: the number of failed fits, the pulls and the residuals of the parameters
+ *  and the time per fit are printed for both. The Riemann fit has to fail as rarely as the fast helix fit and
+ *  must not be less precise. The fast helix fit in float precision has to agree with the one in double precision, and
+ *  all fits have to work for more than the 600 points the fixed size arrays of the original fit allowed. The batch
+ *  fit has to return the same as the fits of the single point sets. The states of fitState() need pulls of width one.
+ *
+ *  usage: test_helixfit [nTracks]
+ *         default: 20000
+ */
+
+#include "MarlinTrk/HelixFit.h"
+#include "MarlinTrk/FastKFKernels.h"
+
+#include "streamlog/streamlog.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace MarlinTrk ;
+
+namespace {
+
+  /** the points of the generated helices and their true parameters in the order of fastHelixFit():
+   *  omega, tanLambda, phi0 in [0,2pi), d0 and z0 in the sign convention of the fit
+   */
+  struct Sample {
+    int npt = 0 ;
+    std::vector<double> x{}, y{}, w{} ;
+    std::vector<float> r{}, phi{}, z{}, wz{} ;
+    std::vector<double> truth{} ;
+  } ;
+
+  void generate( int nTracks, int npt, Sample& sample ) {
+
+    const double sigRPhi = 0.01 ;
+    const double sigZ = 0.1 ;
+
+    std::mt19937 gen( 11 ) ;
+    std::normal_distribution<double> gauss ;
+    std::uniform_real_distribution<double> flat( 0., 1. ) ;
+
+    sample.npt = npt ;
+
+    for( int k = 0 ; k < nTracks ; ++k ) {
+
+      double omega = ( flat( gen ) - 0.5 ) / 100. ;
+      if( std::fabs( omega ) < 1.e-4 ) omega = 1.e-4 ;
+
+      const double d0 = 0.2 * gauss( gen ) ;
+      const double phi0 = -M_PI + 2. * M_PI * flat( gen ) ;
+      const double z0 = gauss( gen ) ;
+      const double tanL = gauss( gen ) ;
+
+      FastKF::State st ;
+      st.par = { d0, phi0, omega, z0, tanL } ;
+      st.ref[0] = st.ref[1] = st.ref[2] = 0. ;
+
+      const double truth[5] = { omega, tanL, phi0 < 0. ? phi0 + 2. * M_PI : phi0, omega > 0. ? d0 : -d0, z0 } ;
+      sample.truth.insert( sample.truth.end(), truth, truth + 5 ) ;
+
+      for( int i = 0 ; i < npt ; ++i ) {
+
+        double pos[3] ;
+        FastKF::positionAt( st, 30. + 300. * i / npt, pos ) ;
+
+        const double r = std::hypot( pos[0], pos[1] ) ;
+        const double phi = std::atan2( pos[1], pos[0] ) + sigRPhi / r * gauss( gen ) ;
+
+        sample.x.push_back( r * std::cos( phi ) ) ;
+        sample.y.push_back( r * std::sin( phi ) ) ;
+        sample.r.push_back( r ) ;
+        sample.phi.push_back( phi ) ;
+        sample.w.push_back( 1. / ( sigRPhi * sigRPhi ) ) ;
+        sample.z.push_back( pos[2] + sigZ * gauss( gen ) ) ;
+        sample.wz.push_back( 1. / ( sigZ * sigZ ) ) ;
+      }
+    }
+  }
+
+  /** the circle fits: fastHelixFit in double and in float precision and riemannHelixFit */
+  enum Engine { chernov, chernovFloat, riemann } ;
+
+  /** the failed fits, the pulls ( mean and rms ) and rms of the residuals of the five parameters and the time per fit,
+   *  together with the parameters and return codes of all fits
+   */
+  struct Result {
+    int failed = 0 ;
+    double pullMean[5] = {}, pullRMS[5] = {}, residualRMS[5] = {} ;
+    double time = 0. ;
+    std::vector<float> par{} ;
+    std::vector<int> status{} ;
+  } ;
+
+  Result fit( HelixFit& helixFit, Engine engine, int iopt, Sample& sample ) {
+
+    const int npt = sample.npt ;
+    const int nTracks = sample.truth.size() / 5 ;
+
+    Result result ;
+    result.par.resize( 5 * nTracks ) ;
+    result.status.resize( nTracks ) ;
+
+    std::vector<float> invCov( 15 * nTracks ) ;
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now() ;
+
+    for( int k = 0 ; k < nTracks ; ++k ) {
+
+      const int o = k * npt ;
+      float chi2RPhi = 0., chi2Z = 0. ;
+
+      float* par = &result.par[5*k] ;
+      float* ee = &invCov[15*k] ;
+
+      switch( engine ) {
+      case chernov:
+        result.status[k] = helixFit.fastHelixFit( npt, &sample.x[o], &sample.y[o], &sample.r[o], &sample.phi[o], &sample.w[o], &sample.z[o], &sample.wz[o],
+                                                  iopt, par, ee, chi2RPhi, chi2Z ) ;
+        break ;
+      case chernovFloat:
+        result.status[k] = helixFit.fastHelixFitT<float>( npt, &sample.x[o], &sample.y[o], &sample.r[o], &sample.phi[o], &sample.w[o], &sample.z[o], &sample.wz[o],
+                                                          iopt, par, ee, chi2RPhi, chi2Z ) ;
+        break ;
+      case riemann:
+        result.status[k] = helixFit.riemannHelixFit( npt, &sample.x[o], &sample.y[o], &sample.r[o], &sample.phi[o], &sample.w[o], &sample.z[o], &sample.wz[o],
+                                                     iopt, par, ee, chi2RPhi, chi2Z ) ;
+        break ;
+      }
+    }
+
+    result.time = std::chrono::duration<double, std::micro>( std::chrono::steady_clock::now() - start ).count() / nTracks ;
+
+    int n = 0 ;
+
+    for( int k = 0 ; k < nTracks ; ++k ) {
+
+      FastKF::SymMatrix5 cov ;
+      for( int i = 0 ; i < 15 ; ++i ) cov[i] = invCov[15*k+i] ;
+
+      if( result.status[k] != 0 || ! FastKF::invert( cov ) ) {
+        ++result.failed ;
+        continue ;
+      }
+
+      ++n ;
+
+      for( int i = 0 ; i < 5 ; ++i ) {
+
+        double d = result.par[5*k+i] - sample.truth[5*k+i] ;
+        if( i == 2 ) d = std::remainder( d, 2. * M_PI ) ;
+
+        const double pull = d / std::sqrt( cov[ FastKF::symIndex( i, i ) ] ) ;
+
+        result.pullMean[i] += pull ;
+        result.pullRMS[i] += pull * pull ;
+        result.residualRMS[i] += d * d ;
+      }
+    }
+
+    for( int i = 0 ; i < 5 && n > 0 ; ++i ) {
+      result.pullMean[i] /= n ;
+      result.pullRMS[i] = std::sqrt( result.pullRMS[i] / n ) ;
+      result.residualRMS[i] = std::sqrt( result.residualRMS[i] / n ) ;
+    }
+
+    return result ;
+  }
+
+  /** the number of fits that succeeded in both results with parameters differing by more than tolerance times the
+   *  rms of the residuals of the reference, or that failed in only one of them
+   */
+  int countDifferent( const Result& result, const Result& reference, double tolerance ) {
+
+    int n = 0 ;
+
+    for( unsigned k = 0 ; k < reference.status.size() ; ++k ) {
+
+      if( ( result.status[k] != 0 ) != ( reference.status[k] != 0 ) ) {
+        ++n ;
+        continue ;
+      }
+
+      if( reference.status[k] != 0 ) continue ;
+
+      for( int i = 0 ; i < 5 ; ++i ) {
+
+        double d = result.par[5*k+i] - reference.par[5*k+i] ;
+        if( i == 2 ) d = std::remainder( d, 2. * M_PI ) ;
+
+        if( ! ( std::fabs( d ) <= tolerance * reference.residualRMS[i] ) ) {
+          ++n ;
+          break ;
+        }
+      }
+    }
+
+    return n ;
+  }
+
+  /** the point set k of the sample as the double precision arrays of the batch */
+  void addToBatch( const Sample& sample, int k, HelixFitBatch& batch ) {
+
+    const int o = k * sample.npt ;
+
+    const std::vector<double> z( sample.z.begin() + o, sample.z.begin() + o + sample.npt ) ;
+    const std::vector<double> wz( sample.wz.begin() + o, sample.wz.begin() + o + sample.npt ) ;
+
+    batch.addPointSet( sample.npt, &sample.x[o], &sample.y[o], &z[0], &sample.w[o], &wz[0] ) ;
+  }
+
+  /** the number of point sets of the batch fit that differ from the single fits in the return code or by more than
+   *  tolerance times the rms of the residuals in the parameters. The sample is extended by a point set with a point
+   *  of zero weight, a point set with only zero weights and a point set with two points, which has to fail.
+   */
+  int countBatchDifferent( HelixFit& helixFit, int iopt, Sample& sample, double tolerance ) {
+
+    const int npt = sample.npt ;
+
+    // the special point sets are copies of the first one
+    Sample special = sample ;
+
+    const int zeroWeightPoint = special.truth.size() / 5 ;
+    special.truth.insert( special.truth.end(), sample.truth.begin(), sample.truth.begin() + 5 ) ;
+    special.x.insert( special.x.end(), sample.x.begin(), sample.x.begin() + npt ) ;
+    special.y.insert( special.y.end(), sample.y.begin(), sample.y.begin() + npt ) ;
+    special.r.insert( special.r.end(), sample.r.begin(), sample.r.begin() + npt ) ;
+    special.phi.insert( special.phi.end(), sample.phi.begin(), sample.phi.begin() + npt ) ;
+    special.w.insert( special.w.end(), sample.w.begin(), sample.w.begin() + npt ) ;
+    special.z.insert( special.z.end(), sample.z.begin(), sample.z.begin() + npt ) ;
+    special.wz.insert( special.wz.end(), sample.wz.begin(), sample.wz.begin() + npt ) ;
+
+    special.w[ zeroWeightPoint * npt + npt / 2 ] = 0. ;
+    special.wz[ zeroWeightPoint * npt + npt / 2 ] = 0. ;
+
+    const int zeroWeights = zeroWeightPoint + 1 ;
+    special.truth.insert( special.truth.end(), sample.truth.begin(), sample.truth.begin() + 5 ) ;
+    special.x.insert( special.x.end(), sample.x.begin(), sample.x.begin() + npt ) ;
+    special.y.insert( special.y.end(), sample.y.begin(), sample.y.begin() + npt ) ;
+    special.r.insert( special.r.end(), sample.r.begin(), sample.r.begin() + npt ) ;
+    special.phi.insert( special.phi.end(), sample.phi.begin(), sample.phi.begin() + npt ) ;
+    special.w.insert( special.w.end(), npt, 0. ) ;
+    special.z.insert( special.z.end(), sample.z.begin(), sample.z.begin() + npt ) ;
+    special.wz.insert( special.wz.end(), npt, 0.f ) ;
+
+    const Result single = fit( helixFit, chernov, iopt, special ) ;
+
+    HelixFitBatch batch ;
+    for( int k = 0 ; k <= zeroWeights ; ++k ) addToBatch( special, k, batch ) ;
+
+    // two points, fit as single point set with the same arrays
+    float twoPoints[5], twoPointsCov[15], chi2RPhi, chi2Z ;
+    const int twoPointsStatus = helixFit.fastHelixFit( 2, &special.x[0], &special.y[0], &special.r[0], &special.phi[0], &special.w[0],
+                                                       &special.z[0], &special.wz[0], iopt, twoPoints, twoPointsCov, chi2RPhi, chi2Z ) ;
+    const std::vector<double> z2( special.z.begin(), special.z.begin() + 2 ), wz2( special.wz.begin(), special.wz.begin() + 2 ) ;
+    batch.addPointSet( 2, &special.x[0], &special.y[0], &z2[0], &special.w[0], &wz2[0] ) ;
+
+    const int nFailed = helixFit.fastHelixFit( batch, iopt ) ;
+
+    int nDifferent = 0 ;
+    int nFailedSingle = 0 ;
+
+    for( int k = 0 ; k <= zeroWeights ; ++k ) {
+
+      nFailedSingle += ( single.status[k] != 0 ) ;
+
+      bool same = ( ( batch.status[k] != 0 ) == ( single.status[k] != 0 ) ) ;
+
+      for( int i = 0 ; i < 5 && same && single.status[k] == 0 ; ++i ) {
+
+        double d = batch.par[5*k+i] - single.par[5*k+i] ;
+        if( i == 2 ) d = std::remainder( d, 2. * M_PI ) ;
+
+        same = ( std::fabs( d ) <= tolerance * single.residualRMS[i] ) ;
+      }
+
+      if( ! same ) ++nDifferent ;
+    }
+
+    if( single.status[ zeroWeightPoint ] != 0 || single.status[ zeroWeights ] == 0 || twoPointsStatus == 0 ) {
+      std::printf( "  the single fits of the special point sets return %d %d %d instead of 0 1 1\n",
+                   single.status[ zeroWeightPoint ], single.status[ zeroWeights ], twoPointsStatus ) ;
+      ++nDifferent ;
+    }
+
+    if( batch.status.back() == 0 ) ++nDifferent ;
+
+    if( nFailed != nFailedSingle + 1 ) ++nDifferent ;
+
+    return nDifferent ;
+  }
+
+  /** pulls of the states of fitState() in both orientations with respect to the true parameters - returns the
+   *  number of failed fits and fills the means and rms of the pulls of the state from the first to the last point.
+   *  The state from the last to the first point has to be the same helix in the opposite direction.
+   */
+  int fitStates( HelixFit& helixFit, const Sample& sample, double* pullMean, double* pullRMS, int& nReversed ) {
+
+    const int npt = sample.npt ;
+    const int nTracks = sample.truth.size() / 5 ;
+
+    int nFailed = 0 ;
+    int n = 0 ;
+    nReversed = 0 ;
+
+    for( int i = 0 ; i < 5 ; ++i ) pullMean[i] = pullRMS[i] = 0. ;
+
+    std::vector<double> chi2s( npt ), arcs( npt ) ;
+
+    for( int k = 0 ; k < nTracks ; ++k ) {
+
+      const int o = k * npt ;
+      const double* t = &sample.truth[5*k] ;
+
+      // the true parameters in the LCIO convention of the state
+      const double truth[5] = { t[0] > 0. ? t[3] : -t[3], FastKF::toBaseRange( t[2] ), t[0], t[4], t[1] } ;
+
+      const std::vector<double> z( sample.z.begin() + o, sample.z.begin() + o + npt ) ;
+      const std::vector<double> wz( sample.wz.begin() + o, sample.wz.begin() + o + npt ) ;
+
+      FastKF::State state, reversed ;
+
+      if( helixFit.fitState( npt, &sample.x[o], &sample.y[o], &z[0], &sample.w[o], &wz[0], true, state, &chi2s[0], &arcs[0] ) != 0 ||
+          helixFit.fitState( npt, &sample.x[o], &sample.y[o], &z[0], &sample.w[o], &wz[0], false, reversed ) != 0 ) {
+        ++nFailed ;
+        continue ;
+      }
+
+      ++n ;
+
+      for( int i = 0 ; i < 5 ; ++i ) {
+
+        double d = state.par[i] - truth[i] ;
+        if( i == FastKF::iPhi ) d = std::remainder( d, 2. * M_PI ) ;
+
+        const double pull = d / std::sqrt( state.cov[ FastKF::symIndex( i, i ) ] ) ;
+
+        pullMean[i] += pull ;
+        pullRMS[i] += pull * pull ;
+      }
+
+      const double eps = 1.e-6 ;
+
+      if( ! ( std::fabs( reversed.par[FastKF::iD0] + state.par[FastKF::iD0] ) < eps &&
+              std::fabs( std::remainder( reversed.par[FastKF::iPhi] - state.par[FastKF::iPhi] - M_PI, 2. * M_PI ) ) < eps &&
+              std::fabs( reversed.par[FastKF::iOmega] + state.par[FastKF::iOmega] ) < eps * std::fabs( state.par[FastKF::iOmega] ) &&
+              std::fabs( reversed.par[FastKF::iZ0] - state.par[FastKF::iZ0] ) < eps &&
+              std::fabs( reversed.par[FastKF::iTanL] + state.par[FastKF::iTanL] ) < eps ) )
+        ++nReversed ;
+    }
+
+    for( int i = 0 ; i < 5 && n > 0 ; ++i ) {
+      pullMean[i] /= n ;
+      pullRMS[i] = std::sqrt( pullRMS[i] / n ) ;
+    }
+
+    return nFailed ;
+  }
+
+  void print( const char* name, int npt, int iopt, const Result& result ) {
+
+    const char* names[5] = { "omega", "tanL", "phi0", "d0", "z0" } ;
+
+    std::printf( "%-8s npt %4d iopt %d: %6.3f us/fit, %4d failed\n", name, npt, iopt, result.time, result.failed ) ;
+
+    for( int i = 0 ; i < 5 ; ++i )
+      std::printf( "    %-5s pull %6.2f +- %6.2f  rms residual %.3g\n", names[i], result.pullMean[i], result.pullRMS[i], result.residualRMS[i] ) ;
+  }
+}
+
+
+int main( int argc, char** argv ) {
+
+  const int nTracks = ( argc > 1 ? std::atoi( argv[1] ) : 20000 ) ;
+
+  streamlog::out.init( std::cout , "test_helixfit" ) ;
+  streamlog::out.addLevelName<streamlog::WARNING>() ;
+  streamlog::out.setLevel( "WARNING" ) ;
+
+  HelixFit helixFit ;
+
+  int failed = 0 ;
+
+  for( int npt : { 4, 8, 30 } ) {
+
+    Sample sample ;
+    generate( nTracks, npt, sample ) ;
+
+    for( int iopt : { 2, 3 } ) {
+
+      const Result chernovResult = fit( helixFit, chernov, iopt, sample ) ;
+      const Result riemannResult = fit( helixFit, riemann, iopt, sample ) ;
+
+      print( "chernov", npt, iopt, chernovResult ) ;
+      print( "riemann", npt, iopt, riemannResult ) ;
+
+      // a few fits out of 10^4 may fail for points close to a straight line in float precision
+      bool ok = ( riemannResult.failed <= 1.e-3 * nTracks && riemannResult.failed <= chernovResult.failed + 1.e-4 * nTracks + 5 ) ;
+
+      for( int i = 0 ; i < 5 ; ++i ) {
+        ok = ok && riemannResult.residualRMS[i] <= 1.05 * chernovResult.residualRMS[i] ;
+        ok = ok && std::fabs( riemannResult.pullRMS[i] - chernovResult.pullRMS[i] ) <= 0.05 * chernovResult.pullRMS[i] ;
+      }
+
+      if( ! ok ) {
+        std::printf( "  FAILED riemann fit with npt %d iopt %d\n", npt, iopt ) ;
+        ++failed ;
+      }
+
+      // the fit in float precision agrees with the one in double precision within a fraction of the resolution - it
+      // fails more often for points close to a straight line, where the Newton step of iopt = 3 is not invertible
+      const Result floatResult = fit( helixFit, chernovFloat, iopt, sample ) ;
+      const int nDifferent = countDifferent( floatResult, chernovResult, 0.1 ) ;
+
+      std::printf( "float    npt %4d iopt %d: %6.3f us/fit, %4d failed, %4d differ from double precision\n", npt, iopt,
+                   floatResult.time, floatResult.failed, nDifferent ) ;
+
+      if( nDifferent > 5.e-3 * nTracks + 5 ) {
+        std::printf( "  FAILED fastHelixFitT<float> with npt %d iopt %d\n", npt, iopt ) ;
+        ++failed ;
+      }
+
+      // the batch fit returns the same as the fit of every point set - up to the r and phi of the points, which the
+      // single fit takes in float precision and the Newton step of iopt = 3 amplifies to a few percent of the resolution
+      const int nBatchDifferent = countBatchDifferent( helixFit, iopt, sample, iopt < 3 ? 1.e-2 : 1.e-1 ) ;
+
+      std::printf( "batch    npt %4d iopt %d: %4d differ from the single fits\n", npt, iopt, nBatchDifferent ) ;
+
+      if( nBatchDifferent > 0 ) {
+        std::printf( "  FAILED batch fit with npt %d iopt %d\n", npt, iopt ) ;
+        ++failed ;
+      }
+    }
+  }
+
+  // the state and covariance matrix of fitState() for 30 points
+  {
+    Sample sample ;
+    generate( nTracks, 30, sample ) ;
+
+    double pullMean[5], pullRMS[5] ;
+    int nReversed = 0 ;
+
+    const int nFailed = fitStates( helixFit, sample, pullMean, pullRMS, nReversed ) ;
+
+    const char* names[5] = { "d0", "phi0", "omega", "z0", "tanL" } ;
+
+    std::printf( "fitState npt   30: %4d failed, %4d not reversed\n", nFailed, nReversed ) ;
+
+    bool ok = ( nFailed <= 1.e-3 * nTracks + 5 && nReversed == 0 ) ;
+
+    for( int i = 0 ; i < 5 ; ++i ) {
+
+      std::printf( "    %-5s pull %6.2f +- %6.2f\n", names[i], pullMean[i], pullRMS[i] ) ;
+
+      ok = ok && std::fabs( pullMean[i] ) < 0.1 && std::fabs( pullRMS[i] - 1. ) < 0.1 ;
+    }
+
+    if( ! ok ) {
+      std::printf( "  FAILED fitState\n" ) ;
+      ++failed ;
+    }
+  }
+
+  // more points than the fixed size arrays of the original fit had room for - the resolution improves with the points
+  {
+    const int nLong = std::max( 1, nTracks / 100 ) ;
+
+    Sample sample30, sample1000 ;
+    generate( nLong, 30, sample30 ) ;
+    generate( nLong, 1000, sample1000 ) ;
+
+    const char* names[3] = { "chernov", "float", "riemann" } ;
+
+    for( Engine engine : { chernov, chernovFloat, riemann } ) {
+
+      const Result result30 = fit( helixFit, engine, 2, sample30 ) ;
+      const Result result1000 = fit( helixFit, engine, 2, sample1000 ) ;
+
+      print( names[engine], 1000, 2, result1000 ) ;
+
+      bool ok = ( result1000.failed <= 1.e-2 * nLong ) ;
+
+      for( int i = 0 ; i < 5 ; ++i ) ok = ok && result1000.residualRMS[i] < result30.residualRMS[i] ;
+
+      if( ! ok ) {
+        std::printf( "  FAILED %s fit of 1000 points\n", names[engine] ) ;
+        ++failed ;
+      }
+    }
+  }
+
+  return ( failed ? 1 : 0 ) ;
+}
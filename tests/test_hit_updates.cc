@@ -0,0 +1,98 @@
+/** Checks of IMarlinTrack::removeHit() and IMarlinTrack::insertHit() of the DDKalTest track system: a hit at the
+ *  start, in the middle and at the end of the fitted tracks of an LCIO file is removed from the fit and inserted into
+ *  the fit without it. The chi2, ndf and the track states at the hits and at the IP have to be the same as those of
+ *  the full refit of the same hits.
+ *
+ *  usage: test_hit_updates compact.xml file.slcio [collection] [maxEvents]
+ *         default: SiTracks 10
+ */
+
+#include "TestUtils.h"
+
+#include <cstdlib>
+
+using namespace MarlinTrk ;
+
+int main( int argc, char** argv ) {
+
+  if( argc < 3 ) {
+    std::cout << "usage: " << argv[0] << " compact.xml file.slcio [collection] [maxEvents]" << std::endl ;
+    return 1 ;
+  }
+
+  const std::string collection = ( argc > 3 ? argv[3] : "SiTracks" ) ;
+  const unsigned maxEvents = ( argc > 4 ? std::atoi( argv[4] ) : 10 ) ;
+
+  // the states only differ by the rounding of the re-filtered sites
+  const double tolerance = 1.e-4 ;
+
+  const double bz = MarlinTrkTest::initDetector( argv[1] ) ;
+
+  IMarlinTrkSystem* trkSystem = MarlinTrkTest::createTrkSystem( "DDKalTest" ) ;
+
+  MarlinTrkTest::Checks check ;
+
+  const unsigned nTracks = MarlinTrkTest::forEachTrack( argv[2], collection, maxEvents, 6, [&]( std::vector<EVENT::TrackerHit*>& hits ) {
+
+      IMPL::TrackStateImpl prefit ;
+      if( ! check( MarlinTrkTest::createPrefit( hits, bz, prefit ) == IMarlinTrack::success, "prefit" ) ) return ;
+
+      std::unique_ptr<IMarlinTrack> full( MarlinTrkTest::fitHits( trkSystem, hits, prefit, bz ) ) ;
+      if( ! check( full != 0, "full fit" ) ) return ;
+
+      // the hits used in the fit, in the order of the fit and with the composite space points split into their strips
+      std::vector<std::pair<EVENT::TrackerHit*, double> > hitsInFit ;
+      full->getHitsInFit( hitsInFit ) ;
+
+      std::vector<EVENT::TrackerHit*> fitHits ;
+      for( unsigned i = 0 ; i < hitsInFit.size() ; ++i ) fitHits.push_back( hitsInFit[i].first ) ;
+
+      if( fitHits.size() < 6 ) return ;
+
+      // the refit of the hits in the fit uses all of them
+      std::unique_ptr<IMarlinTrack> reference( MarlinTrkTest::fitHits( trkSystem, fitHits, prefit, bz ) ) ;
+      hitsInFit.clear() ;
+      if( reference ) reference->getHitsInFit( hitsInFit ) ;
+
+      if( ! check( reference != 0 && hitsInFit.size() == fitHits.size(), "refit of the hits in the fit" ) ) return ;
+
+      const unsigned indices[3] = { 0, unsigned( fitHits.size() / 2 ), unsigned( fitHits.size() - 1 ) } ;
+      const char* where[3] = { "first", "middle", "last" } ;
+
+      for( int k = 0 ; k < 3 ; ++k ) {
+
+        EVENT::TrackerHit* hit = fitHits[ indices[k] ] ;
+
+        std::vector<EVENT::TrackerHit*> otherHits = fitHits ;
+        otherHits.erase( otherHits.begin() + indices[k] ) ;
+
+        std::unique_ptr<IMarlinTrack> without( MarlinTrkTest::fitHits( trkSystem, otherHits, prefit, bz ) ) ;
+        if( ! check( without != 0, std::string( "refit without the " ) + where[k] + " hit" ) ) continue ;
+
+        // removeHit
+        std::unique_ptr<IMarlinTrack> removed( MarlinTrkTest::fitHits( trkSystem, fitHits, prefit, bz ) ) ;
+
+        if( check( removed != 0, std::string( "fit before the removal of the " ) + where[k] + " hit" ) ) {
+
+          const int st = removed->removeHit( hit ) ;
+          if( check( st == IMarlinTrack::success, std::string( "removeHit of the " ) + where[k] + " hit", errorCode( st ) ) )
+            MarlinTrkTest::compareFits( check, std::string( "removeHit of the " ) + where[k] + " hit", *removed, *without, otherHits, tolerance ) ;
+        }
+
+        // insertHit
+        std::unique_ptr<IMarlinTrack> inserted( MarlinTrkTest::fitHits( trkSystem, otherHits, prefit, bz ) ) ;
+
+        if( check( inserted != 0, std::string( "fit before the insertion of the " ) + where[k] + " hit" ) ) {
+
+          double chi2increment = 0. ;
+          const int st = inserted->insertHit( hit, chi2increment ) ;
+          if( check( st == IMarlinTrack::success, std::string( "insertHit of the " ) + where[k] + " hit", errorCode( st ) ) )
+            MarlinTrkTest::compareFits( check, std::string( "insertHit of the " ) + where[k] + " hit", *inserted, *reference, fitHits, tolerance ) ;
+        }
+      }
+    } ) ;
+
+  std::cout << " " << nTracks << " tracks refit " << std::endl ;
+
+  return ( nTracks == 0 || check.summary( 0.02 ) ? 1 : 0 ) ;
+}
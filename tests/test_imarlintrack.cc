@@ -0,0 +1,155 @@
+/** Checks of the IMarlinTrack interface that every track system has to pass: the tracks of an LCIO file are refit
+ *  with createFinalisedLCIOTrack() and queried through the interface. The track parameters at the IP of every
+ *  system are compared with those of the first one.
+ *
+ *  usage: test_imarlintrack compact.xml file.slcio [collection] [maxEvents] [systems...]
+ *         default: SiTracks 10 DDKalTest FastKF
+ */
+
+#include "TestUtils.h"
+
+#include "MarlinTrk/IMarlinTrack.h"
+#include "MarlinTrk/MarlinTrkUtils.h"
+
+#include "IMPL/TrackImpl.h"
+#include "IMPL/TrackStateImpl.h"
+
+#include <cstdlib>
+#include <memory>
+#include <sstream>
+
+using namespace MarlinTrk ;
+
+namespace {
+
+  bool finite( const EVENT::TrackState& ts ) {
+    return std::isfinite( ts.getD0() ) && std::isfinite( ts.getPhi() ) && std::isfinite( ts.getOmega() ) &&
+      std::isfinite( ts.getZ0() ) && std::isfinite( ts.getTanLambda() ) ;
+  }
+
+  /** all diagonal elements of the covariance matrix are positive, except omega of a straight line */
+  bool positiveDiagonal( const EVENT::TrackState& ts ) {
+    const EVENT::FloatVec& cov = ts.getCovMatrix() ;
+    return cov[0] > 0. && cov[2] > 0. && ( cov[5] > 0. || ts.getOmega() == 0. ) && cov[9] > 0. && cov[14] > 0. ;
+  }
+
+  /** pulls of the parameters of ts with respect to the reference state, using the errors of the reference */
+  void pulls( const EVENT::TrackState& ts, const EVENT::TrackState& ref, double* pull ) {
+    const double d[5] = { ts.getD0() - ref.getD0(), std::remainder( ts.getPhi() - ref.getPhi(), 2. * M_PI ), ts.getOmega() - ref.getOmega(),
+                          ts.getZ0() - ref.getZ0(), ts.getTanLambda() - ref.getTanLambda() } ;
+    const int diag[5] = { 0, 2, 5, 9, 14 } ;
+    for( int i = 0 ; i < 5 ; ++i ) pull[i] = d[i] / std::sqrt( ref.getCovMatrix()[ diag[i] ] ) ;
+  }
+}
+
+
+int main( int argc, char** argv ) {
+
+  if( argc < 3 ) {
+    std::cout << "usage: " << argv[0] << " compact.xml file.slcio [collection] [maxEvents] [systems...]" << std::endl ;
+    return 1 ;
+  }
+
+  const std::string collection = ( argc > 3 ? argv[3] : "SiTracks" ) ;
+  const unsigned maxEvents = ( argc > 4 ? std::atoi( argv[4] ) : 10 ) ;
+
+  std::vector<std::string> types ;
+  for( int i = 5 ; i < argc ; ++i ) types.push_back( argv[i] ) ;
+  if( types.empty() ) types = { "DDKalTest", "FastKF" } ;
+
+  const double bz = MarlinTrkTest::initDetector( argv[1] ) ;
+
+  std::vector<IMarlinTrkSystem*> systems ;
+  for( unsigned s = 0 ; s < types.size() ; ++s ) systems.push_back( MarlinTrkTest::createTrkSystem( types[s] ) ) ;
+
+  MarlinTrkTest::Checks check ;
+
+  const EVENT::FloatVec cov = MarlinTrkTest::initialCovariance() ;
+
+  const unsigned nTracks = MarlinTrkTest::forEachTrack( argv[2], collection, maxEvents, 4, [&]( std::vector<EVENT::TrackerHit*>& hits ) {
+
+      IMPL::TrackStateImpl reference ;
+      bool hasReference = false ;
+
+      for( unsigned s = 0 ; s < systems.size() ; ++s ) {
+
+        const std::string& name = types[s] ;
+
+        std::unique_ptr<IMarlinTrack> trk( systems[s]->createTrack() ) ;
+        IMPL::TrackImpl track ;
+
+        std::vector<EVENT::TrackerHit*> hitList = hits ;
+
+        const int status = createFinalisedLCIOTrack( trk.get(), hitList, &track, IMarlinTrack::backward, cov, bz, DBL_MAX ) ;
+
+        if( ! check( status == IMarlinTrack::success, name + " createFinalisedLCIOTrack", errorCode( status ) ) ) continue ;
+
+        // the fit
+        check( track.getNdf() > 0 && track.getChi2() >= 0. && std::isfinite( track.getChi2() ), name + " chi2 and ndf" ) ;
+        check( track.getTrackState( EVENT::TrackState::AtIP ) && track.getTrackState( EVENT::TrackState::AtFirstHit ) &&
+               track.getTrackState( EVENT::TrackState::AtLastHit ), name + " track states" ) ;
+
+        std::vector<std::pair<EVENT::TrackerHit*, double> > hitsInFit, outliers ;
+        trk->getHitsInFit( hitsInFit ) ;
+        trk->getOutliers( outliers ) ;
+
+        if( ! check( ! hitsInFit.empty() && hitsInFit.size() + outliers.size() <= hits.size(), name + " hits in fit and outliers" ) ) continue ;
+
+        int ndf = 0 ;
+        double chi2 = 0. ;
+        check( trk->getNDF( ndf ) == IMarlinTrack::success && ndf == track.getNdf(), name + " getNDF" ) ;
+
+        // the states at the hits
+        for( unsigned i = 0 ; i < hitsInFit.size() ; ++i ) {
+
+          IMPL::TrackStateImpl ts ;
+          const int st = trk->getTrackState( hitsInFit[i].first, ts, chi2, ndf ) ;
+
+          check( st == IMarlinTrack::success && finite( ts ), name + " getTrackState at hit", errorCode( st ) ) ;
+        }
+
+        // propagation and extrapolation to the IP
+        IMPL::TrackStateImpl atIP, extrapolated ;
+
+        int st = trk->propagate( Vector3D( 0., 0., 0. ), atIP, chi2, ndf ) ;
+        const bool propagated = check( st == IMarlinTrack::success && finite( atIP ) && positiveDiagonal( atIP ), name + " propagate to the IP", errorCode( st ) ) ;
+
+        st = trk->extrapolate( Vector3D( 0., 0., 0. ), extrapolated, chi2, ndf ) ;
+        check( st == IMarlinTrack::success && finite( extrapolated ) && positiveDiagonal( extrapolated ), name + " extrapolate to the IP", errorCode( st ) ) ;
+
+        double pathLength = 0., timeOfFlight = 0. ;
+        check( trk->getLastPropagationLength( pathLength, timeOfFlight ) == IMarlinTrack::success && std::isfinite( pathLength ), name + " path length" ) ;
+
+        // the layer of the first hit in the fit is crossed by the track
+        Vector3D point ;
+        int detElementID = 0 ;
+        st = trk->intersectionWithLayer( MarlinTrkTest::layerID( hitsInFit.front().first ), point, detElementID, IMarlinTrack::modeClosest ) ;
+        check( st == IMarlinTrack::success, name + " intersectionWithLayer of a hit", errorCode( st ) ) ;
+
+        // the same parameters at the IP as the first system
+        if( s == 0 ) {
+          reference = atIP ;
+          hasReference = propagated ;
+          continue ;
+        }
+
+        if( ! hasReference || ! propagated ) continue ;
+
+        double pull[5] ;
+        pulls( atIP, reference, pull ) ;
+
+        const char* names[5] = { "d0", "phi0", "omega", "z0", "tanL" } ;
+
+        for( int i = 0 ; i < 5 ; ++i ) {
+          std::stringstream msg ;
+          msg << names[i] << " pull " << pull[i] ;
+          check( std::fabs( pull[i] ) < 3., name + " agrees with " + types[0] + " at the IP", msg.str() ) ;
+        }
+      }
+    } ) ;
+
+  std::cout << " " << nTracks << " tracks refit with " << types.size() << " track systems " << std::endl ;
+
+  // a few tracks may legitimately fail or differ, e.g. for hits close to the edges of the modules
+  return ( nTracks == 0 || check.summary( 0.02 ) ? 1 : 0 ) ;
+}
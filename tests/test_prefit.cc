@@ -0,0 +1,182 @@
+/** Checks of the weighted prefit createWeightedPrefit() on generated helices with Gaussian r-phi and z resolutions:
+ *  the state has to be at the hit the fit starts from, the first hit for a forward and the last hit for a backward fit,
+ *  with the momentum along the hits in both cases. Transported to the origin, the states of both directions have to be
+ *  the same and their pulls with respect to the true parameters have width one. In a vanishing field the prefit is a
+ *  straight line.
+ *
+ *  usage: test_prefit [nTracks]
+ *         default: 2000
+ */
+
+#include "MarlinTrk/FastKFKernels.h"
+#include "MarlinTrk/IMarlinTrack.h"
+#include "MarlinTrk/MarlinTrkUtils.h"
+
+#include "lcio.h"
+#include "EVENT/TrackState.h"
+#include "IMPL/TrackerHitImpl.h"
+#include "IMPL/TrackStateImpl.h"
+
+#include "streamlog/streamlog.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace MarlinTrk ;
+
+namespace {
+
+  void toState( const EVENT::TrackState& ts, FastKF::State& state ) {
+
+    state.par[FastKF::iD0]    = ts.getD0() ;
+    state.par[FastKF::iPhi]   = ts.getPhi() ;
+    state.par[FastKF::iOmega] = ts.getOmega() ;
+    state.par[FastKF::iZ0]    = ts.getZ0() ;
+    state.par[FastKF::iTanL]  = ts.getTanLambda() ;
+
+    for( unsigned i = 0 ; i < 15 ; ++i ) state.cov[i] = ts.getCovMatrix()[i] ;
+    for( unsigned i = 0 ; i < 3 ; ++i ) state.ref[i] = ts.getReferencePoint()[i] ;
+  }
+
+  /** the distance of the reference point of the state from the position */
+  double distance( const EVENT::TrackState& ts, const double* pos ) {
+    const float* ref = ts.getReferencePoint() ;
+    return std::sqrt( ( ref[0] - pos[0] ) * ( ref[0] - pos[0] ) + ( ref[1] - pos[1] ) * ( ref[1] - pos[1] ) + ( ref[2] - pos[2] ) * ( ref[2] - pos[2] ) ) ;
+  }
+}
+
+
+int main( int argc, char** argv ) {
+
+  const int nTracks = ( argc > 1 ? std::atoi( argv[1] ) : 2000 ) ;
+
+  streamlog::out.init( std::cout , "test_prefit" ) ;
+  streamlog::out.addLevelName<streamlog::WARNING>() ;
+  streamlog::out.setLevel( "WARNING" ) ;
+
+  const int nHits = 12 ;
+  const double sigRPhi = 0.01 ;
+  const double sigZ = 0.1 ;
+  const float bz = 3.5 ;
+
+  std::mt19937 gen( 7 ) ;
+  std::normal_distribution<double> gauss ;
+  std::uniform_real_distribution<double> flat( 0., 1. ) ;
+
+  const double origin[3] = { 0., 0., 0. } ;
+
+  int nFailed = 0, nWrongStart = 0, nDifferent = 0, nNotStraight = 0 ;
+  int n = 0 ;
+  double pullMean[5] = {}, pullRMS[5] = {} ;
+
+  for( int k = 0 ; k < nTracks ; ++k ) {
+
+    FastKF::State truth ;
+    truth.par = { 0.2 * gauss( gen ), -M_PI + 2. * M_PI * flat( gen ), ( flat( gen ) - 0.5 ) / 100., gauss( gen ), gauss( gen ) } ;
+    truth.ref[0] = truth.ref[1] = truth.ref[2] = 0. ;
+
+    if( std::fabs( truth.par[FastKF::iOmega] ) < 1.e-4 ) truth.par[FastKF::iOmega] = 1.e-4 ;
+
+    // the hits ordered in time
+    std::vector<IMPL::TrackerHitImpl> hits( nHits ) ;
+    std::vector<EVENT::TrackerHit*> hitList ;
+
+    for( int i = 0 ; i < nHits ; ++i ) {
+
+      double pos[3] ;
+      FastKF::positionAt( truth, 30. + 300. * i / nHits, pos ) ;
+
+      const double r = std::hypot( pos[0], pos[1] ) ;
+      const double phi = std::atan2( pos[1], pos[0] ) + sigRPhi / r * gauss( gen ) ;
+
+      const double smeared[3] = { r * std::cos( phi ), r * std::sin( phi ), pos[2] + sigZ * gauss( gen ) } ;
+
+      // the variance in r-phi is the sum of those in x and y
+      const float cov[6] = { float( sigRPhi * sigRPhi / 2. ), 0.f, float( sigRPhi * sigRPhi / 2. ), 0.f, 0.f, float( sigZ * sigZ ) } ;
+
+      hits[i].setPosition( smeared ) ;
+      hits[i].setCovMatrix( cov ) ;
+
+      hitList.push_back( &hits[i] ) ;
+    }
+
+    IMPL::TrackStateImpl forward, backward, straight ;
+
+    if( createWeightedPrefit( hitList, &forward, bz, IMarlinTrack::forward ) != IMarlinTrack::success ||
+        createWeightedPrefit( hitList, &backward, bz, IMarlinTrack::backward ) != IMarlinTrack::success ||
+        createWeightedPrefit( hitList, &straight, 0., IMarlinTrack::forward ) != IMarlinTrack::success ) {
+      ++nFailed ;
+      continue ;
+    }
+
+    // the states are at the hit the fit starts from
+    if( forward.getLocation() != EVENT::TrackState::AtFirstHit || distance( forward, hitList.front()->getPosition() ) > 1.e-3 ||
+        backward.getLocation() != EVENT::TrackState::AtLastHit || distance( backward, hitList.back()->getPosition() ) > 1.e-3 )
+      ++nWrongStart ;
+
+    // in a vanishing field the prefit is a straight line without correlations of omega
+    const EVENT::FloatVec& straightCov = straight.getCovMatrix() ;
+    if( straight.getOmega() != 0. || straightCov[3] != 0. || straightCov[4] != 0. || straightCov[8] != 0. || straightCov[12] != 0. )
+      ++nNotStraight ;
+
+    // both directions are the same helix, with the momentum along the hits
+    FastKF::State stateF, stateB ;
+    toState( forward, stateF ) ;
+    toState( backward, stateB ) ;
+
+    FastKF::transport( stateF, origin ) ;
+    FastKF::transport( stateB, origin ) ;
+
+    bool same = true ;
+
+    for( int i = 0 ; i < 5 ; ++i ) {
+
+      double d = stateF.par[i] - truth.par[i] ;
+      double dFB = stateF.par[i] - stateB.par[i] ;
+
+      if( i == FastKF::iPhi ) {
+        d = std::remainder( d, 2. * M_PI ) ;
+        dFB = std::remainder( dFB, 2. * M_PI ) ;
+      }
+
+      const double sigma = std::sqrt( stateF.cov[ FastKF::symIndex( i, i ) ] ) ;
+
+      // the reference points are stored in float precision
+      same = same && std::fabs( dFB ) < 1.e-2 * sigma ;
+
+      pullMean[i] += d / sigma ;
+      pullRMS[i] += d * d / ( sigma * sigma ) ;
+    }
+
+    if( ! same ) ++nDifferent ;
+
+    ++n ;
+  }
+
+  for( int i = 0 ; i < 5 && n > 0 ; ++i ) {
+    pullMean[i] /= n ;
+    pullRMS[i] = std::sqrt( pullRMS[i] / n ) ;
+  }
+
+  std::printf( "createWeightedPrefit of %d tracks: %d failed, %d not at the first or last hit, %d differ between the directions, "
+               "%d not straight for bz = 0\n", nTracks, nFailed, nWrongStart, nDifferent, nNotStraight ) ;
+
+  const char* names[5] = { "d0", "phi0", "omega", "z0", "tanL" } ;
+
+  bool ok = ( n > 0 && nFailed <= 1.e-3 * nTracks + 2 && nWrongStart == 0 && nDifferent == 0 && nNotStraight == 0 ) ;
+
+  for( int i = 0 ; i < 5 ; ++i ) {
+
+    std::printf( "    %-5s pull %6.2f +- %6.2f\n", names[i], pullMean[i], pullRMS[i] ) ;
+
+    ok = ok && std::fabs( pullMean[i] ) < 0.1 && std::fabs( pullRMS[i] - 1. ) < 0.1 ;
+  }
+
+  if( ! ok ) std::printf( "  FAILED createWeightedPrefit\n" ) ;
+
+  return ( ok ? 0 : 1 ) ;
+}
@@ -0,0 +1,270 @@
+/** Checks of the LCIO track state propagators on generated track states:
+ *  the batch propagators have to give the same return codes, parameters and covariance matrices as the single track state
+ *  propagators, with and without the covariance matrix and including straight lines, and the track states that cannot be
+ *  propagated have to be unchanged. The Jacobian of FastKF::moveReferencePoint(), which transports the covariance matrices
+ *  of both, has to agree with central finite differences for helices and straight lines.
+ *
+ *  usage: test_propagators [nStates]
+ *         default: 1000
+ */
+
+#include "MarlinTrk/FastKFKernels.h"
+#include "MarlinTrk/LCIOTrackPropagators.h"
+
+#include "lcio.h"
+#include "EVENT/TrackState.h"
+#include "IMPL/TrackStateImpl.h"
+
+#include "streamlog/streamlog.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace MarlinTrk ;
+using namespace LCIOTrackPropagators ;
+
+namespace {
+
+  /** typical sizes of the parameters, used for the step sizes and the tolerances */
+  const double scale[5] = { 1., 1., 1.e-3, 1., 1. } ;
+
+  /** a random track state with a positive definite covariance matrix - omega is 0. for a fraction lineFraction of the states
+   *  and tanLambda for a fraction flatFraction
+   */
+  IMPL::TrackStateImpl randomState( std::mt19937& gen, double lineFraction, double flatFraction ) {
+
+    std::normal_distribution<double> gauss ;
+    std::uniform_real_distribution<double> flat( 0., 1. ) ;
+
+    IMPL::TrackStateImpl ts ;
+
+    const double omega = ( flat( gen ) < 0.5 ? -1. : 1. ) * ( 1.e-4 + 3.e-3 * flat( gen ) ) ;
+
+    ts.setD0( 2. * gauss( gen ) ) ;
+    ts.setPhi( -M_PI + 2. * M_PI * flat( gen ) ) ;
+    ts.setOmega( flat( gen ) < lineFraction ? 0. : omega ) ;
+    ts.setZ0( 10. * gauss( gen ) ) ;
+    ts.setTanLambda( flat( gen ) < flatFraction ? 0. : gauss( gen ) ) ;
+
+    const float ref[3] = { float( 5. * gauss( gen ) ), float( 5. * gauss( gen ) ), float( 5. * gauss( gen ) ) } ;
+    ts.setReferencePoint( ref ) ;
+
+    // cov = L * L^T for a random lower triangular L with the scales of the parameters
+    double L[5][5] = {} ;
+    for( int i = 0 ; i < 5 ; ++i )
+      for( int j = 0 ; j <= i ; ++j )
+        L[i][j] = 1.e-2 * scale[i] * ( i == j ? 1. + flat( gen ) : 0.5 * gauss( gen ) ) ;
+
+    EVENT::FloatVec cov( 15 ) ;
+    for( int i = 0 ; i < 5 ; ++i )
+      for( int j = 0 ; j <= i ; ++j ) {
+        double c = 0. ;
+        for( int k = 0 ; k <= j ; ++k ) c += L[i][k] * L[j][k] ;
+        cov[ FastKF::symIndex( i, j ) ] = c ;
+      }
+
+    ts.setCovMatrix( cov ) ;
+
+    return ts ;
+  }
+
+  void parameters( const EVENT::TrackState& ts, double* par ) {
+    par[FastKF::iD0]    = ts.getD0() ;
+    par[FastKF::iPhi]   = ts.getPhi() ;
+    par[FastKF::iOmega] = ts.getOmega() ;
+    par[FastKF::iZ0]    = ts.getZ0() ;
+    par[FastKF::iTanL]  = ts.getTanLambda() ;
+  }
+
+  /** true if both track states are the same within the relative tolerance, the covariance matrices relative to their diagonal */
+  bool same( const EVENT::TrackState& a, const EVENT::TrackState& b, double tolerance ) {
+
+    double pa[5], pb[5] ;
+    parameters( a, pa ) ;
+    parameters( b, pb ) ;
+
+    for( int i = 0 ; i < 5 ; ++i ) {
+
+      const double d = ( i == FastKF::iPhi ? std::remainder( pa[i] - pb[i], 2. * M_PI ) : pa[i] - pb[i] ) ;
+
+      if( !( std::fabs( d ) <= tolerance * ( std::fabs( pa[i] ) + scale[i] ) ) ) return false ;
+    }
+
+    for( int i = 0 ; i < 3 ; ++i )
+      if( !( std::fabs( a.getReferencePoint()[i] - b.getReferencePoint()[i] ) <= tolerance * ( std::fabs( a.getReferencePoint()[i] ) + 1. ) ) )
+        return false ;
+
+    const EVENT::FloatVec& ca = a.getCovMatrix() ;
+    const EVENT::FloatVec& cb = b.getCovMatrix() ;
+
+    for( int i = 0 ; i < 5 ; ++i )
+      for( int j = 0 ; j <= i ; ++j ) {
+
+        const double norm = std::sqrt( ca[ FastKF::symIndex( i, i ) ] * ca[ FastKF::symIndex( j, j ) ] ) ;
+
+        if( !( std::fabs( ca[ FastKF::symIndex( i, j ) ] - cb[ FastKF::symIndex( i, j ) ] ) <= tolerance * norm ) ) return false ;
+      }
+
+    return true ;
+  }
+
+  /** run the batch propagator and the single track state propagator on all states, returns the number of differences */
+  int compare( const char* name, const std::vector<IMPL::TrackStateImpl>& states, bool withCovariance,
+               const std::function<int( TrackStateBatch& )>& batchPropagator,
+               const std::function<int( IMPL::TrackStateImpl& )>& singlePropagator ) {
+
+    const unsigned n = states.size() ;
+
+    TrackStateBatch batch ;
+    batch.resize( n ) ;
+
+    for( unsigned i = 0 ; i < n ; ++i ) batch.set( i, states[i] ) ;
+
+    const int nFailedBatch = batchPropagator( batch ) ;
+
+    int nFailed = 0, nDifferent = 0 ;
+
+    for( unsigned i = 0 ; i < n ; ++i ) {
+
+      IMPL::TrackStateImpl single = states[i] ;
+      const int rc = singlePropagator( single ) ;
+
+      if( rc != 0 ) ++nFailed ;
+
+      IMPL::TrackStateImpl fromBatch ;
+      batch.get( i, fromBatch ) ;
+
+      // failed track states are unchanged in both
+      const bool ok = ( batch.status[i] == rc && ( rc == 0 ? same( single, fromBatch, 1.e-5 ) : same( states[i], fromBatch, 0. ) ) ) ;
+
+      if( ! ok ) ++nDifferent ;
+    }
+
+    if( nFailedBatch != nFailed ) ++nDifferent ;
+
+    std::printf( "    %-28s %s covariance: %4u states, %4d not propagated, %4d differ\n", name, ( withCovariance ? "with   " : "without" ),
+                 n, nFailed, nDifferent ) ;
+
+    return nDifferent ;
+  }
+
+  /** compare the Jacobian of FastKF::moveReferencePoint() to central finite differences, returns the number of wrong elements */
+  int checkJacobian( const FastKF::State& state, const double* ref ) {
+
+    FastKF::State moved = state ;
+    FastKF::Matrix5 J ;
+    FastKF::moveReferencePoint( moved, ref, &J ) ;
+
+    const bool line = ( state.par[FastKF::iOmega] == 0. ) ;
+
+    int nWrong = 0 ;
+
+    for( int j = 0 ; j < 5 ; ++j ) {
+
+      // the straight line has no derivatives w.r.t. omega
+      if( line && j == FastKF::iOmega ) continue ;
+
+      const double h = 1.e-6 * scale[j] ;
+
+      FastKF::State plus = state, minus = state ;
+      plus.par[j] += h ;
+      minus.par[j] -= h ;
+
+      FastKF::moveReferencePoint( plus, ref, 0 ) ;
+      FastKF::moveReferencePoint( minus, ref, 0 ) ;
+
+      for( int i = 0 ; i < 5 ; ++i ) {
+
+        double d = plus.par[i] - minus.par[i] ;
+        if( i == FastKF::iPhi ) d = std::remainder( d, 2. * M_PI ) ;
+
+        const double derivative = d / ( 2. * h ) ;
+
+        if( !( std::fabs( derivative - J[ i * 5 + j ] ) <= 1.e-4 * std::fabs( J[ i * 5 + j ] ) + 1.e-6 * scale[i] / scale[j] ) ) ++nWrong ;
+      }
+    }
+
+    return nWrong ;
+  }
+}
+
+
+int main( int argc, char** argv ) {
+
+  const int nStates = ( argc > 1 ? std::atoi( argv[1] ) : 1000 ) ;
+
+  streamlog::out.init( std::cout , "test_propagators" ) ;
+  streamlog::out.addLevelName<streamlog::WARNING>() ;
+  streamlog::out.setLevel( "WARNING" ) ;
+
+  std::mt19937 gen( 11 ) ;
+
+  // helices for the crossings with cylinders and planes parallel to z, helices and straight lines otherwise
+  std::vector<IMPL::TrackStateImpl> helices, mixed ;
+
+  for( int i = 0 ; i < nStates ; ++i ) {
+    helices.push_back( randomState( gen, 0., 0. ) ) ;
+    mixed.push_back( randomState( gen, 0.2, 0.05 ) ) ;
+  }
+
+  int nDifferent = 0 ;
+
+  std::printf( "batch and single track state propagators:\n" ) ;
+
+  for( int cov = 0 ; cov < 2 ; ++cov ) {
+
+    const bool withCov = ( cov == 1 ) ;
+
+    // close to and far from the reference points, the latter with large changes of the azimuthal angle
+    nDifferent += compare( "PropagateToNewRef near", mixed, withCov,
+                           [=]( TrackStateBatch& b ) { return PropagateToNewRef( b, 3., -4., 12., withCov ) ; },
+                           [=]( IMPL::TrackStateImpl& ts ) { return PropagateLCIOToNewRef( ts, 3., -4., 12., withCov ) ; } ) ;
+
+    nDifferent += compare( "PropagateToNewRef far", mixed, withCov,
+                           [=]( TrackStateBatch& b ) { return PropagateToNewRef( b, 900., 600., -300., withCov ) ; },
+                           [=]( IMPL::TrackStateImpl& ts ) { return PropagateLCIOToNewRef( ts, 900., 600., -300., withCov ) ; } ) ;
+
+    // the helices with a radius below 900 mm do not reach the cylinder
+    for( int direction = -1 ; direction <= 1 ; ++direction )
+      nDifferent += compare( "PropagateToCylinder", helices, withCov,
+                             [=]( TrackStateBatch& b ) { return PropagateToCylinder( b, 1800., 0., 0., direction, 1.e-8, withCov ) ; },
+                             [=]( IMPL::TrackStateImpl& ts ) { return PropagateLCIOToCylinder( ts, 1800., 0., 0., direction, 1.e-8, withCov ) ; } ) ;
+
+    // the states with tanLambda == 0 do not cross the plane
+    nDifferent += compare( "PropagateToZPlane", mixed, withCov,
+                           [=]( TrackStateBatch& b ) { return PropagateToZPlane( b, 2000., withCov ) ; },
+                           [=]( IMPL::TrackStateImpl& ts ) { return PropagateLCIOToZPlane( ts, 2000., withCov ) ; } ) ;
+
+    for( int direction = -1 ; direction <= 1 ; ++direction )
+      nDifferent += compare( "PropagateToPlaneParralelToZ", helices, withCov,
+                             [=]( TrackStateBatch& b ) { return PropagateToPlaneParralelToZ( b, 400., -1000., 400., 1000., direction, 1.e-8, withCov ) ; },
+                             [=]( IMPL::TrackStateImpl& ts ) { return PropagateLCIOToPlaneParralelToZ( ts, 400., -1000., 400., 1000., direction, 1.e-8, withCov ) ; } ) ;
+  }
+
+  // the Jacobian for small and large moves of the reference point
+  int nWrong = 0 ;
+
+  const double refs[3][3] = { { 0.5, -0.3, 1. }, { 30., 20., -10. }, { 900., 600., -300. } } ;
+
+  for( int i = 0 ; i < nStates ; ++i ) {
+
+    FastKF::State state ;
+    parameters( mixed[i], state.par.data() ) ;
+    for( int k = 0 ; k < 3 ; ++k ) state.ref[k] = mixed[i].getReferencePoint()[k] ;
+
+    for( int r = 0 ; r < 3 ; ++r ) nWrong += checkJacobian( state, refs[r] ) ;
+  }
+
+  std::printf( "Jacobian of moveReferencePoint for %d states: %d elements differ from the finite differences\n", 3 * nStates, nWrong ) ;
+
+  const bool ok = ( nDifferent == 0 && nWrong == 0 ) ;
+
+  if( ! ok ) std::printf( "  FAILED propagators\n" ) ;
+
+  return ( ok ? 0 : 1 ) ;
+}